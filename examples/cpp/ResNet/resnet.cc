@@ -140,12 +140,7 @@ void FlexFlow::top_level_task(Task const *task,
       } else {
         // data_loader.next_batch(ff);
       }
-      // runtime->begin_trace(ctx, 111 /*trace_id*/);
-      ff.forward();
-      ff.zero_gradients();
-      ff.backward();
-      ff.update();
-      // runtime->end_trace(ctx, 111 /*trace_id*/);
+      ff.train_step();
     }
   }
   // End timer
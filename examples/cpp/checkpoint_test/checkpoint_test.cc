@@ -0,0 +1,158 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/model.h"
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <poll.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace Legion;
+using namespace FlexFlow;
+
+LegionRuntime::Logger::Category log_app("checkpoint_test");
+
+namespace {
+
+// How long the shard files of the blocked checkpoint cannot be written
+double const WRITE_DELAY_SECS = 5.0;
+
+void check(bool condition, char const *message) {
+  if (!condition) {
+    fprintf(stderr, "checkpoint_test failed: %s\n", message);
+    exit(1);
+  }
+}
+
+std::string read_file(std::string const &path) {
+  std::ifstream input(path, std::ios::binary);
+  check(input.good(), "cannot read a shard of the reference checkpoint");
+  return std::string(std::istreambuf_iterator<char>(input),
+                     std::istreambuf_iterator<char>());
+}
+
+// Reads every FIFO to its end once the delay has passed. The FIFOs are
+// opened without blocking, so that their writers may open them in any order.
+void drain_fifos(std::vector<std::string> const &paths,
+                 std::vector<std::string> *contents) {
+  std::this_thread::sleep_for(std::chrono::duration<double>(WRITE_DELAY_SECS));
+  std::vector<pollfd> fds;
+  for (std::string const &path : paths) {
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+    check(fd >= 0, "cannot open a FIFO");
+    fds.push_back({fd, POLLIN, 0});
+  }
+  contents->assign(paths.size(), "");
+  size_t num_open = fds.size();
+  char buffer[65536];
+  while (num_open > 0) {
+    check(poll(fds.data(), fds.size(), -1) >= 0, "cannot poll the FIFOs");
+    for (size_t i = 0; i < fds.size(); i++) {
+      if (fds[i].fd < 0 || fds[i].revents == 0) {
+        continue;
+      }
+      ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+      if (n > 0) {
+        (*contents)[i].append(buffer, n);
+      } else if (n == 0) {
+        // The writer has closed the FIFO
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        num_open--;
+      }
+    }
+  }
+}
+
+}; // namespace
+
+void FlexFlow::top_level_task(Task const *task,
+                              std::vector<PhysicalRegion> const &regions,
+                              Context ctx,
+                              Runtime *runtime) {
+  FFConfig ffConfig;
+  FFModel ff(ffConfig);
+
+  Tensor input;
+  {
+    int const dims[] = {ffConfig.batchSize, 1024};
+    input = ff.create_tensor<2>(dims, DT_FLOAT);
+  }
+  Tensor t = ff.dense(input, 1024);
+  t = ff.softmax(t);
+  // Weight decay changes the weights in every update, even without gradients
+  Optimizer *optimizer = new SGDOptimizer(&ff, 0.01f, 0.0f, false, 0.1f);
+  std::vector<MetricsType> metrics;
+  metrics.push_back(METRICS_ACCURACY);
+  ff.compile(optimizer, LOSS_SPARSE_CATEGORICAL_CROSSENTROPY, metrics);
+  ff.init_operators();
+
+  std::string const ref_dir = "checkpoint_test_ref";
+  check(ff.save_checkpoint(ref_dir) && ff.wait_for_checkpoint(),
+        "cannot save the reference checkpoint");
+  CheckpointManifest manifest;
+  check(manifest.load(ref_dir), "cannot load the reference checkpoint");
+
+  // Checkpoint again, into FIFOs in place of the shard files, which block the
+  // writes until drain_fifos opens them
+  std::string const dir = "checkpoint_test_blocked";
+  check(mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST,
+        "cannot create the checkpoint directory");
+  std::vector<std::string> ref_shards, fifos;
+  for (CheckpointTensor const &tensor : manifest.tensors) {
+    for (CheckpointShard const &shard : tensor.shards) {
+      ref_shards.push_back(read_file(ref_dir + "/" + shard.filename));
+      std::string fifo = dir + "/" + shard.filename + ".tmp";
+      unlink(fifo.c_str());
+      check(mkfifo(fifo.c_str(), 0644) == 0, "cannot create a FIFO");
+      fifos.push_back(fifo);
+    }
+  }
+  std::vector<std::string> shards;
+  std::thread reader(drain_fifos, std::cref(fifos), &shards);
+  auto start = std::chrono::steady_clock::now();
+  check(ff.save_checkpoint(dir), "cannot start the checkpoint");
+  ff.zero_gradients();
+  ff.update();
+  // Reading a parameter waits for the update, which must only have waited
+  // for the checkpoint's copies, not for its writes
+  ParallelTensor p = ff.parameters[0];
+  size_t volume = 1;
+  for (int i = 0; i < p->num_dims; i++) {
+    volume *= p->dims[i].size / p->dims[i].degree;
+  }
+  std::vector<float> weights(volume);
+  check(p->get_tensor<float>(&ff, weights.data(), false),
+        "cannot read a parameter");
+  double update_secs = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  reader.join();
+  log_app.print("The update took %.3fs while the checkpoint was blocked",
+                update_secs);
+  check(update_secs < WRITE_DELAY_SECS / 2,
+        "the update waited for the checkpoint writes");
+  check(ff.wait_for_checkpoint(), "cannot write the checkpoint");
+  // The checkpoint holds the parameters from before the update
+  check(shards == ref_shards,
+        "the checkpoint does not hold the parameters it was saved with");
+}
+
+void FlexFlow::register_custom_tasks() {}
@@ -14,6 +14,7 @@
  */
 
 #include "moe.h"
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -546,6 +547,62 @@ void DataLoader::reset() {
   next_index = 0;
 }
 
+void DataLoader::load_input_cpu(Task const *task,
+                                std::vector<PhysicalRegion> const &regions,
+                                Context ctx,
+                                Runtime *runtime) {
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  SampleIdxs *meta = (SampleIdxs *)task->local_args;
+  TensorAccessorR<float, 3> acc_full_input(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 3> acc_batch_input(regions[1],
+                                            task->regions[1],
+                                            FID_DATA,
+                                            ctx,
+                                            runtime,
+                                            false /*readOutput*/);
+  coord_t batch_size =
+      acc_batch_input.rect.hi[1] - acc_batch_input.rect.lo[1] + 1;
+  coord_t sample_dim =
+      acc_batch_input.rect.hi[0] - acc_batch_input.rect.lo[0] + 1;
+  // FIXME: currently assume continous indices
+  assert(batch_size == meta->num_samples);
+  for (int i = 1; i < batch_size; i++) {
+    assert(meta->idxs[i] == meta->idxs[0] + i);
+  }
+  memcpy(acc_batch_input.ptr,
+         acc_full_input.ptr + meta->idxs[0] * sample_dim,
+         sizeof(float) * acc_batch_input.rect.volume());
+}
+
+void DataLoader::load_label_cpu(Task const *task,
+                                std::vector<PhysicalRegion> const &regions,
+                                Context ctx,
+                                Runtime *runtime) {
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  SampleIdxs *meta = (SampleIdxs *)task->local_args;
+  TensorAccessorR<int, LABEL_DIM + 2> acc_full_label(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorW<int, LABEL_DIM + 2> acc_batch_label(regions[1],
+                                                      task->regions[1],
+                                                      FID_DATA,
+                                                      ctx,
+                                                      runtime,
+                                                      false /*readOutput*/);
+  coord_t batch_size =
+      acc_batch_label.rect.hi[1] - acc_batch_label.rect.lo[1] + 1;
+  // FIXME: currently assume continous indices
+  assert(batch_size == meta->num_samples);
+  for (int i = 1; i < meta->num_samples; i++) {
+    assert(meta->idxs[i] == meta->idxs[0] + i);
+  }
+  memcpy(acc_batch_label.ptr,
+         acc_full_label.ptr + meta->idxs[0],
+         sizeof(int) * acc_batch_label.rect.volume());
+}
+
 void FlexFlow::register_custom_tasks() {
   // Load entire dataset
   {
@@ -571,4 +628,19 @@ void FlexFlow::register_custom_tasks() {
     Runtime::preregister_task_variant<DataLoader::load_label>(
         registrar, "Load Label Task");
   }
+  // Load input and label on CPU processors
+  {
+    TaskVariantRegistrar registrar(CUSTOM_GPU_TASK_ID_1, "Load Inputs (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<DataLoader::load_input_cpu>(
+        registrar, "Load Input Task (CPU)");
+  }
+  {
+    TaskVariantRegistrar registrar(CUSTOM_GPU_TASK_ID_2, "Load Labels (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    Runtime::preregister_task_variant<DataLoader::load_label_cpu>(
+        registrar, "Load Label Task (CPU)");
+  }
 }
@@ -70,6 +70,14 @@ public:
                          std::vector<PhysicalRegion> const &regions,
                          Context ctx,
                          Runtime *runtime);
+  static void load_input_cpu(Task const *task,
+                             std::vector<PhysicalRegion> const &regions,
+                             Context ctx,
+                             Runtime *runtime);
+  static void load_label_cpu(Task const *task,
+                             std::vector<PhysicalRegion> const &regions,
+                             Context ctx,
+                             Runtime *runtime);
   static void load_entire_dataset(Task const *task,
                                   std::vector<PhysicalRegion> const &regions,
                                   Context ctx,
@@ -0,0 +1,76 @@
+#ifndef _FLEXFLOW_CHECKPOINT_H_
+#define _FLEXFLOW_CHECKPOINT_H_
+
+#include "flexflow/ffconst.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace FlexFlow {
+
+/**
+ * @brief The part [lo, hi] (inclusive) of a checkpointed tensor stored in one
+ * file, with dim 0 contiguous as in Legion instances
+ */
+struct CheckpointShard {
+  std::string filename; ///< Relative to the checkpoint directory
+  std::vector<int> lo, hi;
+
+  size_t get_volume() const;
+};
+
+struct CheckpointTensor {
+  std::string name;
+  DataType data_type;
+  size_t element_size;
+  std::vector<int> dims;
+  std::vector<CheckpointShard> shards;
+};
+
+/**
+ * @brief Describes a checkpoint directory: the shards of every tensor and the
+ * state of the optimizer.
+ *
+ * @details Shards are stored as they were partitioned when saved, so that a
+ * tensor can be restored under any other partitioning with
+ * read_checkpoint_rect. The manifest is written after all shards, so that a
+ * directory without one holds an incomplete checkpoint.
+ */
+class CheckpointManifest {
+public:
+  static constexpr char const *FILENAME = "manifest";
+
+  bool save(std::string const &dir) const;
+  bool load(std::string const &dir);
+  CheckpointTensor const *find_tensor(std::string const &name) const;
+
+public:
+  std::string optimizer = "none";
+  // Scalars of the optimizer, e.g. the bias corrections of Adam
+  std::vector<double> optimizer_state;
+  std::vector<CheckpointTensor> tensors;
+};
+
+/**
+ * @brief Writes num_bytes of data to filename, replacing it only once it is
+ * complete
+ */
+bool write_checkpoint_shard(std::string const &filename,
+                            void const *data,
+                            size_t num_bytes);
+
+/**
+ * @brief Reads [lo, hi] of tensor into data, dim 0 contiguous, from the
+ * shards it overlaps
+ *
+ * @return false if a shard cannot be read or the shards do not cover [lo, hi]
+ */
+bool read_checkpoint_rect(std::string const &dir,
+                          CheckpointTensor const &tensor,
+                          std::vector<int> const &lo,
+                          std::vector<int> const &hi,
+                          void *data);
+
+}; // namespace FlexFlow
+
+#endif // _FLEXFLOW_CHECKPOINT_H_
@@ -0,0 +1,45 @@
+#ifndef _FLEXFLOW_CLUSTER_SIZING_H_
+#define _FLEXFLOW_CLUSTER_SIZING_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace FlexFlow {
+
+/**
+ * @brief The best strategy the search found for one machine shape
+ */
+struct ClusterShapeResult {
+  int num_nodes;
+  int workers_per_node;
+  float iteration_time_ms; ///< Predicted by the search
+  float max_device_memory_mb;
+
+  int get_num_devices() const;
+};
+
+/**
+ * @brief Parses the node counts of --cluster-sizing: a comma-separated list
+ * of counts N, or ranges A-B that double from A up to B, e.g. "1-64"
+ * for 1, 2, 4, ..., 64
+ *
+ * @return false if spec is malformed
+ */
+bool parse_cluster_sizing_nodes(std::string const &spec,
+                                std::vector<int> &num_nodes);
+
+/**
+ * @brief Prints one row per shape with its predicted throughput in samples
+ * per second, its scaling efficiency, i.e. throughput per device relative
+ * to the shape with the fewest devices, and its peak memory per device,
+ * flagging shapes that do not fit in device_memory_mb
+ */
+void write_cluster_sizing_table(std::ostream &os,
+                                std::vector<ClusterShapeResult> const &results,
+                                int batch_size,
+                                float device_memory_mb);
+
+}; // namespace FlexFlow
+
+#endif // _FLEXFLOW_CLUSTER_SIZING_H_
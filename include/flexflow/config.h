@@ -135,6 +135,8 @@ public:
   bool enable_parameter_parallel;
   bool enable_attribute_parallel;
   bool enable_inplace_optimizations;
+  // Emit sparse (row, value) gradients for embedding tables
+  bool sparse_embedding_grad;
   // Control Tensor Op Math Conversion
   bool allow_tensor_op_math_conversion;
   std::string dataset_path;
@@ -144,15 +146,40 @@ public:
   std::string export_strategy_computation_graph_file;
   bool include_costs_dot_graph;
   tl::optional<std::string> substitution_json_path = tl::nullopt;
+  // Per-substitution statistics, read before and written after each search
+  tl::optional<std::string> substitution_profile_path = tl::nullopt;
+  // Only use the best substitutions of the loaded profile
+  tl::optional<int> substitution_prune_top_k = tl::nullopt;
+  tl::optional<double> substitution_prune_min_utility = tl::nullopt;
   // We use MappingTagID as the key since we will pass the tag to the mapper
   // std::map<Legion::MappingTagID, ParallelConfig> strategies;
   int machine_model_version;
   std::string machine_model_file;
+  // Estimate operator costs with RooflineCostModel instead of profiling them
+  // if set, see device_config_example
+  std::string roofline_device_file;
+  // Predict operator costs from these profiled records when confident, see
+  // CostPredictor, and export the records profiled in the search
+  std::string cost_predictor_file;
+  float cost_predictor_threshold;
+  std::string export_cost_records_file;
+  // Legion task launch overhead (in ms) that the simulator adds to the
+  // profiled kernel time of every forward and backward task
+  float task_launch_time;
+  // Profile operator tasks and export their run times with this prefix when
+  // the model is destroyed, see FFModel::export_op_profile
+  std::string profile_ops_prefix;
   int simulator_segment_size;
   int simulator_max_num_segments;
   bool enable_propagation;
+  // Cost DP states that differ only by a translation of their devices across
+  // identical nodes once, see SearchHelper::canonical_gpu_shift
+  bool canonical_machine_views;
   tl::optional<int> search_num_nodes = tl::nullopt;
   tl::optional<int> search_num_workers = tl::nullopt;
+  // Before the search, also search these node counts and report their
+  // predicted performance, see parse_cluster_sizing_nodes
+  std::vector<int> cluster_sizing_nodes;
   int base_optimize_threshold;
   bool enable_control_replication;
   int python_data_loader_type;
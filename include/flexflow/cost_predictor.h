@@ -0,0 +1,96 @@
+#ifndef _FLEXFLOW_COST_PREDICTOR_H_
+#define _FLEXFLOW_COST_PREDICTOR_H_
+
+#include "flexflow/ffconst.h"
+#include "flexflow/roofline_cost_model.h"
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace FlexFlow {
+
+/**
+ * @brief A profiled operator cost together with the work of the shard it was
+ * profiled on (see get_operator_work)
+ */
+struct CostRecord {
+  OperatorType op_type;
+  OperatorWork forward, backward;
+  float forward_time = 0.0f, backward_time = 0.0f;
+};
+
+/**
+ * @brief Leave-one-out accuracy of a CostPredictor on its own records
+ */
+struct CostPredictorEvaluation {
+  int num_records = 0;
+  int num_confident = 0;           ///< Records predicted within the threshold
+  double mean_relative_error = 0.0; ///< Over the confident predictions
+  double max_relative_error = 0.0;  ///< Over the confident predictions
+};
+
+/**
+ * @brief Predicts operator run times from profiled records of the same
+ * operator type, so that the search only needs to profile shapes unlike any
+ * profiled before.
+ *
+ * @details A pass is predicted by a log-log linear fit of run time over FLOPs
+ * and bytes to the NUM_NEIGHBORS nearest records, i.e. piecewise power laws
+ * between profiled shapes. A prediction is only confident if the nearest
+ * record is within MAX_DISTANCE and the fit reproduces every neighbor within
+ * the max_relative_error threshold; otherwise the cost should be measured.
+ */
+class CostPredictor {
+public:
+  static constexpr int NUM_NEIGHBORS = 8;
+  // A fit needs more records than its three coefficients to be checked
+  static constexpr int MIN_NEIGHBORS = 4;
+  // Natural log distance in (FLOPs, bytes), so within about 2x of a record
+  static constexpr double MAX_DISTANCE = 0.7;
+
+  CostPredictor(float max_relative_error = 0.1f);
+
+  void add_record(CostRecord const &record);
+  size_t num_records() const;
+
+  /**
+   * @brief Sets forward_time and backward_time if both passes are predicted
+   * confidently
+   *
+   * @return false, leaving the times unchanged, if the cost should be measured
+   */
+  bool predict(OperatorType op_type,
+               OperatorWork const &forward,
+               OperatorWork const &backward,
+               float &forward_time,
+               float &backward_time) const;
+
+  /**
+   * @brief Predicts every record from the others of its operator type
+   */
+  std::map<OperatorType, CostPredictorEvaluation> evaluate() const;
+
+  /**
+   * @brief Reads records saved by save, adding them to the current ones
+   *
+   * @return false if the file cannot be read or is malformed
+   */
+  bool load(std::string const &filename);
+  bool save(std::string const &filename) const;
+
+private:
+  bool predict_time(std::vector<CostRecord> const &candidates,
+                    bool backward,
+                    OperatorWork const &work,
+                    int skip_idx,
+                    float &time) const;
+
+private:
+  float max_relative_error;
+  std::unordered_map<OperatorType, std::vector<CostRecord>> records;
+};
+
+}; // namespace FlexFlow
+
+#endif // _FLEXFLOW_COST_PREDICTOR_H_
@@ -3,12 +3,15 @@
 
 #include "flexflow/basic_graph.h"
 #include "flexflow/graph_structures.h"
+#include "flexflow/indexed_graph_view.h"
 #include "flexflow/utils/dot/dot_file.h"
 #include "flexflow/utils/dot/record_formatter.h"
 #include "tl/optional.hpp"
 #include <algorithm>
 #include <functional>
+#include <memory>
 #include <queue>
+#include <vector>
 
 namespace FlexFlow::PCG::Utils {
 template <typename G, typename Structure = GraphStructure<G>>
@@ -155,48 +158,227 @@ std::unordered_set<typename Structure::vertex_type> leaves(G const &g) {
 template <typename G, typename Structure = GraphStructure<G>>
 void topo_sort(G const &g,
                std::vector<typename Structure::vertex_type> *ordering) {
-  using N = typename Structure::vertex_type;
+  IndexedGraphView<typename Structure::vertex_type> view =
+      indexed_view<G, Structure>()(g);
 
-  Structure s;
-  std::unordered_map<N, std::unordered_set<N>> predecessors;
+  std::vector<int> indices;
+  view.topo_sort(&indices);
+  for (int i : indices) {
+    ordering->push_back(view.node(i));
+  }
+}
+
+/**
+ * @brief Dominator tree of a DAG over dense node indices.
+ *
+ * Nodes are numbered in topological order, so every immediate dominator has
+ * a smaller index than the nodes it dominates. Nodes that are only dominated
+ * by themselves (e.g. roots, or nodes reachable from several roots without a
+ * common dominator) are the roots of the resulting forest.
+ *
+ * Immediate-dominator and dominance queries are O(1); dominance uses the
+ * pre/post-order interval of each node in the tree.
+ */
+template <typename N>
+class DominatorTree {
+public:
+  DominatorTree() {}
+  /**
+   * @param order the nodes in topological order
+   * @param idom for each position in order, the position of its immediate
+   * dominator, or -1 if it has none
+   */
+  DominatorTree(std::vector<N> const &order, std::vector<int> const &idom)
+      : order(order), idom(idom), pre(order.size()), post(order.size()) {
+    assert(order.size() == idom.size());
+    for (int i = 0; i < (int)order.size(); i++) {
+      this->index[order[i]] = i;
+    }
+    // Children lists in CSR form, then an iterative DFS numbering
+    std::vector<int> child_start(order.size() + 1, 0);
+    std::vector<int> children(order.size());
+    for (int i = 0; i < (int)order.size(); i++) {
+      if (idom[i] != -1) {
+        assert(idom[i] < i);
+        child_start[idom[i] + 1]++;
+      }
+    }
+    for (size_t i = 0; i < order.size(); i++) {
+      child_start[i + 1] += child_start[i];
+    }
+    std::vector<int> fill(child_start.begin(), child_start.end() - 1);
+    for (int i = 0; i < (int)order.size(); i++) {
+      if (idom[i] != -1) {
+        children[fill[idom[i]]++] = i;
+      }
+    }
+    int counter = 0;
+    std::vector<std::pair<int, int>> stack;
+    for (int r = 0; r < (int)order.size(); r++) {
+      if (idom[r] != -1) {
+        continue;
+      }
+      this->pre[r] = counter++;
+      stack.push_back({r, child_start[r]});
+      while (!stack.empty()) {
+        int v = stack.back().first;
+        int &next = stack.back().second;
+        if (next < child_start[v + 1]) {
+          int c = children[next++];
+          this->pre[c] = counter++;
+          stack.push_back({c, child_start[c]});
+        } else {
+          this->post[v] = counter++;
+          stack.pop_back();
+        }
+      }
+    }
+  }
+
+  bool contains(N const &n) const {
+    return this->index.find(n) != this->index.end();
+  }
+
+  bool has_imm_dominator(N const &n) const {
+    return this->idom.at(this->index.at(n)) != -1;
+  }
+
+  /**
+   * @brief Returns the immediate dominator of n, or n itself if n has none
+   */
+  N const &imm_dominator(N const &n) const {
+    int i = this->index.at(n);
+    return this->idom.at(i) == -1 ? this->order.at(i)
+                                  : this->order.at(this->idom.at(i));
+  }
+
+  /**
+   * @brief Whether a dominates b (every node dominates itself)
+   */
+  bool dominates(N const &a, N const &b) const {
+    int i = this->index.at(a), j = this->index.at(b);
+    return this->pre[i] <= this->pre[j] && this->post[j] <= this->post[i];
+  }
 
-  std::queue<N> q;
-  for (auto const &node : s.get_nodes(g)) {
-    predecessors[node];
-    for (auto const &edge : s.get_incoming_edges(g, node)) {
-      predecessors.at(node).insert(s.get_src(g, edge));
+  /**
+   * @brief All dominators of n, starting with n and walking up the tree
+   */
+  std::vector<N> dominator_chain(N const &n) const {
+    std::vector<N> chain;
+    for (int i = this->index.at(n); i != -1; i = this->idom[i]) {
+      chain.push_back(this->order[i]);
     }
+    return chain;
   }
 
-  for (auto it = predecessors.begin(); it != predecessors.end();) {
-    if (it->second.empty()) {
-      q.push(it->first);
-      it = predecessors.erase(it);
-    } else {
-      it++;
+  /**
+   * @brief The closest node dominating every node in ns, if any
+   */
+  tl::optional<N> common_dominator(std::unordered_set<N> const &ns) const {
+    int lca = -2;
+    for (N const &n : ns) {
+      int i = this->index.at(n);
+      if (lca == -2) {
+        lca = i;
+        continue;
+      }
+      // Immediate dominators precede the nodes they dominate in the
+      // topological order, so the deeper of the two always has the larger
+      // index
+      while (lca != i && lca != -1 && i != -1) {
+        if (lca > i) {
+          lca = this->idom[lca];
+        } else {
+          i = this->idom[i];
+        }
+      }
+      if (lca != i) {
+        return tl::nullopt;
+      }
     }
+    if (lca < 0) {
+      return tl::nullopt;
+    }
+    return this->order[lca];
   }
 
-  std::unordered_set<N> node_successors;
-  while (!q.empty()) {
-    N const &current = q.front();
+  std::vector<N> const &topo_order() const {
+    return this->order;
+  }
 
-    ordering->push_back(current);
+private:
+  std::vector<N> order;
+  std::unordered_map<N, int> index;
+  std::vector<int> idom, pre, post;
+};
 
-    node_successors.clear();
-    successors<G, Structure>(g, current, &node_successors);
-    for (auto const &succ : node_successors) {
-      if (predecessors.find(succ) != predecessors.end()) {
-        predecessors.at(succ).erase(current);
-        if (predecessors.at(succ).empty()) {
-          predecessors.erase(succ);
-          q.push(succ);
+/**
+ * @brief Builds the dominator tree of a DAG
+ *
+ * @details Uses the Cooper-Harvey-Kennedy intersection over dense indices.
+ * Visiting the nodes in topological order guarantees that all predecessors
+ * are final before a node is processed, so a single pass suffices and the
+ * cost is O(V + E) plus the (typically short) tree walks of the
+ * intersections.
+ */
+template <typename N>
+DominatorTree<N> dominator_tree(IndexedGraphView<N> const &view) {
+  std::vector<int> topo;
+  bool acyclic = view.topo_sort(&topo);
+  assert(acyclic && "dominator_tree requires a DAG");
+
+  std::vector<int> pos(view.num_nodes());
+  for (int t = 0; t < (int)topo.size(); t++) {
+    pos[topo[t]] = t;
+  }
+
+  // idom over topological positions; -1 stands for the virtual root that
+  // precedes all sources
+  std::vector<int> idom(topo.size(), -1);
+  for (int t = 0; t < (int)topo.size(); t++) {
+    int cur = -2;
+    for (int pred : view.predecessors(topo[t])) {
+      int p = pos[pred];
+      if (cur == -2) {
+        cur = p;
+        continue;
+      }
+      while (cur != p && cur != -1 && p != -1) {
+        if (cur > p) {
+          cur = idom[cur];
+        } else {
+          p = idom[p];
         }
       }
+      cur = (cur == p) ? cur : -1;
+      if (cur == -1) {
+        break;
+      }
     }
+    idom[t] = (cur == -2) ? -1 : cur;
+  }
 
-    q.pop();
+  std::vector<N> order;
+  order.reserve(topo.size());
+  for (int v : topo) {
+    order.push_back(view.node(v));
   }
+  return DominatorTree<N>(order, idom);
+}
+
+template <typename N>
+DominatorTree<N> post_dominator_tree(IndexedGraphView<N> const &view) {
+  return dominator_tree(view.reversed());
+}
+
+template <typename G, typename Structure = GraphStructure<G>>
+DominatorTree<typename Structure::vertex_type> dominator_tree(G const &g) {
+  return dominator_tree(indexed_view<G, Structure>()(g));
+}
+
+template <typename G, typename Structure = GraphStructure<G>>
+DominatorTree<typename Structure::vertex_type> post_dominator_tree(G const &g) {
+  return post_dominator_tree(indexed_view<G, Structure>()(g));
 }
 
 template <typename G, typename Structure = GraphStructure<G>>
@@ -204,34 +386,12 @@ std::unordered_map<typename Structure::vertex_type,
                    std::unordered_set<typename Structure::vertex_type>>
     dominators(G const &g) {
   using N = typename Structure::vertex_type;
-  // using E = typename Structure::edge_type;
 
-  // Structure s;
-
-  std::vector<N> nodes;
-  topo_sort<G, Structure>(g, &nodes);
+  DominatorTree<N> tree = dominator_tree<G, Structure>(g);
   std::unordered_map<N, std::unordered_set<N>> dom;
-
-  std::unordered_set<N> pred_part;
-  for (auto const &node : nodes) {
-    pred_part.clear();
-    predecessors<G, Structure>(g, node, &pred_part);
-    for (auto const &p : pred_part) {
-      if (dom.find(node) == dom.end()) {
-        dom[node] = dom.at(p);
-      } else {
-        auto &node_dom_set = dom.at(node);
-        auto const &p_dom_set = dom.at(p);
-        for (auto it = node_dom_set.begin(); it != node_dom_set.end();) {
-          if (p_dom_set.find(*it) == p_dom_set.end()) {
-            it = node_dom_set.erase(it);
-          } else {
-            it++;
-          }
-        }
-      }
-    }
-    dom[node].insert(node);
+  for (N const &n : tree.topo_order()) {
+    std::vector<N> chain = tree.dominator_chain(n);
+    dom[n].insert(chain.begin(), chain.end());
   }
 
   return dom;
@@ -249,38 +409,13 @@ std::unordered_map<typename Structure::vertex_type,
                    typename Structure::vertex_type>
     imm_dominators(G const &g) {
   using N = typename Structure::vertex_type;
-  // using E = typename Structure::edge_type;
-
-  std::vector<N> topo;
-  topo_sort<G, Structure>(g, &topo);
-  std::unordered_map<N, int> topo_rank;
-  for (int i = 0; i < (int)topo.size(); i++) {
-    topo_rank[topo[i]] = i;
-  }
-  std::unordered_map<N, std::unordered_set<N>> dom =
-      dominators<G, Structure>(g);
 
+  DominatorTree<N> tree = dominator_tree<G, Structure>(g);
+  // if a node is only dominated by itself, set the dominator to itself to
+  // signify that it has no immediate dominator
   std::unordered_map<N, N> imm_dom;
-  for (auto const &kv : dom) {
-    N const &n = kv.first;
-    std::unordered_set<N> const &n_doms = kv.second;
-
-    // if a node is only dominated by itself, set the dominator to itself to
-    // signify that it has no immediate dominator
-    if (n_doms.size() == 1) {
-      imm_dom[n] = n;
-      continue;
-    }
-
-    N const *n_imm_dom = nullptr;
-    int current_topo_rank = std::numeric_limits<int>::min();
-    for (auto const &d : n_doms) {
-      if (topo_rank.at(d) > current_topo_rank && d != n) {
-        n_imm_dom = &d;
-        current_topo_rank = topo_rank.at(d);
-      }
-    }
-    imm_dom[n] = *n_imm_dom;
+  for (N const &n : tree.topo_order()) {
+    imm_dom.insert({n, tree.imm_dominator(n)});
   }
 
   return imm_dom;
@@ -294,57 +429,21 @@ void dfs(G const &g,
                             typename Structure::vertex_type const &,
                             typename Structure::vertex_type const &)> const
              &visitor) {
-  using N = typename Structure::vertex_type;
-  using E = typename Structure::edge_type;
-
   Structure s;
 
-  /* auto i_visitor = std::bind(visitor, g, s, n); */
-  auto i_visitor = [&](N const &nn) { return visitor(g, s, n, nn); };
-
-  std::queue<N> q;
-  std::unordered_set<N> visited;
-
-  auto visit = [&](N const &n) {
-    if (visited.find(n) == visited.end()) {
-      q.push(n);
-      visited.insert(n);
-    }
-  };
-
-  visit(n);
-
-  while (!q.empty()) {
-    N current = q.front();
-    q.pop();
-
-    i_visitor(current);
-
-    for (E const &edge : s.get_outgoing_edges(g, current)) {
-      N const &dst = s.get_dst(g, edge);
-      visit(dst);
-    }
-  }
-
-  return;
+  IndexedGraphView<typename Structure::vertex_type> view =
+      indexed_view<G, Structure>()(g);
+  view.bfs(view.index_of(n), [&](int i) { visitor(g, s, n, view.node(i)); });
 }
 
 template <typename G, typename Structure = GraphStructure<G>>
 std::unordered_set<typename Structure::vertex_type>
     descendants(G const &g, typename Structure::vertex_type const &n) {
   using N = typename Structure::vertex_type;
-  using E = typename Structure::edge_type;
 
+  IndexedGraphView<N> view = indexed_view<G, Structure>()(g);
   std::unordered_set<N> descendants;
-
-  auto dfs_visitor = [&](G const &gg,
-                         Structure const &ss,
-                         N const &dfs_src,
-                         N const &current_node) {
-    descendants.insert(current_node);
-  };
-
-  dfs<G, Structure>(g, n, dfs_visitor);
+  view.bfs(view.index_of(n), [&](int i) { descendants.insert(view.node(i)); });
 
   return descendants;
 }
@@ -353,18 +452,24 @@ template <typename G, typename Structure = GraphStructure<G>>
 std::vector<std::unordered_set<typename Structure::vertex_type>>
     weakly_connected_components(G const &g) {
   using N = typename Structure::vertex_type;
-  using E = typename Structure::edge_type;
 
+  IndexedGraphView<N> view = indexed_view<G, Structure>()(g);
   std::vector<std::unordered_set<N>> result;
-  std::unordered_set<N> seen;
+  DenseBitset seen(view.num_nodes());
 
-  for (N const &n : nodes<G, UndirectedStructure<G, Structure>>(g)) {
-    if (seen.find(n) != seen.end()) {
+  for (int i = 0; i < view.num_nodes(); i++) {
+    if (seen.test(i)) {
       continue;
     }
 
-    auto component = descendants<G, UndirectedStructure<G, Structure>>(g, n);
-    seen.insert(component.begin(), component.end());
+    std::unordered_set<N> component;
+    view.bfs(
+        i,
+        [&](int j) {
+          seen.set(j);
+          component.insert(view.node(j));
+        },
+        true /*undirected*/);
     result.emplace_back(component);
   }
 
@@ -378,83 +483,60 @@ std::unordered_map<typename Structure::vertex_type,
   return imm_dominators<G, ReverseStructure<Structure>>(g);
 }
 
+/**
+ * @brief Calls f(n, m, redundant) for every edge (n, m) of the view, where
+ * redundant is set if m is also reachable from n through another successor
+ * of n
+ */
+template <typename N, typename F>
+void classify_transitive_edges(IndexedGraphView<N> const &view, F &&f) {
+  DenseBitset redundant;
+  for (int n = 0; n < view.num_nodes(); n++) {
+    redundant.reset(view.num_nodes());
+    for (int child : view.successors(n)) {
+      view.bfs(child, [&](int nn) {
+        if (nn != child) {
+          redundant.set(nn);
+        }
+      });
+    }
+    for (int m : view.successors(n)) {
+      f(n, m, redundant.test(m));
+    }
+  }
+}
+
 template <typename G, typename Structure = GraphStructure<G>>
 BasicGraph<typename Structure::vertex_type> transitive_reduction(G const &g) {
   using N = typename Structure::vertex_type;
-  using E = typename Structure::edge_type;
 
-  Structure s;
+  IndexedGraphView<N> view = indexed_view<G, Structure>()(g);
   BasicGraph<N> reduction;
 
-  std::unordered_set<N> nodes = s.get_nodes(g);
-
-  reduction.add_nodes(nodes);
-
-  std::unordered_set<std::pair<N, N>> to_delete;
+  reduction.add_nodes(
+      std::unordered_set<N>(view.nodes().begin(), view.nodes().end()));
 
-  auto dfs_visitor = [&](N const &src,
-                         G const &gg,
-                         Structure const &ss,
-                         N const &dfs_src,
-                         N const &nn) {
-    if (nn != dfs_src && to_delete.find({src, nn}) == to_delete.end() &&
-        has_edge<G, Structure>(gg, src, nn)) {
-      to_delete.insert({src, nn});
+  classify_transitive_edges(view, [&](int n, int m, bool redundant) {
+    if (!redundant) {
+      reduction.add_edge(view.node(n), view.node(m));
     }
-  };
-
-  for (N const &n : nodes) {
-    /* auto n_dfs_visitor = std::bind(dfs_visitor, n); */
-    auto n_dfs_visitor =
-        [&](G const &gg, Structure const &ss, N const &dfs_src, N const &nn) {
-          return dfs_visitor(n, gg, ss, dfs_src, nn);
-        };
-
-    for (N const &child : successors<G, Structure>(g, n)) {
-      dfs<G, Structure>(g, child, n_dfs_visitor);
-    }
-  }
-
-  for (E const &e : get_edges<G, Structure>(g)) {
-    std::pair<N, N> basic_edge = get_basic_edge<G, Structure>(g, e);
-
-    if (to_delete.find(basic_edge) == to_delete.end()) {
-      reduction.add_edge(basic_edge);
-    }
-  }
+  });
 
   return reduction;
 }
 
 template <typename N>
 void inplace_transitive_reduction(BasicGraph<N> &g) {
-  using Structure = GraphStructure<BasicGraph<N>>;
-  using G = BasicGraph<N>;
   using E = std::pair<N, N>;
 
-  std::unordered_set<E> to_delete;
-
-  auto dfs_visitor = [&](N const &src,
-                         G const &gg,
-                         Structure const &ss,
-                         N const &dfs_src,
-                         N const &nn) {
-    if (nn != dfs_src && to_delete.find({src, nn}) == to_delete.end() &&
-        has_edge(gg, src, nn)) {
-      to_delete.insert({src, nn});
-    }
-  };
-
-  for (N const &n : g.nodes) {
-    auto n_dfs_visitor =
-        [&](G const &gg, Structure const &ss, N const &dfs_src, N const &nn) {
-          return dfs_visitor(n, gg, ss, dfs_src, nn);
-        };
+  IndexedGraphView<N> view = indexed_graph_view(g);
+  std::vector<E> to_delete;
 
-    for (N const &child : successors(g, n)) {
-      dfs<G, Structure>(g, child, n_dfs_visitor);
+  classify_transitive_edges(view, [&](int n, int m, bool redundant) {
+    if (redundant) {
+      to_delete.push_back({view.node(n), view.node(m)});
     }
-  }
+  });
 
   for (E const &e : to_delete) {
     g.remove_edge(e);
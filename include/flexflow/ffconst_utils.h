@@ -8,6 +8,9 @@ namespace FlexFlow {
 
 std::string get_operator_type_name(OperatorType type);
 
+// The inverse of get_operator_type_name; returns false for unknown names
+bool get_operator_type_from_name(std::string const &name, OperatorType &type);
+
 std::ostream &operator<<(std::ostream &, OperatorType);
 
 }; // namespace FlexFlow
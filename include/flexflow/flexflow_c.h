@@ -105,6 +105,12 @@ flexflow_tensor_t flexflow_model_get_label_tensor(flexflow_model_t handle);
 
 void flexflow_model_zero_gradients(flexflow_model_t handle);
 
+bool flexflow_model_save_checkpoint(flexflow_model_t handle, char const *dir);
+
+bool flexflow_model_wait_for_checkpoint(flexflow_model_t handle);
+
+bool flexflow_model_load_checkpoint(flexflow_model_t handle, char const *dir);
+
 flexflow_tensor_t flexflow_model_add_exp(flexflow_model_t handle,
                                          const flexflow_tensor_t x,
                                          char const *name);
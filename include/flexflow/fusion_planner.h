@@ -0,0 +1,70 @@
+#ifndef _FLEXFLOW_FUSION_PLANNER_H_
+#define _FLEXFLOW_FUSION_PLANNER_H_
+
+#include <vector>
+
+namespace FlexFlow {
+
+/**
+ * @brief What the fusion planner needs to know about one operator.
+ *
+ * Machine views and tensors are identified by small integer ids (equal ids
+ * meaning equal MachineViews / the same logical region), which keeps the
+ * planner independent of Legion.
+ */
+struct FusionPlannerOp {
+  int view;             ///< Id of the machine view of the first output
+  bool can_fuse;        ///< Whether the operator may join a fused group
+  bool can_start_group; ///< Whether a fused group may start at the operator
+  /// For each input, the index of the operator producing it, or -1
+  std::vector<int> producers;
+  std::vector<int> inputs, weights, outputs; ///< Tensor ids
+};
+
+/**
+ * @brief Capacity of a single FusedOp (see MAX_NUM_FUSED_OPERATORS,
+ * MAX_NUM_FUSED_TENSORS and MAX_NUM_INPUTS/WEIGHTS/OUTPUTS)
+ */
+struct FusionLimits {
+  int max_operators;
+  int max_tensors; ///< Per-operator tensor slots, counted for each kind
+  int max_inputs, max_weights, max_outputs; ///< Distinct tensors of a group
+};
+
+/**
+ * @brief Groups operators, given in topological order, into FusedOps.
+ *
+ * @details Operators are visited once, in order. Each operator joins the
+ * earliest group (or single operator that may start one) that has the same
+ * machine view, is not placed before the latest producer of the operator's
+ * inputs and has room left for the operator's tensors. This yields the same
+ * groups as repeatedly fusing the first fusable pair and rescanning, since an
+ * operator that cannot join any group never becomes fusable once later
+ * operators have been added. The first and last operators are never added to
+ * a group.
+ *
+ * @return For every operator, the index of the first operator of its group.
+ * Operators that start a group or are left alone map to themselves.
+ */
+std::vector<int> plan_fusion(std::vector<FusionPlannerOp> const &ops,
+                             FusionLimits const &limits);
+
+/**
+ * @brief Picks the input through which fusing an operator with its producers
+ * refunds the operator's task launches.
+ *
+ * @details A fused group launches one task for all of its operators, so the
+ * launches are refunded once, through the first input whose producer can fuse
+ * and has the operator's view (apply_fusion only fuses operators with
+ * identical views). A producer view of -1 is unknown and taken to match,
+ * which may only move the refund to an earlier input, never count it twice.
+ *
+ * @return The index of that input, or -1 if no producer qualifies
+ */
+int fusion_refund_input(int view,
+                        std::vector<bool> const &producer_can_fuse,
+                        std::vector<int> const &producer_views);
+
+}; // namespace FlexFlow
+
+#endif // _FLEXFLOW_FUSION_PLANNER_H_
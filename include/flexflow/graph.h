@@ -16,6 +16,7 @@
 #ifndef _FLEXFLOW_GRAPH_H_
 #define _FLEXFLOW_GRAPH_H_
 #include "flexflow/basic_graph.h"
+#include "flexflow/dominators.h"
 #include "flexflow/graph_structures.h"
 #include "flexflow/memory_optimization.h"
 #include "flexflow/model.h"
@@ -55,6 +56,21 @@ struct EdgeCompare {
     return false;
   };
 };
+
+/**
+ * @brief Ops whose outputs have the same shapes, partitioned over the same
+ * machine view dimensions, accept the same machine views. SearchHelper caches
+ * valid views under this key so that equivalent ops, including those created
+ * by substitutions, share an entry.
+ */
+struct ValidViewsKey {
+  ValidViewsKey(Op const *op);
+  bool operator==(ValidViewsKey const &other) const;
+
+  // ParallelTensorShape equality ignores parallel_idx, so it is kept apart
+  std::vector<ParallelTensorShape> output_shapes;
+  std::vector<int> parallel_idxs;
+};
 }; // namespace FlexFlow::PCG
 
 namespace std {
@@ -76,6 +92,11 @@ struct hash<FlexFlow::PCG::Node> {
     return n.guid;
   }
 };
+
+template <>
+struct hash<FlexFlow::PCG::ValidViewsKey> {
+  size_t operator()(FlexFlow::PCG::ValidViewsKey const &key) const;
+};
 }; // namespace std
 
 namespace FlexFlow::PCG {
@@ -140,6 +161,30 @@ struct GraphCostResultWithMemory {
                                   GraphCostResultWithMemory const &);
 };
 
+/**
+ * @brief The Pareto front of (run time, peak per-device memory) tradeoffs of
+ * a (sub-)PCG, each point with its machine views.
+ *
+ * @details No point is dominated by another, and points are sorted by
+ * increasing run time. Peak memory is in MB and composes conservatively: the
+ * peaks of subgraphs that share devices are added, and those of subgraphs on
+ * disjoint devices are maxed.
+ */
+struct GraphCostFront {
+  static constexpr size_t MAX_POINTS = 16;
+
+  std::vector<GraphCostResultWithMemory> points;
+
+  void prune();
+  /**
+   * @brief The fastest point whose peak memory fits in memory_limit (in MB),
+   * or an invalid result if there is none.
+   */
+  GraphCostResultWithMemory fastest_within(float memory_limit) const;
+
+  friend std::ostream &operator<<(std::ostream &, GraphCostFront const &);
+};
+
 template <typename T>
 T sequence_cost(T const &first, T const &second);
 
@@ -252,6 +297,24 @@ public:
   template <typename T>
   void check_matches_graph(Graph const *, T const &, Node const &) const;
 
+  /**
+   * @brief How many GPUs a DP state can be moved down by without changing
+   * its cost, see FlexFlow::canonical_gpu_shift
+   */
+  int canonical_gpu_shift(NodeAssignment const &source,
+                          NodeAssignment const &sink,
+                          MachineResource const &resources) const;
+
+  template <typename T>
+  void shift_result_views(T &result, int shift) const;
+
+  /**
+   * @brief Keeps in best the better of two alternative results for the same
+   * DP state: the cheaper one, or for GraphCostFront the front of both.
+   */
+  template <typename T>
+  void keep_best(T &best, T const &candidate) const;
+
 public:
   mutable std::unique_ptr<RecursiveLogger> logger;
 
@@ -274,11 +337,23 @@ private:
                            MachineResource const &resources,
                            SequenceSplit const &split) const;
 
+  std::vector<MachineView>
+      get_bottleneck_views(Graph const *g,
+                           Node const &bottleneck_node,
+                           NodeAssignment const &sink,
+                           MachineResource const &resources) const;
+  /**
+   * @brief All nonsequence splits of resources, the sequential one first
+   */
+  std::vector<NonsequenceSplit>
+      get_nonsequence_splits(MachineResource const &resources) const;
+
 private:
   FFModel *model;
 
   mutable std::unordered_map<size_t, float> cached_graph_costs;
-  mutable std::unordered_map<size_t,
+  mutable std::unordered_map<size_t, GraphCostFront> cached_graph_fronts;
+  mutable std::unordered_map<ValidViewsKey,
                              std::unique_ptr<const std::vector<MachineView>>>
       cached_operator_valid_views;
 };
@@ -309,6 +384,13 @@ public:
   void contract_out_node(Node const &);
   float optimal_cost() const;
   float optimal_cost_with_memory(float run_time_cost_factor) const;
+  GraphCostFront optimal_cost_front() const;
+  /**
+   * @brief The fastest strategy whose peak per-device memory fits in
+   * memory_limit (in MB), or an invalid result if there is none
+   */
+  GraphCostResultWithMemory
+      optimal_cost_within_memory(float memory_limit) const;
   std::unordered_map<Node, MachineView> optimal_views() const;
   void remove_input_nodes();
   void duplicate_input_node(Node const &);
@@ -334,6 +416,26 @@ public:
                           Legion::Runtime *runtime);
   Node find_bottleneck_node(Node const &sink_node,
                             Node const &source_node) const;
+  /**
+   * @brief Returns the post-dominator tree of the graph, built on first use
+   * and cached until the graph is next modified.
+   *
+   * @details Graphs produced by split_at_node share the tree of the graph
+   * they were split from, so it may contain nodes that are not in this
+   * graph. Post-dominance among the nodes of this graph is unaffected; the
+   * first dominator of a node that is outside of this graph stands for "no
+   * dominator".
+   */
+  Utils::DominatorTree<Node> const &get_post_dominator_tree() const;
+  /**
+   * @brief Returns a dense-index snapshot of the graph's topology, built on
+   * first use and cached until the graph is next modified
+   *
+   * @details Traversals of the view reuse its scratch buffers; copy the view
+   * (which shares the topology) to traverse it from several threads.
+   */
+  Utils::IndexedGraphView<Node> const &get_indexed_view() const;
+  bool has_node(Node const &) const;
   void print_strategy_computation_graph(
       std::unordered_map<Node, MachineView> const &strategy) const;
   void export_strategy_computation_graph(
@@ -374,6 +476,14 @@ private:
   void remove_inverse_parallel_ops();
   void replace_subgraph_with_nonempty(
       std::unordered_set<Node> const &currentNodes, Graph const &replaceWith);
+
+  void invalidate_cached_analyses();
+
+private:
+  mutable std::shared_ptr<Utils::IndexedGraphView<Node> const>
+      cached_indexed_view;
+  mutable std::shared_ptr<Utils::DominatorTree<Node> const>
+      cached_post_dominator_tree;
 };
 
 struct GraphOptimizeResult {
@@ -470,6 +580,20 @@ struct invalid_node<BasicGraph<Node>, GraphStructure<BasicGraph<Node>>> {
     return Node::INVALID_NODE;
   }
 };
+
+template <>
+struct indexed_view<Graph, GraphStructure<Graph>> {
+  IndexedGraphView<Node> operator()(Graph const &g) const {
+    return g.get_indexed_view();
+  }
+};
+
+template <>
+struct indexed_view<Graph, ReverseStructure<GraphStructure<Graph>>> {
+  IndexedGraphView<Node> operator()(Graph const &g) const {
+    return g.get_indexed_view().reversed();
+  }
+};
 }; // namespace Utils
 }; // namespace FlexFlow::PCG
 #endif
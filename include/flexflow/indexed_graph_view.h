@@ -0,0 +1,357 @@
+#ifndef _INDEXED_GRAPH_VIEW_H
+#define _INDEXED_GRAPH_VIEW_H
+
+#include "flexflow/graph_structures.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace FlexFlow::PCG::Utils {
+
+/**
+ * @brief Fixed-size set of dense indices stored one bit per index
+ */
+class DenseBitset {
+public:
+  DenseBitset() : num_bits(0) {}
+  explicit DenseBitset(int num_bits)
+      : words((num_bits + 63) / 64, 0), num_bits(num_bits) {}
+
+  /**
+   * @brief Resizes the set to num_bits and clears it, reusing the storage
+   */
+  void reset(int num_bits) {
+    this->num_bits = num_bits;
+    this->words.assign((num_bits + 63) / 64, 0);
+  }
+
+  bool test(int i) const {
+    assert(i >= 0 && i < this->num_bits);
+    return (this->words[i >> 6] >> (i & 63)) & 1;
+  }
+
+  void set(int i) {
+    assert(i >= 0 && i < this->num_bits);
+    this->words[i >> 6] |= uint64_t(1) << (i & 63);
+  }
+
+  /**
+   * @brief Sets bit i and returns whether it was previously clear
+   */
+  bool insert(int i) {
+    bool was_clear = !this->test(i);
+    this->set(i);
+    return was_clear;
+  }
+
+  int size() const {
+    return this->num_bits;
+  }
+
+private:
+  std::vector<uint64_t> words;
+  int num_bits;
+};
+
+/**
+ * @brief A contiguous range of node indices, e.g. the successors of a node
+ */
+struct IndexRange {
+  int const *first, *last;
+
+  int const *begin() const {
+    return this->first;
+  }
+  int const *end() const {
+    return this->last;
+  }
+  size_t size() const {
+    return this->last - this->first;
+  }
+  bool empty() const {
+    return this->first == this->last;
+  }
+};
+
+/**
+ * @brief Immutable snapshot of a graph's topology over dense node indices.
+ *
+ * @details Nodes are numbered 0..num_nodes()-1 and both directions of the
+ * adjacency are stored in CSR form with sorted neighbor lists. Parallel
+ * edges between the same two nodes are merged, since the traversals below
+ * only care about which nodes are connected.
+ *
+ * The topology is shared between copies and with reversed(), so copying a
+ * view is cheap. Each copy owns the scratch buffers its traversals reuse;
+ * a single view object must therefore not be traversed from several threads
+ * at once, nor from within one of its own traversal callbacks.
+ */
+template <typename N>
+class IndexedGraphView {
+public:
+  IndexedGraphView() : IndexedGraphView({}, {}) {}
+
+  /**
+   * @param nodes the nodes of the graph; node i gets index i
+   * @param edges (src, dst) index pairs
+   */
+  IndexedGraphView(std::vector<N> const &nodes,
+                   std::vector<std::pair<int, int>> const &edges)
+      : IndexedGraphView(nodes, node_indices(nodes), edges) {}
+
+  /**
+   * @param index maps nodes[i] to i, for callers that already built it
+   */
+  IndexedGraphView(std::vector<N> nodes,
+                   std::unordered_map<N, int> index,
+                   std::vector<std::pair<int, int>> edges) {
+    assert(index.size() == nodes.size());
+
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    auto out = std::make_shared<Adjacency>();
+    auto in = std::make_shared<Adjacency>();
+    out->start.assign(nodes.size() + 1, 0);
+    in->start.assign(nodes.size() + 1, 0);
+    for (auto const &e : edges) {
+      assert(e.first >= 0 && e.first < (int)nodes.size());
+      assert(e.second >= 0 && e.second < (int)nodes.size());
+      out->start[e.first + 1]++;
+      in->start[e.second + 1]++;
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+      out->start[i + 1] += out->start[i];
+      in->start[i + 1] += in->start[i];
+    }
+    // edges are sorted by (src, dst), so both fills produce sorted lists
+    out->adj.resize(edges.size());
+    in->adj.resize(edges.size());
+    std::vector<int> in_fill(in->start.begin(), in->start.end() - 1);
+    for (size_t k = 0; k < edges.size(); k++) {
+      out->adj[k] = edges[k].second;
+      in->adj[in_fill[edges[k].second]++] = edges[k].first;
+    }
+
+    this->node_list = std::make_shared<std::vector<N> const>(std::move(nodes));
+    this->index =
+        std::make_shared<std::unordered_map<N, int> const>(std::move(index));
+    this->out = out;
+    this->in = in;
+  }
+
+  int num_nodes() const {
+    return this->node_list->size();
+  }
+
+  size_t num_edges() const {
+    return this->out->adj.size();
+  }
+
+  N const &node(int i) const {
+    return this->node_list->at(i);
+  }
+
+  std::vector<N> const &nodes() const {
+    return *this->node_list;
+  }
+
+  bool contains(N const &n) const {
+    return this->index->find(n) != this->index->end();
+  }
+
+  int index_of(N const &n) const {
+    return this->index->at(n);
+  }
+
+  IndexRange successors(int i) const {
+    return this->out->at(i);
+  }
+
+  IndexRange predecessors(int i) const {
+    return this->in->at(i);
+  }
+
+  bool has_edge(int src, int dst) const {
+    IndexRange succs = this->successors(src);
+    return std::binary_search(succs.begin(), succs.end(), dst);
+  }
+
+  /**
+   * @brief The same graph with every edge reversed; shares the topology
+   */
+  IndexedGraphView reversed() const {
+    IndexedGraphView r(*this);
+    std::swap(r.out, r.in);
+    return r;
+  }
+
+  void roots(std::vector<int> *result) const {
+    for (int i = 0; i < this->num_nodes(); i++) {
+      if (this->predecessors(i).empty()) {
+        result->push_back(i);
+      }
+    }
+  }
+
+  void leaves(std::vector<int> *result) const {
+    this->reversed().roots(result);
+  }
+
+  /**
+   * @brief Kahn's algorithm; returns false (leaving the nodes on cycles out
+   * of the ordering) if the graph is not acyclic
+   */
+  bool topo_sort(std::vector<int> *ordering) const {
+    size_t offset = ordering->size();
+    std::vector<int> &degree = this->scratch_degree;
+    degree.resize(this->num_nodes());
+    for (int i = 0; i < this->num_nodes(); i++) {
+      degree[i] = this->predecessors(i).size();
+      if (degree[i] == 0) {
+        ordering->push_back(i);
+      }
+    }
+    for (size_t head = offset; head < ordering->size(); head++) {
+      for (int succ : this->successors((*ordering)[head])) {
+        if (--degree[succ] == 0) {
+          ordering->push_back(succ);
+        }
+      }
+    }
+    return ordering->size() - offset == (size_t)this->num_nodes();
+  }
+
+  /**
+   * @brief Calls visit(i) on every node reachable from src (including src)
+   * in breadth-first order. If undirected is set, edges are followed in both
+   * directions.
+   */
+  template <typename F>
+  void bfs(int src, F &&visit, bool undirected = false) const {
+    std::vector<int> &queue = this->scratch_nodes;
+    this->visited.reset(this->num_nodes());
+    queue.clear();
+    queue.push_back(src);
+    this->visited.set(src);
+    for (size_t head = 0; head < queue.size(); head++) {
+      int current = queue[head];
+      visit(current);
+      for (int succ : this->successors(current)) {
+        if (this->visited.insert(succ)) {
+          queue.push_back(succ);
+        }
+      }
+      if (undirected) {
+        for (int pred : this->predecessors(current)) {
+          if (this->visited.insert(pred)) {
+            queue.push_back(pred);
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Calls visit(i) on every node reachable from src (including src)
+   * in depth-first preorder
+   */
+  template <typename F>
+  void dfs(int src, F &&visit) const {
+    std::vector<int> &stack = this->scratch_nodes;
+    this->visited.reset(this->num_nodes());
+    stack.clear();
+    stack.push_back(src);
+    while (!stack.empty()) {
+      int current = stack.back();
+      stack.pop_back();
+      if (!this->visited.insert(current)) {
+        continue;
+      }
+      visit(current);
+      IndexRange succs = this->successors(current);
+      // push in reverse so that successors are visited in index order
+      for (int const *it = succs.end(); it != succs.begin();) {
+        if (!this->visited.test(*--it)) {
+          stack.push_back(*it);
+        }
+      }
+    }
+  }
+
+private:
+  static std::unordered_map<N, int> node_indices(std::vector<N> const &nodes) {
+    std::unordered_map<N, int> index;
+    index.reserve(nodes.size());
+    for (int i = 0; i < (int)nodes.size(); i++) {
+      index.insert({nodes[i], i});
+    }
+    return index;
+  }
+
+  struct Adjacency {
+    std::vector<int> start, adj;
+
+    IndexRange at(int i) const {
+      return {this->adj.data() + this->start.at(i),
+              this->adj.data() + this->start.at(i + 1)};
+    }
+  };
+
+  std::shared_ptr<std::vector<N> const> node_list;
+  std::shared_ptr<std::unordered_map<N, int> const> index;
+  std::shared_ptr<Adjacency const> out, in;
+
+  mutable std::vector<int> scratch_nodes, scratch_degree;
+  mutable DenseBitset visited;
+};
+
+/**
+ * @brief Builds an IndexedGraphView of g with one get_outgoing_edges call
+ * per node
+ */
+template <typename G, typename Structure = GraphStructure<G>>
+IndexedGraphView<typename Structure::vertex_type>
+    indexed_graph_view(G const &g) {
+  using N = typename Structure::vertex_type;
+
+  Structure s;
+
+  std::unordered_set<N> node_set = s.get_nodes(g);
+  std::vector<N> nodes(node_set.begin(), node_set.end());
+  std::unordered_map<N, int> index;
+  index.reserve(nodes.size());
+  for (int i = 0; i < (int)nodes.size(); i++) {
+    index.insert({nodes[i], i});
+  }
+  std::vector<std::pair<int, int>> edges;
+  for (int i = 0; i < (int)nodes.size(); i++) {
+    for (auto const &e : s.get_outgoing_edges(g, nodes[i])) {
+      edges.push_back({i, index.at(s.get_dst(g, e))});
+    }
+  }
+
+  return IndexedGraphView<N>(
+      std::move(nodes), std::move(index), std::move(edges));
+}
+
+/**
+ * @brief The view the graph algorithms in dominators.h run on. Graphs that
+ * cache their view specialize it to return a copy of the cached view, which
+ * shares its topology, instead of building a new one on every call.
+ */
+template <typename G, typename Structure = GraphStructure<G>>
+struct indexed_view {
+  IndexedGraphView<typename Structure::vertex_type>
+      operator()(G const &g) const {
+    return indexed_graph_view<G, Structure>(g);
+  }
+};
+
+} // namespace FlexFlow::PCG::Utils
+
+#endif // _INDEXED_GRAPH_VIEW_H
@@ -2,6 +2,7 @@
 #define _FLEXFLOW_MACHINE_VIEW_H
 
 #include "legion.h"
+#include <unordered_map>
 #include <vector>
 #ifdef FF_USE_NCCL
 #include <nccl.h>
@@ -50,6 +51,7 @@ struct MachineViewDimCompare {
 
 struct MachineResource {
   MachineResource(FFConfig const &);
+  MachineResource(int num_nodes, int cpus_per_node, int gpus_per_node);
 
   bool is_valid_machine_view(MachineView const &view) const;
   size_t hash() const;
@@ -59,6 +61,28 @@ struct MachineResource {
   int start_gpu_id = 0, start_cpu_id = 0;
 };
 
+/**
+ * @brief How many GPUs views placed within resources can be moved down by
+ * without changing their costs on a machine of identical nodes: whole nodes,
+ * or down to GPU 0 when the views and the resources lie on one node. Returns
+ * 0 if any of the views is a CPU view.
+ */
+int canonical_gpu_shift(std::vector<MachineView> const &views,
+                        MachineResource const &resources);
+
+/**
+ * @brief Moves the GPU views among views up by shift GPUs, e.g. to undo
+ * canonical_gpu_shift
+ */
+template <typename Key>
+void shift_gpu_views(std::unordered_map<Key, MachineView> &views, int shift) {
+  for (auto &kv : views) {
+    if (kv.second.device_type == MachineView::GPU) {
+      kv.second.start_device_id += shift;
+    }
+  }
+}
+
 struct ParallelConfig {
   enum DeviceType {
     GPU = 0,
@@ -20,6 +20,7 @@
 #include "legion.h"
 #include "model.h"
 #include "null_mapper.h"
+#include "op_profiler.h"
 
 namespace FlexFlow {
 
@@ -58,7 +59,8 @@ public:
            Processor local,
            char const *mapper_name, // const std::string& strategyFile,
            bool _enable_control_replication,
-           bool _log_instance_creation);
+           bool _log_instance_creation,
+           bool _profile_ops);
   ~FFMapper();
   virtual char const *get_mapper_name(void) const;
   virtual MapperSyncModel get_mapper_sync_model(void) const;
@@ -314,6 +316,11 @@ private: // Default helper functions
                              RegionRequirement const &req,
                              bool &created,
                              size_t *footprint);
+  void default_create_copy_instance(MapperContext ctx,
+                                    Copy const &copy,
+                                    RegionRequirement const &req,
+                                    Processor target_proc,
+                                    std::vector<PhysicalInstance> &instances);
   LayoutConstraintID
       default_select_layout_constraints(MapperContext ctx,
                                         Memory target_memory,
@@ -333,7 +340,9 @@ private: // Default helper functions
 private:
   unsigned long long compute_task_hash(Task const &task);
   bool is_parameter_server_update_task(TaskID tid);
+  bool is_checkpoint_task(TaskID tid);
   bool is_initializer_task(TaskID tid);
+  bool get_profiled_pass(TaskID tid, ProfiledPass &pass);
   std::vector<Processor> const &all_procs_by_kind(Processor::Kind kind);
 
 protected:
@@ -343,6 +352,7 @@ protected:
   char const *mapper_name;
   bool enable_control_replication;
   bool log_instance_creation;
+  bool profile_ops;
   std::vector<Processor> all_gpus, all_cpus, all_pys, local_gpus, local_cpus,
       local_pys;
   std::map<Processor, Memory> proc_fbmems, proc_zcmems;
@@ -35,6 +35,11 @@ enum class MemorySearchAlgo {
   // Multiple objective DP search. Combine memory cost and run time cost into
   // one single cost function and add a factor to balance them.
   MULTI_OBJECTIVE,
+
+  // Pareto front DP search. Keep every (run time, peak per-device memory)
+  // tradeoff of each sub-problem and pick the fastest strategy that fits in
+  // the device memory, so one search replaces a sweep over the factor.
+  PARETO_FRONT,
 };
 
 /**
@@ -59,6 +64,10 @@ public:
       : mem_usage_type{MemoryUsageType::GLOBAL},
         mem_search_algo{MemorySearchAlgo::MULTI_OBJECTIVE},
         run_time_cost_factor{factor} {}
+  MemoryOptimConfig(MemorySearchAlgo algo)
+      : mem_usage_type{MemoryUsageType::GLOBAL},
+        mem_search_algo{algo},
+        run_time_cost_factor{1.0} {}
 };
 
 /**
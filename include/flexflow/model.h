@@ -17,6 +17,7 @@
 #include "accessor.h"
 #include "config.h"
 #include "device.h"
+#include "flexflow/checkpoint.h"
 #include "flexflow/memory_optimization.h"
 #include "flexflow/node.h"
 #include "flexflow/operator_params.h"
@@ -151,6 +152,9 @@ enum TaskIDs {
   // Optimizer with NCCL
   SGD_UPD_NCCL_TASK_ID,
   ADAM_UPD_NCCL_TASK_ID,
+  // Optimizer with sparse (row, value) gradients
+  SGD_UPD_SPARSE_TASK_ID,
+  ADAM_UPD_SPARSE_TASK_ID,
   // Initializer
   GLOROT_INIT_TASK_ID,
   ZERO_INIT_TASK_ID,
@@ -164,6 +168,9 @@ enum TaskIDs {
   STRATEGY_SEARCH_TASK_ID,
   // Graph
   GRAPH_OPTIMIZE_TASK_ID,
+  // Checkpoint
+  CHECKPOINT_SAVE_TASK_ID,
+  CHECKPOINT_LOAD_TASK_ID,
   // Python data loader
   PY_DL_FLOAT_LOAD_ENTIRE_CPU_TASK_ID,
   PY_DL_INT32_LOAD_ENTIRE_CPU_TASK_ID,
@@ -230,6 +237,7 @@ namespace PCG {
 class SearchHelper;
 class GraphSearchHelper;
 class Graph;
+struct GraphOptimalViewSerialized;
 }; // namespace PCG
 
 class FFModel;
@@ -326,6 +334,7 @@ std::vector<ParallelTensorShape>
 class FFModel {
 public:
   FFModel(FFConfig &config);
+  ~FFModel();
 
   static constexpr float PROPAGATION_CHANCE = 0.25;
   static constexpr float CONTINUE_PROPAGATION_CHANCE = 0.75;
@@ -765,6 +774,16 @@ public:
                           std::vector<Legion::PhysicalRegion> const &regions,
                           Legion::Context ctx,
                           Legion::Runtime *runtime);
+  static bool
+      checkpoint_save_task(Legion::Task const *task,
+                           std::vector<Legion::PhysicalRegion> const &regions,
+                           Legion::Context ctx,
+                           Legion::Runtime *runtime);
+  static bool
+      checkpoint_load_task(Legion::Task const *task,
+                           std::vector<Legion::PhysicalRegion> const &regions,
+                           Legion::Context ctx,
+                           Legion::Runtime *runtime);
   void reset_metrics();
   void init_operators();
   void prefetch();
@@ -773,8 +792,56 @@ public:
   void get_metrics();
   void backward(int seq_length = -1);
   void update();
+  /**
+   * @brief Runs forward, zero_gradients, backward and update as one Legion
+   * trace, so that the runtime replays the dependence analysis and mapping of
+   * the previous step instead of repeating them for every launch.
+   *
+   * @details The trace is captured again under a new ID whenever the
+   * operators, their machine views or tensor shapes, or seq_length change,
+   * and after a recompilation by recompile_on_condition.
+   */
+  void train_step(int seq_length = -1);
+  /**
+   * @brief Makes the next train_step capture a new trace, for changes to the
+   * model that train_step cannot detect
+   */
+  void invalidate_train_step_trace();
+  /**
+   * @brief Writes the run times of the operator tasks profiled with
+   * --profile-ops to <prefix>.csv, next to the costs the search predicted for
+   * them, and every profiled task to the Chrome trace <prefix>.json
+   */
+  bool export_op_profile(std::string const &prefix) const;
+  /**
+   * @brief Checkpoints the parameters and optimizer state to dir without
+   * waiting for it.
+   *
+   * @details Each shard of a tensor is copied by Legion to host memory in the
+   * background, so training only waits for the copies, and written to its own
+   * file by a CPU of the node that owns the shard, staged in its zero-copy
+   * memory (-ll:zsize). The manifest that describes the shards is written by
+   * wait_for_checkpoint, which the next save_checkpoint or load_checkpoint
+   * and the destructor call. The checkpoint can only be loaded after that.
+   */
+  bool save_checkpoint(std::string const &dir);
+  /**
+   * @brief Waits for the shards of the last save_checkpoint and writes its
+   * manifest
+   *
+   * @return false if a shard could not be written, in which case the
+   * checkpoint has no manifest
+   */
+  bool wait_for_checkpoint();
+  /**
+   * @brief Restores the parameters, and the optimizer state if it was saved
+   * for the same kind of optimizer, from a checkpoint of this model saved
+   * under any machine views. Must be called after compile.
+   */
+  bool load_checkpoint(std::string const &dir);
   bool apply_fusion(std::vector<Op *> const &operators,
                     std::vector<Op *> &new_operators);
+  static bool can_fuse_operator(Op const *op);
   Op *get_final_operator() const;
   void compile(LossType loss_type,
                std::vector<MetricsType> const &metrics,
@@ -794,6 +861,19 @@ public:
                       bool perform_memory_search,
                       MemoryOptimConfig new_config,
                       MemorySearchResult &search_result);
+  /**
+   * @brief Write the result of graph_optimize_task to a versioned strategy
+   * file, together with the layers and machine it was searched for.
+   */
+  bool export_strategy(std::string const &filename,
+                       PCG::GraphOptimalViewSerialized const &strategy) const;
+  /**
+   * @brief Read a strategy file written by export_strategy. Fails if the file
+   * was written by another version or for another model or machine, in which
+   * case the strategy has to be searched again.
+   */
+  bool import_strategy(std::string const &filename,
+                       PCG::GraphOptimalViewSerialized &strategy) const;
   void mcmc_optimize(std::map<Op const *, ParallelConfig> &best,
                      size_t budget,
                      float alpha,
@@ -927,12 +1007,36 @@ public:
   std::unordered_map<size_t, NoOp *> cached_noop_ops;
   std::unordered_map<size_t, NoOp *> cached_input_ops;
   std::vector<MachineView> all_valid_views;
+  // The operator costs of the search, kept with --profile-ops to compare
+  // against the profiled run times
+  std::unordered_map<ProfilingRecordKey, CostMetrics> searched_operator_costs;
 #ifdef FF_USE_NCCL
   std::unordered_map<size_t, ncclComm_t *> view_hash_to_nccl_comms;
 #endif
 private:
   bool debug;
   std::map<MachineView, Legion::IndexSpace, MachineViewDimCompare> all_task_is;
+  // The trace of train_step and the signature of the step it captured
+  tl::optional<Legion::TraceID> train_step_trace_id;
+  size_t train_step_signature = 0;
+
+  size_t get_train_step_signature(int seq_length) const;
+  void register_profiled_ops() const;
+
+  // A tensor of the checkpoint, which is partitioned like parameter
+  struct CheckpointTarget {
+    std::string name;
+    ParallelTensor parameter;
+    Legion::LogicalRegion region;
+  };
+  struct PendingCheckpoint {
+    std::string dir;
+    CheckpointManifest manifest;
+    std::vector<std::pair<Legion::FutureMap, Legion::Domain>> future_maps;
+  };
+  tl::optional<PendingCheckpoint> pending_checkpoint;
+
+  std::vector<CheckpointTarget> get_checkpoint_targets() const;
 
   template <int NDIM>
   void map_tensor_with_dim(ParallelTensor tensor, Op const *parallel_op);
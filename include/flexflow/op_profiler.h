@@ -0,0 +1,93 @@
+#ifndef _FLEXFLOW_OP_PROFILER_H_
+#define _FLEXFLOW_OP_PROFILER_H_
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace FlexFlow {
+
+enum class ProfiledPass { FORWARD, BACKWARD, UPDATE };
+
+std::string get_profiled_pass_name(ProfiledPass pass);
+
+/**
+ * @brief One execution of an operator task on one shard
+ */
+struct OpProfileSample {
+  ProfiledPass pass;
+  int shard;
+  unsigned long long processor; ///< Realm ID of the processor it ran on
+  double start_us, end_us;
+};
+
+/**
+ * @brief The run times of one pass of an operator over all iterations and
+ * shards
+ */
+struct OpProfileSummary {
+  size_t op_guid;
+  std::string op_name;
+  ProfiledPass pass;
+  int num_samples;
+  double mean_ms, p50_ms, p99_ms;
+};
+
+/**
+ * @brief Collects the run times of operator tasks, which the mapper requests
+ * from Legion's task profiling when --profile-ops is set.
+ *
+ * @details Tasks are attributed to operators by the OpMeta pointer they get
+ * as their point argument, which FFModel registers for every shard. Samples
+ * are kept for the whole run, and reported as a CSV of per-pass statistics
+ * and a Chrome trace (chrome://tracing or Perfetto) of every sample.
+ */
+class OpProfiler {
+public:
+  static OpProfiler &get_instance();
+
+  void register_shard(void const *meta,
+                      size_t op_guid,
+                      std::string const &op_name,
+                      int shard);
+  /**
+   * @brief Adds a sample for the shard registered for meta, if any
+   */
+  void record(void const *meta,
+              ProfiledPass pass,
+              unsigned long long processor,
+              double start_us,
+              double end_us);
+  void clear();
+
+  std::vector<OpProfileSummary> summarize() const;
+  /**
+   * @brief Writes the statistics of summarize, with a column for the run time
+   * (in ms) the search predicted for each (op_guid, pass) in predicted_ms
+   */
+  bool write_csv(
+      std::string const &filename,
+      std::map<std::pair<size_t, ProfiledPass>, float> const &predicted_ms)
+      const;
+  bool write_chrome_trace(std::string const &filename) const;
+
+private:
+  struct OpShard {
+    size_t op_guid;
+    int shard;
+  };
+
+private:
+  mutable std::mutex mutex;
+  std::unordered_map<void const *, OpShard> shards;
+  std::map<size_t, std::string> op_names;
+  std::map<size_t, std::vector<OpProfileSample>> samples;
+};
+
+}; // namespace FlexFlow
+
+#endif // _FLEXFLOW_OP_PROFILER_H_
@@ -13,6 +13,9 @@ namespace FlexFlow {
 class AggregateMeta : public OpMeta {
 public:
   AggregateMeta(FFHandler handle, int n);
+  // The CPU kernels index the expert tensors directly and need no device
+  // copy of their pointers
+  AggregateMeta(FFHandler handle, int n, bool cpu_kernels);
   ~AggregateMeta(void);
   float **dev_exp_preds;
   float **dev_exp_grads;
@@ -80,6 +83,43 @@ public:
                                       float lambda_bal,
                                       int const batch_size,
                                       int out_dim);
+  static OpMeta *
+      init_task_cpu(Legion::Task const *task,
+                    std::vector<Legion::PhysicalRegion> const &regions,
+                    Legion::Context ctx,
+                    Legion::Runtime *runtime);
+  static void
+      forward_task_cpu(Legion::Task const *task,
+                       std::vector<Legion::PhysicalRegion> const &regions,
+                       Legion::Context ctx,
+                       Legion::Runtime *runtime);
+  static void
+      backward_task_cpu(Legion::Task const *task,
+                        std::vector<Legion::PhysicalRegion> const &regions,
+                        Legion::Context ctx,
+                        Legion::Runtime *runtime);
+  static void forward_kernel_cpu(float const *const *exp_preds,
+                                 int const *gate_assign,
+                                 float const *gate_pred,
+                                 float *output,
+                                 int n,
+                                 int k,
+                                 int rows,
+                                 int batch_size,
+                                 int out_dim);
+  static void backward_kernel_cpu(float const *const *exp_preds,
+                                  float *const *exp_grads,
+                                  int const *gate_assign,
+                                  int const *true_gate_assign,
+                                  float const *gate_pred,
+                                  float *full_gate_grad,
+                                  float const *output_grad,
+                                  int n,
+                                  int k,
+                                  int rows,
+                                  float lambda_bal,
+                                  int batch_size,
+                                  int out_dim);
   void serialize(Legion::Serializer &s) const override;
   bool measure_operator_cost(Simulator *sim,
                              MachineView const &mv,
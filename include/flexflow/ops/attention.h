@@ -12,6 +12,7 @@
 namespace FlexFlow {
 
 class MultiHeadAttentionMeta;
+class MultiHeadAttentionCPUMeta;
 
 class MultiHeadAttention : public Op {
 public:
@@ -83,6 +84,21 @@ public:
                             std::vector<Legion::PhysicalRegion> const &regions,
                             Legion::Context ctx,
                             Legion::Runtime *runtime);
+  static OpMeta *
+      init_task_cpu(Legion::Task const *task,
+                    std::vector<Legion::PhysicalRegion> const &regions,
+                    Legion::Context ctx,
+                    Legion::Runtime *runtime);
+  static void
+      forward_task_cpu(Legion::Task const *task,
+                       std::vector<Legion::PhysicalRegion> const &regions,
+                       Legion::Context ctx,
+                       Legion::Runtime *runtime);
+  static void
+      backward_task_cpu(Legion::Task const *task,
+                        std::vector<Legion::PhysicalRegion> const &regions,
+                        Legion::Context ctx,
+                        Legion::Runtime *runtime);
   bool measure_operator_cost(Simulator *sim,
                              MachineView const &mv,
                              CostMetrics &cost_metrics) const override;
@@ -120,6 +136,22 @@ public:
                                       float const *weight_ptr,
                                       float *weight_grad_ptr,
                                       float const *output_grad_ptr);
+  static void forward_kernel_cpu(MultiHeadAttentionCPUMeta const *m,
+                                 float const *query_ptr,
+                                 float const *key_ptr,
+                                 float const *value_ptr,
+                                 float const *weight_ptr,
+                                 float *output_ptr);
+  static void backward_kernel_cpu(MultiHeadAttentionCPUMeta const *m,
+                                  float const *query_ptr,
+                                  float *query_grad_ptr,
+                                  float const *key_ptr,
+                                  float *key_grad_ptr,
+                                  float const *value_ptr,
+                                  float *value_grad_ptr,
+                                  float const *weight_ptr,
+                                  float *weight_grad_ptr,
+                                  float const *output_grad_ptr);
 
   Params get_params() const;
 
@@ -152,6 +184,59 @@ public:
   void *reserveSpace;
 };
 
+// Offsets of the projection weights in a weight shard of num_heads heads.
+// This is the layout cudnnGetMultiHeadAttnWeights reports for the GPU task
+// variants, which the CPU task variants share so that weights can move
+// between them: the Q, K, V and O weights of all heads in turn, each head
+// holding a column-major [proj_size x input_size] matrix. Element (r, c) of
+// head h of the Q weights is at wq_off + h * wq_head + c * qProjSize + r.
+struct MultiHeadAttentionWeightLayout {
+  MultiHeadAttentionWeightLayout(int num_heads,
+                                 int qSize,
+                                 int kSize,
+                                 int vSize,
+                                 int qProjSize,
+                                 int kProjSize,
+                                 int vProjSize,
+                                 int oProjSize);
+  // Parameters of one head of each projection
+  int64_t wq_head, wk_head, wv_head, wo_head;
+  int64_t wq_off, wk_off, wv_off, wo_off, num_params;
+};
+
+// State for the CPU task variants. The weights follow
+// MultiHeadAttentionWeightLayout, and the projected Q/K/V, per-head
+// outputs and softmax log-sum-exp values from the forward pass are kept
+// for the backward pass in place of cuDNN's reserve space.
+class MultiHeadAttentionCPUMeta : public OpMeta {
+public:
+  MultiHeadAttentionCPUMeta(FFHandler handler,
+                            MultiHeadAttention const *attn,
+                            int num_samples,
+                            int num_heads);
+  MultiHeadAttentionCPUMeta(FFHandler handler,
+                            int num_samples,
+                            int num_heads,
+                            int qSize,
+                            int kSize,
+                            int vSize,
+                            int qProjSize,
+                            int kProjSize,
+                            int vProjSize,
+                            int oProjSize,
+                            int qoSeqLength,
+                            int kvSeqLength);
+  ~MultiHeadAttentionCPUMeta(void);
+
+public:
+  int num_samples, num_heads;
+  int qSize, kSize, vSize, qProjSize, kProjSize, vProjSize, oProjSize;
+  int qoSeqLength, kvSeqLength;
+  float *qProj, *kProj, *vProj, *headOutput, *logSumExp;
+  // Scratch space for the backward pass
+  float *qProjGrad, *kProjGrad, *vProjGrad, *headOutputGrad;
+};
+
 }; // namespace FlexFlow
 
 #endif // _FLEXFLOW_ATTENTION_H
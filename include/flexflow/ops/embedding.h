@@ -51,6 +51,7 @@ public:
   void init(FFModel const &) override;
   void forward(FFModel const &) override;
   void backward(FFModel const &) override;
+  void map_output_tensors(FFModel &model) override;
   // void update(const FFModel&);
   void print_layer(FFModel const &model) override {
     assert(0);
@@ -121,6 +122,12 @@ private:
 public:
   int num_entries, out_channels;
   AggrMode aggr;
+  // When set, the table has no dense gradient: backward writes the distinct
+  // rows touched by each shard (sparse_grad_indices, shaped like the input
+  // and padded with -1) and their reduced gradients (sparse_grad_values, one
+  // out_channels row per lookup slot), which the optimizer applies row-wise
+  bool sparse_grad;
+  ParallelTensor sparse_grad_indices, sparse_grad_values;
 };
 
 }; // namespace FlexFlow
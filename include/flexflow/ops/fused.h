@@ -2,6 +2,7 @@
 #define _FLEXFLOW_FUSED_H_
 
 #include "flexflow/model.h"
+#include "flexflow/ops/kernels/fused_elementwise_kernels.h"
 
 namespace FlexFlow {
 
@@ -46,10 +47,18 @@ public:
                             std::vector<Legion::PhysicalRegion> const &regions,
                             Legion::Context ctx,
                             Legion::Runtime *runtime);
+  static void forward_elementwise_program(
+      FusedOp const *fused,
+      int program,
+      GenericTensorAccessorR const *input_accessor,
+      GenericTensorAccessorW const *output_accessor);
   bool measure_operator_cost(Simulator *sim,
                              MachineView const &pc,
                              CostMetrics &cost_metrics) const override;
 
+private:
+  void compile_elementwise_programs(FFModel const &ff);
+
 public:
   FFIterationConfig iter_config;
   int op_num_inputs[MAX_NUM_FUSED_OPERATORS];
@@ -66,6 +75,14 @@ public:
   int op_weight_idx[MAX_NUM_FUSED_TENSORS];
   int op_output_idx[MAX_NUM_FUSED_TENSORS];
   Op *operators[MAX_NUM_FUSED_OPERATORS];
+  // Runs of element-wise sub-operators compiled into single loops: the
+  // program of each sub-operator, or -1 if it runs its own kernels
+  int op_ew_program[MAX_NUM_FUSED_OPERATORS];
+  Kernels::FusedElementwise::Program ew_programs[MAX_NUM_FUSED_OPERATORS];
+  int numEwPrograms;
+  // Outputs that only live in the registers of an element-wise program and
+  // are therefore not mapped by forward
+  bool output_elided[MAX_NUM_OUTPUTS];
   FusedOpMeta fused_meta[MAX_NUM_WORKERS];
   int numOperators;
 };
@@ -10,6 +10,9 @@ namespace FlexFlow {
 class GroupByMeta : public OpMeta {
 public:
   GroupByMeta(FFHandler handle, int n);
+  // The CPU kernels index the expert buffers directly and need no device
+  // copy of the output pointers
+  GroupByMeta(FFHandler handle, int n, bool cpu_kernels);
   ~GroupByMeta(void);
   float **dev_region_ptrs;
 };
@@ -54,6 +57,21 @@ public:
                             std::vector<Legion::PhysicalRegion> const &regions,
                             Legion::Context ctx,
                             Legion::Runtime *runtime);
+  static OpMeta *
+      init_task_cpu(Legion::Task const *task,
+                    std::vector<Legion::PhysicalRegion> const &regions,
+                    Legion::Context ctx,
+                    Legion::Runtime *runtime);
+  static void
+      forward_task_cpu(Legion::Task const *task,
+                       std::vector<Legion::PhysicalRegion> const &regions,
+                       Legion::Context ctx,
+                       Legion::Runtime *runtime);
+  static void
+      backward_task_cpu(Legion::Task const *task,
+                        std::vector<Legion::PhysicalRegion> const &regions,
+                        Legion::Context ctx,
+                        Legion::Runtime *runtime);
   void serialize(Legion::Serializer &s) const override;
   static PCG::Node deserialize(FFModel &ff,
                                Legion::Deserializer &d,
@@ -76,12 +94,28 @@ public:
       backward_kernel_wrapper(GroupByMeta const *m,
                               float *input_grad,
                               int const *exp_assign,
-                              float **output_grads,
+                              float const *const *output_grads,
                               int n,       // num experts
                               int k,       // chosen experts
                               float alpha, // factor additional memory assigned
                               int batch_size,
                               int data_dim);
+  static void forward_kernel_cpu(float const *input,
+                                 int const *exp_assign,
+                                 float **outputs,
+                                 int n,
+                                 int k,
+                                 float alpha,
+                                 int batch_size,
+                                 int data_dim);
+  static void backward_kernel_cpu(float *input_grad,
+                                  int const *exp_assign,
+                                  float const *const *output_grads,
+                                  int n,
+                                  int k,
+                                  float alpha,
+                                  int batch_size,
+                                  int data_dim);
   bool measure_operator_cost(Simulator *sim,
                              MachineView const &pc,
                              CostMetrics &cost_metrics) const override;
@@ -5,6 +5,7 @@
 #include "flexflow/device.h"
 #include "flexflow/fftype.h"
 #include "flexflow/op_meta.h"
+#include <vector>
 
 namespace FlexFlow {
 
@@ -13,6 +14,7 @@ public:
   EmbeddingMeta(FFHandler handle, Op const *op);
   DataType input_data_type;
   AggrMode aggr;
+  int num_entries;
 };
 
 namespace Kernels {
@@ -32,6 +34,69 @@ void backward_kernel_wrapper(EmbeddingMeta const *m,
                              int out_dim,
                              int batch_size);
 
+// Backward pass for tables without a dense gradient: sparse_indices (shaped
+// like input) receives the sorted, distinct rows touched by this shard
+// followed by -1 padding, and sparse_values receives one reduced out_dim
+// gradient row per distinct index. Duplicate rows are combined with a
+// segmented reduction instead of atomics.
+void sparse_backward_kernel_wrapper(
+    EmbeddingMeta const *m,
+    GenericTensorAccessorR const &input,
+    GenericTensorAccessorR const &output,
+    GenericTensorAccessorW const &sparse_indices,
+    GenericTensorAccessorW const &sparse_values,
+    int in_dim,
+    int out_dim,
+    int batch_size);
+
+// Lookups grouped by the embedding row they reference. Rows are sorted in
+// ascending order and the lookups referencing rows[r] are
+// positions[offsets[r]] ... positions[offsets[r + 1] - 1].
+struct RowGroups {
+  std::vector<int64_t> rows;
+  std::vector<int64_t> offsets;
+  std::vector<int64_t> positions;
+};
+
+// Sorts and deduplicates `num_indices` row indices in [0, num_entries).
+// Negative indices mark unused slots and are skipped.
+void group_rows_cpu(int64_t const *indices,
+                    int64_t num_indices,
+                    int64_t num_entries,
+                    RowGroups &groups);
+// For every group r, reduces src[positions[k] / lookups_per_row] (out_dim
+// floats each, multiplied by scale) into a single row. The result overwrites
+// row r of `reduced` and is added to row rows[r] of `table`; either may be
+// NULL. Groups are split across threads so no two threads write the same row.
+void reduce_rows_cpu(RowGroups const &groups,
+                     float const *src,
+                     int lookups_per_row,
+                     float scale,
+                     int out_dim,
+                     float *reduced,
+                     float *table);
+void forward_kernel_cpu(int64_t const *input,
+                        float *output,
+                        float const *weight,
+                        int in_dim,
+                        int out_dim,
+                        int batch_size,
+                        AggrMode aggr,
+                        int64_t num_entries);
+// Returns the number of distinct rows. weight_grad, sparse_indices and
+// sparse_values are optional; the sparse buffers have room for
+// in_dim * batch_size rows.
+int64_t backward_kernel_cpu(int64_t const *input,
+                            float const *output_grad,
+                            float *weight_grad,
+                            int64_t *sparse_indices,
+                            float *sparse_values,
+                            int in_dim,
+                            int out_dim,
+                            int batch_size,
+                            AggrMode aggr,
+                            int64_t num_entries);
+
 void rand_generate_int64_wrapper(int64_t *ptr, size_t size, int64_t p);
 void rand_generate_int32_wrapper(int32_t *ptr, size_t size, int32_t p);
 
@@ -59,6 +124,21 @@ void backward_kernel(TI const *input_ptr,
                      ffStream_t stream);
 template <typename TD>
 __global__ void rand_generate_int(TD *ptr, size_t size, TD p);
+template <typename TI>
+__global__ void copy_lookup_indices(TI const *input,
+                                    int64_t *keys,
+                                    int64_t *positions,
+                                    int64_t num_lookups);
+__global__ void embed_backward_sparse(int64_t const *rows,
+                                      int64_t const *segment_starts,
+                                      int64_t const *positions,
+                                      float const *output,
+                                      float *values,
+                                      int64_t num_unique,
+                                      int64_t num_lookups,
+                                      int lookups_per_row,
+                                      int out_dim,
+                                      float scale);
 } // namespace Internal
 } // namespace Embedding
 } // namespace Kernels
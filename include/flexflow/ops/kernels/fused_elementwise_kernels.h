@@ -0,0 +1,117 @@
+#ifndef _FLEXFLOW_OPS_KERNELS_FUSED_ELEMENTWISE_KERNELS_H
+#define _FLEXFLOW_OPS_KERNELS_FUSED_ELEMENTWISE_KERNELS_H
+
+#include "flexflow/device.h"
+#include "flexflow/ffconst.h"
+#include <cstddef>
+#include <vector>
+
+#define MAX_NUM_FUSED_EW_INSTRS 32
+#define MAX_NUM_FUSED_EW_REGISTERS 8
+#define MAX_NUM_FUSED_EW_TENSORS 8
+
+namespace FlexFlow {
+namespace Kernels {
+namespace FusedElementwise {
+
+enum InstrKind {
+  EW_LOAD,    // registers[dst] = (float)inputs[tensor][i]
+  EW_COMPUTE, // registers[dst] = op_type(registers[src[0]], registers[src[1]])
+  EW_STORE,   // outputs[tensor][i] = registers[src[0]]
+};
+
+struct Instr {
+  InstrKind kind;
+  OperatorType op_type;
+  // EW_LOAD/EW_STORE: the tensor's type; OP_CAST: the target type
+  DataType data_type;
+  int tensor; // index into the program's inputs (EW_LOAD) or outputs
+  int dst, src[2];
+  float scalar;
+};
+
+/**
+ * @brief A chain of element-wise operators compiled into one loop.
+ *
+ * @details Every instruction is applied to one element index at a time, with
+ * values kept in float registers, so intermediate tensors of the chain are
+ * never written to or read back from memory. Programs are plain data so that
+ * they can be copied into Legion task arguments and CUDA kernel parameters.
+ */
+struct Program {
+  int num_instrs, num_registers;
+  int num_inputs, num_outputs;
+  // The caller's ids of the tensors the program loads and stores
+  int input_tensors[MAX_NUM_FUSED_EW_TENSORS];
+  int output_tensors[MAX_NUM_FUSED_EW_TENSORS];
+  Instr instrs[MAX_NUM_FUSED_EW_INSTRS];
+};
+
+/**
+ * @brief What the planner needs to know about a sub-operator of a FusedOp
+ */
+struct OpInfo {
+  OperatorType op_type;
+  float scalar; ///< ElementUnary scalar
+  /// All inputs and outputs have the same shape, ignoring data types
+  bool same_shape;
+  /// Id of the output shape; the operators of a program share it
+  int shape;
+  std::vector<int> inputs, outputs; ///< Tensor ids
+  std::vector<DataType> input_types, output_types;
+};
+
+/**
+ * @brief Whether op can be evaluated by a Program: element-wise binary and
+ * unary operators and casts between float and another numeric type, with
+ * no broadcasting. Dropout is excluded since it depends on cuDNN state.
+ */
+bool is_elementwise(OpInfo const &op);
+
+/**
+ * @brief Groups consecutive element-wise sub-operators into Programs.
+ *
+ * @param ops the sub-operators of a FusedOp in execution order
+ * @param pinned tensors that must be written even if no later sub-operator
+ * reads them, e.g. because operators outside the FusedOp do
+ * @param programs receives the compiled programs
+ * @param op_program receives, for each op, the index of its program or -1
+ * @param materialized receives whether each tensor is read or written by
+ * any program or remaining sub-operator. Tensors that are not only exist
+ * in registers and need no storage.
+ */
+void plan_programs(std::vector<OpInfo> const &ops,
+                   std::vector<bool> const &pinned,
+                   std::vector<Program> *programs,
+                   std::vector<int> *op_program,
+                   std::vector<bool> *materialized);
+
+/**
+ * @brief Runs program over volume elements on the CPU, tile by tile across
+ * the CPUThreadPool with AVX2 loops for the arithmetic instructions
+ */
+void forward_kernel_cpu(Program const &program,
+                        void const *const *inputs,
+                        void *const *outputs,
+                        size_t volume);
+
+void forward_kernel_wrapper(Program const &program,
+                            void const *const *inputs,
+                            void *const *outputs,
+                            size_t volume,
+                            bool profiling);
+
+namespace Internal {
+
+void forward_kernel(Program const &program,
+                    void const *const *inputs,
+                    void *const *outputs,
+                    size_t volume,
+                    ffStream_t stream);
+
+} // namespace Internal
+} // namespace FusedElementwise
+} // namespace Kernels
+} // namespace FlexFlow
+
+#endif // _FLEXFLOW_OPS_KERNELS_FUSED_ELEMENTWISE_KERNELS_H
@@ -35,6 +35,17 @@ void backward_kernel_wrapper(SoftmaxMeta const *m,
                              float const *output_grad_ptr,
                              size_t num_elements);
 
+// CPU kernels used by the LOC_PROC task variants. Softmax is always taken
+// along the innermost (contiguous) dimension of each row.
+void forward_kernel_cpu(float const *input_ptr,
+                        float *output_ptr,
+                        size_t num_rows,
+                        size_t row_size);
+
+void backward_kernel_cpu(float *input_grad_ptr,
+                         float const *output_grad_ptr,
+                         size_t num_elements);
+
 namespace Internal {
 void forward_kernel(SoftmaxMeta const *m,
                     float const *input_ptr,
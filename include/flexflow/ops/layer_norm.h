@@ -56,6 +56,21 @@ public:
                             std::vector<Legion::PhysicalRegion> const &regions,
                             Legion::Context ctx,
                             Legion::Runtime *runtime);
+  static OpMeta *
+      init_task_cpu(Legion::Task const *task,
+                    std::vector<Legion::PhysicalRegion> const &regions,
+                    Legion::Context ctx,
+                    Legion::Runtime *runtime);
+  static void
+      forward_task_cpu(Legion::Task const *task,
+                       std::vector<Legion::PhysicalRegion> const &regions,
+                       Legion::Context ctx,
+                       Legion::Runtime *runtime);
+  static void
+      backward_task_cpu(Legion::Task const *task,
+                        std::vector<Legion::PhysicalRegion> const &regions,
+                        Legion::Context ctx,
+                        Legion::Runtime *runtime);
   bool measure_operator_cost(Simulator *sim,
                              MachineView const &pc,
                              CostMetrics &cost_metrics) const;
@@ -89,6 +104,18 @@ public:
                                       T const *gamma_ptr,
                                       T *gamma_grad_ptr,
                                       T *beta_grad_ptr);
+  static void forward_kernel_cpu(LayerNormMeta const *m,
+                                 float const *input_ptr,
+                                 float *output_ptr,
+                                 float const *gamma_ptr,
+                                 float const *beta_ptr);
+  static void backward_kernel_cpu(LayerNormMeta const *m,
+                                  float const *output_grad_ptr,
+                                  float const *input_ptr,
+                                  float *input_grad_ptr,
+                                  float const *gamma_ptr,
+                                  float *gamma_grad_ptr,
+                                  float *beta_grad_ptr);
 
 public:
   bool elementwise_affine;
@@ -100,6 +127,14 @@ public:
 class LayerNormMeta : public OpMeta {
 public:
   LayerNormMeta(FFHandler handle, LayerNorm const *ln);
+  // Keeps the per-row statistics in host memory for the CPU kernels
+  LayerNormMeta(FFHandler handle, LayerNorm const *ln, bool cpu_kernels);
+  LayerNormMeta(FFHandler handle,
+                bool elementwise_affine,
+                int64_t effective_batch_size,
+                int64_t effective_num_elements,
+                float eps,
+                bool cpu_kernels);
 
 public:
   bool elementwise_affine;
@@ -50,6 +50,16 @@ public:
                             std::vector<Legion::PhysicalRegion> const &regions,
                             Legion::Context ctx,
                             Legion::Runtime *runtime);
+  static void
+      forward_task_cpu(Legion::Task const *task,
+                       std::vector<Legion::PhysicalRegion> const &regions,
+                       Legion::Context ctx,
+                       Legion::Runtime *runtime);
+  static void
+      backward_task_cpu(Legion::Task const *task,
+                        std::vector<Legion::PhysicalRegion> const &regions,
+                        Legion::Context ctx,
+                        Legion::Runtime *runtime);
   void serialize(Legion::Serializer &s) const override;
   static PCG::Node deserialize(FFModel &ff,
                                Legion::Deserializer &d,
@@ -93,6 +103,19 @@ public:
                                       size_t batch_size,
                                       int length,
                                       int k);
+  static void forward_kernel_cpu(float const *input_ptr,
+                                 float *output_ptr,
+                                 int *indices_ptr,
+                                 size_t batch_size,
+                                 int length,
+                                 int k,
+                                 bool sorted);
+  static void backward_kernel_cpu(float const *out_grad_ptr,
+                                  int const *indices_ptr,
+                                  float *in_grad_ptr,
+                                  size_t batch_size,
+                                  int length,
+                                  int k);
   Params get_params() const;
 
 public:
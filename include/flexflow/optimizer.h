@@ -30,7 +30,12 @@ public:
   virtual void init(void) = 0;
   virtual void next(void) = 0;
   virtual void update(const ParallelTensor p) = 0;
+  // Records the (indices, values) gradient of every embedding table that is
+  // trained from a sparse gradient, keyed by the table's region
+  void init_sparse_grads(void);
   FFModel const *model;
+  std::map<Legion::LogicalRegion, std::pair<ParallelTensor, ParallelTensor>>
+      sparse_grads;
 };
 
 class SGDOptimizer : public Optimizer {
@@ -43,6 +48,7 @@ public:
   void init(void);
   void next(void);
   void update(const ParallelTensor p);
+  void sparse_update(const ParallelTensor p);
   void set_weight_decay(double _weight_decay);
   static void ps_update_task(Legion::Task const *task,
                              std::vector<Legion::PhysicalRegion> const &regions,
@@ -54,6 +60,49 @@ public:
                                  int num_replicas,
                                  float *w_ptr,
                                  float *v_ptr);
+  static void
+      ps_update_task_cpu(Legion::Task const *task,
+                         std::vector<Legion::PhysicalRegion> const &regions,
+                         Legion::Context ctx,
+                         Legion::Runtime *runtime);
+  // Fused, vectorized update of w_ptr[0, size) from the sum of num_replicas
+  // gradient copies stored size elements apart; split across CPU threads
+  static void update_kernel_cpu(SGDOptimizer const *op,
+                                float const *w_grad_ptr,
+                                size_t size,
+                                int num_replicas,
+                                float *w_ptr,
+                                float *v_ptr);
+  static void
+      sparse_update_task(Legion::Task const *task,
+                         std::vector<Legion::PhysicalRegion> const &regions,
+                         Legion::Context ctx,
+                         Legion::Runtime *runtime);
+  static void
+      sparse_update_task_cpu(Legion::Task const *task,
+                             std::vector<Legion::PhysicalRegion> const &regions,
+                             Legion::Context ctx,
+                             Legion::Runtime *runtime);
+  // Row-wise update of the rows of w_ptr in indices_ptr, summing the
+  // values_ptr rows of duplicate indices; negative indices are skipped
+  static void sparse_update_kernel_cpu(SGDOptimizer const *op,
+                                       int64_t const *indices_ptr,
+                                       float const *values_ptr,
+                                       int64_t num_lookups,
+                                       int out_dim,
+                                       int64_t num_entries,
+                                       int num_replicas,
+                                       float *w_ptr,
+                                       float *v_ptr);
+  static void sparse_update_task_gpu(SGDOptimizer const *op,
+                                     int64_t const *indices_ptr,
+                                     float const *values_ptr,
+                                     int64_t num_lookups,
+                                     int out_dim,
+                                     int64_t num_entries,
+                                     int num_replicas,
+                                     float *w_ptr,
+                                     float *v_ptr);
 #ifdef FF_USE_NCCL
   static void
       nccl_update_task(Legion::Task const *task,
@@ -85,6 +134,7 @@ public:
   void init(void);
   void next(void);
   void update(const ParallelTensor p);
+  void sparse_update(const ParallelTensor p);
   void set_weight_decay(double _weight_decay);
   static void ps_update_task(Legion::Task const *task,
                              std::vector<Legion::PhysicalRegion> const &regions,
@@ -97,6 +147,49 @@ public:
                                  float *w_ptr,
                                  float *v_ptr,
                                  float *m_ptr);
+  static void
+      ps_update_task_cpu(Legion::Task const *task,
+                         std::vector<Legion::PhysicalRegion> const &regions,
+                         Legion::Context ctx,
+                         Legion::Runtime *runtime);
+  static void update_kernel_cpu(AdamOptimizer const *op,
+                                float const *w_grad_ptr,
+                                size_t size,
+                                int num_replicas,
+                                float *w_ptr,
+                                float *v_ptr,
+                                float *m_ptr);
+  static void
+      sparse_update_task(Legion::Task const *task,
+                         std::vector<Legion::PhysicalRegion> const &regions,
+                         Legion::Context ctx,
+                         Legion::Runtime *runtime);
+  static void
+      sparse_update_task_cpu(Legion::Task const *task,
+                             std::vector<Legion::PhysicalRegion> const &regions,
+                             Legion::Context ctx,
+                             Legion::Runtime *runtime);
+  // Lazy Adam: only the moments of the rows in indices_ptr are updated
+  static void sparse_update_kernel_cpu(AdamOptimizer const *op,
+                                       int64_t const *indices_ptr,
+                                       float const *values_ptr,
+                                       int64_t num_lookups,
+                                       int out_dim,
+                                       int64_t num_entries,
+                                       int num_replicas,
+                                       float *w_ptr,
+                                       float *v_ptr,
+                                       float *m_ptr);
+  static void sparse_update_task_gpu(AdamOptimizer const *op,
+                                     int64_t const *indices_ptr,
+                                     float const *values_ptr,
+                                     int64_t num_lookups,
+                                     int out_dim,
+                                     int64_t num_entries,
+                                     int num_replicas,
+                                     float *w_ptr,
+                                     float *v_ptr,
+                                     float *m_ptr);
 #ifdef FF_USE_NCCL
   static void
       nccl_update_task(Legion::Task const *task,
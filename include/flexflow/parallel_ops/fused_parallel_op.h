@@ -8,6 +8,7 @@
 #include "flexflow/op_meta.h"
 #include "flexflow/operator.h"
 #include "flexflow/parallel_ops/fused_parallel_op_params.h"
+#include "flexflow/parallel_ops/kernels/fused_parallel_op_kernels.h"
 #include "parallel_op.h"
 
 namespace FlexFlow {
@@ -34,13 +35,19 @@ public:
                             std::vector<Legion::PhysicalRegion> const &regions,
                             Legion::Context ctx,
                             Legion::Runtime *runtime);
+  static void gather_task(Legion::Task const *task,
+                          std::vector<Legion::PhysicalRegion> const &regions,
+                          Legion::Context ctx,
+                          Legion::Runtime *runtime,
+                          bool accumulate);
   template <typename T>
-  static void
-      forward_kernel(T const *input_ptr, T *output_ptr, size_t num_elements);
-  template <typename T>
-  static void backward_kernel(T const *output_grad_ptr,
-                              T *input_grad_ptr,
-                              size_t num_elements);
+  static void gather_task_with_type(
+      Legion::Task const *task,
+      std::vector<Legion::PhysicalRegion> const &regions,
+      Legion::Context ctx,
+      Legion::Runtime *runtime,
+      Kernels::FusedParallelOp::CopyPlan const &plan,
+      bool accumulate);
   bool measure_operator_cost(Simulator *sim,
                              MachineView const &mv,
                              CostMetrics &cost_metrics) const override;
@@ -52,6 +59,8 @@ public:
 public:
   int num_parallel_ops;
   ParallelOpInfo parallel_ops[MAX_NUM_FUSED_OPERATORS];
+  // The whole chain as one copy, and its adjoint for the gradients
+  Kernels::FusedParallelOp::CopyPlan forward_plan, backward_plan;
 };
 
 }; // namespace FlexFlow
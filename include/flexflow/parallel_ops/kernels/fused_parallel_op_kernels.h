@@ -0,0 +1,77 @@
+#ifndef _FLEXFLOW_OPS_KERNELS_FUSED_PARALLEL_OP_KERNELS_H
+#define _FLEXFLOW_OPS_KERNELS_FUSED_PARALLEL_OP_KERNELS_H
+
+#include "flexflow/parallel_ops/parallel_op_info.h"
+#include "tl/optional.hpp"
+#include <cstddef>
+#include <vector>
+
+#define MAX_FUSED_PARALLEL_REPLICAS 64
+#define MAX_FUSED_PARALLEL_ENTRIES 256
+
+namespace FlexFlow {
+namespace Kernels {
+namespace FusedParallelOp {
+
+/**
+ * @brief The source-to-destination mapping of a whole chain of Repartition,
+ * Combine, Replicate and Reduction operators.
+ *
+ * @details Repartition and Combine only change which device owns a shard,
+ * which Legion resolves when it maps the regions of a single launch, so the
+ * only data transformation left is along the replica dim. Destination
+ * replica r there is the weighted sum of the source replicas
+ * source[row_start[r]..row_start[r + 1]), where the weights count how many
+ * paths through the chain lead from a source replica to r. A chain that
+ * never replicates or reduces has replica_dim == -1 and one identity row.
+ * Plans are plain data so that they can be copied into Legion task arguments
+ * and CUDA kernel parameters.
+ */
+struct CopyPlan {
+  int replica_dim;      ///< Legion dim that is replicated or reduced, or -1
+  int num_src, num_dst; ///< Sizes of the replica dim before and after
+  int num_entries;
+  int row_start[MAX_FUSED_PARALLEL_REPLICAS + 1];
+  int source[MAX_FUSED_PARALLEL_ENTRIES];
+  int weight[MAX_FUSED_PARALLEL_ENTRIES];
+};
+
+/**
+ * @brief Composes the chain ops applied to a tensor whose Legion-ordered
+ * dims have the given sizes. As for the individual Replicate and Reduction
+ * operators, only the outermost dim may be replicated or reduced.
+ *
+ * @return nullopt if the chain has more than MAX_FUSED_PARALLEL_REPLICAS
+ * destination replicas or more than MAX_FUSED_PARALLEL_ENTRIES nonzero
+ * weights, in which case it has to stay unfused
+ */
+tl::optional<CopyPlan> plan_copy(std::vector<int> const &sizes,
+                                 std::vector<ParallelOpInfo> const &ops);
+
+/**
+ * @brief The plan of the adjoint mapping, which backward uses to accumulate
+ * the output gradients into the input gradients
+ *
+ * @return nullopt under the same limits as plan_copy
+ */
+tl::optional<CopyPlan> transpose_plan(CopyPlan const &plan);
+
+/**
+ * @brief Writes (or, with accumulate, adds) rows [dst_lo, dst_lo +
+ * num_rows) of the plan's destination, reading all of its source rows.
+ * Every row holds row_volume contiguous elements.
+ */
+template <typename T>
+void gather_kernel(CopyPlan const &plan,
+                   T const *src_ptr,
+                   T *dst_ptr,
+                   size_t row_volume,
+                   int dst_lo,
+                   int num_rows,
+                   bool accumulate);
+
+} // namespace FusedParallelOp
+} // namespace Kernels
+} // namespace FlexFlow
+
+#endif // _FLEXFLOW_OPS_KERNELS_FUSED_PARALLEL_OP_KERNELS_H
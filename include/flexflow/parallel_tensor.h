@@ -102,6 +102,7 @@ struct ParallelTensorShape {
 
   size_t get_piece_size() const;
   bool is_valid() const;
+  bool is_valid_machine_view(MachineView const &view) const;
 
   int get_num_replica_dims() const;
   int get_num_replicas() const;
@@ -0,0 +1,90 @@
+#ifndef _FLEXFLOW_ROOFLINE_COST_MODEL_H_
+#define _FLEXFLOW_ROOFLINE_COST_MODEL_H_
+
+#include "flexflow/ffconst.h"
+#include <string>
+#include <unordered_map>
+
+namespace FlexFlow {
+
+class Op;
+struct MachineView;
+struct CostMetrics;
+
+/**
+ * @brief Peak rates of one device, read from a device description file of
+ * "key = value" and "efficiency <operator type> = value" lines (see
+ * device_config_example).
+ */
+struct DeviceDescription {
+  float peak_tflops = 15.0f;            ///< Dense compute throughput
+  float memory_bandwidth = 900.0f;      ///< Device memory bandwidth in GB/s
+  float kernel_launch_latency = 0.005f; ///< Per kernel launch, in ms
+  /// Fraction of the peak rates that an operator type achieves, calibrated
+  /// against profiled costs; 1 for types without an entry
+  std::unordered_map<OperatorType, float> efficiency;
+
+  float get_efficiency(OperatorType type) const;
+
+  static DeviceDescription from_file(std::string const &filename);
+};
+
+/**
+ * @brief The work of one pass of an operator on one device
+ */
+struct OperatorWork {
+  double flops = 0.0;
+  double bytes = 0.0; ///< Read from and written to device memory
+  int num_kernels = 0;
+};
+
+/**
+ * @brief The work of the forward and backward (zero unless comp_mode is
+ * training) passes of op on one device of view, also filling in the memory of
+ * cost_metrics and zeroing the rest
+ *
+ * @return false if the view does not apply to the operator's tensors
+ */
+bool get_operator_work(Op const *op,
+                       MachineView const &view,
+                       CompMode comp_mode,
+                       OperatorWork &forward,
+                       OperatorWork &backward,
+                       CostMetrics &cost_metrics);
+
+/**
+ * @brief Estimates operator costs from FLOPs, bytes moved and launch
+ * overhead instead of timing kernels, so that the search can run without a
+ * GPU.
+ *
+ * @details Every kernel is assumed to run at the speed of its bottleneck,
+ * i.e. max(flops / compute rate, bytes / memory bandwidth), with both rates
+ * scaled by the efficiency of the operator type.
+ */
+class RooflineCostModel {
+public:
+  RooflineCostModel(DeviceDescription const &device);
+
+  /**
+   * @brief Fills in the times and memory of cost_metrics like
+   * Op::measure_operator_cost does for profiling, except for sync costs
+   *
+   * @return false if the view does not apply to the operator's tensors
+   */
+  bool estimate_operator_cost(Op const *op,
+                              MachineView const &view,
+                              CompMode comp_mode,
+                              CostMetrics &cost_metrics) const;
+
+  /**
+   * @brief The run time (in ms) of work done by an operator of the given type
+   */
+  float run_time(OperatorType type, OperatorWork const &work) const;
+
+private:
+  DeviceDescription device;
+};
+
+}; // namespace FlexFlow
+
+#endif // _FLEXFLOW_ROOFLINE_COST_MODEL_H_
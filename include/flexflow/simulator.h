@@ -17,7 +17,9 @@
 
 #include "config.h"
 #include "ffconst.h"
+#include "flexflow/cost_predictor.h"
 #include "flexflow/operator_params.h"
+#include "flexflow/roofline_cost_model.h"
 #include "flexflow/utils/hash_utils.h"
 #include "mpark/variant.hpp"
 #include "parallel_tensor.h"
@@ -686,7 +688,16 @@ public:
 
 size_t data_type_size(DataType);
 
-using ProfilingRecordKey = std::tuple<OperatorParameters, MachineView>;
+/**
+ * @brief What a profiled operator cost depends on: the operator's parameters,
+ * the device type, and the shapes of the input, output and weight shards
+ * that one device computes on. Views that only differ in which devices they
+ * use (e.g. in their start device or strides) share a record; their sync
+ * costs, which do depend on the devices, are estimated separately.
+ */
+using ProfilingRecordKey = std::tuple<OperatorParameters,
+                                      MachineView::DeviceType,
+                                      std::vector<ParallelTensorShape>>;
 
 class Simulator {
 public:
@@ -704,10 +715,17 @@ public:
                                        bool force_zero_cost = false);
   CostMetrics measure_operator_cost(Op const *op, ParallelConfig const &config);
   CostMetrics measure_operator_cost(Op const *op, MachineView const &view);
+  static tl::optional<ProfilingRecordKey>
+      get_profiling_record_key(Op const *op, MachineView const &view);
   float estimate_xfer_cost(Op const *op,
                            int input_idx,
                            MachineView const &source_view,
                            MachineView const &sink_view);
+  void add_launch_costs(Op const *op, CostMetrics &cost_metrics) const;
+  float estimate_fusion_saving(Op const *op,
+                               int input_idx,
+                               MachineView const &source_view,
+                               MachineView const &sink_view);
   float
       default_estimate_sync_cost(const ParallelDim tensor_dims[MAX_TENSOR_DIM],
                                  int tensor_ndims,
@@ -750,6 +768,15 @@ public:
   std::unordered_map<size_t, CostMetrics> hash_to_operator_cost;
   std::unordered_map<ProfilingRecordKey, CostMetrics>
       strict_hash_to_operator_cost;
+  // Estimates operator costs instead of profiling them if set, in which case
+  // the simulator allocates no device resources
+  std::unique_ptr<RooflineCostModel> roofline_model;
+  // Records every profiled cost if set, and predicts costs from them instead
+  // of profiling if predict_costs is also set
+  std::unique_ptr<CostPredictor> cost_predictor;
+  bool predict_costs;
+  // Legion task launch overhead (in ms), which kernel timings do not include
+  float task_launch_time;
 
 public:
   Conv2DMeta *conv2d_meta;
@@ -768,6 +795,10 @@ public:
   int max_num_segments; // simulation could be slow if the number of segments
                         // are too large
 private:
+  void init_cost_models(FFConfig const &config);
+  bool compute_operator_cost(Op const *op,
+                             MachineView const &view,
+                             CostMetrics &cost_metrics);
   float estimate_repartition_xfer_cost(
       int repartition_dim,
       int repartition_degree,
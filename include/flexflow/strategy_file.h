@@ -0,0 +1,39 @@
+#ifndef _FLEXFLOW_STRATEGY_FILE_H_
+#define _FLEXFLOW_STRATEGY_FILE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Far larger than the signature of any model, which takes a few dozen bytes
+// per layer
+#define MAX_STRATEGY_SIGNATURE_BYTES (64 * 1024 * 1024)
+
+namespace FlexFlow {
+
+/**
+ * @brief Writes a versioned strategy file holding the signature of the model
+ * and machine that strategy was searched for, followed by the strategy
+ */
+bool write_strategy_file(std::string const &filename,
+                         std::vector<char> const &signature,
+                         char const *strategy,
+                         size_t strategy_bytes);
+
+/**
+ * @brief Reads a file written by write_strategy_file into signature and
+ * strategy, which has room for max_strategy_bytes
+ *
+ * @return false, after printing why, if the file is not a strategy file of
+ * this version, or if it is truncated, has trailing data or holds sizes that
+ * exceed the file or the limits
+ */
+bool read_strategy_file(std::string const &filename,
+                        std::vector<char> &signature,
+                        char *strategy,
+                        size_t max_strategy_bytes,
+                        size_t &strategy_bytes);
+
+}; // namespace FlexFlow
+
+#endif // _FLEXFLOW_STRATEGY_FILE_H_
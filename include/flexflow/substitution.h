@@ -19,6 +19,7 @@
 #include "flexflow/graph.h"
 #include "flexflow/parallel_tensor.h"
 #include "flexflow/substitution_loader.h"
+#include "flexflow/substitution_profile.h"
 #include "flexflow/utils/recursive_logger.h"
 #include "tl/optional.hpp"
 #include <queue>
@@ -117,6 +118,10 @@ OpX *create_opx(sl::Operator const &op,
                 TensorX const &input3 = TensorX::NO_TX,
                 TensorX const &input4 = TensorX::NO_TX);
 void create_xfer(GraphXfer &xfer, sl::Rule const &r, int parallel_degree);
+void append_xfers(FFModel *model,
+                  std::vector<sl::Rule> const &rules,
+                  int parallel_degree,
+                  std::vector<GraphXfer *> &xfers);
 std::vector<GraphXfer *> create_xfers(FFModel *model,
                                       sl::RuleCollection const &rules,
                                       int parallel_degree);
@@ -128,16 +133,15 @@ public:
   }
 };
 
+class GraphSearchHelper;
+
 class GraphCompareWithMemory {
 public:
-  GraphCompareWithMemory(float factor) : run_time_cost_factor{factor} {}
-  bool operator()(Graph *lhs, Graph *rhs) {
-    return lhs->optimal_cost_with_memory(run_time_cost_factor) >
-           rhs->optimal_cost_with_memory(run_time_cost_factor);
-  }
+  GraphCompareWithMemory(GraphSearchHelper const *search) : search{search} {}
+  bool operator()(Graph *lhs, Graph *rhs);
 
 private:
-  float run_time_cost_factor;
+  GraphSearchHelper const *search;
 };
 
 class GraphXferMatch {
@@ -214,6 +218,9 @@ public:
   bool create_new_operator(OpX const *opx, Node &op);
 
   std::string get_name() const;
+  // Unnamed xfers share no stable identity across searches, so they are
+  // neither profiled nor pruned
+  bool has_name() const;
 
   template <typename GraphComparator>
   void
@@ -225,7 +232,8 @@ public:
           int maxNumOps,
           SimplificationSettings const &simplification_settings,
           int &num_matches_found,
-          int &num_matches_rejected);
+          int &num_matches_rejected,
+          std::vector<Graph *> *new_candidates = nullptr);
 
   void find_matches(Graph const *, std::vector<GraphXferMatch> &matches);
   GraphXferMatch get_match_record(Graph const *) const;
@@ -268,6 +276,11 @@ public:
    * @brief Substitute the mem_config with new_config.
    */
   void update_mem_optim_config(MemoryOptimConfig const &new_config);
+  /**
+   * @brief The cost of graph that base_optimize_with_memory minimizes under
+   * the current mem_config.
+   */
+  float memory_aware_cost(Graph const *graph) const;
 
   /**
    * @brief Clear the optimized graph cache of this helper.
@@ -314,7 +327,34 @@ private:
       ParallelTensorShape const &bottleneck_output_shape);
 
   void generate_all_pcg_xfers();
-  void load_graph_substitutions(std::vector<GraphXfer *> &xfers) const;
+  /**
+   * @brief The substitutions to try on graph: the built-in ones and those
+   * built so far from the rule file, after building the rules that may apply
+   * to graph's op types.
+   */
+  void load_graph_substitutions(Graph const *graph,
+                                std::vector<GraphXfer *> &xfers) const;
+  void load_rules_for_op_types(std::vector<OperatorType> op_types) const;
+  void prune_xfers();
+  /**
+   * @brief Adds one run of xfer in a base search to the substitution profile
+   * and remembers which xfer created each of the new candidates.
+   */
+  void profile_xfer_run(
+      GraphXfer const *xfer,
+      int num_matches_found,
+      double run_time,
+      std::vector<Graph *> &new_candidates,
+      std::unordered_map<Graph const *, GraphXfer const *> &candidate_xfers);
+  /**
+   * @brief Credits the xfer that created candidate, which the search has just
+   * taken from its queue, with an improvement if it lowered the best cost.
+   */
+  void profile_candidate(
+      Graph const *candidate,
+      bool improved,
+      std::unordered_map<Graph const *, GraphXfer const *> &candidate_xfers);
+  void save_substitution_profile() const;
   Graph *construct_graph();
   void subgraph_optimize(Graph *subgraph);
 
@@ -345,6 +385,16 @@ private:
 private:
   std::unordered_map<size_t, float> cached_optimized_graphs;
   std::vector<GraphXfer *> all_pcg_xfers;
+  // Rules from config.substitution_json_path, whose GraphXfers are built the
+  // first time an op type they apply to shows up
+  std::unique_ptr<sl::BinaryRuleCollection> rule_collection;
+  std::vector<int> rule_parallel_degrees;
+  mutable std::unordered_set<OperatorType> loaded_rule_op_types;
+  // One list per entry of rule_parallel_degrees
+  mutable std::vector<std::vector<GraphXfer *>> rule_xfers;
+  SubstitutionProfile substitution_profile;
+  // Names of the substitutions left out by config.substitution_prune_*
+  std::unordered_set<std::string> pruned_xfers;
   FFModel *model;
   FFConfig const &config;
   MemoryOptimConfig mem_config;
@@ -3,6 +3,8 @@
 
 #include "flexflow/ffconst.h"
 #include "tl/optional.hpp"
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <nlohmann/json.hpp>
 
@@ -181,6 +183,65 @@ void from_json(json const &j, RuleCollection &c);
 RuleCollection load_rule_collection(std::istream &s);
 RuleCollection load_rule_collection_from_path(std::string const &path);
 
+/**
+ * @brief Writes c in the binary rule format read by BinaryRuleCollection.
+ *
+ * @details The file is a sequence of 32-bit words: a header, an index that
+ * maps each root source op type (the type of srcOp[0]) to the ids of the
+ * rules rooted at it, a table of rule offsets, and the encoded rules. Rules
+ * keep their order from c.
+ */
+void save_rule_collection_binary(RuleCollection const &c, std::ostream &s);
+void save_rule_collection_binary_to_path(RuleCollection const &c,
+                                         std::string const &path);
+
+/**
+ * @brief Whether the file at path starts with the binary rule format magic
+ */
+bool is_binary_rule_file(std::string const &path);
+
+/**
+ * @brief A read-only view of a binary rule file that decodes rules on demand.
+ *
+ * @details Files are memory-mapped, so opening one only reads the header and
+ * the index; the pages holding a rule are touched when it is decoded.
+ * Malformed files throw std::runtime_error, either when opened or when the
+ * affected rule is decoded.
+ */
+class BinaryRuleCollection {
+public:
+  explicit BinaryRuleCollection(std::string const &path);
+  // Encodes c in memory, e.g. for rules loaded from JSON
+  explicit BinaryRuleCollection(RuleCollection const &c);
+  ~BinaryRuleCollection();
+  BinaryRuleCollection(BinaryRuleCollection const &) = delete;
+  BinaryRuleCollection &operator=(BinaryRuleCollection const &) = delete;
+
+  size_t num_rules() const;
+  std::vector<OperatorType> root_op_types() const;
+  // In increasing order
+  std::vector<int> rules_with_root(OperatorType op_type) const;
+  // The name of a rule without decoding it
+  std::string get_name(int rule_id) const;
+  // The op types of a rule's source and destination ops without decoding it
+  void get_op_types(int rule_id,
+                    std::vector<OperatorType> &src_op_types,
+                    std::vector<OperatorType> &dst_op_types) const;
+  Rule get_rule(int rule_id) const;
+  RuleCollection get_rule_collection() const;
+
+private:
+  void check_header();
+  size_t rule_offset(int rule_id) const;
+
+private:
+  uint32_t const *words;
+  size_t num_words;
+  std::vector<uint32_t> buffer;
+  void *mapped;
+  size_t mapped_size;
+};
+
 } // namespace substitution_loader
 } // namespace FlexFlow
 
@@ -0,0 +1,69 @@
+#ifndef _FLEXFLOW_SUBSTITUTION_PROFILE_H_
+#define _FLEXFLOW_SUBSTITUTION_PROFILE_H_
+
+#include "tl/optional.hpp"
+#include <cstddef>
+#include <map>
+#include <string>
+#include <unordered_set>
+
+namespace FlexFlow::PCG {
+
+/**
+ * @brief What one substitution contributed to the graph searches it was
+ * tried in.
+ */
+struct XferProfile {
+  // Candidate graphs the substitution was run on
+  size_t num_runs = 0;
+  // Matches found, including those whose new graph was rejected
+  size_t num_matches = 0;
+  // New graphs added to the search's candidates
+  size_t num_accepted = 0;
+  // Candidates it created that lowered the best cost once explored
+  size_t num_improvements = 0;
+  // Seconds spent matching and applying the substitution
+  double run_time = 0.0;
+
+  /**
+   * @brief Improvements to the best cost per second of run time
+   */
+  double utility() const;
+  void merge(XferProfile const &other);
+};
+
+/**
+ * @brief Profiles of substitutions keyed by name, saved as JSON so that later
+ * searches of similar models can skip substitutions that never paid off.
+ */
+class SubstitutionProfile {
+public:
+  XferProfile &at(std::string const &name);
+  XferProfile const *find(std::string const &name) const;
+  size_t size() const;
+
+  /**
+   * @brief Adds the profiles saved at path to this one. A missing file is
+   * treated as empty, so the first search can create it.
+   */
+  void load(std::string const &path);
+  void save(std::string const &path) const;
+
+  /**
+   * @brief The names of the substitutions to skip: those outside the top_k
+   * by utility and those with a utility below min_utility.
+   *
+   * @details Substitutions without a profile are never pruned, so rules
+   * added since the profile was written still get profiled.
+   */
+  std::unordered_set<std::string>
+      select_pruned(tl::optional<int> top_k,
+                    tl::optional<double> min_utility) const;
+
+private:
+  std::map<std::string, XferProfile> profiles;
+};
+
+} // namespace FlexFlow::PCG
+
+#endif // _FLEXFLOW_SUBSTITUTION_PROFILE_H_
@@ -0,0 +1,185 @@
+#ifndef _FLEXFLOW_CPU_HELPER_H_
+#define _FLEXFLOW_CPU_HELPER_H_
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef FF_USE_AVX2
+#include <immintrin.h>
+#endif
+
+namespace FlexFlow {
+
+// A process-wide pool of worker threads used by the CPU (LOC_PROC) task
+// variants to split a kernel across cores. The number of threads defaults to
+// std::thread::hardware_concurrency() and can be overridden with the
+// FF_CPU_NUM_THREADS environment variable.
+class CPUThreadPool {
+public:
+  static CPUThreadPool &get_instance();
+  int get_num_threads() const;
+  // Invoke fn(lo, hi) over [begin, end) in chunks of at least `grain`
+  // iterations. Calls issued while the pool is busy (e.g. by another Legion
+  // CPU processor or from inside a worker) run inline on the calling thread.
+  void parallel_for(int64_t begin,
+                    int64_t end,
+                    int64_t grain,
+                    std::function<void(int64_t, int64_t)> const &fn);
+  ~CPUThreadPool();
+
+private:
+  struct Job {
+    std::function<void(int64_t, int64_t)> const *fn;
+    int64_t begin, end, chunk_size, num_chunks;
+    std::atomic<int64_t> next_chunk, pending_chunks;
+    int active_workers;
+  };
+  CPUThreadPool(int num_threads);
+  void worker_loop();
+  static void run_chunks(Job *job);
+
+private:
+  std::vector<std::thread> workers;
+  std::mutex job_mutex, state_mutex;
+  std::condition_variable start_cv, done_cv;
+  Job *current_job;
+  uint64_t generation;
+  bool stop;
+};
+
+template <typename F>
+inline void cpu_parallel_for(int64_t begin, int64_t end, int64_t grain, F fn) {
+  std::function<void(int64_t, int64_t)> func(fn);
+  CPUThreadPool::get_instance().parallel_for(begin, end, grain, func);
+}
+
+inline float cpu_vec_dot(float const *a, float const *b, int64_t n) {
+  int64_t i = 0;
+  float sum = 0.0f;
+#ifdef FF_USE_AVX2
+  __m256 vsum = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    vsum = _mm256_add_ps(
+        vsum, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+  }
+  float buf[8];
+  _mm256_storeu_ps(buf, vsum);
+  for (int k = 0; k < 8; k++) {
+    sum += buf[k];
+  }
+#endif
+  for (; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+// y[i] += alpha * x[i]
+inline void cpu_vec_axpy(float alpha, float const *x, float *y, int64_t n) {
+  int64_t i = 0;
+#ifdef FF_USE_AVX2
+  __m256 valpha = _mm256_set1_ps(alpha);
+  for (; i + 8 <= n; i += 8) {
+    __m256 vx = _mm256_mul_ps(valpha, _mm256_loadu_ps(x + i));
+    _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), vx));
+  }
+#endif
+  for (; i < n; i++) {
+    y[i] += alpha * x[i];
+  }
+}
+
+// x[i] *= alpha
+inline void cpu_vec_scale(float alpha, float *x, int64_t n) {
+  int64_t i = 0;
+#ifdef FF_USE_AVX2
+  __m256 valpha = _mm256_set1_ps(alpha);
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(x + i, _mm256_mul_ps(valpha, _mm256_loadu_ps(x + i)));
+  }
+#endif
+  for (; i < n; i++) {
+    x[i] *= alpha;
+  }
+}
+
+inline float cpu_vec_sum(float const *x, int64_t n) {
+  int64_t i = 0;
+  float sum = 0.0f;
+#ifdef FF_USE_AVX2
+  __m256 vsum = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    vsum = _mm256_add_ps(vsum, _mm256_loadu_ps(x + i));
+  }
+  float buf[8];
+  _mm256_storeu_ps(buf, vsum);
+  for (int k = 0; k < 8; k++) {
+    sum += buf[k];
+  }
+#endif
+  for (; i < n; i++) {
+    sum += x[i];
+  }
+  return sum;
+}
+
+// Computes sum(x) and sum(x * x) in a single pass over x
+inline void
+    cpu_vec_moments(float const *x, int64_t n, float *sum, float *sq_sum) {
+  int64_t i = 0;
+  float s1 = 0.0f, s2 = 0.0f;
+#ifdef FF_USE_AVX2
+  __m256 vs1 = _mm256_setzero_ps();
+  __m256 vs2 = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    __m256 vx = _mm256_loadu_ps(x + i);
+    vs1 = _mm256_add_ps(vs1, vx);
+    vs2 = _mm256_add_ps(vs2, _mm256_mul_ps(vx, vx));
+  }
+  float buf1[8], buf2[8];
+  _mm256_storeu_ps(buf1, vs1);
+  _mm256_storeu_ps(buf2, vs2);
+  for (int k = 0; k < 8; k++) {
+    s1 += buf1[k];
+    s2 += buf2[k];
+  }
+#endif
+  for (; i < n; i++) {
+    s1 += x[i];
+    s2 += x[i] * x[i];
+  }
+  *sum = s1;
+  *sq_sum = s2;
+}
+
+// Mixture-of-experts routing shared by the GroupBy and Aggregate CPU
+// kernels: visits the num_slots (sample, choice) expert assignments in sample
+// order and hands each one the next free row of its expert's buffer, or -1
+// once that expert already holds `capacity` rows. counts[e] receives the
+// number of times expert e was chosen, including dropped assignments.
+inline void cpu_assign_expert_rows(int const *exp_assign,
+                                   int64_t num_slots,
+                                   int n,
+                                   int capacity,
+                                   int *slot_rows,
+                                   int *counts) {
+  for (int e = 0; e < n; e++) {
+    counts[e] = 0;
+  }
+  for (int64_t i = 0; i < num_slots; i++) {
+    int expert = exp_assign[i];
+    assert(expert >= 0 && expert < n);
+    slot_rows[i] = counts[expert] < capacity ? counts[expert] : -1;
+    counts[expert]++;
+  }
+}
+
+} // namespace FlexFlow
+
+#endif // _FLEXFLOW_CPU_HELPER_H_
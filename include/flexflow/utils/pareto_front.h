@@ -0,0 +1,54 @@
+#ifndef _FLEXFLOW_UTILS_PARETO_FRONT_H
+#define _FLEXFLOW_UTILS_PARETO_FRONT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace FlexFlow {
+
+/**
+ * @brief Removes every point dominated by another point, i.e. one that is no
+ * better in either objective and worse in at least one, and sorts the rest by
+ * increasing first objective (and so decreasing second objective). Of points
+ * with equal objectives only one is kept.
+ *
+ * @details If more than max_points points remain, the front is thinned to
+ * max_points evenly spaced points, always keeping both ends, so that cross
+ * products of fronts stay small.
+ *
+ * @param first, second functions returning the two objectives of a point,
+ * both of which are minimized
+ */
+template <typename T, typename First, typename Second>
+void prune_pareto_front(std::vector<T> &points,
+                        First first,
+                        Second second,
+                        size_t max_points) {
+  std::sort(points.begin(), points.end(), [&](T const &a, T const &b) {
+    if (first(a) != first(b)) {
+      return first(a) < first(b);
+    }
+    return second(a) < second(b);
+  });
+  std::vector<T> front;
+  for (T &point : points) {
+    // every point in front is at least as good in the first objective
+    if (front.empty() || second(point) < second(front.back())) {
+      front.push_back(std::move(point));
+    }
+  }
+  if (max_points >= 2 && front.size() > max_points) {
+    std::vector<T> thinned;
+    for (size_t i = 0; i < max_points; i++) {
+      thinned.push_back(
+          std::move(front[i * (front.size() - 1) / (max_points - 1)]));
+    }
+    front.swap(thinned);
+  }
+  points.swap(front);
+}
+
+}; // namespace FlexFlow
+
+#endif // _FLEXFLOW_UTILS_PARETO_FRONT_H
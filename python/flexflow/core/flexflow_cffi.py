@@ -2151,6 +2151,35 @@ class FFModel(object):
     """
     ffc.flexflow_model_zero_gradients(self.handle)
 
+  def save_checkpoint(self, dir):
+    """Checkpoint the weights and optimizer state to a directory in the
+    background. Each shard is written by the node that owns it.
+
+    :param dir: the checkpoint directory.
+    :type dir: str
+
+    :returns:  bool -- False if the directory cannot be created.
+    """
+    return ffc.flexflow_model_save_checkpoint(self.handle, get_c_name(dir))
+
+  def wait_for_checkpoint(self):
+    """Wait for the last save_checkpoint and write its manifest.
+
+    :returns:  bool -- False if the checkpoint could not be written.
+    """
+    return ffc.flexflow_model_wait_for_checkpoint(self.handle)
+
+  def load_checkpoint(self, dir):
+    """Restore a checkpoint of this model, saved under any parallelization
+    strategy. Must be called after compile.
+
+    :param dir: the checkpoint directory.
+    :type dir: str
+
+    :returns:  bool -- False if the checkpoint does not match the model.
+    """
+    return ffc.flexflow_model_load_checkpoint(self.handle, get_c_name(dir))
+
   def set_optimizer(self, optimizer):
     if isinstance(optimizer, SGDOptimizer) == True:
       ffc.flexflow_model_set_sgd_optimizer(self.handle, optimizer.handle)
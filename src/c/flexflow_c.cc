@@ -202,6 +202,23 @@ void flexflow_model_zero_gradients(flexflow_model_t handle_) {
   handle->zero_gradients();
 }
 
+bool flexflow_model_save_checkpoint(flexflow_model_t handle_,
+                                    char const *dir) {
+  FFModel *handle = FFCObjectWrapper::unwrap(handle_);
+  return handle->save_checkpoint(dir);
+}
+
+bool flexflow_model_wait_for_checkpoint(flexflow_model_t handle_) {
+  FFModel *handle = FFCObjectWrapper::unwrap(handle_);
+  return handle->wait_for_checkpoint();
+}
+
+bool flexflow_model_load_checkpoint(flexflow_model_t handle_,
+                                    char const *dir) {
+  FFModel *handle = FFCObjectWrapper::unwrap(handle_);
+  return handle->load_checkpoint(dir);
+}
+
 flexflow_tensor_t flexflow_model_add_exp(flexflow_model_t handle_,
                                          const flexflow_tensor_t x_,
                                          char const *name) {
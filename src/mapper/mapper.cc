@@ -63,11 +63,13 @@ FFMapper::FFMapper(MapperRuntime *rt,
                    char const *_mapper_name,
                    // const std::string& strategyFile,
                    bool _enable_control_replication,
-                   bool _log_instance_creation)
+                   bool _log_instance_creation,
+                   bool _profile_ops)
     : NullMapper(rt, machine), local_processor(_local),
       node_id(_local.address_space()), mapper_name(_mapper_name),
       enable_control_replication(_enable_control_replication),
-      log_instance_creation(_log_instance_creation) {
+      log_instance_creation(_log_instance_creation),
+      profile_ops(_profile_ops) {
   std::vector<Machine::ProcessorMemoryAffinity> proc_mem_affinities;
   machine.get_proc_mem_affinity(proc_mem_affinities);
   Machine::ProcessorQuery proc_query(machine);
@@ -238,6 +240,16 @@ bool FFMapper::is_parameter_server_update_task(TaskID tid) {
   }
 }
 
+bool FFMapper::is_checkpoint_task(TaskID tid) {
+  switch (tid) {
+    case CHECKPOINT_SAVE_TASK_ID:
+    case CHECKPOINT_LOAD_TASK_ID:
+      return true;
+    default:
+      return false;
+  }
+}
+
 bool FFMapper::is_initializer_task(TaskID tid) {
   switch (tid) {
     case GLOROT_INIT_TASK_ID:
@@ -251,6 +263,76 @@ bool FFMapper::is_initializer_task(TaskID tid) {
   }
 }
 
+// Operator tasks get the OpMeta of their shard as the point argument, which
+// the OpProfiler uses to attribute their run times to operators
+bool FFMapper::get_profiled_pass(TaskID tid, ProfiledPass &pass) {
+  switch (tid) {
+    case AGGREGATE_FWD_TASK_ID:
+    case AGG_SPEC_FWD_TASK_ID:
+    case ATTENTION_FWD_TASK_ID:
+    case BATCHMATMUL_FWD_TASK_ID:
+    case BATCHNORM_FWD_TASK_ID:
+    case CACHE_FWD_TASK_ID:
+    case CAST_FWD_TASK_ID:
+    case CONCAT_FWD_TASK_ID:
+    case CONV2D_FWD_TASK_ID:
+    case DROPOUT_FWD_TASK_ID:
+    case ELEMENTBINARY_FWD_TASK_ID:
+    case ELEMENTUNARY_FWD_TASK_ID:
+    case EMBED_FWD_TASK_ID:
+    case FLAT_FWD_TASK_ID:
+    case FUSEDOP_FWD_TASK_ID:
+    case GATHER_FWD_TASK_ID:
+    case GROUP_BY_FWD_TASK_ID:
+    case LAYERNORM_FWD_TASK_ID:
+    case LINEAR_FWD_TASK_ID:
+    case POOL2D_FWD_TASK_ID:
+    case REDUCE_FWD_TASK_ID:
+    case RESHAPE_FWD_TASK_ID:
+    case REVERSE_FWD_TASK_ID:
+    case SOFTMAX_FWD_TASK_ID:
+    case SPLIT_FWD_TASK_ID:
+    case TOPK_FWD_TASK_ID:
+    case TRANSPOSE_FWD_TASK_ID:
+      pass = ProfiledPass::FORWARD;
+      return true;
+    case AGGREGATE_BWD_TASK_ID:
+    case AGG_SPEC_BWD_TASK_ID:
+    case ATTENTION_BWD_TASK_ID:
+    case BATCHMATMUL_BWD_TASK_ID:
+    case BATCHNORM_BWD_TASK_ID:
+    case CAST_BWD_TASK_ID:
+    case CONCAT_BWD_TASK_ID:
+    case CONV2D_BWD_TASK_ID:
+    case DROPOUT_BWD_TASK_ID:
+    case ELEMENTBINARY_BWD_TASK_ID:
+    case ELEMENTUNARY_BWD_TASK_ID:
+    case EMBED_BWD_TASK_ID:
+    case FLAT_BWD_TASK_ID:
+    case FUSEDOP_BWD_TASK_ID:
+    case GATHER_BWD_TASK_ID:
+    case GROUP_BY_BWD_TASK_ID:
+    case LAYERNORM_BWD_TASK_ID:
+    case LINEAR_BWD_TASK_ID:
+    case POOL2D_BWD_TASK_ID:
+    case REDUCE_BWD_TASK_ID:
+    case RESHAPE_BWD_TASK_ID:
+    case REVERSE_BWD_TASK_ID:
+    case SOFTMAX_BWD_TASK_ID:
+    case SPLIT_BWD_TASK_ID:
+    case TOPK_BWD_TASK_ID:
+    case TRANSPOSE_BWD_TASK_ID:
+      pass = ProfiledPass::BACKWARD;
+      return true;
+    case SGD_UPD_NCCL_TASK_ID:
+    case ADAM_UPD_NCCL_TASK_ID:
+      pass = ProfiledPass::UPDATE;
+      return true;
+    default:
+      return false;
+  }
+}
+
 char const *FFMapper::get_mapper_name(void) const {
   return mapper_name;
 }
@@ -272,7 +354,8 @@ void FFMapper::select_task_options(const MapperContext ctx,
     return;
   }
   if (task.task_id == GRAPH_OPTIMIZE_TASK_ID) {
-    output.initial_proc = all_gpus[0];
+    // The search runs on a CPU with the roofline cost model
+    output.initial_proc = all_gpus.empty() ? all_cpus[0] : all_gpus[0];
     return;
   }
   if (task.task_id == NCCL_GETUNIQUEID_TASK_ID) {
@@ -456,6 +539,29 @@ void FFMapper::slice_task(const MapperContext ctx,
     default:
       assert(false);
   }
+  if (is_checkpoint_task(task.task_id)) {
+    // Checkpoint tasks run on a CPU of the node that owns each shard, so that
+    // their file I/O does not block the device. Unless it is the node's only
+    // CPU, the processor of the task launching them is avoided, since its
+    // further launches would wait for the I/O
+    Processor parent_proc = task.parent_task->current_proc;
+    for (size_t i = 0; i < output.slices.size(); i++) {
+      std::vector<Processor> node_cpus, other_cpus;
+      for (Processor const &cpu : all_cpus) {
+        if (cpu.address_space() == output.slices[i].proc.address_space()) {
+          node_cpus.push_back(cpu);
+          if (cpu != parent_proc) {
+            other_cpus.push_back(cpu);
+          }
+        }
+      }
+      if (!other_cpus.empty()) {
+        node_cpus = other_cpus;
+      }
+      assert(node_cpus.size() > 0);
+      output.slices[i].proc = node_cpus[i % node_cpus.size()];
+    }
+  }
   // In control replication, each mapper should only receive task slices
   // that should be assigned to local proccessors
   // Violation of this assertion may result in severe runtime overheads
@@ -487,6 +593,13 @@ void FFMapper::map_task(const MapperContext ctx,
   // TODO: assign priorities
   output.task_priority = 0;
   output.postmap_task = false;
+  ProfiledPass pass;
+  if (profile_ops && get_profiled_pass(task.task_id, pass)) {
+    output.task_prof_requests
+        .add_measurement<ProfilingMeasurements::OperationTimeline>();
+    output.task_prof_requests
+        .add_measurement<ProfilingMeasurements::OperationProcessorUsage>();
+  }
   if (task.target_proc.address_space() != node_id) {
     assert(false);
     output.target_procs.push_back(task.target_proc);
@@ -803,7 +916,30 @@ void FFMapper::speculate(const MapperContext ctx,
 void FFMapper::report_profiling(const MapperContext ctx,
                                 Task const &task,
                                 TaskProfilingInfo const &input) {
-  assert(false);
+  // Only requested by map_task for operator tasks when profiling operators
+  assert(profile_ops);
+  ProfiledPass pass;
+  if (!get_profiled_pass(task.task_id, pass) ||
+      task.local_arglen != sizeof(OpMeta *)) {
+    return;
+  }
+  OpMeta const *meta = *((OpMeta const **)task.local_args);
+  ProfilingMeasurements::OperationTimeline *timeline =
+      input.profiling_responses
+          .get_measurement<ProfilingMeasurements::OperationTimeline>();
+  ProfilingMeasurements::OperationProcessorUsage *usage =
+      input.profiling_responses
+          .get_measurement<ProfilingMeasurements::OperationProcessorUsage>();
+  if (timeline != NULL && usage != NULL) {
+    // Timestamps are in nanoseconds
+    OpProfiler::get_instance().record(meta,
+                                      pass,
+                                      usage->proc.id,
+                                      timeline->start_time / 1e3,
+                                      timeline->complete_time / 1e3);
+  }
+  delete timeline;
+  delete usage;
 }
 
 void FFMapper::select_sharding_functor(const MapperContext ctx,
@@ -962,14 +1098,50 @@ void FFMapper::map_copy(const MapperContext ctx,
                         Copy const &copy,
                         MapCopyInput const &input,
                         MapCopyOutput &output) {
-  assert(false);
+  // Copies come from set_tensor/get_tensor, between a staging region attached
+  // to a host buffer and a tensor, and from save_checkpoint, from a tensor to
+  // a staging region. Reuse the valid instances on both sides, i.e. the
+  // attached instance and the tensor's instances on its devices, so that data
+  // moves directly between them
+  Processor parent_proc = copy.parent_task->current_proc;
+  for (size_t idx = 0; idx < copy.src_requirements.size(); idx++) {
+    output.src_instances[idx] = input.src_instances[idx];
+    default_create_copy_instance(ctx,
+                                 copy,
+                                 copy.src_requirements[idx],
+                                 parent_proc,
+                                 output.src_instances[idx]);
+  }
+  for (size_t idx = 0; idx < copy.dst_requirements.size(); idx++) {
+    output.dst_instances[idx] = input.dst_instances[idx];
+    Processor target_proc = parent_proc;
+    if (copy.dst_requirements[idx].tag == MAP_TO_ZC_MEMORY &&
+        !input.src_instances[idx].empty()) {
+      // Checkpoint shards are staged in the zero-copy memory of the node that
+      // holds them, where the checkpoint tasks writing them run
+      AddressSpace node =
+          input.src_instances[idx][0].get_location().address_space();
+      for (Processor const &cpu : all_cpus) {
+        if (cpu.address_space() == node) {
+          target_proc = cpu;
+          break;
+        }
+      }
+    }
+    default_create_copy_instance(ctx,
+                                 copy,
+                                 copy.dst_requirements[idx],
+                                 target_proc,
+                                 output.dst_instances[idx]);
+  }
 }
 
 void FFMapper::select_copy_sources(const MapperContext ctx,
                                    Copy const &copy,
                                    SelectCopySrcInput const &input,
                                    SelectCopySrcOutput &output) {
-  assert(false);
+  default_policy_select_sources(
+      ctx, input.target, input.source_instances, output.chosen_ranking);
 }
 
 void FFMapper::create_copy_temporary_instance(
@@ -996,8 +1168,14 @@ void FFMapper::select_sharding_functor(const MapperContext ctx,
                                        Copy const &copy,
                                        SelectShardingFunctorInput const &input,
                                        SelectShardingFunctorOutput &output) {
-  // Current all shardings uses data parallelism across machines
-  assert(false);
+  // Index copies carry the machine view hash of the tensor they copy, and
+  // are sharded like its tasks
+  MappingTagID hash = copy.tag;
+  if (machine_views.find(hash) == machine_views.end()) {
+    output.chosen_functor = FFConfig::DataParallelism_GPU;
+  } else {
+    output.chosen_functor = hash;
+  }
 }
 
 void FFMapper::map_close(const MapperContext ctx,
@@ -1202,6 +1380,12 @@ void FFMapper::memoize_operation(const MapperContext ctx,
     output.memoize = false;
     return;
   }
+  // Memoized mappings skip map_task, which requests the profiling of
+  // operator tasks
+  if (profile_ops) {
+    output.memoize = false;
+    return;
+  }
   // Memoize all other mapping decisions
   output.memoize = true;
 }
@@ -1305,6 +1489,61 @@ Memory FFMapper::default_select_target_memory(MapperContext ctx,
   }
 }
 
+void FFMapper::default_create_copy_instance(
+    MapperContext ctx,
+    Copy const &copy,
+    RegionRequirement const &req,
+    Processor target_proc,
+    std::vector<PhysicalInstance> &instances) {
+  if (!instances.empty()) {
+    runtime->acquire_and_filter_instances(ctx, instances);
+  }
+  std::set<FieldID> missing_fields = req.privilege_fields;
+  for (std::vector<PhysicalInstance>::const_iterator it = instances.begin();
+       it != instances.end();
+       it++) {
+    it->remove_space_fields(missing_fields);
+    if (missing_fields.empty()) {
+      break;
+    }
+  }
+  if (missing_fields.empty()) {
+    return;
+  }
+  // No valid instance holds these fields, so make one next to target_proc
+  Memory target_memory = default_select_target_memory(ctx, target_proc, req);
+  LayoutConstraintID our_layout_id =
+      default_select_layout_constraints(ctx, target_memory, req, true);
+  LayoutConstraintSet creation_constraints =
+      runtime->find_layout_constraints(ctx, our_layout_id);
+  creation_constraints.add_constraint(
+      FieldConstraint(missing_fields, false /*contig*/, false /*inorder*/));
+  PhysicalInstance result;
+  size_t footprint;
+  bool created;
+  if (!default_make_instance(ctx,
+                             target_memory,
+                             creation_constraints,
+                             result,
+                             true /*meets_constraints*/,
+                             req,
+                             created,
+                             &footprint)) {
+    log_ff_mapper.error(
+        "FlexFlow Mapper failed allocation of size %zd bytes"
+        " for region requirement of copy in task %s (UID %lld)"
+        " in memory " IDFMT "for processor " IDFMT ".",
+        footprint,
+        copy.parent_task->get_task_name(),
+        copy.parent_task->get_unique_id(),
+        target_memory.id,
+        target_proc.id);
+    assert(false);
+  } else {
+    instances.push_back(result);
+  }
+}
+
 bool FFMapper::default_make_instance(MapperContext ctx,
                                      Memory target_mem,
                                      LayoutConstraintSet const &constraints,
@@ -1460,6 +1699,7 @@ void FFMapper::update_mappers(Machine machine,
 
   bool enable_control_replication = true;
   bool log_instance_creation = false;
+  bool profile_ops = false;
   for (int i = 1; i < argc; i++) {
     // if ((!strcmp(argv[i], "--import")) || (!strcmp(argv[i],
     // "--import-strategy"))) {
@@ -1474,6 +1714,10 @@ void FFMapper::update_mappers(Machine machine,
       log_instance_creation = true;
       continue;
     }
+    if (!strcmp(argv[i], "--profile-ops")) {
+      profile_ops = true;
+      continue;
+    }
   }
 
   for (std::set<Processor>::const_iterator it = local_procs.begin();
@@ -1484,7 +1728,8 @@ void FFMapper::update_mappers(Machine machine,
                                     *it,
                                     "FlexFlow Mapper",
                                     enable_control_replication,
-                                    log_instance_creation);
+                                    log_instance_creation,
+                                    profile_ops);
     runtime->replace_default_mapper(mapper, *it);
   }
 }
@@ -15,8 +15,10 @@
 
 #include "flexflow/ops/aggregate.h"
 #include "flexflow/model.h"
+#include "flexflow/utils/cpu_helper.h"
 #include "flexflow/utils/hash_utils.h"
 #include "legion/legion_utilities.h"
+#include <algorithm>
 
 namespace FlexFlow {
 
@@ -466,6 +468,268 @@ void Aggregate::backward_task(Task const *task,
       out_dim);
 }
 
+AggregateMeta::AggregateMeta(FFHandler handle, int n, bool cpu_kernels)
+    : OpMeta(handle) {
+  assert(cpu_kernels);
+  dev_exp_preds = NULL;
+  dev_exp_grads = NULL;
+}
+
+OpMeta *Aggregate::init_task_cpu(Task const *task,
+                                 std::vector<PhysicalRegion> const &regions,
+                                 Context ctx,
+                                 Runtime *runtime) {
+  Aggregate *agg = (Aggregate *)task->args;
+  FFHandler handle = *((FFHandler *)task->local_args);
+  AggregateMeta *m = new AggregateMeta(handle, agg->n, true /*cpu_kernels*/);
+  m->profiling = agg->profiling;
+  return m;
+}
+
+/*
+  regions[0](I): gate_preds
+  regions[1](I): gate_assign
+  regions[2..n+1](I): exp_preds
+  regions[n+2](O): output
+*/
+void Aggregate::forward_task_cpu(Task const *task,
+                                 std::vector<PhysicalRegion> const &regions,
+                                 Context ctx,
+                                 Runtime *runtime) {
+  int n = ((Aggregate *)task->args)->n;
+  assert((int)regions.size() == n + 3);
+  assert((int)task->regions.size() == n + 3);
+  AggregateMeta const *m = *((AggregateMeta **)task->local_args);
+
+  AccessorRO<float, 3> const acc_gate_pred(regions[0], FID_DATA);
+  AccessorRO<int, 3> const acc_gate_assign(regions[1], FID_DATA);
+  AccessorWO<float, 3> const acc_output(regions[n + 2], FID_DATA);
+  Rect<3> rect_gate_pred = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Rect<3> rect_gate_assign = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  Rect<3> rect_output = runtime->get_index_space_domain(
+      ctx, task->regions[n + 2].region.get_index_space());
+  int batch_size = rect_gate_pred.hi[1] - rect_gate_pred.lo[1] + 1;
+  assert(batch_size == rect_gate_assign.hi[1] - rect_gate_assign.lo[1] + 1);
+  assert(batch_size == rect_output.hi[1] - rect_output.lo[1] + 1);
+  int k = rect_gate_assign.hi[0] - rect_gate_assign.lo[0] + 1;
+  assert(k == rect_gate_pred.hi[0] - rect_gate_pred.lo[0] + 1);
+  int out_dim = rect_output.hi[0] - rect_output.lo[0] + 1;
+
+  float const *exp_preds[n];
+  int rows = 0;
+  for (int i = 0; i < n; i++) {
+    Domain exp_domain = runtime->get_index_space_domain(
+        ctx, task->regions[i + 2].region.get_index_space());
+    exp_preds[i] = helperGetTensorPointerRO<float>(
+        regions[i + 2], task->regions[i + 2], FID_DATA, ctx, runtime);
+    if (i == 0) {
+      rows = exp_domain.hi()[1] - exp_domain.lo()[1] + 1;
+    }
+    assert(rows == exp_domain.hi()[1] - exp_domain.lo()[1] + 1);
+    assert(out_dim == exp_domain.hi()[0] - exp_domain.lo()[0] + 1);
+  }
+  double t_start = 0;
+  if (m->profiling) {
+    t_start = Realm::Clock::current_time_in_microseconds();
+  }
+  Aggregate::forward_kernel_cpu(exp_preds,
+                                acc_gate_assign.ptr(rect_gate_assign),
+                                acc_gate_pred.ptr(rect_gate_pred),
+                                acc_output.ptr(rect_output),
+                                n,
+                                k,
+                                rows,
+                                batch_size,
+                                out_dim);
+  if (m->profiling) {
+    double elapsed = Realm::Clock::current_time_in_microseconds() - t_start;
+    log_measure.debug("[Aggregate] CPU forward time = %.2fms\n",
+                      elapsed / 1000.0);
+  }
+}
+
+/*
+  regions[0](I): gate_preds
+  regions[1](I): gate_assign
+  regions[2](I): true_gate_assign
+  regions[3](I/O): full_gate_grads
+  regions[4..n+3](I): exp_preds
+  regions[n+4..2n+3](I/O): exp_grads
+  regions[2n+4](I): output_grad
+*/
+void Aggregate::backward_task_cpu(Task const *task,
+                                  std::vector<PhysicalRegion> const &regions,
+                                  Context ctx,
+                                  Runtime *runtime) {
+  int n = ((Aggregate *)task->args)->n;
+  float lambda_bal = ((Aggregate *)task->args)->lambda_bal;
+  assert((int)regions.size() == 2 * n + 5);
+  assert((int)task->regions.size() == 2 * n + 5);
+
+  AccessorRO<float, 3> const acc_gate_pred(regions[0], FID_DATA);
+  AccessorRO<int, 3> const acc_gate_assign(regions[1], FID_DATA);
+  AccessorRO<int, 3> const acc_true_gate_assign(regions[2], FID_DATA);
+  AccessorRW<float, 3> const acc_full_gate_grad(regions[3], FID_DATA);
+  AccessorRO<float, 3> const acc_output_grad(regions[2 * n + 4], FID_DATA);
+  Rect<3> rect_gate_pred = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Rect<3> rect_gate_assign = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  Rect<3> rect_true_gate_assign = runtime->get_index_space_domain(
+      ctx, task->regions[2].region.get_index_space());
+  Rect<3> rect_full_gate_grad = runtime->get_index_space_domain(
+      ctx, task->regions[3].region.get_index_space());
+  Rect<3> rect_out_grad = runtime->get_index_space_domain(
+      ctx, task->regions[2 * n + 4].region.get_index_space());
+  int batch_size = rect_gate_pred.hi[1] - rect_gate_pred.lo[1] + 1;
+  assert(batch_size == rect_gate_assign.hi[1] - rect_gate_assign.lo[1] + 1);
+  assert(rect_gate_assign == rect_true_gate_assign);
+  assert(batch_size == rect_out_grad.hi[1] - rect_out_grad.lo[1] + 1);
+  assert(batch_size ==
+         rect_full_gate_grad.hi[1] - rect_full_gate_grad.lo[1] + 1);
+  int k = rect_gate_assign.hi[0] - rect_gate_assign.lo[0] + 1;
+  assert(k == rect_gate_pred.hi[0] - rect_gate_pred.lo[0] + 1);
+  assert(n == rect_full_gate_grad.hi[0] - rect_full_gate_grad.lo[0] + 1);
+  int out_dim = rect_out_grad.hi[0] - rect_out_grad.lo[0] + 1;
+
+  float const *exp_preds[n];
+  float *exp_grads[n];
+  int rows = 0;
+  for (int i = 0; i < n; i++) {
+    Domain exp_domain = runtime->get_index_space_domain(
+        ctx, task->regions[i + 4].region.get_index_space());
+    Domain grad_domain = runtime->get_index_space_domain(
+        ctx, task->regions[n + i + 4].region.get_index_space());
+    exp_preds[i] = helperGetTensorPointerRO<float>(
+        regions[i + 4], task->regions[i + 4], FID_DATA, ctx, runtime);
+    exp_grads[i] = helperGetTensorPointerRW<float>(
+        regions[n + i + 4], task->regions[n + i + 4], FID_DATA, ctx, runtime);
+    if (i == 0) {
+      rows = exp_domain.hi()[1] - exp_domain.lo()[1] + 1;
+    }
+    assert(rows == exp_domain.hi()[1] - exp_domain.lo()[1] + 1);
+    assert(out_dim == exp_domain.hi()[0] - exp_domain.lo()[0] + 1);
+    assert(exp_domain == grad_domain);
+  }
+  Aggregate::backward_kernel_cpu(
+      exp_preds,
+      exp_grads,
+      acc_gate_assign.ptr(rect_gate_assign),
+      acc_true_gate_assign.ptr(rect_true_gate_assign),
+      acc_gate_pred.ptr(rect_gate_pred),
+      acc_full_gate_grad.ptr(rect_full_gate_grad),
+      acc_output_grad.ptr(rect_out_grad),
+      n,
+      k,
+      rows,
+      lambda_bal,
+      batch_size,
+      out_dim);
+}
+
+// Number of elements handled per chunk of the CPU thread pool
+static int64_t const AGGREGATE_CPU_GRAIN_ELEMENTS = 16384;
+
+/*static*/
+void Aggregate::forward_kernel_cpu(float const *const *exp_preds,
+                                   int const *gate_assign,
+                                   float const *gate_pred,
+                                   float *output,
+                                   int n,
+                                   int k,
+                                   int rows,
+                                   int batch_size,
+                                   int out_dim) {
+  std::vector<int> slot_rows(k * batch_size), counts(n);
+  cpu_assign_expert_rows(
+      gate_assign, k * batch_size, n, rows, slot_rows.data(), counts.data());
+  int64_t grain = std::max(
+      (int64_t)1, AGGREGATE_CPU_GRAIN_ELEMENTS / ((int64_t)k * out_dim));
+  cpu_parallel_for(0, batch_size, grain, [&](int64_t lo, int64_t hi) {
+    for (int64_t i = lo; i < hi; i++) {
+      float *out = output + i * out_dim;
+      std::fill(out, out + out_dim, 0.0f);
+      for (int j = 0; j < k; j++) {
+        int64_t slot = i * k + j;
+        if (slot_rows[slot] >= 0) {
+          cpu_vec_axpy(gate_pred[slot],
+                       exp_preds[gate_assign[slot]] +
+                           (int64_t)slot_rows[slot] * out_dim,
+                       out,
+                       out_dim);
+        }
+      }
+    }
+  });
+}
+
+/*static*/
+void Aggregate::backward_kernel_cpu(float const *const *exp_preds,
+                                    float *const *exp_grads,
+                                    int const *gate_assign,
+                                    int const *true_gate_assign,
+                                    float const *gate_pred,
+                                    float *full_gate_grad,
+                                    float const *output_grad,
+                                    int n,
+                                    int k,
+                                    int rows,
+                                    float lambda_bal,
+                                    int batch_size,
+                                    int out_dim) {
+  // As in the GPU kernel, expert rows follow the true assignment and
+  // expert_bal counts every assignment, dropped ones included
+  std::vector<int> slot_rows(k * batch_size), expert_bal(n);
+  cpu_assign_expert_rows(true_gate_assign,
+                         k * batch_size,
+                         n,
+                         rows,
+                         slot_rows.data(),
+                         expert_bal.data());
+  float bal_scale = lambda_bal * n / batch_size;
+  // Every expert row belongs to exactly one (sample, choice) slot and every
+  // gate gradient row to one sample, so samples are processed independently
+  int64_t grain = std::max(
+      (int64_t)1, AGGREGATE_CPU_GRAIN_ELEMENTS / ((int64_t)k * out_dim));
+  cpu_parallel_for(0, batch_size, grain, [&](int64_t lo, int64_t hi) {
+    for (int64_t i = lo; i < hi; i++) {
+      float const *out_grad = output_grad + i * out_dim;
+      float *gate_grad = full_gate_grad + i * n;
+      bool cache_corr = true;
+      for (int j = 0; j < k; j++) {
+        if (gate_assign[i * k + j] != true_gate_assign[i * k + j]) {
+          cache_corr = false;
+        }
+      }
+      for (int j = 0; j < k; j++) {
+        int64_t slot = i * k + j;
+        if (slot_rows[slot] < 0) {
+          continue;
+        }
+        int64_t offset = (int64_t)slot_rows[slot] * out_dim;
+        int expert = true_gate_assign[slot];
+        cpu_vec_axpy(
+            gate_pred[slot], out_grad, exp_grads[expert] + offset, out_dim);
+        if (cache_corr) {
+          gate_grad[gate_assign[slot]] +=
+              cpu_vec_dot(out_grad, exp_preds[expert] + offset, out_dim);
+        }
+      }
+      // Load-balancing term, then shift the row to zero mean
+      float sum = 0.0f;
+      for (int e = 0; e < n; e++) {
+        gate_grad[e] += bal_scale * expert_bal[e];
+        sum += gate_grad[e];
+      }
+      for (int e = 0; e < n; e++) {
+        gate_grad[e] -= sum / n;
+      }
+    }
+  });
+}
+
 void Aggregate::serialize(Legion::Serializer &sez) const {
   sez.serialize(this->n);
   sez.serialize(this->lambda_bal);
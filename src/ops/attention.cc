@@ -15,7 +15,10 @@
 
 #include "flexflow/ops/attention.h"
 #include "flexflow/model.h"
+#include "flexflow/utils/cpu_helper.h"
 #include "flexflow/utils/hash_utils.h"
+#include <cmath>
+#include <limits>
 
 namespace FlexFlow {
 
@@ -82,7 +85,8 @@ Tensor FFModel::multihead_attention(const Tensor query,
         numdims, dims, DT_FLOAT, li, 0, true /*create_grad*/);
   }
   {
-    // Compute weight size
+    // Compute weight size. The weights of all heads are laid out as
+    // MultiHeadAttentionWeightLayout describes, on CPUs and GPUs alike
     int qProjSize = kdim, kProjSize = kdim, vProjSize = kdim,
         oProjSize = embed_dim;
     int qSize = query->dims[0], kSize = key->dims[0], vSize = value->dims[0];
@@ -737,6 +741,585 @@ void MultiHeadAttention::backward_task(
                                               acc_output_grad.ptr);
 }
 
+MultiHeadAttentionCPUMeta::MultiHeadAttentionCPUMeta(
+    FFHandler handler,
+    MultiHeadAttention const *attn,
+    int _num_samples,
+    int _num_heads)
+    : MultiHeadAttentionCPUMeta(handler,
+                                _num_samples,
+                                _num_heads,
+                                attn->qSize,
+                                attn->kSize,
+                                attn->vSize,
+                                attn->qProjSize,
+                                attn->kProjSize,
+                                attn->vProjSize,
+                                attn->oProjSize,
+                                attn->qoSeqLength,
+                                attn->kvSeqLength) {
+  // Currently do not support adding bias to key/value projection
+  assert(!attn->add_bias_kv);
+}
+
+MultiHeadAttentionCPUMeta::MultiHeadAttentionCPUMeta(FFHandler handler,
+                                                     int _num_samples,
+                                                     int _num_heads,
+                                                     int _qSize,
+                                                     int _kSize,
+                                                     int _vSize,
+                                                     int _qProjSize,
+                                                     int _kProjSize,
+                                                     int _vProjSize,
+                                                     int _oProjSize,
+                                                     int _qoSeqLength,
+                                                     int _kvSeqLength)
+    : OpMeta(handler), num_samples(_num_samples), num_heads(_num_heads),
+      qSize(_qSize), kSize(_kSize), vSize(_vSize), qProjSize(_qProjSize),
+      kProjSize(_kProjSize), vProjSize(_vProjSize), oProjSize(_oProjSize),
+      qoSeqLength(_qoSeqLength), kvSeqLength(_kvSeqLength) {
+  assert(vProjSize > 0);
+  assert(qProjSize == kProjSize);
+  size_t num_seqs = (size_t)num_samples * num_heads;
+  qProj = (float *)malloc(sizeof(float) * num_seqs * qoSeqLength * qProjSize);
+  kProj = (float *)malloc(sizeof(float) * num_seqs * kvSeqLength * kProjSize);
+  vProj = (float *)malloc(sizeof(float) * num_seqs * kvSeqLength * vProjSize);
+  headOutput =
+      (float *)malloc(sizeof(float) * num_seqs * qoSeqLength * vProjSize);
+  logSumExp = (float *)malloc(sizeof(float) * num_seqs * qoSeqLength);
+  qProjGrad =
+      (float *)malloc(sizeof(float) * num_seqs * qoSeqLength * qProjSize);
+  kProjGrad =
+      (float *)malloc(sizeof(float) * num_seqs * kvSeqLength * kProjSize);
+  vProjGrad =
+      (float *)malloc(sizeof(float) * num_seqs * kvSeqLength * vProjSize);
+  headOutputGrad =
+      (float *)malloc(sizeof(float) * num_seqs * qoSeqLength * vProjSize);
+}
+
+MultiHeadAttentionCPUMeta::~MultiHeadAttentionCPUMeta(void) {
+  free(qProj);
+  free(kProj);
+  free(vProj);
+  free(headOutput);
+  free(logSumExp);
+  free(qProjGrad);
+  free(kProjGrad);
+  free(vProjGrad);
+  free(headOutputGrad);
+}
+
+/*
+  regions[0](I): query
+  regions[1](I): key
+  regions[2](I): value
+  regions[3](I): weight
+  regions[4](O): output
+*/
+OpMeta *MultiHeadAttention::init_task_cpu(
+    Task const *task,
+    std::vector<PhysicalRegion> const &regions,
+    Context ctx,
+    Runtime *runtime) {
+  MultiHeadAttention const *attn = (MultiHeadAttention *)task->args;
+  FFHandler handle = *((FFHandler const *)task->local_args);
+  TensorAccessorR<float, 4> acc_query(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 4> acc_key(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 3> acc_weight(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  int num_samples = acc_query.rect.hi[2] - acc_query.rect.lo[2] + 1;
+  assert(attn->qoSeqLength == acc_query.rect.hi[1] - acc_query.rect.lo[1] + 1);
+  assert(attn->kvSeqLength == acc_key.rect.hi[1] - acc_key.rect.lo[1] + 1);
+  int num_heads = acc_weight.rect.hi[1] - acc_weight.rect.lo[1] + 1;
+  MultiHeadAttentionCPUMeta *m =
+      new MultiHeadAttentionCPUMeta(handle, attn, num_samples, num_heads);
+  m->profiling = attn->profiling;
+  assert(acc_weight.rect.volume() ==
+         MultiHeadAttentionWeightLayout(num_heads,
+                                        attn->qSize,
+                                        attn->kSize,
+                                        attn->vSize,
+                                        attn->qProjSize,
+                                        attn->kProjSize,
+                                        attn->vProjSize,
+                                        attn->oProjSize)
+             .num_params);
+  return m;
+}
+
+/*
+  regions[0](I): query
+  regions[1](I): key
+  regions[2](I): value
+  regions[3](I): weight
+  regions[4](O): output
+*/
+void MultiHeadAttention::forward_task_cpu(
+    Task const *task,
+    std::vector<PhysicalRegion> const &regions,
+    Context ctx,
+    Runtime *runtime) {
+  assert(regions.size() == 5);
+  assert(task->regions.size() == regions.size());
+  MultiHeadAttentionCPUMeta const *m =
+      *((MultiHeadAttentionCPUMeta **)task->local_args);
+  TensorAccessorR<float, 4> acc_query(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 4> acc_key(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 4> acc_value(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 3> acc_weight(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 4> acc_output(regions[4],
+                                       task->regions[4],
+                                       FID_DATA,
+                                       ctx,
+                                       runtime,
+                                       false /*readOutput*/);
+  double t_start = 0;
+  if (m->profiling) {
+    t_start = Realm::Clock::current_time_in_microseconds();
+  }
+  MultiHeadAttention::forward_kernel_cpu(m,
+                                         acc_query.ptr,
+                                         acc_key.ptr,
+                                         acc_value.ptr,
+                                         acc_weight.ptr,
+                                         acc_output.ptr);
+  if (m->profiling) {
+    double elapsed = Realm::Clock::current_time_in_microseconds() - t_start;
+    printf("MultiHeadAttention CPU forward time = %.2fms\n", elapsed / 1000.0);
+  }
+}
+
+/*
+  regions[0](I): query
+  regions[1](I): key
+  regions[2](I): value
+  regions[3](I): weight
+  regions[4](I): output_grad
+  regions[5](I/O): weight_grad
+  regions[6](I/O): query_grad
+  regions[7](I/O) (optional): key_grad
+  regions[8](I/O) (optional): value_grad
+*/
+void MultiHeadAttention::backward_task_cpu(
+    Task const *task,
+    std::vector<PhysicalRegion> const &regions,
+    Context ctx,
+    Runtime *runtime) {
+  assert(regions.size() >= 7);
+  assert(task->regions.size() == regions.size());
+  MultiHeadAttentionCPUMeta const *m =
+      *((MultiHeadAttentionCPUMeta **)task->local_args);
+  TensorAccessorR<float, 4> acc_query(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 4> acc_key(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 4> acc_value(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 3> acc_weight(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  TensorAccessorR<float, 4> acc_output_grad(
+      regions[4], task->regions[4], FID_DATA, ctx, runtime);
+  TensorAccessorW<float, 3> acc_weight_grad(regions[5],
+                                            task->regions[5],
+                                            FID_DATA,
+                                            ctx,
+                                            runtime,
+                                            true /*readOutput*/);
+  TensorAccessorW<float, 4> acc_query_grad(regions[6],
+                                           task->regions[6],
+                                           FID_DATA,
+                                           ctx,
+                                           runtime,
+                                           true /*readOutput*/);
+  float *key_grad_ptr, *value_grad_ptr;
+  assert(acc_query_grad.rect == acc_query.rect);
+  assert(acc_weight_grad.rect.volume() == acc_weight.rect.volume());
+  if (regions.size() == 7) {
+    // assert query == key and query == value
+    assert(regions[0].get_logical_region() == regions[1].get_logical_region());
+    assert(regions[0].get_logical_region() == regions[2].get_logical_region());
+    key_grad_ptr = acc_query_grad.ptr;
+    value_grad_ptr = acc_query_grad.ptr;
+  } else if (regions.size() == 8) {
+    // assert query == key
+    assert(regions[0].get_logical_region() == regions[1].get_logical_region());
+    TensorAccessorW<float, 4> acc_value_grad(regions[7],
+                                             task->regions[7],
+                                             FID_DATA,
+                                             ctx,
+                                             runtime,
+                                             true /*readOutput*/);
+    assert(acc_value_grad.rect == acc_value.rect);
+    key_grad_ptr = acc_query_grad.ptr;
+    value_grad_ptr = acc_value_grad.ptr;
+  } else {
+    assert(regions.size() == 9);
+    TensorAccessorW<float, 4> acc_key_grad(regions[7],
+                                           task->regions[7],
+                                           FID_DATA,
+                                           ctx,
+                                           runtime,
+                                           true /*readOutput*/);
+    TensorAccessorW<float, 4> acc_value_grad(regions[8],
+                                             task->regions[8],
+                                             FID_DATA,
+                                             ctx,
+                                             runtime,
+                                             true /*readOutput*/);
+    assert(acc_key.rect == acc_key_grad.rect);
+    assert(acc_value.rect == acc_value_grad.rect);
+    value_grad_ptr = acc_value_grad.ptr;
+    key_grad_ptr = acc_key_grad.ptr;
+  }
+  double t_start = 0;
+  if (m->profiling) {
+    t_start = Realm::Clock::current_time_in_microseconds();
+  }
+  MultiHeadAttention::backward_kernel_cpu(m,
+                                          acc_query.ptr,
+                                          acc_query_grad.ptr,
+                                          acc_key.ptr,
+                                          key_grad_ptr,
+                                          acc_value.ptr,
+                                          value_grad_ptr,
+                                          acc_weight.ptr,
+                                          acc_weight_grad.ptr,
+                                          acc_output_grad.ptr);
+  if (m->profiling) {
+    double elapsed = Realm::Clock::current_time_in_microseconds() - t_start;
+    printf("MultiHeadAttention CPU backward time = %.2fms\n",
+           elapsed / 1000.0);
+  }
+}
+
+// Tile sizes for the CPU attention kernels. A query tile and a key tile
+// produce at most CPU_ATTN_TILE_Q x CPU_ATTN_TILE_K scores at a time, so the
+// full qoSeqLength x kvSeqLength score matrix is never materialized.
+static int const CPU_ATTN_TILE_Q = 32;
+static int const CPU_ATTN_TILE_K = 64;
+// Matches the smScaler passed to cudnnSetAttnDescriptor
+static float const CPU_ATTN_SM_SCALER = 1.0f;
+
+MultiHeadAttentionWeightLayout::MultiHeadAttentionWeightLayout(int num_heads,
+                                                               int qSize,
+                                                               int kSize,
+                                                               int vSize,
+                                                               int qProjSize,
+                                                               int kProjSize,
+                                                               int vProjSize,
+                                                               int oProjSize)
+    : wq_head((int64_t)qProjSize * qSize), wk_head((int64_t)kProjSize * kSize),
+      wv_head((int64_t)vProjSize * vSize),
+      wo_head((int64_t)oProjSize * vProjSize) {
+  wq_off = 0;
+  wk_off = wq_off + num_heads * wq_head;
+  wv_off = wk_off + num_heads * wk_head;
+  wo_off = wv_off + num_heads * wv_head;
+  num_params = wo_off + num_heads * wo_head;
+}
+
+namespace {
+
+MultiHeadAttentionWeightLayout
+    weight_layout_cpu(MultiHeadAttentionCPUMeta const *m) {
+  return MultiHeadAttentionWeightLayout(m->num_heads,
+                                        m->qSize,
+                                        m->kSize,
+                                        m->vSize,
+                                        m->qProjSize,
+                                        m->kProjSize,
+                                        m->vProjSize,
+                                        m->oProjSize);
+}
+
+// out[i] = w x[i] for a column-major [out_size x in_size] weight matrix
+void project_rows_cpu(float const *x,
+                      float const *w,
+                      float *out,
+                      int64_t num_rows,
+                      int64_t out_size,
+                      int64_t in_size) {
+  for (int64_t i = 0; i < num_rows; i++) {
+    float *out_row = out + i * out_size;
+    std::fill(out_row, out_row + out_size, 0.0f);
+    for (int64_t c = 0; c < in_size; c++) {
+      cpu_vec_axpy(x[i * in_size + c], w + c * out_size, out_row, out_size);
+    }
+  }
+}
+
+} // namespace
+
+/*static*/
+void MultiHeadAttention::forward_kernel_cpu(MultiHeadAttentionCPUMeta const *m,
+                                            float const *query_ptr,
+                                            float const *key_ptr,
+                                            float const *value_ptr,
+                                            float const *weight_ptr,
+                                            float *output_ptr) {
+  MultiHeadAttentionWeightLayout const layout = weight_layout_cpu(m);
+  int64_t const Lq = m->qoSeqLength, Lk = m->kvSeqLength;
+  int64_t const dk = m->kProjSize, dv = m->vProjSize;
+  int64_t const H = m->num_heads;
+  // Step 1: projections and tiled attention, parallel over batch x heads
+  cpu_parallel_for(
+      0, (int64_t)m->num_samples * H, 1, [&](int64_t lo, int64_t hi) {
+        std::vector<float> scores(CPU_ATTN_TILE_Q * CPU_ATTN_TILE_K);
+        std::vector<float> row_max(CPU_ATTN_TILE_Q), row_sum(CPU_ATTN_TILE_Q);
+        for (int64_t s = lo; s < hi; s++) {
+          int64_t b = s / H, h = s % H;
+          float *Q = m->qProj + s * Lq * dk;
+          float *K = m->kProj + s * Lk * dk;
+          float *V = m->vProj + s * Lk * dv;
+          float *O = m->headOutput + s * Lq * dv;
+          float *lse = m->logSumExp + s * Lq;
+          project_rows_cpu(query_ptr + b * Lq * m->qSize,
+                           weight_ptr + layout.wq_off + h * layout.wq_head,
+                           Q,
+                           Lq,
+                           dk,
+                           m->qSize);
+          project_rows_cpu(key_ptr + b * Lk * m->kSize,
+                           weight_ptr + layout.wk_off + h * layout.wk_head,
+                           K,
+                           Lk,
+                           dk,
+                           m->kSize);
+          project_rows_cpu(value_ptr + b * Lk * m->vSize,
+                           weight_ptr + layout.wv_off + h * layout.wv_head,
+                           V,
+                           Lk,
+                           dv,
+                           m->vSize);
+          for (int64_t q0 = 0; q0 < Lq; q0 += CPU_ATTN_TILE_Q) {
+            int64_t nq = std::min((int64_t)CPU_ATTN_TILE_Q, Lq - q0);
+            std::fill(O + q0 * dv, O + (q0 + nq) * dv, 0.0f);
+            std::fill(row_max.begin(),
+                      row_max.end(),
+                      -std::numeric_limits<float>::infinity());
+            std::fill(row_sum.begin(), row_sum.end(), 0.0f);
+            for (int64_t k0 = 0; k0 < Lk; k0 += CPU_ATTN_TILE_K) {
+              int64_t nk = std::min((int64_t)CPU_ATTN_TILE_K, Lk - k0);
+              for (int64_t i = 0; i < nq; i++) {
+                float const *qrow = Q + (q0 + i) * dk;
+                float *srow = scores.data() + i * CPU_ATTN_TILE_K;
+                float tile_max = row_max[i];
+                for (int64_t j = 0; j < nk; j++) {
+                  srow[j] = CPU_ATTN_SM_SCALER *
+                            cpu_vec_dot(qrow, K + (k0 + j) * dk, dk);
+                  tile_max = std::max(tile_max, srow[j]);
+                }
+                // Online softmax: rescale the running sum and accumulator
+                // whenever the row maximum grows
+                float correction = std::exp(row_max[i] - tile_max);
+                float *orow = O + (q0 + i) * dv;
+                if (correction != 1.0f) {
+                  row_sum[i] *= correction;
+                  cpu_vec_scale(correction, orow, dv);
+                }
+                row_max[i] = tile_max;
+                for (int64_t j = 0; j < nk; j++) {
+                  float p = std::exp(srow[j] - tile_max);
+                  row_sum[i] += p;
+                  cpu_vec_axpy(p, V + (k0 + j) * dv, orow, dv);
+                }
+              }
+            }
+            for (int64_t i = 0; i < nq; i++) {
+              cpu_vec_scale(1.0f / row_sum[i], O + (q0 + i) * dv, dv);
+              lse[q0 + i] = row_max[i] + std::log(row_sum[i]);
+            }
+          }
+        }
+      });
+  // Step 2: output projection summed over heads, parallel over output rows
+  int64_t const oSize = m->oProjSize;
+  cpu_parallel_for(
+      0, (int64_t)m->num_samples * Lq, 16, [&](int64_t lo, int64_t hi) {
+        for (int64_t r = lo; r < hi; r++) {
+          int64_t b = r / Lq, i = r % Lq;
+          float *out = output_ptr + r * oSize;
+          std::fill(out, out + oSize, 0.0f);
+          for (int64_t h = 0; h < H; h++) {
+            float const *wo = weight_ptr + layout.wo_off + h * layout.wo_head;
+            float const *o = m->headOutput + ((b * H + h) * Lq + i) * dv;
+            for (int64_t e = 0; e < dv; e++) {
+              cpu_vec_axpy(o[e], wo + e * oSize, out, oSize);
+            }
+          }
+        }
+      });
+}
+
+/*static*/
+void MultiHeadAttention::backward_kernel_cpu(
+    MultiHeadAttentionCPUMeta const *m,
+    float const *query_ptr,
+    float *query_grad_ptr,
+    float const *key_ptr,
+    float *key_grad_ptr,
+    float const *value_ptr,
+    float *value_grad_ptr,
+    float const *weight_ptr,
+    float *weight_grad_ptr,
+    float const *output_grad_ptr) {
+  MultiHeadAttentionWeightLayout const layout = weight_layout_cpu(m);
+  int64_t const Lq = m->qoSeqLength, Lk = m->kvSeqLength;
+  int64_t const dk = m->kProjSize, dv = m->vProjSize;
+  int64_t const oSize = m->oProjSize;
+  int64_t const H = m->num_heads, B = m->num_samples;
+  // Step 1: gradients w.r.t. the projected Q/K/V of every (sample, head),
+  // recomputing the attention probabilities tile by tile from the saved
+  // log-sum-exp values
+  cpu_parallel_for(0, B * H, 1, [&](int64_t lo, int64_t hi) {
+    std::vector<float> probs(CPU_ATTN_TILE_Q * CPU_ATTN_TILE_K);
+    std::vector<float> delta(CPU_ATTN_TILE_Q);
+    for (int64_t s = lo; s < hi; s++) {
+      int64_t b = s / H, h = s % H;
+      float const *wo = weight_ptr + layout.wo_off + h * layout.wo_head;
+      float const *Q = m->qProj + s * Lq * dk;
+      float const *K = m->kProj + s * Lk * dk;
+      float const *V = m->vProj + s * Lk * dv;
+      float const *O = m->headOutput + s * Lq * dv;
+      float const *lse = m->logSumExp + s * Lq;
+      float *dQ = m->qProjGrad + s * Lq * dk;
+      float *dK = m->kProjGrad + s * Lk * dk;
+      float *dV = m->vProjGrad + s * Lk * dv;
+      float *dO = m->headOutputGrad + s * Lq * dv;
+      std::fill(dQ, dQ + Lq * dk, 0.0f);
+      std::fill(dK, dK + Lk * dk, 0.0f);
+      std::fill(dV, dV + Lk * dv, 0.0f);
+      // dO_h = dOutput * Wo_h
+      for (int64_t i = 0; i < Lq; i++) {
+        float const *dy = output_grad_ptr + (b * Lq + i) * oSize;
+        float *do_row = dO + i * dv;
+        for (int64_t e = 0; e < dv; e++) {
+          do_row[e] = cpu_vec_dot(dy, wo + e * oSize, oSize);
+        }
+      }
+      for (int64_t q0 = 0; q0 < Lq; q0 += CPU_ATTN_TILE_Q) {
+        int64_t nq = std::min((int64_t)CPU_ATTN_TILE_Q, Lq - q0);
+        for (int64_t i = 0; i < nq; i++) {
+          delta[i] = cpu_vec_dot(dO + (q0 + i) * dv, O + (q0 + i) * dv, dv);
+        }
+        for (int64_t k0 = 0; k0 < Lk; k0 += CPU_ATTN_TILE_K) {
+          int64_t nk = std::min((int64_t)CPU_ATTN_TILE_K, Lk - k0);
+          for (int64_t i = 0; i < nq; i++) {
+            float const *qrow = Q + (q0 + i) * dk;
+            float const *do_row = dO + (q0 + i) * dv;
+            float *prow = probs.data() + i * CPU_ATTN_TILE_K;
+            for (int64_t j = 0; j < nk; j++) {
+              float score = CPU_ATTN_SM_SCALER *
+                            cpu_vec_dot(qrow, K + (k0 + j) * dk, dk);
+              float p = std::exp(score - lse[q0 + i]);
+              // dV += P^T dO
+              cpu_vec_axpy(p, do_row, dV + (k0 + j) * dv, dv);
+              // dS = P * (dO V^T - rowsum(dO * O))
+              float dp = cpu_vec_dot(do_row, V + (k0 + j) * dv, dv);
+              prow[j] = CPU_ATTN_SM_SCALER * p * (dp - delta[i]);
+            }
+            for (int64_t j = 0; j < nk; j++) {
+              cpu_vec_axpy(prow[j], K + (k0 + j) * dk, dQ + (q0 + i) * dk, dk);
+              cpu_vec_axpy(prow[j], qrow, dK + (k0 + j) * dk, dk);
+            }
+          }
+        }
+      }
+    }
+  });
+  // Step 2: input gradients, parallel over samples so that heads writing
+  // the same (possibly aliased) query/key/value rows never race
+  cpu_parallel_for(0, B, 1, [&](int64_t lo, int64_t hi) {
+    for (int64_t b = lo; b < hi; b++) {
+      for (int64_t h = 0; h < H; h++) {
+        int64_t s = b * H + h;
+        float const *wq = weight_ptr + layout.wq_off + h * layout.wq_head;
+        float const *wk = weight_ptr + layout.wk_off + h * layout.wk_head;
+        float const *wv = weight_ptr + layout.wv_off + h * layout.wv_head;
+        for (int64_t i = 0; i < Lq; i++) {
+          float const *dq = m->qProjGrad + (s * Lq + i) * dk;
+          float *dx = query_grad_ptr + (b * Lq + i) * m->qSize;
+          for (int64_t c = 0; c < m->qSize; c++) {
+            dx[c] += cpu_vec_dot(dq, wq + c * dk, dk);
+          }
+        }
+        for (int64_t j = 0; j < Lk; j++) {
+          float const *dkr = m->kProjGrad + (s * Lk + j) * dk;
+          float *dx = key_grad_ptr + (b * Lk + j) * m->kSize;
+          for (int64_t c = 0; c < m->kSize; c++) {
+            dx[c] += cpu_vec_dot(dkr, wk + c * dk, dk);
+          }
+          float const *dvr = m->vProjGrad + (s * Lk + j) * dv;
+          dx = value_grad_ptr + (b * Lk + j) * m->vSize;
+          for (int64_t c = 0; c < m->vSize; c++) {
+            dx[c] += cpu_vec_dot(dvr, wv + c * dv, dv);
+          }
+        }
+      }
+    }
+  });
+  // Step 3: weight gradients, parallel over the columns of every head's
+  // Wq, Wk, Wv and Wo matrices so that each column has exactly one writer
+  int64_t const qSize = m->qSize, kSize = m->kSize, vSize = m->vSize;
+  int64_t const cols_per_head = qSize + kSize + vSize + dv;
+  cpu_parallel_for(0, H * cols_per_head, 4, [&](int64_t lo, int64_t hi) {
+    for (int64_t r = lo; r < hi; r++) {
+      int64_t h = r / cols_per_head, c = r % cols_per_head;
+      for (int64_t b = 0; b < B; b++) {
+        int64_t s = b * H + h;
+        if (c < qSize) {
+          // dWq[:, c] += sum_i Xq[i][c] * dQ[i]
+          float *col = weight_grad_ptr + layout.wq_off + h * layout.wq_head +
+                       c * dk;
+          for (int64_t i = 0; i < Lq; i++) {
+            cpu_vec_axpy(query_ptr[(b * Lq + i) * qSize + c],
+                         m->qProjGrad + (s * Lq + i) * dk,
+                         col,
+                         dk);
+          }
+        } else if (c < qSize + kSize) {
+          int64_t cc = c - qSize;
+          float *col = weight_grad_ptr + layout.wk_off + h * layout.wk_head +
+                       cc * dk;
+          for (int64_t j = 0; j < Lk; j++) {
+            cpu_vec_axpy(key_ptr[(b * Lk + j) * kSize + cc],
+                         m->kProjGrad + (s * Lk + j) * dk,
+                         col,
+                         dk);
+          }
+        } else if (c < qSize + kSize + vSize) {
+          int64_t cc = c - qSize - kSize;
+          float *col = weight_grad_ptr + layout.wv_off + h * layout.wv_head +
+                       cc * dv;
+          for (int64_t j = 0; j < Lk; j++) {
+            cpu_vec_axpy(value_ptr[(b * Lk + j) * vSize + cc],
+                         m->vProjGrad + (s * Lk + j) * dv,
+                         col,
+                         dv);
+          }
+        } else {
+          // dWo[:, e] += sum_i O_h[i][e] * dOutput[i]
+          int64_t e = c - qSize - kSize - vSize;
+          float *col = weight_grad_ptr + layout.wo_off + h * layout.wo_head +
+                       e * oSize;
+          for (int64_t i = 0; i < Lq; i++) {
+            cpu_vec_axpy(m->headOutput[(s * Lq + i) * dv + e],
+                         output_grad_ptr + (b * Lq + i) * oSize,
+                         col,
+                         oSize);
+          }
+        }
+      }
+    }
+  });
+}
+
 bool MultiHeadAttention::get_int_parameter(PMParameter para, int *value) const {
   switch (para) {
     case PM_NUM_HEADS:
@@ -44,7 +44,10 @@ void ElementUnary::init_kernel(ElementUnaryMeta *m,
     default:
       assert(false);
   }
-  checkCUDNN(miopenSetActivationDescriptor(m->actiDesc, mode, 0.0, 0.0, 0.0));
+  // alpha of ELU; keep it in line with the fused element-wise kernels
+  double alpha = m->op_type == OP_ELU ? 1.0 : 0.0;
+  checkCUDNN(
+      miopenSetActivationDescriptor(m->actiDesc, mode, alpha, 0.0, 0.0));
   checkCUDNN(cudnnSetTensorDescriptorFromDomain(m->inputTensor, input_domain));
   // input_domain == output_domain
   checkCUDNN(
@@ -43,8 +43,11 @@ void ElementUnary::init_kernel(ElementUnaryMeta *m,
     default:
       assert(false);
   }
+  // coef is the alpha of ELU (and ignored by the other modes); keep it in
+  // line with the fused element-wise kernels
+  double coef = m->op_type == OP_ELU ? 1.0 : 0.0;
   checkCUDNN(cudnnSetActivationDescriptor(
-      m->actiDesc, mode, CUDNN_PROPAGATE_NAN, 0.0));
+      m->actiDesc, mode, CUDNN_PROPAGATE_NAN, coef));
   checkCUDNN(cudnnSetTensorDescriptorFromDomain(m->inputTensor, input_domain));
   // input_domain == output_domain
   checkCUDNN(
@@ -16,7 +16,9 @@
 #include "flexflow/ops/embedding.h"
 #include "flexflow/model.h"
 #include "flexflow/ops/kernels/embedding_kernels.h"
+#include "flexflow/utils/cpu_helper.h"
 #include "flexflow/utils/hash_utils.h"
+#include <algorithm>
 
 namespace FlexFlow {
 
@@ -283,7 +285,9 @@ Embedding::Embedding(FFModel &model,
          allocate_weights,
          1 /*outputs*/,
          _input),
-      num_entries(_num_entries), out_channels(_out_channels), aggr(_aggr) {
+      num_entries(_num_entries), out_channels(_out_channels), aggr(_aggr),
+      sparse_grad(model.config.sparse_embedding_grad),
+      sparse_grad_indices(nullptr), sparse_grad_values(nullptr) {
   layer_guid = _layer_guid;
   std::vector<ParallelDim *> weight_dim_sets;
 
@@ -306,13 +310,15 @@ Embedding::Embedding(FFModel &model,
   if (allocate_weights) {
     Initializer *weight_initializer = new GlorotUniform(std::rand() /*seed*/);
     // Initializer *weight_initializer = new ZeroInitializer(/*seed*/);
+    // Tables trained from a sparse gradient never allocate a dense one
+    bool create_grad = !sparse_grad;
 
     weights[0] =
         model.create_parallel_weight_legion_ordering(weight_ndim,
                                                      weight_dims,
                                                      dtype,
                                                      nullptr /*owner_op*/,
-                                                     true /*create_grad*/,
+                                                     create_grad,
                                                      weight_initializer,
                                                      CHOSEN_SYNC_TYPE);
   }
@@ -323,6 +329,40 @@ Embedding::Embedding(FFModel &model,
   assert(check_output_input_weight_parallel_dims(allocate_weights));
 }
 
+void Embedding::map_output_tensors(FFModel &ff) {
+  Op::map_output_tensors(ff);
+  if (!sparse_grad || ff.config.computationMode != COMP_MODE_TRAINING) {
+    return;
+  }
+  // Each shard can touch at most one row per lookup, so the sparse gradient
+  // is sized and partitioned like the input, with an extra out_channels dim
+  // for the values
+  ParallelTensor const &input = inputs[0];
+  ParallelDim index_dims[MAX_TENSOR_DIM], value_dims[MAX_TENSOR_DIM];
+  value_dims[0].size = out_channels;
+  value_dims[0].degree = 1;
+  value_dims[0].parallel_idx = -1;
+  for (int i = 0; i < input->num_dims; i++) {
+    index_dims[i] = input->dims[i];
+    value_dims[i + 1] = input->dims[i];
+  }
+  sparse_grad_indices = ff.create_parallel_tensor_legion_ordering(
+      input->num_dims, index_dims, DT_INT64, this, 0, false /*create_grad*/);
+  sparse_grad_values =
+      ff.create_parallel_tensor_legion_ordering(input->num_dims + 1,
+                                                value_dims,
+                                                DT_FLOAT,
+                                                this,
+                                                0,
+                                                false /*create_grad*/);
+  ff.map_tensor(sparse_grad_indices, this);
+  ff.map_tensor(sparse_grad_values, this);
+  sparse_grad_indices->machine_view = outputs[0]->machine_view;
+  sparse_grad_values->machine_view = outputs[0]->machine_view;
+  assert(sparse_grad_indices->parallel_is == outputs[0]->parallel_is);
+  assert(sparse_grad_values->parallel_is == outputs[0]->parallel_is);
+}
+
 void Embedding::init(FFModel const &ff) {
   assert(check_output_input_weight_same_parallel_is());
   parallel_is = outputs[0]->parallel_is;
@@ -378,6 +418,7 @@ OpMeta *Embedding::init_task(Task const *task,
   EmbeddingMeta *m = new EmbeddingMeta(handle, embed);
   m->profiling = embed->profiling;
   m->aggr = embed->aggr;
+  m->num_entries = embed->num_entries;
   return m;
 }
 
@@ -572,13 +613,33 @@ void Embedding::backward(FFModel const &ff) {
                                                     EXCLUSIVE,
                                                     outputs[0]->region_grad));
   launcher.add_field(1, FID_DATA);
-  // regions[2]: weight_grad
-  launcher.add_region_requirement(RegionRequirement(weights[0]->part_grad,
-                                                    0 /*projection*/,
-                                                    READ_WRITE,
-                                                    EXCLUSIVE,
-                                                    weights[0]->region_grad));
-  launcher.add_field(2, FID_DATA);
+  if (sparse_grad_indices == nullptr) {
+    // regions[2]: weight_grad
+    launcher.add_region_requirement(RegionRequirement(weights[0]->part_grad,
+                                                      0 /*projection*/,
+                                                      READ_WRITE,
+                                                      EXCLUSIVE,
+                                                      weights[0]->region_grad));
+    launcher.add_field(2, FID_DATA);
+  } else {
+    // The table has no dense gradient; the optimizer applies the sparse one
+    // regions[2]: sparse_grad_indices
+    launcher.add_region_requirement(
+        RegionRequirement(sparse_grad_indices->part,
+                          0 /*projection*/,
+                          WRITE_ONLY,
+                          EXCLUSIVE,
+                          sparse_grad_indices->region));
+    launcher.add_field(2, FID_DATA);
+    // regions[3]: sparse_grad_values
+    launcher.add_region_requirement(
+        RegionRequirement(sparse_grad_values->part,
+                          0 /*projection*/,
+                          WRITE_ONLY,
+                          EXCLUSIVE,
+                          sparse_grad_values->region));
+    launcher.add_field(3, FID_DATA);
+  }
   runtime->execute_index_space(ctx, launcher);
 }
 
@@ -587,8 +648,8 @@ void Embedding::backward_task(Task const *task,
                               Context ctx,
                               Runtime *runtime) {
   EmbeddingMeta const *m = *((EmbeddingMeta **)task->local_args);
-  assert(regions.size() == 3);
-  assert(task->regions.size() == 3);
+  assert(regions.size() == 3 || regions.size() == 4);
+  assert(task->regions.size() == regions.size());
   // Assert that weight and output must have the same data type
   // otherwise, a cast operator should be inserted
   assert(m->weight_type[0] == m->output_type[0]);
@@ -597,26 +658,18 @@ void Embedding::backward_task(Task const *task,
       m->input_type[0], regions[0], task->regions[0], FID_DATA, ctx, runtime);
   GenericTensorAccessorR output_grad = helperGetGenericTensorAccessorRO(
       m->output_type[0], regions[1], task->regions[1], FID_DATA, ctx, runtime);
-  GenericTensorAccessorW kernel_grad = helperGetGenericTensorAccessorRW(
-      m->weight_type[0], regions[2], task->regions[2], FID_DATA, ctx, runtime);
   if (m->aggr == AGGR_MODE_NONE) {
-    // assert(kernel_grad_domain.get_dim() == 2);
     assert(input.domain.get_dim() + 1 == output_grad.domain.get_dim());
     for (size_t i = 0; i < input.domain.get_dim(); i++) {
       assert(input.domain.hi()[i] == output_grad.domain.hi()[i + 1]);
       assert(input.domain.lo()[i] == output_grad.domain.lo()[i + 1]);
     }
-    assert(kernel_grad.domain.hi()[0] - kernel_grad.domain.lo()[0] ==
-           output_grad.domain.hi()[0] - output_grad.domain.lo()[0]);
   } else {
-    // assert(kernel_grad_domain.get_dim() == 2);
     assert(input.domain.get_dim() == output_grad.domain.get_dim());
     for (size_t i = 1; i < input.domain.get_dim(); i++) {
       assert(input.domain.hi()[i] == output_grad.domain.hi()[i]);
       assert(input.domain.lo()[i] == output_grad.domain.lo()[i]);
     }
-    assert(kernel_grad.domain.hi()[0] - kernel_grad.domain.lo()[0] ==
-           output_grad.domain.hi()[0] - output_grad.domain.lo()[0]);
   }
   int in_dim, out_dim, effective_batch_size;
   if (m->aggr == AGGR_MODE_NONE) {
@@ -630,6 +683,29 @@ void Embedding::backward_task(Task const *task,
     effective_batch_size = output_grad.domain.get_volume() / out_dim;
     assert(effective_batch_size * in_dim == input.domain.get_volume());
   }
+  if (regions.size() == 4) {
+    // The table is trained from a sparse gradient
+    GenericTensorAccessorW sparse_indices = helperGetGenericTensorAccessorWO(
+        DT_INT64, regions[2], task->regions[2], FID_DATA, ctx, runtime);
+    GenericTensorAccessorW sparse_values = helperGetGenericTensorAccessorWO(
+        DT_FLOAT, regions[3], task->regions[3], FID_DATA, ctx, runtime);
+    assert(sparse_indices.domain.get_volume() == input.domain.get_volume());
+    assert(sparse_values.domain.get_volume() ==
+           input.domain.get_volume() * out_dim);
+    sparse_backward_kernel_wrapper(m,
+                                   input,
+                                   output_grad,
+                                   sparse_indices,
+                                   sparse_values,
+                                   in_dim,
+                                   out_dim,
+                                   effective_batch_size);
+    return;
+  }
+  GenericTensorAccessorW kernel_grad = helperGetGenericTensorAccessorRW(
+      m->weight_type[0], regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  assert(kernel_grad.domain.hi()[0] - kernel_grad.domain.lo()[0] + 1 ==
+         out_dim);
   backward_kernel_wrapper(m,
                           input,
                           output_grad,
@@ -720,6 +796,7 @@ bool Embedding::measure_operator_cost(Simulator *sim,
   EmbeddingMeta *m = new EmbeddingMeta(sim->handler, this);
   assert(m->profiling == false);
   m->aggr = this->aggr;
+  m->num_entries = this->num_entries;
 
   sim->free_all();
   bool out_of_memory = false;
@@ -954,236 +1031,386 @@ void EmbeddingLookup_int64_t_float_float__avx2_fma(int const block_size,
         _mm256_storeu_ps(&op[120], _mm256_mul_ps(vop120, vlen_inv));
       }
     }
-    __m256 vwgt = _mm256_set1_ps(wgt);
-    float const *ip = &input[idx * block_size];
-    const int64_t next_T0 = (dataInd < index_size - prefdist_T0)
-                                ? (dataInd + prefdist_T0)
-                                : dataInd;
-    const int64_t idx_pref_T0 = indices[next_T0];
-    assert(idx >= 0 && idx_pref_T0 >= 0 && idx < data_size &&
-           idx_pref_T0 < data_size);
-    float const *ip_next_T0 = &input[idx_pref_T0 * block_size];
-    vop0 = _mm256_fmadd_ps(vwgt, _mm256_loadu_ps(ip + (0)), vop0);
-    _mm_prefetch((&ip_next_T0[0]), _MM_HINT_T0);
-    vop8 = _mm256_fmadd_ps(vwgt, _mm256_loadu_ps(ip + (8)), vop8);
-    _mm_prefetch((&ip_next_T0[8]), _MM_HINT_T0);
-    vop16 = _mm256_fmadd_ps(vwgt, _mm256_loadu_ps(ip + (16)), vop16);
-    _mm_prefetch((&ip_next_T0[16]), _MM_HINT_T0);
-    vop24 = _mm256_fmadd_ps(vwgt, _mm256_loadu_ps(ip + (24)), vop24);
-    _mm_prefetch((&ip_next_T0[24]), _MM_HINT_T0);
-  }
-  if (normalize_by_lengths == false) {
-    _mm256_storeu_ps(&op[0], vop0);
-    _mm256_storeu_ps(&op[8], vop8);
-    _mm256_storeu_ps(&op[16], vop16);
-    _mm256_storeu_ps(&op[24], vop24);
-  } else if (lengths[rangeIndex]) {
-    __m256 vlen_inv = _mm256_set1_ps(1.0f / lengths[rangeIndex]);
-    _mm256_storeu_ps(&op[0], _mm256_mul_ps(vop0, vlen_inv));
-    _mm256_storeu_ps(&op[8], _mm256_mul_ps(vop8, vlen_inv));
-    _mm256_storeu_ps(&op[16], _mm256_mul_ps(vop16, vlen_inv));
-    _mm256_storeu_ps(&op[24], _mm256_mul_ps(vop24, vlen_inv));
-  }
-}
-}
-else {
-  // generic code
-  int64_t dataInd = 0;
-  for (int64_t rangeIndex = 0; rangeIndex < output_size; ++rangeIndex) {
-    float *op = &out[rangeIndex * block_size];
-    int j = 0;
-    for (; j + 8 <= block_size; j += 8) {
-      _mm256_storeu_ps(op + j, _mm256_setzero_ps());
-    }
-    for (; j < block_size; j++) {
-      op[j] = 0.0f;
-    }
-    for (int64_t start = dataInd; dataInd < start + lengths[rangeIndex];
-         ++dataInd) {
-      const int64_t idx = indices[dataInd];
-      float wgt = 1.f;
-      if (weight) {
-        wgt = weight[dataInd];
-      }
-      __m256 vwgt = _mm256_set1_ps(wgt);
-      float const *ip = &input[idx * block_size];
-      const int64_t next_T0 = (dataInd < index_size - prefdist_T0)
-                                  ? (dataInd + prefdist_T0)
-                                  : dataInd;
-      const int64_t idx_pref_T0 = indices[next_T0];
-      assert(idx >= 0 && idx_pref_T0 >= 0 && idx < data_size &&
-             idx_pref_T0 < data_size);
-      float const *ip_next_T0 = &input[idx_pref_T0 * block_size];
-      j = 0;
+  } else {
+    // generic code
+    int64_t dataInd = 0;
+    for (int64_t rangeIndex = 0; rangeIndex < output_size; ++rangeIndex) {
+      float *op = &out[rangeIndex * block_size];
+      int j = 0;
       for (; j + 8 <= block_size; j += 8) {
-        _mm256_storeu_ps(&op[j],
-                         _mm256_fmadd_ps(vwgt,
-                                         _mm256_loadu_ps(&ip[j]),
-                                         _mm256_loadu_ps(&op[j])));
-        _mm_prefetch((&ip_next_T0[j]), _MM_HINT_T0);
+        _mm256_storeu_ps(op + j, _mm256_setzero_ps());
       }
       for (; j < block_size; j++) {
-        op[j] += wgt * ip[j];
+        op[j] = 0.0f;
       }
-    }
-    if (normalize_by_lengths && lengths[rangeIndex]) {
-      float len_inv = 1.0f / lengths[rangeIndex];
-      __m256 vlen_inv = _mm256_set1_ps(len_inv);
-      j = 0;
-      for (; j + 8 <= block_size; j += 8) {
-        _mm256_storeu_ps(&op[j],
-                         _mm256_mul_ps(_mm256_loadu_ps(&op[j]), vlen_inv));
+      for (int64_t start = dataInd; dataInd < start + lengths[rangeIndex];
+           ++dataInd) {
+        const int64_t idx = indices[dataInd];
+        float wgt = 1.f;
+        if (weight) {
+          wgt = weight[dataInd];
+        }
+        __m256 vwgt = _mm256_set1_ps(wgt);
+        float const *ip = &input[idx * block_size];
+        const int64_t next_T0 = (dataInd < index_size - prefdist_T0)
+                                    ? (dataInd + prefdist_T0)
+                                    : dataInd;
+        const int64_t idx_pref_T0 = indices[next_T0];
+        assert(idx >= 0 && idx_pref_T0 >= 0 && idx < data_size &&
+               idx_pref_T0 < data_size);
+        float const *ip_next_T0 = &input[idx_pref_T0 * block_size];
+        j = 0;
+        for (; j + 8 <= block_size; j += 8) {
+          _mm256_storeu_ps(&op[j],
+                           _mm256_fmadd_ps(vwgt,
+                                           _mm256_loadu_ps(&ip[j]),
+                                           _mm256_loadu_ps(&op[j])));
+          _mm_prefetch((&ip_next_T0[j]), _MM_HINT_T0);
+        }
+        for (; j < block_size; j++) {
+          op[j] += wgt * ip[j];
+        }
       }
-      for (; j < block_size; j++) {
-        op[j] = len_inv * op[j];
+      if (normalize_by_lengths && lengths[rangeIndex]) {
+        float len_inv = 1.0f / lengths[rangeIndex];
+        __m256 vlen_inv = _mm256_set1_ps(len_inv);
+        j = 0;
+        for (; j + 8 <= block_size; j += 8) {
+          _mm256_storeu_ps(&op[j],
+                           _mm256_mul_ps(_mm256_loadu_ps(&op[j]), vlen_inv));
+        }
+        for (; j < block_size; j++) {
+          op[j] = len_inv * op[j];
+        }
       }
     }
   }
-}
 #else
   assert(0);
 #endif
 }
 
-void embed_forward(int64_t const *input,
-                   int const *lengths,
-                   float *output,
-                   float const *embed,
-                   int block_size,
-                   int output_size,
-                   int index_size,
-                   int data_size) {
-  EmbeddingLookup_int64_t_float_float__avx2_fma(block_size,
-                                                output_size,
-                                                index_size,
-                                                data_size,
-                                                embed,
-                                                input,
-                                                lengths,
-                                                nullptr,
-                                                false,
-                                                output);
+namespace Kernels {
+namespace Embedding {
+
+void group_rows_cpu(int64_t const *indices,
+                    int64_t num_indices,
+                    int64_t num_entries,
+                    RowGroups &groups) {
+  // Range-partition the lookups by row so that sorting every bucket
+  // independently yields a globally sorted order
+  int64_t num_buckets = 1;
+  if (num_indices >= 4096) {
+    num_buckets = 4 * (int64_t)CPUThreadPool::get_instance().get_num_threads();
+  }
+  std::vector<int64_t> bucket_start(num_buckets + 1, 0);
+  for (int64_t i = 0; i < num_indices; i++) {
+    int64_t row = indices[i];
+    if (row < 0) {
+      continue;
+    }
+    assert(row < num_entries);
+    bucket_start[row * num_buckets / num_entries + 1]++;
+  }
+  for (int64_t b = 0; b < num_buckets; b++) {
+    bucket_start[b + 1] += bucket_start[b];
+  }
+  int64_t num_valid = bucket_start[num_buckets];
+  std::vector<std::pair<int64_t, int64_t>> entries(num_valid);
+  {
+    std::vector<int64_t> cursor(bucket_start.begin(), bucket_start.end() - 1);
+    for (int64_t i = 0; i < num_indices; i++) {
+      int64_t row = indices[i];
+      if (row >= 0) {
+        entries[cursor[row * num_buckets / num_entries]++] =
+            std::make_pair(row, i);
+      }
+    }
+  }
+  // Sort each bucket and count its distinct rows
+  std::vector<int64_t> unique_start(num_buckets + 1, 0);
+  cpu_parallel_for(0, num_buckets, 1, [&](int64_t lo, int64_t hi) {
+    for (int64_t b = lo; b < hi; b++) {
+      auto first = entries.begin() + bucket_start[b];
+      auto last = entries.begin() + bucket_start[b + 1];
+      std::sort(first, last);
+      int64_t num_unique = 0;
+      for (auto it = first; it != last; it++) {
+        if (it == first || it->first != (it - 1)->first) {
+          num_unique++;
+        }
+      }
+      unique_start[b + 1] = num_unique;
+    }
+  });
+  for (int64_t b = 0; b < num_buckets; b++) {
+    unique_start[b + 1] += unique_start[b];
+  }
+  int64_t num_unique = unique_start[num_buckets];
+  groups.rows.resize(num_unique);
+  groups.offsets.resize(num_unique + 1);
+  groups.positions.resize(num_valid);
+  cpu_parallel_for(0, num_buckets, 1, [&](int64_t lo, int64_t hi) {
+    for (int64_t b = lo; b < hi; b++) {
+      int64_t r = unique_start[b];
+      for (int64_t k = bucket_start[b]; k < bucket_start[b + 1]; k++) {
+        if (k == bucket_start[b] || entries[k].first != entries[k - 1].first) {
+          groups.rows[r] = entries[k].first;
+          groups.offsets[r] = k;
+          r++;
+        }
+        groups.positions[k] = entries[k].second;
+      }
+      assert(r == unique_start[b + 1]);
+    }
+  });
+  groups.offsets[num_unique] = num_valid;
+}
+
+void reduce_rows_cpu(RowGroups const &groups,
+                     float const *src,
+                     int lookups_per_row,
+                     float scale,
+                     int out_dim,
+                     float *reduced,
+                     float *table) {
+  int64_t num_rows = groups.rows.size();
+  int64_t grain = std::max((int64_t)1, (int64_t)4096 / out_dim);
+  cpu_parallel_for(0, num_rows, grain, [&](int64_t lo, int64_t hi) {
+    for (int64_t r = lo; r < hi; r++) {
+      float *dst = nullptr;
+      if (reduced != nullptr) {
+        dst = reduced + r * out_dim;
+        std::fill(dst, dst + out_dim, 0.0f);
+      } else if (table != nullptr) {
+        // Accumulate straight into the table row owned by this group
+        dst = table + groups.rows[r] * out_dim;
+      } else {
+        continue;
+      }
+      for (int64_t k = groups.offsets[r]; k < groups.offsets[r + 1]; k++) {
+        int64_t src_row = groups.positions[k] / lookups_per_row;
+        cpu_vec_axpy(scale, src + src_row * out_dim, dst, out_dim);
+      }
+      if (reduced != nullptr && table != nullptr) {
+        cpu_vec_axpy(1.0f, dst, table + groups.rows[r] * out_dim, out_dim);
+      }
+    }
+  });
+}
+
+void forward_kernel_cpu(int64_t const *input,
+                        float *output,
+                        float const *weight,
+                        int in_dim,
+                        int out_dim,
+                        int batch_size,
+                        AggrMode aggr,
+                        int64_t num_entries) {
+  int lookups_per_row = (aggr == AGGR_MODE_NONE) ? 1 : in_dim;
+  int64_t grain =
+      std::max((int64_t)1, (int64_t)16384 / (lookups_per_row * out_dim));
+  cpu_parallel_for(0, batch_size, grain, [&](int64_t lo, int64_t hi) {
+#ifdef FF_USE_AVX2
+    std::vector<int> lengths(hi - lo, lookups_per_row);
+    EmbeddingLookup_int64_t_float_float__avx2_fma(
+        out_dim,
+        hi - lo,
+        (hi - lo) * lookups_per_row,
+        num_entries,
+        weight,
+        input + lo * lookups_per_row,
+        lengths.data(),
+        nullptr,
+        aggr == AGGR_MODE_AVG /*normalize_by_lengths*/,
+        output + lo * out_dim);
+#else
+    for (int64_t b = lo; b < hi; b++) {
+      float *out = output + b * out_dim;
+      std::fill(out, out + out_dim, 0.0f);
+      for (int j = 0; j < lookups_per_row; j++) {
+        int64_t row = input[b * lookups_per_row + j];
+        assert(row >= 0 && row < num_entries);
+        cpu_vec_axpy(1.0f, weight + row * out_dim, out, out_dim);
+      }
+      if (aggr == AGGR_MODE_AVG) {
+        cpu_vec_scale(1.0f / lookups_per_row, out, out_dim);
+      }
+    }
+#endif
+  });
 }
 
-void embed_backward_generic(int64_t const *input,
-                            int const *lengths,
-                            float const *output,
-                            float *embed,
-                            int block_size,
-                            int output_size,
-                            int index_size,
-                            int data_size) {
-  // FIXME: Not functionaly correct.
-  for (int i = 0; i < output_size * block_size; i++) {
-    int idx = i / block_size;
-    int off = i % block_size;
-    int64_t wordIdx = input[idx];
-    // FIXME: Need to be atomic depending on the strategy
-    embed[wordIdx * block_size + off] += output[i];
-    ;
+int64_t backward_kernel_cpu(int64_t const *input,
+                            float const *output_grad,
+                            float *weight_grad,
+                            int64_t *sparse_indices,
+                            float *sparse_values,
+                            int in_dim,
+                            int out_dim,
+                            int batch_size,
+                            AggrMode aggr,
+                            int64_t num_entries) {
+  int lookups_per_row = (aggr == AGGR_MODE_NONE) ? 1 : in_dim;
+  int64_t num_lookups = (int64_t)lookups_per_row * batch_size;
+  float scale = (aggr == AGGR_MODE_AVG) ? 1.0f / in_dim : 1.0f;
+  RowGroups groups;
+  group_rows_cpu(input, num_lookups, num_entries, groups);
+  reduce_rows_cpu(groups,
+                  output_grad,
+                  lookups_per_row,
+                  scale,
+                  out_dim,
+                  sparse_values,
+                  weight_grad);
+  int64_t num_unique = groups.rows.size();
+  if (sparse_indices != nullptr) {
+    std::copy(groups.rows.begin(), groups.rows.end(), sparse_indices);
+    std::fill(sparse_indices + num_unique,
+              sparse_indices + num_lookups,
+              (int64_t)-1);
   }
+  return num_unique;
 }
 
-void embed_backward(int64_t const *input,
-                    int const *lengths,
-                    float const *output,
-                    float *embed,
-                    int block_size,
-                    int output_size,
-                    int index_size,
-                    int data_size) {
-  embed_backward_generic(input,
-                         lengths,
-                         output,
-                         embed,
-                         block_size,
-                         output_size,
-                         index_size,
-                         data_size);
+} // namespace Embedding
+} // namespace Kernels
+
+// Derives the kernel dimensions from the region shapes the same way the GPU
+// tasks do
+static void get_cpu_kernel_dims(AggrMode aggr,
+                                Domain const &input_domain,
+                                Domain const &output_domain,
+                                int &in_dim,
+                                int &out_dim,
+                                int &batch_size) {
+  out_dim = output_domain.hi()[0] - output_domain.lo()[0] + 1;
+  if (aggr == AGGR_MODE_NONE) {
+    in_dim = 1;
+    assert(input_domain.get_dim() + 1 == output_domain.get_dim());
+  } else {
+    in_dim = input_domain.hi()[0] - input_domain.lo()[0] + 1;
+    assert(input_domain.get_dim() == output_domain.get_dim());
+  }
+  batch_size = output_domain.get_volume() / out_dim;
+  assert((size_t)batch_size * in_dim == input_domain.get_volume());
 }
 
+/*
+  regions[0](I): input
+  regions[1](O): output
+  regions[2](I): kernel
+*/
 void Embedding::forward_task_cpu(Task const *task,
                                  std::vector<PhysicalRegion> const &regions,
                                  Context ctx,
                                  Runtime *runtime) {
   assert(regions.size() == 3);
   assert(task->regions.size() == 3);
-  // const Embedding* embed = (Embedding*) task->args;
-  AccessorRO<int64_t, 2> const acc_input(regions[0], FID_DATA);
-  AccessorWO<float, 2> const acc_output(regions[1], FID_DATA);
-  AccessorRO<float, 2> const acc_weight(regions[2], FID_DATA);
-  Rect<2> rect_input = runtime->get_index_space_domain(
+  EmbeddingMeta const *m = *((EmbeddingMeta **)task->local_args);
+  // The CPU kernels only support int64 indices and float tables
+  assert(m->input_type[0] == DT_INT64);
+  assert(m->output_type[0] == DT_FLOAT);
+  Domain input_domain = runtime->get_index_space_domain(
       ctx, task->regions[0].region.get_index_space());
-  Rect<2> rect_output = runtime->get_index_space_domain(
+  Domain output_domain = runtime->get_index_space_domain(
       ctx, task->regions[1].region.get_index_space());
-  Rect<2> rect_weight = runtime->get_index_space_domain(
+  Domain weight_domain = runtime->get_index_space_domain(
       ctx, task->regions[2].region.get_index_space());
-  coord_t batch_size = rect_input.hi[1] - rect_input.lo[1] + 1;
-  // Input and output have same batch size
-  assert(batch_size == rect_output.hi[1] - rect_output.lo[1] + 1);
-  coord_t out_dim = rect_output.hi[0] - rect_output.lo[0] + 1;
-  // Weight and output have same out dim
-  assert(out_dim == rect_weight.hi[1] - rect_weight.lo[1] + 1);
-  // const int64_t* input = acc_input.ptr(rect_input);
-  // float* output = acc_output.ptr(rect_output);
-  // const float* weight = acc_weight.ptr(rect_weight);
-  int block_size = out_dim;
-  int output_size = batch_size;
-  int data_size = 1000000; // FIXME
-  // For now we are assuming the length is always 1
-  int index_size = rect_input.hi[1] - rect_input.lo[1] + 1;
-  coord_t in_dim = rect_input.hi[0] - rect_input.lo[0] + 1;
-  assert(in_dim == 1);
-  std::vector<int> lengths(output_size, 1);
-  embed_forward(acc_input.ptr(rect_input),
-                lengths.data(),
-                acc_output.ptr(rect_output),
-                acc_weight.ptr(rect_weight),
-                block_size,
-                output_size,
-                index_size,
-                data_size);
+  int in_dim, out_dim, batch_size;
+  get_cpu_kernel_dims(
+      m->aggr, input_domain, output_domain, in_dim, out_dim, batch_size);
+  assert(weight_domain.get_volume() == (size_t)m->num_entries * out_dim);
+  int64_t const *input_ptr = helperGetTensorPointerRO<int64_t>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float *output_ptr = helperGetTensorPointerWO<float>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  float const *weight_ptr = helperGetTensorPointerRO<float>(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  double t_start = 0;
+  if (m->profiling) {
+    t_start = Realm::Clock::current_time_in_microseconds();
+  }
+  forward_kernel_cpu(input_ptr,
+                     output_ptr,
+                     weight_ptr,
+                     in_dim,
+                     out_dim,
+                     batch_size,
+                     m->aggr,
+                     m->num_entries);
+  if (m->profiling) {
+    double elapsed = Realm::Clock::current_time_in_microseconds() - t_start;
+    log_measure.debug("[Embedding] CPU forward time = %.2fms\n",
+                      elapsed / 1000.0);
+  }
 }
 
+/*
+  regions[0](I): input
+  regions[1](I): output_grad
+  regions[2](I/O): weight_grad
+  or, when the table is trained from a sparse gradient,
+  regions[2](O): sparse_grad_indices
+  regions[3](O): sparse_grad_values
+*/
 void Embedding::backward_task_cpu(Task const *task,
                                   std::vector<PhysicalRegion> const &regions,
                                   Context ctx,
                                   Runtime *runtime) {
-  assert(regions.size() == 3);
-  assert(task->regions.size() == 3);
-  // const Embedding* embed = (Embedding*) task->args;
-  AccessorRO<int64_t, 2> const acc_input(regions[0], FID_DATA);
-  AccessorRO<float, 2> const acc_output(regions[1], FID_DATA);
-  AccessorRW<float, 2> const acc_weight(regions[2], FID_DATA);
-  Rect<2> rect_input = runtime->get_index_space_domain(
+  assert(regions.size() == 3 || regions.size() == 4);
+  assert(task->regions.size() == regions.size());
+  EmbeddingMeta const *m = *((EmbeddingMeta **)task->local_args);
+  assert(m->input_type[0] == DT_INT64);
+  assert(m->output_type[0] == DT_FLOAT);
+  Domain input_domain = runtime->get_index_space_domain(
       ctx, task->regions[0].region.get_index_space());
-  Rect<2> rect_output = runtime->get_index_space_domain(
+  Domain output_domain = runtime->get_index_space_domain(
       ctx, task->regions[1].region.get_index_space());
-  Rect<2> rect_weight = runtime->get_index_space_domain(
-      ctx, task->regions[2].region.get_index_space());
-  coord_t batch_size = rect_input.hi[1] - rect_input.lo[1] + 1;
-  // Input and output have same batch size
-  assert(batch_size == rect_output.hi[1] - rect_output.lo[1] + 1);
-  // coord_t in_dim = rect_input.hi[0] - rect_input.lo[0] + 1;
-  coord_t out_dim = rect_output.hi[0] - rect_output.lo[0] + 1;
-  // Weight and output have same out dim
-  assert(out_dim == rect_weight.hi[1] - rect_weight.lo[1] + 1);
-  // const int64_t* input = acc_input.ptr(rect_input);
-  // const float* output = acc_output.ptr(rect_output);
-  // float* weight = acc_weight.ptr(rect_weight);
-  int block_size = out_dim;
-  int output_size = batch_size;
-  int index_size = rect_input.hi[1] - rect_input.lo[0] + 1;
-  int data_size = 1000000; // FIXME
-  std::vector<int> lengths(output_size, 1);
-  embed_backward(acc_input.ptr(rect_input),
-                 lengths.data(),
-                 acc_output.ptr(rect_output),
-                 acc_weight.ptr(rect_weight),
-                 block_size,
-                 output_size,
-                 index_size,
-                 data_size);
+  int in_dim, out_dim, batch_size;
+  get_cpu_kernel_dims(
+      m->aggr, input_domain, output_domain, in_dim, out_dim, batch_size);
+  int64_t const *input_ptr = helperGetTensorPointerRO<int64_t>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float const *output_grad_ptr = helperGetTensorPointerRO<float>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  float *weight_grad_ptr = nullptr;
+  int64_t *sparse_indices_ptr = nullptr;
+  float *sparse_values_ptr = nullptr;
+  if (regions.size() == 3) {
+    Domain weight_grad_domain = runtime->get_index_space_domain(
+        ctx, task->regions[2].region.get_index_space());
+    assert(weight_grad_domain.get_volume() ==
+           (size_t)m->num_entries * out_dim);
+    weight_grad_ptr = helperGetTensorPointerRW<float>(
+        regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  } else {
+    sparse_indices_ptr = helperGetTensorPointerWO<int64_t>(
+        regions[2], task->regions[2], FID_DATA, ctx, runtime);
+    sparse_values_ptr = helperGetTensorPointerWO<float>(
+        regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  }
+  double t_start = 0;
+  if (m->profiling) {
+    t_start = Realm::Clock::current_time_in_microseconds();
+  }
+  int64_t num_unique = backward_kernel_cpu(input_ptr,
+                                           output_grad_ptr,
+                                           weight_grad_ptr,
+                                           sparse_indices_ptr,
+                                           sparse_values_ptr,
+                                           in_dim,
+                                           out_dim,
+                                           batch_size,
+                                           m->aggr,
+                                           m->num_entries);
+  if (m->profiling) {
+    double elapsed = Realm::Clock::current_time_in_microseconds() - t_start;
+    log_measure.debug("[Embedding] CPU backward time = %.2fms "
+                      "(%lld distinct rows)\n",
+                      elapsed / 1000.0,
+                      (long long)num_unique);
+  }
 }
 
 EmbeddingMeta::EmbeddingMeta(FFHandler _handle, Op const *op)
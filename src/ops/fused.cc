@@ -25,6 +25,7 @@
 #include "flexflow/ops/pool_2d.h"
 #include "flexflow/ops/reshape.h"
 #include "flexflow/ops/transpose.h"
+#include <algorithm>
 
 namespace FlexFlow {
 // declare Legion names
@@ -112,6 +113,13 @@ FusedOp::FusedOp(FFModel &model, Op *op)
     op_output_source[i] = SOURCE_OUTPUT;
     op_output_idx[i] = i;
   }
+  numEwPrograms = 0;
+  for (int i = 0; i < MAX_NUM_FUSED_OPERATORS; i++) {
+    op_ew_program[i] = -1;
+  }
+  for (int i = 0; i < MAX_NUM_OUTPUTS; i++) {
+    output_elided[i] = false;
+  }
 }
 
 bool FusedOp::add_operator(FFModel &model, Op *op) {
@@ -271,15 +279,114 @@ bool FusedOp::add_operator(FFModel &model, Op *op) {
   return true;
 }
 
+namespace {
+
+// The shape of a tensor regardless of its data type
+ParallelTensorShape layout_of(ParallelTensor const &tensor) {
+  ParallelTensorShape shape = tensor->get_shape();
+  shape.data_type = DT_NONE;
+  return shape;
+}
+
+} // namespace
+
+/*
+  Element-wise programs refer to the fused inputs by their index i and to the
+  fused outputs by MAX_NUM_INPUTS + i.
+*/
+void FusedOp::compile_elementwise_programs(FFModel const &ff) {
+  using namespace Kernels::FusedElementwise;
+  std::vector<OpInfo> infos(numOperators);
+  std::vector<ParallelTensorShape> shapes;
+  int ioff = 0, ooff = 0;
+  for (int op = 0; op < numOperators; op++) {
+    Op const *sub = operators[op];
+    OpInfo &info = infos[op];
+    info.op_type = op_op_type[op];
+    ElementUnary const *unary = dynamic_cast<ElementUnary const *>(sub);
+    info.scalar = unary != nullptr ? unary->scalar : 0.0f;
+    ParallelTensorShape shape = layout_of(sub->outputs[0]);
+    info.same_shape = op_num_weights[op] == 0;
+    for (int i = 0; i < op_num_inputs[op]; i++) {
+      info.same_shape &= layout_of(sub->inputs[i]) == shape;
+      int idx = op_input_idx[ioff + i];
+      info.inputs.push_back(op_input_source[ioff + i] == SOURCE_INPUT
+                                ? idx
+                                : MAX_NUM_INPUTS + idx);
+      info.input_types.push_back(sub->inputs[i]->data_type);
+    }
+    for (int i = 0; i < op_num_outputs[op]; i++) {
+      info.same_shape &= layout_of(sub->outputs[i]) == shape;
+      info.outputs.push_back(MAX_NUM_INPUTS + op_output_idx[ooff + i]);
+      info.output_types.push_back(sub->outputs[i]->data_type);
+    }
+    info.shape = std::find(shapes.begin(), shapes.end(), shape) -
+                 shapes.begin();
+    if (info.shape == (int)shapes.size()) {
+      shapes.push_back(shape);
+    }
+    ioff += op_num_inputs[op];
+    ooff += op_num_outputs[op];
+  }
+
+  // When training, backward reads every output. Otherwise an output can stay
+  // in registers unless an operator outside this FusedOp reads it or nothing
+  // reads it at all (e.g. the final output of the model).
+  std::vector<bool> pinned(MAX_NUM_INPUTS + MAX_NUM_OUTPUTS,
+                           ff.config.computationMode == COMP_MODE_TRAINING);
+  for (int i = 0; i < numOutputs; i++) {
+    bool read_inside = false, read_outside = false;
+    for (OpInfo const &info : infos) {
+      read_inside |= std::find(info.inputs.begin(),
+                               info.inputs.end(),
+                               MAX_NUM_INPUTS + i) != info.inputs.end();
+    }
+    for (Op const *other : ff.operators) {
+      if (other == this) {
+        continue;
+      }
+      for (int j = 0; j < other->numInputs; j++) {
+        read_outside |= other->inputs[j]->region == outputs[i]->region;
+      }
+    }
+    if (read_outside || !read_inside) {
+      pinned[MAX_NUM_INPUTS + i] = true;
+    }
+  }
+
+  std::vector<Program> programs;
+  std::vector<int> op_program;
+  std::vector<bool> materialized;
+  plan_programs(infos, pinned, &programs, &op_program, &materialized);
+  assert((int)programs.size() <= numOperators);
+  numEwPrograms = programs.size();
+  std::copy(programs.begin(), programs.end(), ew_programs);
+  std::copy(op_program.begin(), op_program.end(), op_ew_program);
+  for (int i = 0; i < numOutputs; i++) {
+    output_elided[i] = !materialized[MAX_NUM_INPUTS + i];
+  }
+}
+
 void FusedOp::init(FFModel const &ff) {
   assert(check_output_input_weight_same_parallel_is());
   parallel_is = outputs[0]->parallel_is;
   ArgumentMap argmap;
   Context ctx = ff.config.lg_ctx;
   Runtime *runtime = ff.config.lg_hlr;
+  compile_elementwise_programs(ff);
   // Call init methods in individual operators
   Domain domain = runtime->get_index_space_domain(ctx, parallel_is);
   for (int i = 0; i < numOperators; i++) {
+    if (op_ew_program[i] >= 0 &&
+        ff.config.computationMode != COMP_MODE_TRAINING) {
+      // Element-wise programs need no per-operator state, and initializing
+      // the operator would map outputs that have been elided. Backward,
+      // which uses the per-operator kernels, only runs when training.
+      for (size_t j = 0; j < domain.get_volume(); j++) {
+        fused_meta[j].meta[i] = nullptr;
+      }
+      continue;
+    }
     operators[i]->init(ff);
     for (size_t j = 0; j < domain.get_volume(); j++) {
       fused_meta[j].meta[i] = operators[i]->meta[j];
@@ -369,13 +476,16 @@ void FusedOp::forward(FFModel const &ff) {
   }
   offset += numWeights;
   for (int i = 0; i < numOutputs; i++) {
+    if (output_elided[i]) {
+      continue;
+    }
     assert(outputs[i]->region != LogicalRegion::NO_REGION);
     launcher.add_region_requirement(RegionRequirement(outputs[i]->part,
                                                       0 /*projection id*/,
                                                       WRITE_ONLY,
                                                       EXCLUSIVE,
                                                       outputs[i]->region));
-    launcher.add_field(offset + i, FID_DATA);
+    launcher.add_field(offset++, FID_DATA);
   }
   runtime->execute_index_space(ctx, launcher);
 }
@@ -447,6 +557,37 @@ void FusedOp::backward(FFModel const &ff) {
   runtime->execute_index_space(ctx, launcher);
 }
 
+/*static*/
+void FusedOp::forward_elementwise_program(
+    FusedOp const *fused,
+    int program,
+    GenericTensorAccessorR const *input_accessor,
+    GenericTensorAccessorW const *output_accessor) {
+  Kernels::FusedElementwise::Program const &p = fused->ew_programs[program];
+  void const *inputs[MAX_NUM_FUSED_EW_TENSORS];
+  void *outputs[MAX_NUM_FUSED_EW_TENSORS];
+  size_t volume = 0;
+  for (int i = 0; i < p.num_inputs; i++) {
+    int t = p.input_tensors[i];
+    GenericTensorAccessorR acc =
+        t < MAX_NUM_INPUTS
+            ? input_accessor[t]
+            : GenericTensorAccessorR(output_accessor[t - MAX_NUM_INPUTS]);
+    assert(i == 0 || acc.domain.get_volume() == volume);
+    volume = acc.domain.get_volume();
+    inputs[i] = acc.ptr;
+  }
+  for (int i = 0; i < p.num_outputs; i++) {
+    int t = p.output_tensors[i];
+    assert(t >= MAX_NUM_INPUTS);
+    GenericTensorAccessorW const &acc = output_accessor[t - MAX_NUM_INPUTS];
+    assert(acc.domain.get_volume() == volume);
+    outputs[i] = acc.ptr;
+  }
+  Kernels::FusedElementwise::forward_kernel_wrapper(
+      p, inputs, outputs, volume, fused->profiling);
+}
+
 bool FusedOp::measure_operator_cost(Simulator *sim,
                                     MachineView const &mv,
                                     CostMetrics &cost_metrics) const {
@@ -73,8 +73,12 @@ __host__ void FusedOp::forward_task(Task const *task,
   FusedOp const *fused = metas->fused_op;
   assert(metas->numOperators == fused->numOperators);
   assert(regions.size() == task->regions.size());
-  assert((int)regions.size() ==
-         fused->numInputs + fused->numWeights + fused->numOutputs);
+  int num_elided = 0;
+  for (int i = 0; i < fused->numOutputs; i++) {
+    num_elided += fused->output_elided[i];
+  }
+  assert((int)regions.size() == fused->numInputs + fused->numWeights +
+                                    fused->numOutputs - num_elided);
   // Domain input_domain[MAX_NUM_INPUTS];
   // Domain weight_domain[MAX_NUM_WEIGHTS];
   // Domain output_domain[MAX_NUM_OUTPUTS];
@@ -109,15 +113,18 @@ __host__ void FusedOp::forward_task(Task const *task,
   roff += fused->numWeights;
   assert(fused->numOutputs <= MAX_NUM_OUTPUTS);
   for (int i = 0; i < fused->numOutputs; i++) {
-    // output_domain[i] = runtime->get_index_space_domain(
-    //     ctx, task->regions[i + roff].region.get_index_space());
+    if (fused->output_elided[i]) {
+      // Only lives in the registers of an element-wise program
+      continue;
+    }
     output_accessor[i] =
         helperGetGenericTensorAccessorWO(fused->output_data_types[i],
-                                         regions[i + roff],
-                                         task->regions[i + roff],
+                                         regions[roff],
+                                         task->regions[roff],
                                          FID_DATA,
                                          ctx,
                                          runtime);
+    roff++;
   }
   // Assert that all meta share the same dnn/blas handler
   int start = 0;
@@ -135,6 +142,18 @@ __host__ void FusedOp::forward_task(Task const *task,
 
   int ioff = 0, woff = 0, ooff = 0;
   for (int op = 0; op < fused->numOperators; op++) {
+    int program = fused->op_ew_program[op];
+    if (program >= 0) {
+      // The whole run of element-wise operators executes as one loop
+      if (op == 0 || fused->op_ew_program[op - 1] != program) {
+        FusedOp::forward_elementwise_program(
+            fused, program, input_accessor, output_accessor);
+      }
+      ioff += fused->op_num_inputs[op];
+      woff += fused->op_num_weights[op];
+      ooff += fused->op_num_outputs[op];
+      continue;
+    }
     // Domain my_id[MAX_NUM_INPUTS];
     // Domain my_wd[MAX_NUM_WEIGHTS];
     // Domain my_od[MAX_NUM_OUTPUTS];
@@ -833,7 +852,18 @@ __host__ void FusedOp::backward_task(Task const *task,
       case OP_RELU:
       case OP_SIGMOID:
       case OP_TANH:
-      case OP_ELU: {
+      case OP_ELU:
+      case OP_EXP:
+      case OP_IDENTITY:
+      case OP_GELU:
+      case OP_RSQRT:
+      case OP_POW:
+      case OP_SIN:
+      case OP_COS:
+      case OP_SCALAR_MULTIPLY:
+      case OP_SCALAR_ADD:
+      case OP_SCALAR_SUB:
+      case OP_SCALAR_TRUE_DIV: {
         assert(fused->op_num_inputs[op] == 1);
         assert(fused->op_num_weights[op] == 0);
         assert(fused->op_num_outputs[op] == 1);
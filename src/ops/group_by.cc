@@ -15,10 +15,13 @@
 
 #include "flexflow/model.h"
 #include "flexflow/ops/groupby.h"
+#include "flexflow/utils/cpu_helper.h"
 #include "flexflow/utils/hash_utils.h"
 #include "legion/legion_utilities.h"
+#include <algorithm>
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 
 namespace FlexFlow {
 // declare Legion names
@@ -338,7 +341,7 @@ void Group_by::backward(FFModel const &ff) {
   // input_grad
   launcher.add_region_requirement(RegionRequirement(inputs[0]->part_grad,
                                                     0 /*projection id*/,
-                                                    WRITE_ONLY,
+                                                    READ_WRITE,
                                                     EXCLUSIVE,
                                                     inputs[0]->region_grad));
   launcher.add_field(0, FID_DATA);
@@ -355,7 +358,7 @@ void Group_by::backward(FFModel const &ff) {
   for (int i = 0; i < n; i++) {
     launcher.add_region_requirement(RegionRequirement(outputs[i]->part_grad,
                                                       0 /*projection id*/,
-                                                      WRITE_ONLY,
+                                                      READ_ONLY,
                                                       EXCLUSIVE,
                                                       outputs[i]->region_grad));
     launcher.add_field(i + 2, FID_DATA);
@@ -378,7 +381,7 @@ void Group_by::backward_task(Task const *task,
   assert((int)task->regions.size() == n + 2);
 
   // get input and assign regions
-  AccessorWO<float, 3> const acc_input_grad(regions[0], FID_DATA);
+  AccessorRW<float, 3> const acc_input_grad(regions[0], FID_DATA);
   AccessorRO<int, 3> const acc_assign(regions[1], FID_DATA);
 
   Rect<3> rect_input_grad = runtime->get_index_space_domain(
@@ -395,12 +398,12 @@ void Group_by::backward_task(Task const *task,
   int data_dim = input_cols;
 
   // get output
-  float *output_grads[n];
+  float const *output_grads[n];
   int exp_output_rows = (int)ceil(alpha * k / n * batch_size);
   for (int i = 0; i < n; i++) {
     Domain out_domain = runtime->get_index_space_domain(
         ctx, task->regions[i + 2].region.get_index_space());
-    output_grads[i] = helperGetTensorPointerRW<float>(
+    output_grads[i] = helperGetTensorPointerRO<float>(
         regions[i + 2], task->regions[i + 2], FID_DATA, ctx, runtime);
 
     coord_t output_rows = out_domain.hi()[1] - out_domain.lo()[1] + 1;
@@ -420,6 +423,204 @@ void Group_by::backward_task(Task const *task,
                                     data_dim);
 }
 
+GroupByMeta::GroupByMeta(FFHandler handle, int n, bool cpu_kernels)
+    : OpMeta(handle) {
+  assert(cpu_kernels);
+  dev_region_ptrs = NULL;
+}
+
+OpMeta *Group_by::init_task_cpu(Task const *task,
+                                std::vector<PhysicalRegion> const &regions,
+                                Context ctx,
+                                Runtime *runtime) {
+  Group_by *gb = (Group_by *)task->args;
+  FFHandler handle = *((FFHandler *)task->local_args);
+  GroupByMeta *m = new GroupByMeta(handle, gb->n, true /*cpu_kernels*/);
+  m->profiling = gb->profiling;
+  return m;
+}
+
+/*
+  regions[0](I): input
+  regions[1](I): assign
+  regions[2..n+1](O): outputs
+*/
+void Group_by::forward_task_cpu(Task const *task,
+                                std::vector<PhysicalRegion> const &regions,
+                                Context ctx,
+                                Runtime *runtime) {
+  Group_by const *gb = (Group_by *)task->args;
+  int n = gb->n;
+  float alpha = gb->alpha;
+  assert((int)regions.size() == n + 2);
+  assert((int)task->regions.size() == n + 2);
+  GroupByMeta const *m = *((GroupByMeta **)task->local_args);
+
+  AccessorRO<float, 3> const acc_input(regions[0], FID_DATA);
+  AccessorRO<int, 3> const acc_assign(regions[1], FID_DATA);
+  Rect<3> rect_input = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Rect<3> rect_assign = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  int batch_size = rect_input.hi[1] - rect_input.lo[1] + 1;
+  int data_dim = rect_input.hi[0] - rect_input.lo[0] + 1;
+  assert(batch_size == rect_assign.hi[1] - rect_assign.lo[1] + 1);
+  int k = rect_assign.hi[0] - rect_assign.lo[0] + 1;
+
+  float *outputs[n];
+  int exp_output_rows = (int)ceil(alpha * k / n * batch_size);
+  for (int i = 0; i < n; i++) {
+    Domain out_domain = runtime->get_index_space_domain(
+        ctx, task->regions[i + 2].region.get_index_space());
+    outputs[i] = helperGetTensorPointerWO<float>(
+        regions[i + 2], task->regions[i + 2], FID_DATA, ctx, runtime);
+    assert(out_domain.hi()[1] - out_domain.lo()[1] + 1 == exp_output_rows);
+    assert(out_domain.hi()[0] - out_domain.lo()[0] + 1 == data_dim);
+  }
+  double t_start = 0;
+  if (m->profiling) {
+    t_start = Realm::Clock::current_time_in_microseconds();
+  }
+  Group_by::forward_kernel_cpu(acc_input.ptr(rect_input),
+                               acc_assign.ptr(rect_assign),
+                               outputs,
+                               n,
+                               k,
+                               alpha,
+                               batch_size,
+                               data_dim);
+  if (m->profiling) {
+    double elapsed = Realm::Clock::current_time_in_microseconds() - t_start;
+    log_measure.debug("[GroupBy] CPU forward time = %.2fms\n",
+                      elapsed / 1000.0);
+  }
+}
+
+/*
+  regions[0](I/O): input_grad
+  regions[1](I): assign
+  regions[2..n+1](I): output_grads
+*/
+void Group_by::backward_task_cpu(Task const *task,
+                                 std::vector<PhysicalRegion> const &regions,
+                                 Context ctx,
+                                 Runtime *runtime) {
+  Group_by const *gb = (Group_by *)task->args;
+  int n = gb->n;
+  float alpha = gb->alpha;
+  assert((int)regions.size() == n + 2);
+  assert((int)task->regions.size() == n + 2);
+
+  AccessorRW<float, 3> const acc_input_grad(regions[0], FID_DATA);
+  AccessorRO<int, 3> const acc_assign(regions[1], FID_DATA);
+  Rect<3> rect_input_grad = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Rect<3> rect_assign = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  int batch_size = rect_input_grad.hi[1] - rect_input_grad.lo[1] + 1;
+  int data_dim = rect_input_grad.hi[0] - rect_input_grad.lo[0] + 1;
+  assert(batch_size == rect_assign.hi[1] - rect_assign.lo[1] + 1);
+  int k = rect_assign.hi[0] - rect_assign.lo[0] + 1;
+
+  float const *output_grads[n];
+  int exp_output_rows = (int)ceil(alpha * k / n * batch_size);
+  for (int i = 0; i < n; i++) {
+    Domain out_domain = runtime->get_index_space_domain(
+        ctx, task->regions[i + 2].region.get_index_space());
+    output_grads[i] = helperGetTensorPointerRO<float>(
+        regions[i + 2], task->regions[i + 2], FID_DATA, ctx, runtime);
+    assert(out_domain.hi()[1] - out_domain.lo()[1] + 1 == exp_output_rows);
+    assert(out_domain.hi()[0] - out_domain.lo()[0] + 1 == data_dim);
+  }
+  Group_by::backward_kernel_cpu(acc_input_grad.ptr(rect_input_grad),
+                                acc_assign.ptr(rect_assign),
+                                output_grads,
+                                n,
+                                k,
+                                alpha,
+                                batch_size,
+                                data_dim);
+}
+
+// Number of elements handled per chunk of the CPU thread pool
+static int64_t const GROUP_BY_CPU_GRAIN_ELEMENTS = 16384;
+
+/*static*/
+void Group_by::forward_kernel_cpu(float const *input,
+                                  int const *exp_assign,
+                                  float **outputs,
+                                  int n,
+                                  int k,
+                                  float alpha,
+                                  int batch_size,
+                                  int data_dim) {
+  int capacity = (int)ceil(alpha * k / n * batch_size);
+  int num_slots = k * batch_size;
+  // Counting sort of the assignments: one pass gives every kept assignment
+  // its row in the expert buffer, and inverting that mapping yields, for
+  // each expert row, the sample it is copied from
+  std::vector<int> slot_rows(num_slots), counts(n);
+  cpu_assign_expert_rows(
+      exp_assign, num_slots, n, capacity, slot_rows.data(), counts.data());
+  std::vector<int> row_samples(n * capacity, -1);
+  for (int i = 0; i < num_slots; i++) {
+    if (slot_rows[i] >= 0) {
+      row_samples[exp_assign[i] * capacity + slot_rows[i]] = i / k;
+    }
+  }
+  // Rows an expert did not fill are zeroed so that the expert never sees
+  // stale data
+  int64_t grain =
+      std::max((int64_t)1, GROUP_BY_CPU_GRAIN_ELEMENTS / (int64_t)data_dim);
+  cpu_parallel_for(0, n * capacity, grain, [&](int64_t lo, int64_t hi) {
+    for (int64_t r = lo; r < hi; r++) {
+      float *dst = outputs[r / capacity] + (r % capacity) * data_dim;
+      if (row_samples[r] >= 0) {
+        memcpy(dst,
+               input + (int64_t)row_samples[r] * data_dim,
+               sizeof(float) * data_dim);
+      } else {
+        memset(dst, 0, sizeof(float) * data_dim);
+      }
+    }
+  });
+}
+
+/*static*/
+void Group_by::backward_kernel_cpu(float *input_grad,
+                                   int const *exp_assign,
+                                   float const *const *output_grads,
+                                   int n,
+                                   int k,
+                                   float alpha,
+                                   int batch_size,
+                                   int data_dim) {
+  int capacity = (int)ceil(alpha * k / n * batch_size);
+  int num_slots = k * batch_size;
+  std::vector<int> slot_rows(num_slots), counts(n);
+  cpu_assign_expert_rows(
+      exp_assign, num_slots, n, capacity, slot_rows.data(), counts.data());
+  // A sample routed to several experts receives the sum of their gradients;
+  // each sample owns its input_grad row so the loop needs no atomics
+  int64_t grain = std::max(
+      (int64_t)1, GROUP_BY_CPU_GRAIN_ELEMENTS / ((int64_t)k * data_dim));
+  cpu_parallel_for(0, batch_size, grain, [&](int64_t lo, int64_t hi) {
+    for (int64_t b = lo; b < hi; b++) {
+      for (int j = 0; j < k; j++) {
+        int64_t slot = b * k + j;
+        if (slot_rows[slot] < 0) {
+          continue;
+        }
+        cpu_vec_axpy(1.0f,
+                     output_grads[exp_assign[slot]] +
+                         (int64_t)slot_rows[slot] * data_dim,
+                     input_grad + b * data_dim,
+                     data_dim);
+      }
+    }
+  });
+}
+
 void Group_by::serialize(Legion::Serializer &sez) const {
   sez.serialize(this->n);
   sez.serialize(this->alpha);
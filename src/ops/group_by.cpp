@@ -80,13 +80,13 @@ __global__ void
 __global__ void
     gb_backward_kernel(float *input_grad,
                        int const *exp_assign,
-                       float **output_grads,
+                       float const *const *output_grads,
                        int n,       // num experts
                        int k,       // chosen experts
                        float alpha, // factor additional memory assigned
                        int batch_size,
                        int data_dim) {
-  __shared__ float *chosen_exp_grads[MAX_K * MAX_BATCH_SIZE];
+  __shared__ float const *chosen_exp_grads[MAX_K * MAX_BATCH_SIZE];
 
   // Get pred pointers, single thread
   if (blockIdx.x * blockDim.x + threadIdx.x == 0) {
@@ -111,8 +111,15 @@ __global__ void
   // compute output
   CUDA_KERNEL_LOOP(i, k * batch_size * data_dim) {
     if (chosen_exp_grads[i / data_dim] != 0) {
-      input_grad[(i / (k * data_dim)) * data_dim + i % data_dim] =
-          chosen_exp_grads[i / data_dim][i % data_dim];
+      // Accumulate like the CPU kernel; with k > 1 the k slots of a sample
+      // add into the same input gradient row
+      float *dst = input_grad + (i / (k * data_dim)) * data_dim + i % data_dim;
+      float grad = chosen_exp_grads[i / data_dim][i % data_dim];
+      if (k == 1) {
+        *dst += grad;
+      } else {
+        atomicAdd(dst, grad);
+      }
     }
   }
 }
@@ -155,7 +162,7 @@ void Group_by::backward_kernel_wrapper(
     GroupByMeta const *m,
     float *input_grad,
     int const *exp_assign,
-    float **output_grads,
+    float const *const *output_grads,
     int n,       // num experts
     int k,       // chosen experts
     float alpha, // factor additional memory assigned
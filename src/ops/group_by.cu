@@ -66,13 +66,13 @@ __global__ void
 __global__ void
     gb_backward_kernel(float *input_grad,
                        int const *exp_assign,
-                       float **output_grads,
+                       float const *const *output_grads,
                        int n,       // num experts
                        int k,       // chosen experts
                        float alpha, // factor additional memory assigned
                        int batch_size,
                        int data_dim) {
-  __shared__ float *chosen_exp_grads[MAX_K * MAX_BATCH_SIZE];
+  __shared__ float const *chosen_exp_grads[MAX_K * MAX_BATCH_SIZE];
   assert(k <= MAX_K);
   assert(batch_size <= MAX_BATCH_SIZE);
   assert(n <= MAX_N);
@@ -99,8 +99,15 @@ __global__ void
   // compute output
   CUDA_KERNEL_LOOP(i, k * batch_size * data_dim) {
     if (chosen_exp_grads[i / data_dim] != nullptr) {
-      input_grad[(i / (k * data_dim)) * data_dim + i % data_dim] =
-          chosen_exp_grads[i / data_dim][i % data_dim];
+      // Accumulate like the CPU kernel; with k > 1 the k slots of a sample
+      // add into the same input gradient row
+      float *dst = input_grad + (i / (k * data_dim)) * data_dim + i % data_dim;
+      float grad = chosen_exp_grads[i / data_dim][i % data_dim];
+      if (k == 1) {
+        *dst += grad;
+      } else {
+        atomicAdd(dst, grad);
+      }
     }
   }
 }
@@ -152,7 +159,7 @@ void Group_by::backward_kernel_wrapper(
     GroupByMeta const *m,
     float *input_grad,
     int const *exp_assign,
-    float **output_grads,
+    float const *const *output_grads,
     int n,       // num experts
     int k,       // chosen experts
     float alpha, // factor additional memory assigned
@@ -16,6 +16,11 @@
 #include "flexflow/ops/kernels/embedding_kernels.h"
 #include "flexflow/utils/hip_helper.h"
 #include <hip/hip_runtime.h>
+#include <thrust/execution_policy.h>
+#include <thrust/fill.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/sort.h>
+#include <thrust/unique.h>
 
 namespace FlexFlow {
 // declare Legion names
@@ -211,6 +216,82 @@ void backward_kernel_wrapper(EmbeddingMeta const *m,
   }
 }
 
+void sparse_backward_kernel_wrapper(
+    EmbeddingMeta const *m,
+    GenericTensorAccessorR const &input,
+    GenericTensorAccessorR const &output,
+    GenericTensorAccessorW const &sparse_indices,
+    GenericTensorAccessorW const &sparse_values,
+    int in_dim,
+    int out_dim,
+    int batch_size) {
+  hipStream_t stream;
+  checkCUDA(get_legion_stream(&stream));
+  assert(m->output_type[0] == DT_FLOAT);
+  int lookups_per_row = (m->aggr == AGGR_MODE_NONE) ? 1 : in_dim;
+  int64_t num_lookups = (int64_t)lookups_per_row * batch_size;
+  float scale = (m->aggr == AGGR_MODE_AVG) ? 1.0f / in_dim : 1.0f;
+  // The sorted keys, their lookup positions and the segment starts are
+  // staged in the handle's work space
+  assert(3 * num_lookups * sizeof(int64_t) <= m->handle.workSpaceSize);
+  int64_t *keys = (int64_t *)m->handle.workSpace;
+  int64_t *positions = keys + num_lookups;
+  int64_t *segment_starts = positions + num_lookups;
+  if (m->input_type[0] == DT_INT32) {
+    hipLaunchKernelGGL(HIP_KERNEL_NAME(Internal::copy_lookup_indices<int32_t>),
+                       GET_BLOCKS(num_lookups),
+                       CUDA_NUM_THREADS,
+                       0,
+                       stream,
+                       input.get_int32_ptr(),
+                       keys,
+                       positions,
+                       num_lookups);
+  } else {
+    assert(m->input_type[0] == DT_INT64);
+    hipLaunchKernelGGL(HIP_KERNEL_NAME(Internal::copy_lookup_indices<int64_t>),
+                       GET_BLOCKS(num_lookups),
+                       CUDA_NUM_THREADS,
+                       0,
+                       stream,
+                       input.get_int64_ptr(),
+                       keys,
+                       positions,
+                       num_lookups);
+  }
+  thrust::sort_by_key(
+      thrust::hip::par.on(stream), keys, keys + num_lookups, positions);
+  int64_t *rows = sparse_indices.get_int64_ptr();
+  auto ends = thrust::unique_by_key_copy(thrust::hip::par.on(stream),
+                                         keys,
+                                         keys + num_lookups,
+                                         thrust::counting_iterator<int64_t>(0),
+                                         rows,
+                                         segment_starts);
+  int64_t num_unique = ends.first - rows;
+  thrust::fill(thrust::hip::par.on(stream),
+               rows + num_unique,
+               rows + num_lookups,
+               (int64_t)-1);
+  if (num_unique > 0) {
+    hipLaunchKernelGGL(Internal::embed_backward_sparse,
+                       GET_BLOCKS(num_unique * out_dim),
+                       CUDA_NUM_THREADS,
+                       0,
+                       stream,
+                       rows,
+                       segment_starts,
+                       positions,
+                       output.get_float_ptr(),
+                       sparse_values.get_float_ptr(),
+                       num_unique,
+                       num_lookups,
+                       lookups_per_row,
+                       out_dim,
+                       scale);
+  }
+}
+
 void rand_generate_int64_wrapper(int64_t *ptr, size_t size, int64_t p) {
   hipStream_t stream;
   checkCUDA(get_legion_stream(&stream));
@@ -426,6 +507,41 @@ __global__ void embed_backward_with_aggr<int64_t, half>(int64_t const *input,
   }
 }
 
+template <typename TI>
+__global__ void copy_lookup_indices(TI const *input,
+                                    int64_t *keys,
+                                    int64_t *positions,
+                                    int64_t num_lookups) {
+  CUDA_KERNEL_LOOP(i, num_lookups) {
+    keys[i] = input[i];
+    positions[i] = i;
+  }
+}
+
+// One thread per (distinct row, channel), so duplicate lookups are reduced
+// without atomics
+__global__ void embed_backward_sparse(int64_t const *rows,
+                                      int64_t const *segment_starts,
+                                      int64_t const *positions,
+                                      float const *output,
+                                      float *values,
+                                      int64_t num_unique,
+                                      int64_t num_lookups,
+                                      int lookups_per_row,
+                                      int out_dim,
+                                      float scale) {
+  CUDA_KERNEL_LOOP(i, num_unique * out_dim) {
+    int64_t r = i / out_dim;
+    int off = i % out_dim;
+    int64_t end = (r + 1 < num_unique) ? segment_starts[r + 1] : num_lookups;
+    float sum = 0.0f;
+    for (int64_t k = segment_starts[r]; k < end; k++) {
+      sum += output[(positions[k] / lookups_per_row) * out_dim + off];
+    }
+    values[i] = sum * scale;
+  }
+}
+
 /*static*/
 template <typename TI, typename TD>
 void forward_kernel(TI const *input_ptr,
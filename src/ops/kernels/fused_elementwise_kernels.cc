@@ -0,0 +1,583 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/ops/kernels/fused_elementwise_kernels.h"
+#include "flexflow/utils/cpu_helper.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+namespace FlexFlow {
+namespace Kernels {
+namespace FusedElementwise {
+
+namespace {
+
+bool is_loadable(DataType type) {
+  return type == DT_FLOAT || type == DT_DOUBLE || type == DT_INT32 ||
+         type == DT_INT64;
+}
+
+bool is_binary(OperatorType type) {
+  switch (type) {
+    case OP_EW_ADD:
+    case OP_EW_SUB:
+    case OP_EW_MUL:
+    case OP_EW_DIV:
+    case OP_EW_MAX:
+    case OP_EW_MIN:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool is_unary(OperatorType type) {
+  switch (type) {
+    case OP_RELU:
+    case OP_SIGMOID:
+    case OP_TANH:
+    case OP_ELU:
+    case OP_EXP:
+    case OP_IDENTITY:
+    case OP_GELU:
+    case OP_RSQRT:
+    case OP_POW:
+    case OP_SIN:
+    case OP_COS:
+    case OP_SCALAR_MULTIPLY:
+    case OP_SCALAR_ADD:
+    case OP_SCALAR_SUB:
+    case OP_SCALAR_TRUE_DIV:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool reads(OpInfo const &op, int t) {
+  return std::find(op.inputs.begin(), op.inputs.end(), t) != op.inputs.end();
+}
+
+bool writes(OpInfo const &op, int t) {
+  return std::find(op.outputs.begin(), op.outputs.end(), t) !=
+         op.outputs.end();
+}
+
+// Whether any of ops[first, last) reads tensor t before writing it
+bool read_in(std::vector<OpInfo> const &ops, int first, int last, int t) {
+  for (int k = first; k < last; k++) {
+    if (reads(ops[k], t)) {
+      return true;
+    }
+    if (writes(ops[k], t)) {
+      return false;
+    }
+  }
+  return false;
+}
+
+int slot_of(int *tensors, int *num_tensors, int t) {
+  for (int i = 0; i < *num_tensors; i++) {
+    if (tensors[i] == t) {
+      return i;
+    }
+  }
+  if (*num_tensors == MAX_NUM_FUSED_EW_TENSORS) {
+    return -1;
+  }
+  tensors[*num_tensors] = t;
+  return (*num_tensors)++;
+}
+
+// Compiles ops[first, last) into program. Registers are allocated linearly
+// and released after the last read of their value. Returns false if the
+// program does not fit into the MAX_NUM_FUSED_EW_* limits.
+bool compile(std::vector<OpInfo> const &ops,
+             int first,
+             int last,
+             std::vector<bool> const &pinned,
+             Program *program) {
+  program->num_instrs = program->num_registers = 0;
+  program->num_inputs = program->num_outputs = 0;
+  bool busy[MAX_NUM_FUSED_EW_REGISTERS] = {false};
+  std::unordered_map<int, int> reg_of;
+  auto alloc = [&]() {
+    for (int r = 0; r < MAX_NUM_FUSED_EW_REGISTERS; r++) {
+      if (!busy[r]) {
+        busy[r] = true;
+        program->num_registers = std::max(program->num_registers, r + 1);
+        return r;
+      }
+    }
+    return -1;
+  };
+  auto emit = [&](Instr const &instr) {
+    if (program->num_instrs == MAX_NUM_FUSED_EW_INSTRS) {
+      return false;
+    }
+    program->instrs[program->num_instrs++] = instr;
+    return true;
+  };
+
+  for (int k = first; k < last; k++) {
+    OpInfo const &op = ops[k];
+    Instr compute;
+    compute.kind = EW_COMPUTE;
+    compute.op_type = op.op_type;
+    compute.data_type = op.output_types[0];
+    compute.tensor = -1;
+    compute.scalar = op.scalar;
+    compute.src[0] = compute.src[1] = -1;
+    for (size_t i = 0; i < op.inputs.size(); i++) {
+      int t = op.inputs[i];
+      if (!reg_of.count(t)) {
+        Instr load;
+        load.kind = EW_LOAD;
+        load.op_type = OP_NOOP;
+        load.data_type = op.input_types[i];
+        load.tensor = slot_of(program->input_tensors, &program->num_inputs, t);
+        load.dst = alloc();
+        load.src[0] = load.src[1] = -1;
+        load.scalar = 0.0f;
+        if (load.tensor < 0 || load.dst < 0 || !emit(load)) {
+          return false;
+        }
+        reg_of[t] = load.dst;
+      }
+      compute.src[i] = reg_of[t];
+    }
+    // Values read for the last time can be overwritten by the result
+    for (int t : op.inputs) {
+      if (reg_of.count(t) && !read_in(ops, k + 1, last, t)) {
+        busy[reg_of[t]] = false;
+        reg_of.erase(t);
+      }
+    }
+    int t = op.outputs[0];
+    if (reg_of.count(t)) {
+      // t is overwritten; its previous value is dead
+      busy[reg_of[t]] = false;
+      reg_of.erase(t);
+    }
+    compute.dst = alloc();
+    if (compute.dst < 0 || !emit(compute)) {
+      return false;
+    }
+    bool rewritten = false;
+    for (int j = k + 1; j < last; j++) {
+      rewritten |= writes(ops[j], t);
+    }
+    if (!rewritten && (pinned[t] || read_in(ops, last, (int)ops.size(), t))) {
+      Instr store;
+      store.kind = EW_STORE;
+      store.op_type = OP_NOOP;
+      store.data_type = op.output_types[0];
+      store.tensor = slot_of(program->output_tensors, &program->num_outputs, t);
+      store.dst = -1;
+      store.src[0] = compute.dst;
+      store.src[1] = -1;
+      store.scalar = 0.0f;
+      if (store.tensor < 0 || !emit(store)) {
+        return false;
+      }
+    }
+    if (read_in(ops, k + 1, last, t)) {
+      reg_of[t] = compute.dst;
+    } else {
+      busy[compute.dst] = false;
+    }
+  }
+  return true;
+}
+
+int const TILE_SIZE = 256;
+
+template <typename T>
+void load_tile(T const *src, float *dst, int n) {
+  for (int i = 0; i < n; i++) {
+    dst[i] = (float)src[i];
+  }
+}
+
+template <typename T>
+void store_tile(float const *src, T *dst, int n) {
+  for (int i = 0; i < n; i++) {
+    dst[i] = (T)src[i];
+  }
+}
+
+struct AddOp {
+  static float apply(float x, float y) {
+    return x + y;
+  }
+#ifdef FF_USE_AVX2
+  static __m256 apply(__m256 x, __m256 y) {
+    return _mm256_add_ps(x, y);
+  }
+#endif
+};
+
+struct SubOp {
+  static float apply(float x, float y) {
+    return x - y;
+  }
+#ifdef FF_USE_AVX2
+  static __m256 apply(__m256 x, __m256 y) {
+    return _mm256_sub_ps(x, y);
+  }
+#endif
+};
+
+struct MulOp {
+  static float apply(float x, float y) {
+    return x * y;
+  }
+#ifdef FF_USE_AVX2
+  static __m256 apply(__m256 x, __m256 y) {
+    return _mm256_mul_ps(x, y);
+  }
+#endif
+};
+
+struct DivOp {
+  static float apply(float x, float y) {
+    return x / y;
+  }
+#ifdef FF_USE_AVX2
+  static __m256 apply(__m256 x, __m256 y) {
+    return _mm256_div_ps(x, y);
+  }
+#endif
+};
+
+// Same NaN handling as _mm256_max_ps / _mm256_min_ps
+struct MaxOp {
+  static float apply(float x, float y) {
+    return x > y ? x : y;
+  }
+#ifdef FF_USE_AVX2
+  static __m256 apply(__m256 x, __m256 y) {
+    return _mm256_max_ps(x, y);
+  }
+#endif
+};
+
+struct MinOp {
+  static float apply(float x, float y) {
+    return x < y ? x : y;
+  }
+#ifdef FF_USE_AVX2
+  static __m256 apply(__m256 x, __m256 y) {
+    return _mm256_min_ps(x, y);
+  }
+#endif
+};
+
+// out[i] = F(a[i], b[i])
+template <typename F>
+void binary_tile(float const *a, float const *b, float *out, int n) {
+  int i = 0;
+#ifdef FF_USE_AVX2
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(
+        out + i, F::apply(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = F::apply(a[i], b[i]);
+  }
+}
+
+// out[i] = F(a[i], scalar)
+template <typename F>
+void scalar_tile(float const *a, float scalar, float *out, int n) {
+  int i = 0;
+#ifdef FF_USE_AVX2
+  __m256 vscalar = _mm256_set1_ps(scalar);
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(out + i, F::apply(_mm256_loadu_ps(a + i), vscalar));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = F::apply(a[i], scalar);
+  }
+}
+
+void compute_tile(Instr const &instr,
+                  float const *a,
+                  float const *b,
+                  float *out,
+                  int n) {
+  switch (instr.op_type) {
+    case OP_EW_ADD:
+      binary_tile<AddOp>(a, b, out, n);
+      break;
+    case OP_EW_SUB:
+      binary_tile<SubOp>(a, b, out, n);
+      break;
+    case OP_EW_MUL:
+      binary_tile<MulOp>(a, b, out, n);
+      break;
+    case OP_EW_DIV:
+      binary_tile<DivOp>(a, b, out, n);
+      break;
+    case OP_EW_MAX:
+      binary_tile<MaxOp>(a, b, out, n);
+      break;
+    case OP_EW_MIN:
+      binary_tile<MinOp>(a, b, out, n);
+      break;
+    case OP_RELU:
+      scalar_tile<MaxOp>(a, 0.0f, out, n);
+      break;
+    case OP_SCALAR_ADD:
+      scalar_tile<AddOp>(a, instr.scalar, out, n);
+      break;
+    case OP_SCALAR_SUB:
+      scalar_tile<SubOp>(a, instr.scalar, out, n);
+      break;
+    case OP_SCALAR_MULTIPLY:
+      scalar_tile<MulOp>(a, instr.scalar, out, n);
+      break;
+    case OP_SCALAR_TRUE_DIV:
+      scalar_tile<DivOp>(a, instr.scalar, out, n);
+      break;
+    case OP_IDENTITY:
+      std::copy(a, a + n, out);
+      break;
+    case OP_CAST:
+      if (instr.data_type == DT_INT32 || instr.data_type == DT_INT64) {
+        for (int i = 0; i < n; i++) {
+          out[i] = std::trunc(a[i]);
+        }
+      } else {
+        std::copy(a, a + n, out);
+      }
+      break;
+    case OP_SIGMOID:
+      for (int i = 0; i < n; i++) {
+        out[i] = 1.0f / (1.0f + std::exp(-a[i]));
+      }
+      break;
+    case OP_TANH:
+      for (int i = 0; i < n; i++) {
+        out[i] = std::tanh(a[i]);
+      }
+      break;
+    case OP_ELU:
+      for (int i = 0; i < n; i++) {
+        out[i] = a[i] > 0.0f ? a[i] : std::exp(a[i]) - 1.0f;
+      }
+      break;
+    case OP_EXP:
+      for (int i = 0; i < n; i++) {
+        out[i] = std::exp(a[i]);
+      }
+      break;
+    case OP_GELU:
+      for (int i = 0; i < n; i++) {
+        out[i] = (float)(a[i] * 0.5 * std::erfc(-a[i] * M_SQRT1_2));
+      }
+      break;
+    case OP_RSQRT:
+      for (int i = 0; i < n; i++) {
+        out[i] = 1.0f / std::sqrt(a[i]);
+      }
+      break;
+    case OP_POW:
+      for (int i = 0; i < n; i++) {
+        out[i] = std::pow(a[i], instr.scalar);
+      }
+      break;
+    case OP_SIN:
+      for (int i = 0; i < n; i++) {
+        out[i] = std::sin(a[i]);
+      }
+      break;
+    case OP_COS:
+      for (int i = 0; i < n; i++) {
+        out[i] = std::cos(a[i]);
+      }
+      break;
+    default:
+      assert(false && "Unsupported element-wise operator");
+  }
+}
+
+} // namespace
+
+bool is_elementwise(OpInfo const &op) {
+  if (!op.same_shape || op.outputs.size() != 1) {
+    return false;
+  }
+  assert(op.input_types.size() == op.inputs.size());
+  assert(op.output_types.size() == op.outputs.size());
+  if (op.op_type == OP_CAST) {
+    return op.inputs.size() == 1 &&
+           ((op.input_types[0] == DT_FLOAT &&
+             is_loadable(op.output_types[0])) ||
+            (op.output_types[0] == DT_FLOAT &&
+             is_loadable(op.input_types[0])));
+  }
+  if (is_binary(op.op_type)) {
+    if (op.inputs.size() != 2) {
+      return false;
+    }
+  } else if (is_unary(op.op_type)) {
+    if (op.inputs.size() != 1) {
+      return false;
+    }
+  } else {
+    return false;
+  }
+  for (DataType type : op.input_types) {
+    if (type != DT_FLOAT) {
+      return false;
+    }
+  }
+  return op.output_types[0] == DT_FLOAT;
+}
+
+void plan_programs(std::vector<OpInfo> const &ops,
+                   std::vector<bool> const &pinned,
+                   std::vector<Program> *programs,
+                   std::vector<int> *op_program,
+                   std::vector<bool> *materialized) {
+  int const num_ops = ops.size();
+  op_program->assign(num_ops, -1);
+  materialized->assign(pinned.size(), false);
+  int first = 0;
+  while (first < num_ops) {
+    if (!is_elementwise(ops[first])) {
+      for (int t : ops[first].inputs) {
+        materialized->at(t) = true;
+      }
+      for (int t : ops[first].outputs) {
+        materialized->at(t) = true;
+      }
+      first++;
+      continue;
+    }
+    // Extend the program for as long as the next operator fits into it
+    Program program;
+    bool fits = compile(ops, first, first + 1, pinned, &program);
+    assert(fits);
+    int last = first + 1;
+    while (last < num_ops && is_elementwise(ops[last]) &&
+           ops[last].shape == ops[first].shape) {
+      Program longer;
+      if (!compile(ops, first, last + 1, pinned, &longer)) {
+        break;
+      }
+      program = longer;
+      last++;
+    }
+    for (int i = 0; i < program.num_inputs; i++) {
+      materialized->at(program.input_tensors[i]) = true;
+    }
+    for (int i = 0; i < program.num_outputs; i++) {
+      materialized->at(program.output_tensors[i]) = true;
+    }
+    for (int k = first; k < last; k++) {
+      (*op_program)[k] = programs->size();
+    }
+    programs->push_back(program);
+    first = last;
+  }
+}
+
+void forward_kernel_cpu(Program const &program,
+                        void const *const *inputs,
+                        void *const *outputs,
+                        size_t volume) {
+  int64_t num_tiles = (volume + TILE_SIZE - 1) / TILE_SIZE;
+  cpu_parallel_for(0, num_tiles, 16, [&](int64_t lo, int64_t hi) {
+    float buffers[MAX_NUM_FUSED_EW_REGISTERS][TILE_SIZE];
+    // Registers loaded from float tensors point into the tensor itself
+    float const *registers[MAX_NUM_FUSED_EW_REGISTERS];
+    for (int64_t tile = lo; tile < hi; tile++) {
+      size_t offset = tile * TILE_SIZE;
+      int n = std::min((size_t)TILE_SIZE, volume - offset);
+      for (int k = 0; k < program.num_instrs; k++) {
+        Instr const &instr = program.instrs[k];
+        switch (instr.kind) {
+          case EW_LOAD: {
+            void const *src = inputs[instr.tensor];
+            float *dst = buffers[instr.dst];
+            registers[instr.dst] = dst;
+            switch (instr.data_type) {
+              case DT_FLOAT:
+                registers[instr.dst] = (float const *)src + offset;
+                break;
+              case DT_DOUBLE:
+                load_tile((double const *)src + offset, dst, n);
+                break;
+              case DT_INT32:
+                load_tile((int32_t const *)src + offset, dst, n);
+                break;
+              case DT_INT64:
+                load_tile((int64_t const *)src + offset, dst, n);
+                break;
+              default:
+                assert(false);
+            }
+            break;
+          }
+          case EW_COMPUTE: {
+            float const *b =
+                instr.src[1] >= 0 ? registers[instr.src[1]] : nullptr;
+            compute_tile(instr,
+                         registers[instr.src[0]],
+                         b,
+                         buffers[instr.dst],
+                         n);
+            registers[instr.dst] = buffers[instr.dst];
+            break;
+          }
+          case EW_STORE: {
+            void *dst = outputs[instr.tensor];
+            float const *src = registers[instr.src[0]];
+            switch (instr.data_type) {
+              case DT_FLOAT:
+                store_tile(src, (float *)dst + offset, n);
+                break;
+              case DT_DOUBLE:
+                store_tile(src, (double *)dst + offset, n);
+                break;
+              case DT_INT32:
+                store_tile(src, (int32_t *)dst + offset, n);
+                break;
+              case DT_INT64:
+                store_tile(src, (int64_t *)dst + offset, n);
+                break;
+              default:
+                assert(false);
+            }
+            break;
+          }
+          default:
+            assert(false);
+        }
+      }
+    }
+  });
+}
+
+} // namespace FusedElementwise
+} // namespace Kernels
+} // namespace FlexFlow
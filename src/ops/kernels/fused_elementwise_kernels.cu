@@ -0,0 +1,201 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/ops/kernels/fused_elementwise_kernels.h"
+#include "flexflow/utils/cuda_helper.h"
+
+namespace FlexFlow {
+// declare Legion names
+using Legion::coord_t;
+
+namespace Kernels {
+namespace FusedElementwise {
+
+/*static*/
+void forward_kernel_wrapper(Program const &program,
+                            void const *const *inputs,
+                            void *const *outputs,
+                            size_t volume,
+                            bool profiling) {
+  cudaStream_t stream;
+  checkCUDA(get_legion_stream(&stream));
+
+  cudaEvent_t t_start, t_end;
+  if (profiling) {
+    cudaEventCreate(&t_start);
+    cudaEventCreate(&t_end);
+    cudaEventRecord(t_start, stream);
+  }
+  Internal::forward_kernel(program, inputs, outputs, volume, stream);
+  if (profiling) {
+    cudaEventRecord(t_end, stream);
+    checkCUDA(cudaEventSynchronize(t_end));
+    float elapsed = 0;
+    checkCUDA(cudaEventElapsedTime(&elapsed, t_start, t_end));
+    cudaEventDestroy(t_start);
+    cudaEventDestroy(t_end);
+    printf("[FusedElementwise] forward time (%d instrs) = %.2fms\n",
+           program.num_instrs,
+           elapsed);
+  }
+}
+
+namespace Internal {
+
+struct TensorPointers {
+  void const *inputs[MAX_NUM_FUSED_EW_TENSORS];
+  void *outputs[MAX_NUM_FUSED_EW_TENSORS];
+};
+
+__device__ float apply_instr(Instr const &instr, float a, float b) {
+  switch (instr.op_type) {
+    case OP_EW_ADD:
+      return a + b;
+    case OP_EW_SUB:
+      return a - b;
+    case OP_EW_MUL:
+      return a * b;
+    case OP_EW_DIV:
+      return a / b;
+    case OP_EW_MAX:
+      return a > b ? a : b;
+    case OP_EW_MIN:
+      return a < b ? a : b;
+    case OP_RELU:
+      return a > 0.0f ? a : 0.0f;
+    case OP_SCALAR_ADD:
+      return a + instr.scalar;
+    case OP_SCALAR_SUB:
+      return a - instr.scalar;
+    case OP_SCALAR_MULTIPLY:
+      return a * instr.scalar;
+    case OP_SCALAR_TRUE_DIV:
+      return a / instr.scalar;
+    case OP_IDENTITY:
+      return a;
+    case OP_CAST:
+      return (instr.data_type == DT_INT32 || instr.data_type == DT_INT64)
+                 ? truncf(a)
+                 : a;
+    case OP_SIGMOID:
+      return 1.0f / (1.0f + expf(-a));
+    case OP_TANH:
+      return tanhf(a);
+    case OP_ELU:
+      return a > 0.0f ? a : expf(a) - 1.0f;
+    case OP_EXP:
+      return expf(a);
+    case OP_GELU:
+      return (float)(a * 0.5 * erfc(-a * M_SQRT1_2));
+    case OP_RSQRT:
+      return 1.0f / sqrtf(a);
+    case OP_POW:
+      return powf(a, instr.scalar);
+    case OP_SIN:
+      return sinf(a);
+    case OP_COS:
+      return cosf(a);
+    default:
+      assert(false);
+  }
+  return 0.0f;
+}
+
+// Every thread interprets the whole program for its elements. All threads
+// take the same branches, and the program lives in kernel parameter memory,
+// so decoding it costs little next to the loads and stores it saves.
+__global__ void fused_elementwise_forward(Program const program,
+                                          TensorPointers const ptrs,
+                                          coord_t volume) {
+  CUDA_KERNEL_LOOP(i, volume) {
+    float registers[MAX_NUM_FUSED_EW_REGISTERS];
+    for (int k = 0; k < program.num_instrs; k++) {
+      Instr const &instr = program.instrs[k];
+      switch (instr.kind) {
+        case EW_LOAD: {
+          void const *src = ptrs.inputs[instr.tensor];
+          float value;
+          switch (instr.data_type) {
+            case DT_FLOAT:
+              value = ((float const *)src)[i];
+              break;
+            case DT_DOUBLE:
+              value = (float)((double const *)src)[i];
+              break;
+            case DT_INT32:
+              value = (float)((int32_t const *)src)[i];
+              break;
+            case DT_INT64:
+              value = (float)((int64_t const *)src)[i];
+              break;
+            default:
+              assert(false);
+          }
+          registers[instr.dst] = value;
+          break;
+        }
+        case EW_COMPUTE: {
+          float b = instr.src[1] >= 0 ? registers[instr.src[1]] : 0.0f;
+          registers[instr.dst] = apply_instr(instr, registers[instr.src[0]], b);
+          break;
+        }
+        case EW_STORE: {
+          void *dst = ptrs.outputs[instr.tensor];
+          float value = registers[instr.src[0]];
+          switch (instr.data_type) {
+            case DT_FLOAT:
+              ((float *)dst)[i] = value;
+              break;
+            case DT_DOUBLE:
+              ((double *)dst)[i] = (double)value;
+              break;
+            case DT_INT32:
+              ((int32_t *)dst)[i] = (int32_t)value;
+              break;
+            case DT_INT64:
+              ((int64_t *)dst)[i] = (int64_t)value;
+              break;
+            default:
+              assert(false);
+          }
+          break;
+        }
+      }
+    }
+  }
+}
+
+void forward_kernel(Program const &program,
+                    void const *const *inputs,
+                    void *const *outputs,
+                    size_t volume,
+                    cudaStream_t stream) {
+  TensorPointers ptrs;
+  for (int i = 0; i < program.num_inputs; i++) {
+    ptrs.inputs[i] = inputs[i];
+  }
+  for (int i = 0; i < program.num_outputs; i++) {
+    ptrs.outputs[i] = outputs[i];
+  }
+  fused_elementwise_forward<<<GET_BLOCKS(volume),
+                              CUDA_NUM_THREADS,
+                              0,
+                              stream>>>(program, ptrs, volume);
+}
+
+} // namespace Internal
+} // namespace FusedElementwise
+} // namespace Kernels
+} // namespace FlexFlow
@@ -15,6 +15,7 @@
 
 #include "flexflow/ops/layer_norm.h"
 #include "flexflow/model.h"
+#include "flexflow/utils/cpu_helper.h"
 #include "flexflow/utils/hash_utils.h"
 #include "legion/legion_utilities.h"
 
@@ -444,6 +445,236 @@ void LayerNorm::backward_task(Task const *task,
                                             beta_grad_ptr);
 }
 
+LayerNormMeta::LayerNormMeta(FFHandler handle,
+                             LayerNorm const *ln,
+                             bool cpu_kernels)
+    : LayerNormMeta(handle,
+                    ln->elementwise_affine,
+                    ln->effective_batch_size,
+                    ln->effective_num_elements,
+                    ln->eps,
+                    cpu_kernels) {
+  profiling = ln->profiling;
+}
+
+LayerNormMeta::LayerNormMeta(FFHandler handle,
+                             bool _elementwise_affine,
+                             int64_t _effective_batch_size,
+                             int64_t _effective_num_elements,
+                             float _eps,
+                             bool cpu_kernels)
+    : OpMeta(handle), elementwise_affine(_elementwise_affine),
+      effective_batch_size(_effective_batch_size),
+      effective_num_elements(_effective_num_elements), eps(_eps) {
+  assert(cpu_kernels);
+  mean_ptr = (float *)malloc(sizeof(float) * effective_batch_size);
+  rstd_ptr = (float *)malloc(sizeof(float) * effective_batch_size);
+  // The CPU backward fuses the intermediate reductions per row and does not
+  // need the remaining scratch buffers
+  ds_ptr = db_ptr = scale_ptr = bias_ptr = NULL;
+}
+
+OpMeta *LayerNorm::init_task_cpu(Task const *task,
+                                 std::vector<PhysicalRegion> const &regions,
+                                 Context ctx,
+                                 Runtime *runtime) {
+  LayerNorm *ln = (LayerNorm *)task->args;
+  FFHandler handle = *((FFHandler const *)task->local_args);
+  LayerNormMeta *meta = new LayerNormMeta(handle, ln, true /*cpu_kernels*/);
+  return meta;
+}
+
+/*
+  regions[0](I): input
+  regions[1](O): output
+  regions[2](I/O): gamma
+  regions[3](I/O): beta
+*/
+void LayerNorm::forward_task_cpu(Task const *task,
+                                 std::vector<PhysicalRegion> const &regions,
+                                 Context ctx,
+                                 Runtime *runtime) {
+  LayerNormMeta const *m = *((LayerNormMeta **)task->local_args);
+  assert(task->regions.size() == regions.size());
+  float const *in_ptr = NULL;
+  float *out_ptr = NULL, *gamma_ptr = NULL, *beta_ptr = NULL;
+  Domain in_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  in_ptr = helperGetTensorPointerRO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  Domain out_domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  out_ptr = helperGetTensorPointerWO<float>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  assert(in_domain == out_domain);
+  assert(in_domain.get_volume() ==
+         m->effective_num_elements * m->effective_batch_size);
+  if (m->elementwise_affine) {
+    assert(regions.size() == 4);
+    gamma_ptr = helperGetTensorPointerRW<float>(
+        regions[2], task->regions[2], FID_DATA, ctx, runtime);
+    beta_ptr = helperGetTensorPointerRW<float>(
+        regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  } else {
+    assert(regions.size() == 2);
+  }
+  double t_start = 0;
+  if (m->profiling) {
+    t_start = Realm::Clock::current_time_in_microseconds();
+  }
+  LayerNorm::forward_kernel_cpu(m, in_ptr, out_ptr, gamma_ptr, beta_ptr);
+  if (m->profiling) {
+    double elapsed = Realm::Clock::current_time_in_microseconds() - t_start;
+    printf("[LayerNorm] CPU forward time = %.2fms\n", elapsed / 1000.0);
+  }
+}
+
+/*
+  regions[0](I): output_grad
+  regions[1](I): input
+  regions[2](I/O): input_grad
+  regions[3](I): gamma
+  regions[4](I/O): gamma_grad
+  regions[5](I/O): beta_grad
+   */
+void LayerNorm::backward_task_cpu(Task const *task,
+                                  std::vector<PhysicalRegion> const &regions,
+                                  Context ctx,
+                                  Runtime *runtime) {
+  LayerNormMeta const *m = *((LayerNormMeta **)task->local_args);
+  assert(task->regions.size() == regions.size());
+  float const *in_ptr = NULL, *out_grad_ptr = NULL, *gamma_ptr = NULL;
+  float *in_grad_ptr = NULL, *gamma_grad_ptr = NULL, *beta_grad_ptr = NULL;
+  Domain out_grad_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  out_grad_ptr = helperGetTensorPointerRO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  Domain in_domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  in_ptr = helperGetTensorPointerRO<float>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  in_grad_ptr = helperGetTensorPointerRW<float>(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  assert(in_domain == out_grad_domain);
+  assert(in_domain.get_volume() ==
+         m->effective_num_elements * m->effective_batch_size);
+  if (m->elementwise_affine) {
+    assert(regions.size() == 6);
+    gamma_ptr = helperGetTensorPointerRO<float>(
+        regions[3], task->regions[3], FID_DATA, ctx, runtime);
+    gamma_grad_ptr = helperGetTensorPointerRW<float>(
+        regions[4], task->regions[4], FID_DATA, ctx, runtime);
+    beta_grad_ptr = helperGetTensorPointerRW<float>(
+        regions[5], task->regions[5], FID_DATA, ctx, runtime);
+  } else {
+    assert(regions.size() == 3);
+  }
+  LayerNorm::backward_kernel_cpu(m,
+                                 out_grad_ptr,
+                                 in_ptr,
+                                 in_grad_ptr,
+                                 gamma_ptr,
+                                 gamma_grad_ptr,
+                                 beta_grad_ptr);
+}
+
+/*static*/
+void LayerNorm::forward_kernel_cpu(LayerNormMeta const *m,
+                                   float const *in_ptr,
+                                   float *out_ptr,
+                                   float const *gamma_ptr,
+                                   float const *beta_ptr) {
+  int64_t const M = m->effective_batch_size;
+  int64_t const N = m->effective_num_elements;
+  int64_t grain = std::max((int64_t)1, (int64_t)16384 / N);
+  cpu_parallel_for(0, M, grain, [&](int64_t lo, int64_t hi) {
+    for (int64_t i = lo; i < hi; i++) {
+      float const *x = in_ptr + i * N;
+      float *y = out_ptr + i * N;
+      // Mean and variance are accumulated together in one sweep of the row
+      float sum1 = 0.0f, sum2 = 0.0f;
+      cpu_vec_moments(x, N, &sum1, &sum2);
+      float mean = sum1 / N;
+      float var = std::max(sum2 / N - mean * mean, 0.0f);
+      float rstd = 1.0f / std::sqrt(var + m->eps);
+      m->mean_ptr[i] = mean;
+      m->rstd_ptr[i] = rstd;
+      if (gamma_ptr != NULL) {
+        for (int64_t j = 0; j < N; j++) {
+          y[j] = (x[j] - mean) * rstd * gamma_ptr[j] + beta_ptr[j];
+        }
+      } else {
+        for (int64_t j = 0; j < N; j++) {
+          y[j] = (x[j] - mean) * rstd;
+        }
+      }
+    }
+  });
+}
+
+/*static*/
+void LayerNorm::backward_kernel_cpu(LayerNormMeta const *m,
+                                    float const *output_grad_ptr,
+                                    float const *input_ptr,
+                                    float *input_grad_ptr,
+                                    float const *gamma_ptr,
+                                    float *gamma_grad_ptr,
+                                    float *beta_grad_ptr) {
+  int64_t const M = m->effective_batch_size;
+  int64_t const N = m->effective_num_elements;
+  int64_t grain = std::max((int64_t)1, (int64_t)16384 / N);
+  // Same formulation as the GPU kernels: dX = rstd * gamma * dY + c1 * X + c2
+  // where c1 and c2 are derived from per-row reductions of dY * gamma
+  cpu_parallel_for(0, M, grain, [&](int64_t lo, int64_t hi) {
+    for (int64_t i = lo; i < hi; i++) {
+      float const *dy = output_grad_ptr + i * N;
+      float const *x = input_ptr + i * N;
+      float *dx = input_grad_ptr + i * N;
+      float ds = 0.0f, db = 0.0f;
+      for (int64_t j = 0; j < N; j++) {
+        float g = gamma_ptr == NULL ? 1.0f : gamma_ptr[j];
+        ds += dy[j] * x[j] * g;
+        db += dy[j] * g;
+      }
+      float mean = m->mean_ptr[i], rstd = m->rstd_ptr[i];
+      float s = 1.0f / N;
+      float c1 = (db * mean - ds) * rstd * rstd * rstd * s;
+      float c2 = -(c1 * mean + db * rstd * s);
+      for (int64_t j = 0; j < N; j++) {
+        float g = gamma_ptr == NULL ? 1.0f : gamma_ptr[j];
+        dx[j] = rstd * dy[j] * g + c1 * x[j] + c2;
+      }
+    }
+  });
+  if (gamma_grad_ptr != NULL || beta_grad_ptr != NULL) {
+    // Column reductions: each chunk owns a disjoint range of columns and
+    // walks all rows, so no synchronization is needed
+    cpu_parallel_for(0, N, 64, [&](int64_t lo, int64_t hi) {
+      for (int64_t j = lo; j < hi; j++) {
+        if (gamma_grad_ptr != NULL) {
+          gamma_grad_ptr[j] = 0.0f;
+        }
+        if (beta_grad_ptr != NULL) {
+          beta_grad_ptr[j] = 0.0f;
+        }
+      }
+      for (int64_t i = 0; i < M; i++) {
+        float const *dy = output_grad_ptr + i * N;
+        float const *x = input_ptr + i * N;
+        float mean = m->mean_ptr[i], rstd = m->rstd_ptr[i];
+        for (int64_t j = lo; j < hi; j++) {
+          if (gamma_grad_ptr != NULL) {
+            gamma_grad_ptr[j] += dy[j] * (x[j] - mean) * rstd;
+          }
+          if (beta_grad_ptr != NULL) {
+            beta_grad_ptr[j] += dy[j];
+          }
+        }
+      }
+    });
+  }
+}
+
 bool LayerNorm::measure_operator_cost(Simulator *sim,
                                       MachineView const &mv,
                                       CostMetrics &cost_metrics) const {
@@ -16,7 +16,11 @@
 #include "flexflow/ops/softmax.h"
 #include "flexflow/model.h"
 #include "flexflow/ops/kernels/softmax_kernels.h"
+#include "flexflow/utils/cpu_helper.h"
 #include "flexflow/utils/hash_utils.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 namespace FlexFlow {
 // declare Legion names
@@ -334,6 +338,78 @@ void Softmax::backward_task_with_dim(Task const *task,
       m, acc_input_grad.ptr, acc_output_grad.ptr, acc_input_grad.rect.volume());
 }
 
+OpMeta *Softmax::init_task_cpu(Task const *task,
+                               std::vector<PhysicalRegion> const &regions,
+                               Context ctx,
+                               Runtime *runtime) {
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  Softmax const *softmax = (Softmax *)task->args;
+  FFHandler handle = *((FFHandler const *)task->local_args);
+  // The CPU kernels derive everything from the region shapes and do not
+  // need any cuDNN descriptors
+  OpMeta *m = new OpMeta(handle, softmax);
+  m->profiling = softmax->profiling;
+  return m;
+}
+
+/*
+  regions[0](I): input
+  regions[1](O): output
+*/
+void Softmax::forward_task_cpu(Task const *task,
+                               std::vector<PhysicalRegion> const &regions,
+                               Context ctx,
+                               Runtime *runtime) {
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  OpMeta const *m = *((OpMeta **)task->local_args);
+  Domain in_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Domain out_domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  assert(in_domain == out_domain);
+  float const *input_ptr = helperGetTensorPointerRO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float *output_ptr = helperGetTensorPointerWO<float>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  size_t row_size = in_domain.hi()[0] - in_domain.lo()[0] + 1;
+  size_t num_rows = in_domain.get_volume() / row_size;
+  double t_start = 0;
+  if (m->profiling) {
+    t_start = Realm::Clock::current_time_in_microseconds();
+  }
+  forward_kernel_cpu(input_ptr, output_ptr, num_rows, row_size);
+  if (m->profiling) {
+    double elapsed = Realm::Clock::current_time_in_microseconds() - t_start;
+    log_measure.debug("[Softmax] CPU forward time = %.2fms\n",
+                      elapsed / 1000.0);
+  }
+}
+
+/*
+  regions[0](I/O): input_grad
+  regions[1](I): output_grad
+*/
+void Softmax::backward_task_cpu(Task const *task,
+                                std::vector<PhysicalRegion> const &regions,
+                                Context ctx,
+                                Runtime *runtime) {
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  Domain in_grad_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Domain out_grad_domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  assert(in_grad_domain == out_grad_domain);
+  float *input_grad_ptr = helperGetTensorPointerRW<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float const *output_grad_ptr = helperGetTensorPointerRO<float>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  backward_kernel_cpu(
+      input_grad_ptr, output_grad_ptr, in_grad_domain.get_volume());
+}
+
 bool Softmax::get_int_parameter(PMParameter para, int *value) const {
   switch (para) {
     case PM_SOFTMAX_DIM:
@@ -406,6 +482,79 @@ bool Softmax::measure_operator_cost(Simulator *sim,
   return true;
 }
 
+namespace Kernels {
+namespace Softmax {
+
+// Number of elements handled per chunk of the CPU thread pool
+static int64_t const CPU_GRAIN_ELEMENTS = 16384;
+// Rows are scanned in blocks of this many elements so that the running
+// maximum is only rescaled once per block
+static size_t const CPU_BLOCK_SIZE = 16;
+
+static void softmax_row_cpu(float const *x, float *y, size_t n) {
+  // Online softmax: a single pass computes the maximum together with the
+  // sum of exponentials rescaled to the current maximum, and a second pass
+  // writes the normalized outputs.
+  float max_val = -std::numeric_limits<float>::infinity();
+  float sum = 0.0f;
+  for (size_t i = 0; i < n; i += CPU_BLOCK_SIZE) {
+    size_t end = std::min(n, i + CPU_BLOCK_SIZE);
+    float block_max = max_val;
+    for (size_t j = i; j < end; j++) {
+      block_max = std::max(block_max, x[j]);
+    }
+    if (block_max > max_val) {
+      sum *= std::exp(max_val - block_max);
+      max_val = block_max;
+    }
+    for (size_t j = i; j < end; j++) {
+      float e = std::exp(x[j] - max_val);
+      y[j] = e;
+      sum += e;
+    }
+  }
+  // y currently holds exp(x - m_i) for the running maximum m_i seen when the
+  // element's block was visited; fold in the correction to the final maximum
+  float block_max = -std::numeric_limits<float>::infinity();
+  for (size_t i = 0; i < n; i += CPU_BLOCK_SIZE) {
+    size_t end = std::min(n, i + CPU_BLOCK_SIZE);
+    for (size_t j = i; j < end; j++) {
+      block_max = std::max(block_max, x[j]);
+    }
+    float scale = std::exp(block_max - max_val) / sum;
+    cpu_vec_scale(scale, y + i, end - i);
+  }
+}
+
+void forward_kernel_cpu(float const *input_ptr,
+                        float *output_ptr,
+                        size_t num_rows,
+                        size_t row_size) {
+  int64_t grain =
+      std::max((int64_t)1, CPU_GRAIN_ELEMENTS / (int64_t)row_size);
+  cpu_parallel_for(0, num_rows, grain, [&](int64_t lo, int64_t hi) {
+    for (int64_t r = lo; r < hi; r++) {
+      softmax_row_cpu(
+          input_ptr + r * row_size, output_ptr + r * row_size, row_size);
+    }
+  });
+}
+
+// Matches the GPU variant: the upstream softmax_cross_entropy loss already
+// produces the gradient w.r.t. the logits, so backward is a copy
+void backward_kernel_cpu(float *input_grad_ptr,
+                         float const *output_grad_ptr,
+                         size_t num_elements) {
+  cpu_parallel_for(
+      0, num_elements, CPU_GRAIN_ELEMENTS, [&](int64_t lo, int64_t hi) {
+        std::copy(
+            output_grad_ptr + lo, output_grad_ptr + hi, input_grad_ptr + lo);
+      });
+}
+
+} // namespace Softmax
+} // namespace Kernels
+
 }; // namespace FlexFlow
 
 namespace std {
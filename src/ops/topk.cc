@@ -15,8 +15,10 @@
 
 #include "flexflow/ops/topk.h"
 #include "flexflow/model.h"
+#include "flexflow/utils/cpu_helper.h"
 #include "flexflow/utils/hash_utils.h"
 #include "legion/legion_utilities.h"
+#include <algorithm>
 
 namespace FlexFlow {
 // declare Legion names
@@ -334,6 +336,188 @@ void TopK::backward_task(Task const *task,
       m, value_grad_ptr, indices_ptr, in_grad_ptr, batch_size, length, k);
 }
 
+/*
+  regions[0](I): input
+  regions[1](O): values
+  regions[2](O): indices
+*/
+void TopK::forward_task_cpu(Task const *task,
+                            std::vector<PhysicalRegion> const &regions,
+                            Context ctx,
+                            Runtime *runtime) {
+  assert(regions.size() == 3);
+  assert(task->regions.size() == 3);
+  TopKMeta const *m = *((TopKMeta **)task->local_args);
+  Domain in_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Domain out1_domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  Domain out2_domain = runtime->get_index_space_domain(
+      ctx, task->regions[2].region.get_index_space());
+  assert(out1_domain == out2_domain);
+  for (int i = 1; i < in_domain.get_dim(); i++) {
+    assert(in_domain.lo()[i] == out1_domain.lo()[i]);
+    assert(in_domain.hi()[i] == out1_domain.hi()[i]);
+  }
+  float const *in_ptr = helperGetTensorPointerRO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float *value_ptr = helperGetTensorPointerWO<float>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  int *index_ptr = helperGetTensorPointerWO<int>(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+
+  int length = in_domain.hi()[0] - in_domain.lo()[0] + 1;
+  int k = out1_domain.hi()[0] - out1_domain.lo()[0] + 1;
+  size_t batch_size = in_domain.get_volume() / length;
+  double t_start = 0;
+  if (m->profiling) {
+    t_start = Realm::Clock::current_time_in_microseconds();
+  }
+  TopK::forward_kernel_cpu(
+      in_ptr, value_ptr, index_ptr, batch_size, length, k, m->sorted);
+  if (m->profiling) {
+    double elapsed = Realm::Clock::current_time_in_microseconds() - t_start;
+    log_measure.debug("[TopK] CPU forward time = %.2fms\n", elapsed / 1000.0);
+  }
+}
+
+/*
+  regions[0](I): out1_grad
+  regions[1](I): out2
+  regions[2](I/0): in_grad
+*/
+void TopK::backward_task_cpu(Task const *task,
+                             std::vector<PhysicalRegion> const &regions,
+                             Context ctx,
+                             Runtime *runtime) {
+  assert(regions.size() == 3);
+  assert(task->regions.size() == 3);
+  Domain out1_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Domain out2_domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  Domain in_domain = runtime->get_index_space_domain(
+      ctx, task->regions[2].region.get_index_space());
+  assert(out1_domain == out2_domain);
+  for (int i = 1; i < in_domain.get_dim(); i++) {
+    assert(in_domain.lo()[i] == out1_domain.lo()[i]);
+    assert(in_domain.hi()[i] == out1_domain.hi()[i]);
+  }
+  float const *value_grad_ptr = helperGetTensorPointerRO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  int const *indices_ptr = helperGetTensorPointerRO<int>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  float *in_grad_ptr = helperGetTensorPointerRW<float>(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+
+  int length = in_domain.hi()[0] - in_domain.lo()[0] + 1;
+  int k = out1_domain.hi()[0] - out1_domain.lo()[0] + 1;
+  size_t batch_size = in_domain.get_volume() / length;
+  TopK::backward_kernel_cpu(
+      value_grad_ptr, indices_ptr, in_grad_ptr, batch_size, length, k);
+}
+
+// Number of input elements handled per chunk of the CPU thread pool
+static int64_t const TOPK_CPU_GRAIN_ELEMENTS = 16384;
+
+typedef std::pair<float, int> TopKEntry;
+
+// Larger values win; ties go to the lower index, as in the GPU kernel
+static inline bool topk_entry_better(TopKEntry const &a, TopKEntry const &b) {
+  return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+// Keeps the k best entries of a row in a min-heap (the worst kept entry sits
+// at heap[0]). Only elements strictly greater than the current minimum can
+// enter the heap, so with AVX2 whole 8-lane blocks are rejected with a single
+// compare against the broadcast minimum and only surviving lanes are
+// inserted. Since the row is scanned in index order, rejecting ties keeps
+// the lower index.
+static void topk_row_cpu(float const *x,
+                         int length,
+                         int k,
+                         bool sorted,
+                         TopKEntry *heap,
+                         float *values,
+                         int *indices) {
+  for (int i = 0; i < k; i++) {
+    heap[i] = TopKEntry(x[i], i);
+  }
+  std::make_heap(heap, heap + k, topk_entry_better);
+  auto insert = [&](int i) {
+    if (x[i] > heap[0].first) {
+      std::pop_heap(heap, heap + k, topk_entry_better);
+      heap[k - 1] = TopKEntry(x[i], i);
+      std::push_heap(heap, heap + k, topk_entry_better);
+    }
+  };
+  int i = k;
+#ifdef FF_USE_AVX2
+  for (; i + 8 <= length; i += 8) {
+    __m256 vmin = _mm256_set1_ps(heap[0].first);
+    int mask = _mm256_movemask_ps(
+        _mm256_cmp_ps(_mm256_loadu_ps(x + i), vmin, _CMP_GT_OQ));
+    while (mask != 0) {
+      int lane = __builtin_ctz(mask);
+      mask &= mask - 1;
+      insert(i + lane);
+    }
+  }
+#endif
+  for (; i < length; i++) {
+    insert(i);
+  }
+  if (sorted) {
+    std::sort_heap(heap, heap + k, topk_entry_better);
+  }
+  for (int j = 0; j < k; j++) {
+    values[j] = heap[j].first;
+    indices[j] = heap[j].second;
+  }
+}
+
+/*static*/
+void TopK::forward_kernel_cpu(float const *input_ptr,
+                              float *output_ptr,
+                              int *indices_ptr,
+                              size_t batch_size,
+                              int length,
+                              int k,
+                              bool sorted) {
+  assert(k <= length);
+  int64_t grain = std::max((int64_t)1, TOPK_CPU_GRAIN_ELEMENTS / length);
+  cpu_parallel_for(0, batch_size, grain, [&](int64_t lo, int64_t hi) {
+    std::vector<TopKEntry> heap(k);
+    for (int64_t r = lo; r < hi; r++) {
+      topk_row_cpu(input_ptr + r * length,
+                   length,
+                   k,
+                   sorted,
+                   heap.data(),
+                   output_ptr + r * k,
+                   indices_ptr + r * k);
+    }
+  });
+}
+
+/*static*/
+void TopK::backward_kernel_cpu(float const *value_grad_ptr,
+                               int const *indices_ptr,
+                               float *in_grad_ptr,
+                               size_t batch_size,
+                               int length,
+                               int k) {
+  int64_t grain = std::max((int64_t)1, TOPK_CPU_GRAIN_ELEMENTS / length);
+  cpu_parallel_for(0, batch_size, grain, [&](int64_t lo, int64_t hi) {
+    for (int64_t r = lo; r < hi; r++) {
+      for (int j = 0; j < k; j++) {
+        in_grad_ptr[r * length + indices_ptr[r * k + j]] +=
+            value_grad_ptr[r * k + j];
+      }
+    }
+  });
+}
+
 void TopK::serialize(Legion::Serializer &sez) const {
   sez.serialize(this->k);
   sez.serialize(this->sorted);
@@ -15,6 +15,7 @@
 
 #include "flexflow/parallel_ops/fused_parallel_op.h"
 #include "flexflow/model.h"
+#include "flexflow/parallel_ops/kernels/fused_parallel_op_kernels.h"
 #include "flexflow/utils/hash_utils.h"
 
 namespace FlexFlow {
@@ -38,6 +39,17 @@ using Legion::Task;
 using Legion::TaskArgument;
 using Legion::TaskLauncher;
 
+using Kernels::FusedParallelOp::CopyPlan;
+
+namespace {
+
+struct FusedParallelOpArgs {
+  DataType data_type;
+  CopyPlan plan;
+};
+
+} // namespace
+
 /* Params */
 bool operator==(ParallelOpInfo const &lhs, ParallelOpInfo const &rhs) {
   return lhs.op_type == rhs.op_type &&
@@ -51,7 +63,18 @@ bool operator==(FusedParallelOpParams const &lhs,
 }
 
 bool FusedParallelOpParams::is_valid(ParallelTensorShape const &input) const {
-  return input.is_valid();
+  if (!input.is_valid()) {
+    return false;
+  }
+  // Chains whose replica mapping is too large for a CopyPlan stay unfused
+  std::vector<int> sizes;
+  for (int i = 0; i < input.num_dims; i++) {
+    sizes.push_back(input.dims[i].size);
+  }
+  tl::optional<CopyPlan> plan =
+      Kernels::FusedParallelOp::plan_copy(sizes, this->parallel_ops);
+  return plan.has_value() &&
+         Kernels::FusedParallelOp::transpose_plan(plan.value()).has_value();
 }
 
 FusedParallelOpParams FusedParallelOp::get_params() const {
@@ -106,6 +129,14 @@ FusedParallelOp::FusedParallelOp(
   }
   outputs[0] = model.create_parallel_tensor_legion_ordering(
       numdim, dims, inputs[0]->data_type, this);
+  std::vector<int> sizes;
+  for (int i = 0; i < numdim; i++) {
+    sizes.push_back(_input->dims[i].size);
+  }
+  forward_plan =
+      Kernels::FusedParallelOp::plan_copy(sizes, _parallel_ops).value();
+  backward_plan =
+      Kernels::FusedParallelOp::transpose_plan(forward_plan).value();
 }
 
 FusedParallelOp::FusedParallelOp(FFModel &model,
@@ -155,9 +186,12 @@ void FusedParallelOp::init(FFModel const &ff) {
   Runtime *runtime = ff.config.lg_hlr;
   assert(numOutputs == 1);
   assert(numInputs == 1);
+  FusedParallelOpArgs args;
+  args.data_type = inputs[0]->data_type;
+  args.plan = forward_plan;
   IndexLauncher launcher(FUSED_PARALLELOP_FWD_TASK_ID,
                          outputs[0]->parallel_is,
-                         TaskArgument(NULL, 0),
+                         TaskArgument(&args, sizeof(FusedParallelOpArgs)),
                          argmap,
                          Predicate::TRUE_PRED,
                          false /*must*/,
@@ -178,16 +212,35 @@ void FusedParallelOp::init(FFModel const &ff) {
 void FusedParallelOp::create_input_partition(FFModel &ff) {
   assert(outputs[0]->part != LogicalPartition::NO_PART);
   assert(inputs[0]->part != LogicalPartition::NO_PART);
-  ff.create_disjoint_partition(outputs[0]->num_dims,
-                               outputs[0]->dims,
-                               outputs[0]->parallel_is,
-                               inputs[0]->region,
-                               input_lp);
-  ff.create_disjoint_partition(inputs[0]->num_dims,
-                               inputs[0]->dims,
-                               inputs[0]->parallel_is,
-                               outputs[0]->region_grad,
-                               output_grad_lp);
+  int replica_dim = forward_plan.replica_dim;
+  if (replica_dim == -1) {
+    // the chain only moves shards, so each output shard reads the same
+    // rectangle of the input
+    ff.create_disjoint_partition(outputs[0]->num_dims,
+                                 outputs[0]->dims,
+                                 outputs[0]->parallel_is,
+                                 inputs[0]->region,
+                                 input_lp);
+    ff.create_disjoint_partition(inputs[0]->num_dims,
+                                 inputs[0]->dims,
+                                 inputs[0]->parallel_is,
+                                 outputs[0]->region_grad,
+                                 output_grad_lp);
+  } else {
+    // every shard gathers from all replicas on the other side of the chain
+    ff.create_aliased_partition(outputs[0]->num_dims,
+                                outputs[0]->dims,
+                                replica_dim,
+                                outputs[0]->parallel_is,
+                                inputs[0]->region,
+                                input_lp);
+    ff.create_aliased_partition(inputs[0]->num_dims,
+                                inputs[0]->dims,
+                                replica_dim,
+                                inputs[0]->parallel_is,
+                                outputs[0]->region_grad,
+                                output_grad_lp);
+  }
 }
 
 void FusedParallelOp::forward(FFModel const &ff) {
@@ -196,9 +249,12 @@ void FusedParallelOp::forward(FFModel const &ff) {
   Runtime *runtime = ff.config.lg_hlr;
   assert(numOutputs == 1);
   assert(numInputs == 1);
+  FusedParallelOpArgs args;
+  args.data_type = inputs[0]->data_type;
+  args.plan = forward_plan;
   IndexLauncher launcher(FUSED_PARALLELOP_FWD_TASK_ID,
                          outputs[0]->parallel_is,
-                         TaskArgument(NULL, 0),
+                         TaskArgument(&args, sizeof(FusedParallelOpArgs)),
                          argmap,
                          Predicate::TRUE_PRED,
                          false /*must*/,
@@ -222,9 +278,12 @@ void FusedParallelOp::backward(FFModel const &ff) {
   Runtime *runtime = ff.config.lg_hlr;
   assert(numOutputs == 1);
   assert(numInputs == 1);
+  FusedParallelOpArgs args;
+  args.data_type = inputs[0]->data_type;
+  args.plan = backward_plan;
   IndexLauncher launcher(FUSED_PARALLELOP_BWD_TASK_ID,
                          inputs[0]->parallel_is,
-                         TaskArgument(NULL, 0),
+                         TaskArgument(&args, sizeof(FusedParallelOpArgs)),
                          argmap,
                          Predicate::TRUE_PRED,
                          false /*must*/,
@@ -283,15 +342,91 @@ Node FFModel::get_or_create_fused_parallel_node(
   return get_or_create_node<FusedParallelOp>(input, params);
 }
 
+/*
+  regions[0](I): input
+  regions[1](O): output
+*/
 void FusedParallelOp::forward_task(Task const *task,
                                    std::vector<PhysicalRegion> const &regions,
                                    Context ctx,
-                                   Runtime *runtime) {}
+                                   Runtime *runtime) {
+  gather_task(task, regions, ctx, runtime, false /*accumulate*/);
+}
 
+/*
+  regions[0](I): output_grad
+  regions[1](I/O): input_grad
+*/
 void FusedParallelOp::backward_task(Task const *task,
                                     std::vector<PhysicalRegion> const &regions,
                                     Context ctx,
-                                    Runtime *runtime) {}
+                                    Runtime *runtime) {
+  gather_task(task, regions, ctx, runtime, true /*accumulate*/);
+}
+
+void FusedParallelOp::gather_task(Task const *task,
+                                  std::vector<PhysicalRegion> const &regions,
+                                  Context ctx,
+                                  Runtime *runtime,
+                                  bool accumulate) {
+  assert(regions.size() == 2);
+  assert(task->regions.size() == 2);
+  FusedParallelOpArgs const *args = (FusedParallelOpArgs const *)task->args;
+  if (args->data_type == DT_FLOAT) {
+    gather_task_with_type<float>(
+        task, regions, ctx, runtime, args->plan, accumulate);
+  } else if (args->data_type == DT_DOUBLE) {
+    gather_task_with_type<double>(
+        task, regions, ctx, runtime, args->plan, accumulate);
+  } else if (args->data_type == DT_INT32) {
+    gather_task_with_type<int32_t>(
+        task, regions, ctx, runtime, args->plan, accumulate);
+  } else if (args->data_type == DT_INT64) {
+    gather_task_with_type<int64_t>(
+        task, regions, ctx, runtime, args->plan, accumulate);
+  } else {
+    assert(false && "Unsupported data type in FusedParallelOp");
+  }
+}
+
+template <typename T>
+void FusedParallelOp::gather_task_with_type(
+    Task const *task,
+    std::vector<PhysicalRegion> const &regions,
+    Context ctx,
+    Runtime *runtime,
+    CopyPlan const &plan,
+    bool accumulate) {
+  Domain src_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Domain dst_domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  int replica_dim = plan.replica_dim;
+  for (int i = 0; i < dst_domain.get_dim(); i++) {
+    if (i != replica_dim) {
+      assert(src_domain.lo()[i] == dst_domain.lo()[i]);
+      assert(src_domain.hi()[i] == dst_domain.hi()[i]);
+    }
+  }
+  int dst_lo = 0, num_rows = 1;
+  if (replica_dim != -1) {
+    // the source holds all replicas, the destination a range of them
+    assert(src_domain.lo()[replica_dim] == 0);
+    assert(src_domain.hi()[replica_dim] == plan.num_src - 1);
+    dst_lo = dst_domain.lo()[replica_dim];
+    num_rows = dst_domain.hi()[replica_dim] - dst_lo + 1;
+  }
+  size_t row_volume = dst_domain.get_volume() / num_rows;
+  T const *src_ptr = helperGetTensorPointerRO<T>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  T *dst_ptr = accumulate
+                   ? helperGetTensorPointerRW<T>(
+                         regions[1], task->regions[1], FID_DATA, ctx, runtime)
+                   : helperGetTensorPointerWO<T>(
+                         regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  Kernels::FusedParallelOp::gather_kernel<T>(
+      plan, src_ptr, dst_ptr, row_volume, dst_lo, num_rows, accumulate);
+}
 
 }; // namespace FlexFlow
 
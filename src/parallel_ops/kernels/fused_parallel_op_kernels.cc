@@ -0,0 +1,127 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/parallel_ops/kernels/fused_parallel_op_kernels.h"
+#include <cassert>
+
+namespace FlexFlow {
+namespace Kernels {
+namespace FusedParallelOp {
+
+namespace {
+
+// weights[r][s] is the weight of source replica s in destination replica r.
+// Returns nullopt if the mapping does not fit in a CopyPlan
+tl::optional<CopyPlan> compress(std::vector<std::vector<int>> const &weights,
+                                int replica_dim,
+                                int num_src) {
+  if (weights.size() > MAX_FUSED_PARALLEL_REPLICAS) {
+    return tl::nullopt;
+  }
+  CopyPlan plan;
+  plan.replica_dim = replica_dim;
+  plan.num_src = num_src;
+  plan.num_dst = weights.size();
+  plan.num_entries = 0;
+  for (int r = 0; r < plan.num_dst; r++) {
+    plan.row_start[r] = plan.num_entries;
+    for (int s = 0; s < num_src; s++) {
+      if (weights[r][s] != 0) {
+        if (plan.num_entries == MAX_FUSED_PARALLEL_ENTRIES) {
+          return tl::nullopt;
+        }
+        plan.source[plan.num_entries] = s;
+        plan.weight[plan.num_entries] = weights[r][s];
+        plan.num_entries++;
+      }
+    }
+  }
+  plan.row_start[plan.num_dst] = plan.num_entries;
+  return plan;
+}
+
+} // namespace
+
+tl::optional<CopyPlan> plan_copy(std::vector<int> const &sizes,
+                                 std::vector<ParallelOpInfo> const &ops) {
+  int replica_dim = -1;
+  for (ParallelOpInfo const &info : ops) {
+    if (info.op_type == OP_REPLICATE || info.op_type == OP_REDUCTION) {
+      assert(replica_dim == -1 || replica_dim == info.parallel_dim);
+      replica_dim = info.parallel_dim;
+    }
+  }
+  if (replica_dim == -1) {
+    return compress({{1}}, -1, 1);
+  }
+  // Currently only support the outter most dimension
+  assert(replica_dim == (int)sizes.size() - 1);
+  int num_src = sizes[replica_dim];
+  std::vector<std::vector<int>> weights(num_src, std::vector<int>(num_src, 0));
+  for (int s = 0; s < num_src; s++) {
+    weights[s][s] = 1;
+  }
+  for (ParallelOpInfo const &info : ops) {
+    if (info.parallel_dim != replica_dim) {
+      continue;
+    }
+    int size = weights.size();
+    switch (info.op_type) {
+      case OP_REPLICATE: {
+        // replica r is a copy of the input's replica r % size
+        std::vector<std::vector<int>> next;
+        for (int r = 0; r < size * info.parallel_degree; r++) {
+          next.push_back(weights[r % size]);
+        }
+        weights.swap(next);
+        break;
+      }
+      case OP_REDUCTION: {
+        // replica r sums the input's replicas r, r + size', r + 2 * size'...
+        assert(size % info.parallel_degree == 0);
+        int next_size = size / info.parallel_degree;
+        std::vector<std::vector<int>> next(next_size,
+                                           std::vector<int>(num_src, 0));
+        for (int r = 0; r < size; r++) {
+          for (int s = 0; s < num_src; s++) {
+            next[r % next_size][s] += weights[r][s];
+          }
+        }
+        weights.swap(next);
+        break;
+      }
+      default: {
+        // Repartition and Combine only move shards
+        break;
+      }
+    }
+  }
+  return compress(weights, replica_dim, num_src);
+}
+
+tl::optional<CopyPlan> transpose_plan(CopyPlan const &plan) {
+  std::vector<std::vector<int>> weights(plan.num_src,
+                                        std::vector<int>(plan.num_dst, 0));
+  for (int r = 0; r < plan.num_dst; r++) {
+    for (int e = plan.row_start[r]; e < plan.row_start[r + 1]; e++) {
+      weights[plan.source[e]][r] += plan.weight[e];
+    }
+  }
+  return compress(weights, plan.replica_dim, plan.num_dst);
+}
+
+} // namespace FusedParallelOp
+} // namespace Kernels
+} // namespace FlexFlow
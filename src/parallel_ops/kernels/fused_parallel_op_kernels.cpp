@@ -0,0 +1,111 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/parallel_ops/kernels/fused_parallel_op_kernels.h"
+#include "flexflow/utils/hip_helper.h"
+#include <hip/hip_runtime.h>
+
+namespace FlexFlow {
+namespace Kernels {
+namespace FusedParallelOp {
+
+// Every destination element is produced by one thread that reads its
+// sources directly, so the chain's intermediate replicas never exist
+template <typename T>
+__global__ void fused_parallel_gather(CopyPlan const plan,
+                                      T const *src_ptr,
+                                      T *dst_ptr,
+                                      size_t row_volume,
+                                      int dst_lo,
+                                      size_t volume,
+                                      bool accumulate) {
+  CUDA_KERNEL_LOOP(i, volume) {
+    int row = dst_lo + i / row_volume;
+    size_t offset = i % row_volume;
+    T value = accumulate ? dst_ptr[i] : (T)0;
+    for (int e = plan.row_start[row]; e < plan.row_start[row + 1]; e++) {
+      value +=
+          (T)plan.weight[e] * src_ptr[plan.source[e] * row_volume + offset];
+    }
+    dst_ptr[i] = value;
+  }
+}
+
+template <typename T>
+void gather_kernel(CopyPlan const &plan,
+                   T const *src_ptr,
+                   T *dst_ptr,
+                   size_t row_volume,
+                   int dst_lo,
+                   int num_rows,
+                   bool accumulate) {
+  hipStream_t stream;
+  checkCUDA(get_legion_stream(&stream));
+  size_t volume = row_volume * num_rows;
+  if (!accumulate && plan.replica_dim == -1) {
+    // the chain only moves shards, which Legion did when mapping the regions
+    checkCUDA(hipMemcpyAsync(dst_ptr,
+                             src_ptr,
+                             volume * sizeof(T),
+                             hipMemcpyDeviceToDevice,
+                             stream));
+    return;
+  }
+  hipLaunchKernelGGL(HIP_KERNEL_NAME(fused_parallel_gather<T>),
+                     GET_BLOCKS(volume),
+                     CUDA_NUM_THREADS,
+                     0,
+                     stream,
+                     plan,
+                     src_ptr,
+                     dst_ptr,
+                     row_volume,
+                     dst_lo,
+                     volume,
+                     accumulate);
+}
+
+template void gather_kernel<float>(CopyPlan const &plan,
+                                   float const *src_ptr,
+                                   float *dst_ptr,
+                                   size_t row_volume,
+                                   int dst_lo,
+                                   int num_rows,
+                                   bool accumulate);
+template void gather_kernel<double>(CopyPlan const &plan,
+                                    double const *src_ptr,
+                                    double *dst_ptr,
+                                    size_t row_volume,
+                                    int dst_lo,
+                                    int num_rows,
+                                    bool accumulate);
+template void gather_kernel<int32_t>(CopyPlan const &plan,
+                                     int32_t const *src_ptr,
+                                     int32_t *dst_ptr,
+                                     size_t row_volume,
+                                     int dst_lo,
+                                     int num_rows,
+                                     bool accumulate);
+template void gather_kernel<int64_t>(CopyPlan const &plan,
+                                     int64_t const *src_ptr,
+                                     int64_t *dst_ptr,
+                                     size_t row_volume,
+                                     int dst_lo,
+                                     int num_rows,
+                                     bool accumulate);
+
+} // namespace FusedParallelOp
+} // namespace Kernels
+} // namespace FlexFlow
@@ -0,0 +1,260 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/checkpoint.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace FlexFlow {
+
+namespace {
+
+// Linear offset of point in [lo, hi] with dim 0 contiguous
+size_t get_offset(std::vector<int> const &point,
+                  std::vector<int> const &lo,
+                  std::vector<int> const &hi) {
+  size_t offset = 0, stride = 1;
+  for (size_t i = 0; i < point.size(); i++) {
+    offset += (point[i] - lo[i]) * stride;
+    stride *= hi[i] - lo[i] + 1;
+  }
+  return offset;
+}
+
+}; // namespace
+
+size_t CheckpointShard::get_volume() const {
+  size_t volume = 1;
+  for (size_t i = 0; i < lo.size(); i++) {
+    volume *= hi[i] - lo[i] + 1;
+  }
+  return volume;
+}
+
+bool CheckpointManifest::save(std::string const &dir) const {
+  std::string filename = dir + "/" + FILENAME;
+  std::string tmp_filename = filename + ".tmp";
+  {
+    std::ofstream file(tmp_filename);
+    if (!file) {
+      fprintf(stderr,
+              "Failed to open checkpoint manifest %s\n",
+              tmp_filename.c_str());
+      return false;
+    }
+    file.precision(std::numeric_limits<double>::max_digits10);
+    file << "# FlexFlow checkpoint\n";
+    file << "optimizer " << optimizer << " " << optimizer_state.size();
+    for (double value : optimizer_state) {
+      file << " " << value;
+    }
+    file << "\n";
+    for (CheckpointTensor const &tensor : tensors) {
+      file << "tensor " << tensor.name << " " << (int)tensor.data_type << " "
+           << tensor.element_size << " " << tensor.dims.size();
+      for (int dim : tensor.dims) {
+        file << " " << dim;
+      }
+      file << " " << tensor.shards.size() << "\n";
+      for (CheckpointShard const &shard : tensor.shards) {
+        file << "shard " << shard.filename;
+        for (int lo : shard.lo) {
+          file << " " << lo;
+        }
+        for (int hi : shard.hi) {
+          file << " " << hi;
+        }
+        file << "\n";
+      }
+    }
+    if (!file.flush()) {
+      fprintf(stderr,
+              "Failed to write checkpoint manifest %s\n",
+              tmp_filename.c_str());
+      return false;
+    }
+  }
+  return std::rename(tmp_filename.c_str(), filename.c_str()) == 0;
+}
+
+bool CheckpointManifest::load(std::string const &dir) {
+  std::string filename = dir + "/" + FILENAME;
+  std::ifstream file(filename);
+  if (!file) {
+    fprintf(
+        stderr, "Failed to open checkpoint manifest %s\n", filename.c_str());
+    return false;
+  }
+  optimizer_state.clear();
+  tensors.clear();
+  std::string line;
+  int line_number = 0;
+  size_t num_shards = 0;
+  while (std::getline(file, line)) {
+    line_number++;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream iss(line);
+    std::string kind;
+    iss >> kind;
+    bool valid = false;
+    if (kind == "optimizer") {
+      size_t num_values = 0;
+      valid = (bool)(iss >> optimizer >> num_values);
+      for (size_t i = 0; valid && i < num_values; i++) {
+        double value;
+        valid = (bool)(iss >> value);
+        optimizer_state.push_back(value);
+      }
+    } else if (kind == "tensor" && num_shards == 0) {
+      CheckpointTensor tensor;
+      int data_type;
+      size_t num_dims = 0;
+      valid = (bool)(iss >> tensor.name >> data_type >> tensor.element_size >>
+                     num_dims);
+      tensor.data_type = (DataType)data_type;
+      tensor.dims.resize(num_dims);
+      for (size_t i = 0; valid && i < num_dims; i++) {
+        valid = (bool)(iss >> tensor.dims[i]);
+      }
+      valid = valid && (iss >> num_shards);
+      tensors.push_back(tensor);
+    } else if (kind == "shard" && num_shards > 0) {
+      CheckpointTensor &tensor = tensors.back();
+      CheckpointShard shard;
+      shard.lo.resize(tensor.dims.size());
+      shard.hi.resize(tensor.dims.size());
+      valid = (bool)(iss >> shard.filename);
+      for (size_t i = 0; valid && i < tensor.dims.size(); i++) {
+        valid = (bool)(iss >> shard.lo[i]);
+      }
+      for (size_t i = 0; valid && i < tensor.dims.size(); i++) {
+        valid = (bool)(iss >> shard.hi[i]);
+      }
+      tensor.shards.push_back(shard);
+      num_shards--;
+    }
+    if (!valid) {
+      fprintf(stderr,
+              "Malformed checkpoint manifest %s line %d\n",
+              filename.c_str(),
+              line_number);
+      return false;
+    }
+  }
+  if (num_shards > 0) {
+    fprintf(stderr, "Checkpoint manifest %s is truncated\n", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+CheckpointTensor const *
+    CheckpointManifest::find_tensor(std::string const &name) const {
+  for (CheckpointTensor const &tensor : tensors) {
+    if (tensor.name == name) {
+      return &tensor;
+    }
+  }
+  return nullptr;
+}
+
+bool write_checkpoint_shard(std::string const &filename,
+                            void const *data,
+                            size_t num_bytes) {
+  std::string tmp_filename = filename + ".tmp";
+  FILE *file = fopen(tmp_filename.c_str(), "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to open checkpoint shard %s\n", filename.c_str());
+    return false;
+  }
+  bool written = fwrite(data, 1, num_bytes, file) == num_bytes;
+  written = (fclose(file) == 0) && written;
+  if (!written) {
+    fprintf(stderr, "Failed to write checkpoint shard %s\n", filename.c_str());
+    return false;
+  }
+  return std::rename(tmp_filename.c_str(), filename.c_str()) == 0;
+}
+
+bool read_checkpoint_rect(std::string const &dir,
+                          CheckpointTensor const &tensor,
+                          std::vector<int> const &lo,
+                          std::vector<int> const &hi,
+                          void *data) {
+  int num_dims = (int)tensor.dims.size();
+  if (num_dims == 0 || (int)lo.size() != num_dims ||
+      (int)hi.size() != num_dims) {
+    return false;
+  }
+  size_t volume = 1, covered = 0;
+  for (int i = 0; i < num_dims; i++) {
+    volume *= hi[i] - lo[i] + 1;
+  }
+  std::vector<char> buffer;
+  for (CheckpointShard const &shard : tensor.shards) {
+    // The part of the shard inside [lo, hi]
+    std::vector<int> overlap_lo(num_dims), overlap_hi(num_dims);
+    bool overlaps = true;
+    for (int i = 0; i < num_dims; i++) {
+      overlap_lo[i] = std::max(lo[i], shard.lo[i]);
+      overlap_hi[i] = std::min(hi[i], shard.hi[i]);
+      overlaps = overlaps && overlap_lo[i] <= overlap_hi[i];
+    }
+    if (!overlaps) {
+      continue;
+    }
+    std::string filename = dir + "/" + shard.filename;
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    buffer.resize(shard.get_volume() * tensor.element_size);
+    if (!file.read(buffer.data(), buffer.size())) {
+      fprintf(stderr, "Failed to read checkpoint shard %s\n", filename.c_str());
+      return false;
+    }
+    // Copy the overlap one run along dim 0 at a time
+    size_t run_length = overlap_hi[0] - overlap_lo[0] + 1;
+    std::vector<int> point = overlap_lo;
+    while (true) {
+      memcpy((char *)data + get_offset(point, lo, hi) * tensor.element_size,
+             buffer.data() +
+                 get_offset(point, shard.lo, shard.hi) * tensor.element_size,
+             run_length * tensor.element_size);
+      covered += run_length;
+      int dim = 1;
+      while (dim < num_dims && point[dim] == overlap_hi[dim]) {
+        point[dim] = overlap_lo[dim];
+        dim++;
+      }
+      if (dim == num_dims) {
+        break;
+      }
+      point[dim]++;
+    }
+  }
+  if (covered != volume) {
+    fprintf(stderr,
+            "Checkpoint of %s does not cover the requested shard\n",
+            tensor.name.c_str());
+    return false;
+  }
+  return true;
+}
+
+}; // namespace FlexFlow
@@ -0,0 +1,110 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/cluster_sizing.h"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+namespace FlexFlow {
+
+namespace {
+
+bool parse_positive_int(std::string const &s, int &value) {
+  if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  value = std::stoi(s);
+  return value > 0;
+}
+
+}; // namespace
+
+int ClusterShapeResult::get_num_devices() const {
+  return num_nodes * workers_per_node;
+}
+
+bool parse_cluster_sizing_nodes(std::string const &spec,
+                                std::vector<int> &num_nodes) {
+  num_nodes.clear();
+  std::istringstream iss(spec);
+  std::string item;
+  while (std::getline(iss, item, ',')) {
+    size_t dash = item.find('-');
+    int lo, hi;
+    if (dash == std::string::npos) {
+      if (!parse_positive_int(item, lo)) {
+        return false;
+      }
+      hi = lo;
+    } else if (!parse_positive_int(item.substr(0, dash), lo) ||
+               !parse_positive_int(item.substr(dash + 1), hi) || lo > hi) {
+      return false;
+    }
+    for (long n = lo; n <= hi; n *= 2) {
+      num_nodes.push_back((int)n);
+    }
+  }
+  std::sort(num_nodes.begin(), num_nodes.end());
+  num_nodes.erase(std::unique(num_nodes.begin(), num_nodes.end()),
+                  num_nodes.end());
+  return !num_nodes.empty();
+}
+
+void write_cluster_sizing_table(std::ostream &os,
+                                std::vector<ClusterShapeResult> const &results,
+                                int batch_size,
+                                float device_memory_mb) {
+  if (results.empty()) {
+    return;
+  }
+  ClusterShapeResult const &base = *std::min_element(
+      results.begin(),
+      results.end(),
+      [](ClusterShapeResult const &a, ClusterShapeResult const &b) {
+        return a.get_num_devices() < b.get_num_devices();
+      });
+  double base_throughput_per_device =
+      batch_size * 1000.0 / base.iteration_time_ms / base.get_num_devices();
+  char line[256];
+  snprintf(line,
+           sizeof(line),
+           "%8s %8s %14s %14s %10s %16s\n",
+           "nodes",
+           "devices",
+           "iteration_ms",
+           "samples/s",
+           "scaling",
+           "device_mem_mb");
+  os << line;
+  for (ClusterShapeResult const &result : results) {
+    double throughput = batch_size * 1000.0 / result.iteration_time_ms;
+    double efficiency =
+        throughput / result.get_num_devices() / base_throughput_per_device;
+    snprintf(line,
+             sizeof(line),
+             "%8d %8d %14.3f %14.1f %9.1f%% %16.1f%s\n",
+             result.num_nodes,
+             result.get_num_devices(),
+             result.iteration_time_ms,
+             throughput,
+             efficiency * 100.0,
+             result.max_device_memory_mb,
+             result.max_device_memory_mb > device_memory_mb ? " (OOM)" : "");
+    os << line;
+  }
+}
+
+}; // namespace FlexFlow
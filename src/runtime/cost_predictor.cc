@@ -0,0 +1,275 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/cost_predictor.h"
+#include "flexflow/ffconst_utils.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace FlexFlow {
+
+namespace {
+
+// Regularizes the slopes of the fit, which are underdetermined when the
+// neighbors' FLOPs and bytes grow together
+constexpr double RIDGE = 1e-3;
+
+double feature(double amount) {
+  return std::log1p(amount);
+}
+
+double distance(OperatorWork const &a, OperatorWork const &b) {
+  double d_flops = feature(a.flops) - feature(b.flops);
+  double d_bytes = feature(a.bytes) - feature(b.bytes);
+  return std::sqrt(d_flops * d_flops + d_bytes * d_bytes);
+}
+
+// Solves the 3x3 system a x = b by Gaussian elimination
+bool solve3(double a[3][3], double b[3], double x[3]) {
+  for (int col = 0; col < 3; col++) {
+    int pivot = col;
+    for (int row = col + 1; row < 3; row++) {
+      if (std::abs(a[row][col]) > std::abs(a[pivot][col])) {
+        pivot = row;
+      }
+    }
+    if (std::abs(a[pivot][col]) < 1e-12) {
+      return false;
+    }
+    std::swap(a[col], a[pivot]);
+    std::swap(b[col], b[pivot]);
+    for (int row = col + 1; row < 3; row++) {
+      double factor = a[row][col] / a[col][col];
+      for (int k = col; k < 3; k++) {
+        a[row][k] -= factor * a[col][k];
+      }
+      b[row] -= factor * b[col];
+    }
+  }
+  for (int row = 2; row >= 0; row--) {
+    x[row] = b[row];
+    for (int k = row + 1; k < 3; k++) {
+      x[row] -= a[row][k] * x[k];
+    }
+    x[row] /= a[row][row];
+  }
+  return true;
+}
+
+}; // namespace
+
+CostPredictor::CostPredictor(float _max_relative_error)
+    : max_relative_error(_max_relative_error) {}
+
+void CostPredictor::add_record(CostRecord const &record) {
+  this->records[record.op_type].push_back(record);
+}
+
+size_t CostPredictor::num_records() const {
+  size_t num = 0;
+  for (auto const &kv : this->records) {
+    num += kv.second.size();
+  }
+  return num;
+}
+
+bool CostPredictor::predict_time(std::vector<CostRecord> const &candidates,
+                                 bool backward,
+                                 OperatorWork const &work,
+                                 int skip_idx,
+                                 float &time) const {
+  if (work.num_kernels == 0) {
+    // A pass without kernels, e.g. the backward pass in inference
+    time = 0.0f;
+    return true;
+  }
+  std::vector<std::pair<double, int>> neighbors;
+  for (int i = 0; i < (int)candidates.size(); i++) {
+    CostRecord const &record = candidates[i];
+    OperatorWork const &record_work =
+        backward ? record.backward : record.forward;
+    float record_time = backward ? record.backward_time : record.forward_time;
+    if (i == skip_idx || record_time <= 0.0f ||
+        record_work.num_kernels != work.num_kernels) {
+      continue;
+    }
+    neighbors.push_back({distance(work, record_work), i});
+  }
+  if ((int)neighbors.size() < MIN_NEIGHBORS) {
+    return false;
+  }
+  size_t num_neighbors = std::min(neighbors.size(), (size_t)NUM_NEIGHBORS);
+  std::partial_sort(neighbors.begin(),
+                    neighbors.begin() + num_neighbors,
+                    neighbors.end());
+  neighbors.resize(num_neighbors);
+  if (neighbors[0].first > MAX_DISTANCE) {
+    return false;
+  }
+
+  // Fit log(time) = c0 + c1 * dx_flops + c2 * dx_bytes with the features
+  // centered at the query, so that c0 is the prediction
+  std::vector<std::array<double, 3>> xs;
+  std::vector<double> ys;
+  for (auto const &neighbor : neighbors) {
+    CostRecord const &record = candidates[neighbor.second];
+    OperatorWork const &record_work =
+        backward ? record.backward : record.forward;
+    xs.push_back({1.0,
+                  feature(record_work.flops) - feature(work.flops),
+                  feature(record_work.bytes) - feature(work.bytes)});
+    ys.push_back(
+        std::log(backward ? record.backward_time : record.forward_time));
+  }
+  double ata[3][3] = {}, aty[3] = {}, coeffs[3];
+  for (size_t i = 0; i < xs.size(); i++) {
+    for (int r = 0; r < 3; r++) {
+      for (int c = 0; c < 3; c++) {
+        ata[r][c] += xs[i][r] * xs[i][c];
+      }
+      aty[r] += xs[i][r] * ys[i];
+    }
+  }
+  ata[1][1] += RIDGE;
+  ata[2][2] += RIDGE;
+  if (!solve3(ata, aty, coeffs)) {
+    return false;
+  }
+  for (size_t i = 0; i < xs.size(); i++) {
+    double fitted = coeffs[0] + coeffs[1] * xs[i][1] + coeffs[2] * xs[i][2];
+    if (std::abs(std::exp(fitted - ys[i]) - 1.0) > this->max_relative_error) {
+      return false;
+    }
+  }
+  time = std::exp(coeffs[0]);
+  return true;
+}
+
+bool CostPredictor::predict(OperatorType op_type,
+                            OperatorWork const &forward,
+                            OperatorWork const &backward,
+                            float &forward_time,
+                            float &backward_time) const {
+  auto const &it = this->records.find(op_type);
+  if (it == this->records.end()) {
+    return false;
+  }
+  float predicted_forward_time, predicted_backward_time;
+  if (!this->predict_time(
+          it->second, false, forward, -1, predicted_forward_time) ||
+      !this->predict_time(
+          it->second, true, backward, -1, predicted_backward_time)) {
+    return false;
+  }
+  forward_time = predicted_forward_time;
+  backward_time = predicted_backward_time;
+  return true;
+}
+
+std::map<OperatorType, CostPredictorEvaluation>
+    CostPredictor::evaluate() const {
+  std::map<OperatorType, CostPredictorEvaluation> evaluations;
+  for (auto const &kv : this->records) {
+    CostPredictorEvaluation &evaluation = evaluations[kv.first];
+    std::vector<CostRecord> const &candidates = kv.second;
+    for (int i = 0; i < (int)candidates.size(); i++) {
+      CostRecord const &record = candidates[i];
+      evaluation.num_records++;
+      float forward_time, backward_time;
+      if (!this->predict_time(
+              candidates, false, record.forward, i, forward_time) ||
+          !this->predict_time(
+              candidates, true, record.backward, i, backward_time)) {
+        continue;
+      }
+      double measured = record.forward_time + record.backward_time;
+      if (measured <= 0.0) {
+        continue;
+      }
+      double error =
+          std::abs(forward_time + backward_time - measured) / measured;
+      evaluation.num_confident++;
+      evaluation.mean_relative_error += error;
+      evaluation.max_relative_error =
+          std::max(evaluation.max_relative_error, error);
+    }
+    if (evaluation.num_confident > 0) {
+      evaluation.mean_relative_error /= evaluation.num_confident;
+    }
+  }
+  return evaluations;
+}
+
+bool CostPredictor::load(std::string const &filename) {
+  std::ifstream file(filename);
+  if (!file) {
+    fprintf(stderr, "Failed to open cost records file %s\n", filename.c_str());
+    return false;
+  }
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    line_number++;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream iss(line);
+    std::string op_name;
+    CostRecord record;
+    if (!(iss >> op_name >> record.forward.flops >> record.forward.bytes >>
+          record.forward.num_kernels >> record.backward.flops >>
+          record.backward.bytes >> record.backward.num_kernels >>
+          record.forward_time >> record.backward_time) ||
+        !get_operator_type_from_name(op_name, record.op_type)) {
+      fprintf(stderr,
+              "Malformed cost record in %s line %d\n",
+              filename.c_str(),
+              line_number);
+      return false;
+    }
+    this->add_record(record);
+  }
+  return true;
+}
+
+bool CostPredictor::save(std::string const &filename) const {
+  std::ofstream file(filename);
+  if (!file) {
+    fprintf(stderr, "Failed to open cost records file %s\n", filename.c_str());
+    return false;
+  }
+  file.precision(std::numeric_limits<double>::max_digits10);
+  file << "# op_type forward_flops forward_bytes forward_kernels "
+          "backward_flops backward_bytes backward_kernels forward_time "
+          "backward_time\n";
+  for (auto const &kv : this->records) {
+    for (CostRecord const &record : kv.second) {
+      file << get_operator_type_name(record.op_type) << " "
+           << record.forward.flops << " " << record.forward.bytes << " "
+           << record.forward.num_kernels << " " << record.backward.flops << " "
+           << record.backward.bytes << " " << record.backward.num_kernels
+           << " " << record.forward_time << " " << record.backward_time
+           << "\n";
+    }
+  }
+  return true;
+}
+
+}; // namespace FlexFlow
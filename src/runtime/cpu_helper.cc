@@ -0,0 +1,149 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/utils/cpu_helper.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace FlexFlow {
+
+// Set on pool workers so that nested parallel_for calls run inline
+static thread_local bool in_cpu_worker = false;
+
+/*static*/
+CPUThreadPool &CPUThreadPool::get_instance() {
+  static CPUThreadPool *pool = nullptr;
+  static std::once_flag flag;
+  std::call_once(flag, [] {
+    int num_threads = (int)std::thread::hardware_concurrency();
+    char const *env = std::getenv("FF_CPU_NUM_THREADS");
+    if (env != nullptr && std::atoi(env) > 0) {
+      num_threads = std::atoi(env);
+    }
+    pool = new CPUThreadPool(std::max(num_threads, 1));
+  });
+  return *pool;
+}
+
+CPUThreadPool::CPUThreadPool(int num_threads)
+    : current_job(nullptr), generation(0), stop(false) {
+  // The calling thread always participates, so spawn one fewer worker
+  for (int i = 0; i < num_threads - 1; i++) {
+    workers.emplace_back(&CPUThreadPool::worker_loop, this);
+  }
+}
+
+CPUThreadPool::~CPUThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    stop = true;
+  }
+  start_cv.notify_all();
+  for (auto &t : workers) {
+    t.join();
+  }
+}
+
+int CPUThreadPool::get_num_threads() const {
+  return (int)workers.size() + 1;
+}
+
+/*static*/
+void CPUThreadPool::run_chunks(Job *job) {
+  while (true) {
+    int64_t chunk = job->next_chunk.fetch_add(1);
+    if (chunk >= job->num_chunks) {
+      break;
+    }
+    int64_t lo = job->begin + chunk * job->chunk_size;
+    int64_t hi = std::min(job->end, lo + job->chunk_size);
+    (*job->fn)(lo, hi);
+    job->pending_chunks.fetch_sub(1);
+  }
+}
+
+void CPUThreadPool::worker_loop() {
+  in_cpu_worker = true;
+  uint64_t seen = 0;
+  while (true) {
+    Job *job = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(state_mutex);
+      start_cv.wait(lock, [&] { return stop || generation != seen; });
+      if (stop) {
+        return;
+      }
+      seen = generation;
+      job = current_job;
+      if (job == nullptr) {
+        continue;
+      }
+      job->active_workers++;
+    }
+    run_chunks(job);
+    {
+      std::lock_guard<std::mutex> lock(state_mutex);
+      job->active_workers--;
+    }
+    done_cv.notify_all();
+  }
+}
+
+void CPUThreadPool::parallel_for(
+    int64_t begin,
+    int64_t end,
+    int64_t grain,
+    std::function<void(int64_t, int64_t)> const &fn) {
+  if (end <= begin) {
+    return;
+  }
+  grain = std::max(grain, (int64_t)1);
+  int64_t num_iters = end - begin;
+  int64_t max_chunks = 4 * (int64_t)get_num_threads();
+  int64_t chunk_size =
+      std::max(grain, (num_iters + max_chunks - 1) / max_chunks);
+  int64_t num_chunks = (num_iters + chunk_size - 1) / chunk_size;
+  if (num_chunks <= 1 || workers.empty() || in_cpu_worker ||
+      !job_mutex.try_lock()) {
+    fn(begin, end);
+    return;
+  }
+  Job job;
+  job.fn = &fn;
+  job.begin = begin;
+  job.end = end;
+  job.chunk_size = chunk_size;
+  job.num_chunks = num_chunks;
+  job.next_chunk = 0;
+  job.pending_chunks = num_chunks;
+  job.active_workers = 0;
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    current_job = &job;
+    generation++;
+  }
+  start_cv.notify_all();
+  run_chunks(&job);
+  {
+    std::unique_lock<std::mutex> lock(state_mutex);
+    current_job = nullptr;
+    done_cv.wait(lock, [&] {
+      return job.pending_chunks.load() == 0 && job.active_workers == 0;
+    });
+  }
+  job_mutex.unlock();
+}
+
+}; // namespace FlexFlow
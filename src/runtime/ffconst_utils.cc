@@ -178,6 +178,20 @@ std::string get_operator_type_name(OperatorType type) {
   }
 }
 
+bool get_operator_type_from_name(std::string const &name, OperatorType &type) {
+  for (int t = OP_INPUT; t < OP_INVALID; t++) {
+    try {
+      if (get_operator_type_name((OperatorType)t) == name) {
+        type = (OperatorType)t;
+        return true;
+      }
+    } catch (std::runtime_error const &) {
+      // Types without a name cannot be looked up
+    }
+  }
+  return false;
+}
+
 std::ostream &operator<<(std::ostream &s, OperatorType op_type) {
   s << get_operator_type_name(op_type);
 
@@ -0,0 +1,161 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/fusion_planner.h"
+#include <algorithm>
+#include <cassert>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace FlexFlow {
+
+namespace {
+
+// Mirrors the bookkeeping of FusedOp::FusedOp and FusedOp::add_operator
+struct FusedGroup {
+  int num_operators = 0;
+  int input_slots = 0, weight_slots = 0, output_slots = 0;
+  int num_inputs = 0, num_weights = 0, num_outputs = 0;
+  std::unordered_set<int> inputs, weights, outputs;
+
+  explicit FusedGroup(FusionPlannerOp const &op) {
+    num_operators = 1;
+    input_slots = op.inputs.size();
+    weight_slots = op.weights.size();
+    output_slots = op.outputs.size();
+    for (int t : op.inputs) {
+      if (inputs.insert(t).second) {
+        num_inputs++;
+      }
+    }
+    weights.insert(op.weights.begin(), op.weights.end());
+    num_weights = op.weights.size();
+    outputs.insert(op.outputs.begin(), op.outputs.end());
+    num_outputs = op.outputs.size();
+  }
+
+  // Adds op if the group has room for it; leaves the group unchanged
+  // otherwise
+  bool try_add(FusionPlannerOp const &op, FusionLimits const &limits) {
+    if (input_slots + (int)op.inputs.size() > limits.max_tensors ||
+        weight_slots + (int)op.weights.size() > limits.max_tensors ||
+        output_slots + (int)op.outputs.size() > limits.max_tensors ||
+        num_operators + 1 > limits.max_operators) {
+      return false;
+    }
+    std::vector<int> new_inputs, new_weights, new_outputs;
+    for (int t : op.inputs) {
+      if (!inputs.count(t) && !outputs.count(t) &&
+          std::find(new_inputs.begin(), new_inputs.end(), t) ==
+              new_inputs.end()) {
+        new_inputs.push_back(t);
+      }
+    }
+    for (int t : op.weights) {
+      if (!weights.count(t) && std::find(new_weights.begin(),
+                                         new_weights.end(),
+                                         t) == new_weights.end()) {
+        new_weights.push_back(t);
+      }
+    }
+    for (int t : op.outputs) {
+      if (!outputs.count(t) && std::find(new_outputs.begin(),
+                                         new_outputs.end(),
+                                         t) == new_outputs.end()) {
+        new_outputs.push_back(t);
+      }
+    }
+    if (num_inputs + (int)new_inputs.size() > limits.max_inputs ||
+        num_weights + (int)new_weights.size() > limits.max_weights ||
+        num_outputs + (int)new_outputs.size() > limits.max_outputs) {
+      return false;
+    }
+    num_operators++;
+    input_slots += op.inputs.size();
+    weight_slots += op.weights.size();
+    output_slots += op.outputs.size();
+    num_inputs += new_inputs.size();
+    num_weights += new_weights.size();
+    num_outputs += new_outputs.size();
+    inputs.insert(new_inputs.begin(), new_inputs.end());
+    weights.insert(new_weights.begin(), new_weights.end());
+    outputs.insert(new_outputs.begin(), new_outputs.end());
+    return true;
+  }
+};
+
+} // namespace
+
+std::vector<int> plan_fusion(std::vector<FusionPlannerOp> const &ops,
+                             FusionLimits const &limits) {
+  int const num_ops = ops.size();
+  std::vector<int> group(num_ops);
+  std::unordered_map<int, FusedGroup> groups;
+  // For each machine view, the operators and groups that can still take
+  // more operators, ordered by position
+  std::unordered_map<int, std::set<int>> hosts;
+
+  for (int l = 0; l < num_ops; l++) {
+    FusionPlannerOp const &op = ops[l];
+    group[l] = l;
+    if (op.can_fuse && l > 0 && l < num_ops - 1) {
+      // The operator can only move up to the group of its latest producer
+      int start = 0;
+      for (int p : op.producers) {
+        assert(p < l);
+        if (p >= 0) {
+          start = std::max(start, group[p]);
+        }
+      }
+      std::set<int> &candidates = hosts[op.view];
+      for (auto it = candidates.lower_bound(start); it != candidates.end();
+           it++) {
+        int i = *it;
+        auto g = groups.find(i);
+        if (g == groups.end()) {
+          FusedGroup fresh(ops[i]);
+          if (!fresh.try_add(op, limits)) {
+            continue;
+          }
+          groups.emplace(i, fresh);
+        } else if (!g->second.try_add(op, limits)) {
+          continue;
+        }
+        group[l] = i;
+        break;
+      }
+    }
+    if (group[l] == l && op.can_start_group) {
+      hosts[op.view].insert(l);
+    }
+  }
+  return group;
+}
+
+int fusion_refund_input(int view,
+                        std::vector<bool> const &producer_can_fuse,
+                        std::vector<int> const &producer_views) {
+  assert(producer_can_fuse.size() == producer_views.size());
+  for (size_t i = 0; i < producer_views.size(); i++) {
+    if (producer_can_fuse[i] &&
+        (producer_views[i] == view || producer_views[i] == -1)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+}; // namespace FlexFlow
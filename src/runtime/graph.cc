@@ -13,6 +13,7 @@
  * limitations under the License.
  */
 #include "flexflow/graph.h"
+#include "flexflow/cluster_sizing.h"
 #include "flexflow/dominators.h"
 #include "flexflow/ffconst_utils.h"
 #include "flexflow/ops/aggregate.h"
@@ -43,9 +44,12 @@
 #include "flexflow/parallel_ops/partition.h"
 #include "flexflow/parallel_ops/reduction.h"
 #include "flexflow/parallel_ops/replicate.h"
+#include "flexflow/utils/cpu_helper.h"
 #include "flexflow/utils/disjoint_set.h"
+#include "flexflow/utils/pareto_front.h"
 #include "legion.h"
 #include "legion/legion_utilities.h"
+#include <algorithm>
 
 namespace FlexFlow::PCG {
 
@@ -106,24 +110,13 @@ T SearchHelper::execute_sequence_split(std::unique_ptr<Graph> const &pre_graph,
 }
 
 /**
- * @brief Starting point to get sequential split time cost.
- *
- * @tparam T float or GraphCostResult (or GraphCostResultWithMemory in memory
- * optimization)
+ * @brief The views to try for the bottleneck node of a sequence split.
  */
-template <typename T>
-T SearchHelper::find_optimal_sequence_graph_time(
-    Graph const *g,
-    Node const &bn_node,
-    NodeAssignment const &source,
-    NodeAssignment const &sink,
-    MachineResource const &resources) const {
-  std::unique_ptr<Graph> pre_graph;
-  std::unique_ptr<Graph> post_graph;
-  std::tie(pre_graph, post_graph) = g->split_at_node(bn_node);
-
-  T optimal = this->infinity<T>();
-
+std::vector<MachineView>
+    SearchHelper::get_bottleneck_views(Graph const *g,
+                                       Node const &bn_node,
+                                       NodeAssignment const &sink,
+                                       MachineResource const &resources) const {
   std::vector<MachineView> valid_views =
       this->get_valid_machine_views(bn_node.ptr, resources);
   // A Corner Case:
@@ -151,7 +144,37 @@ T SearchHelper::find_optimal_sequence_graph_time(
       valid_views.push_back(sink.view);
     }
   }
+  return valid_views;
+}
+
+template <typename T>
+void SearchHelper::keep_best(T &best, T const &candidate) const {
+  if (candidate < best) {
+    best = candidate;
+  }
+}
+
+/**
+ * @brief Starting point to get sequential split time cost.
+ *
+ * @tparam T float or GraphCostResult (or GraphCostResultWithMemory in memory
+ * optimization)
+ */
+template <typename T>
+T SearchHelper::find_optimal_sequence_graph_time(
+    Graph const *g,
+    Node const &bn_node,
+    NodeAssignment const &source,
+    NodeAssignment const &sink,
+    MachineResource const &resources) const {
+  std::unique_ptr<Graph> pre_graph;
+  std::unique_ptr<Graph> post_graph;
+  std::tie(pre_graph, post_graph) = g->split_at_node(bn_node);
+
+  T optimal = this->infinity<T>();
 
+  std::vector<MachineView> valid_views =
+      this->get_bottleneck_views(g, bn_node, sink, resources);
   if (valid_views.empty()) {
     return optimal;
   }
@@ -181,6 +204,7 @@ T SearchHelper::find_optimal_sequence_graph_time(
 
 void SearchHelper::clear_cache() {
   cached_graph_costs.clear();
+  cached_graph_fronts.clear();
   cached_operator_valid_views.clear();
 }
 
@@ -263,18 +287,10 @@ NonsequenceSplit NonsequenceSplit::horizontal(int param, bool flip_graphs) {
   return s;
 }
 
-template <typename T>
-T SearchHelper::find_optimal_nonsequence_graph_time(
-    Graph const *g,
-    NodeAssignment const &source,
-    NodeAssignment const &sink,
+std::vector<NonsequenceSplit> SearchHelper::get_nonsequence_splits(
     MachineResource const &resources) const {
-  std::unique_ptr<Graph> first_graph;
-  std::unique_ptr<Graph> second_graph;
-  std::tie(first_graph, second_graph) =
-      g->split_horizontal(source.node, sink.node);
-
   std::vector<NonsequenceSplit> potential_splits;
+  potential_splits.push_back(NonsequenceSplit::sequential());
 
   for (int i = 1; i < resources.num_nodes; i++) {
     potential_splits.push_back(NonsequenceSplit::vertical(i, false));
@@ -284,11 +300,30 @@ T SearchHelper::find_optimal_nonsequence_graph_time(
     potential_splits.push_back(NonsequenceSplit::horizontal(i, false));
     potential_splits.push_back(NonsequenceSplit::horizontal(i, true));
   }
+  return potential_splits;
+}
 
-  NonsequenceSplit best_split = NonsequenceSplit::sequential();
+template <typename T>
+T SearchHelper::find_optimal_nonsequence_graph_time(
+    Graph const *g,
+    NodeAssignment const &source,
+    NodeAssignment const &sink,
+    MachineResource const &resources) const {
+  std::unique_ptr<Graph> first_graph;
+  std::unique_ptr<Graph> second_graph;
+  std::tie(first_graph, second_graph) =
+      g->split_horizontal(source.node, sink.node);
+
+  std::vector<NonsequenceSplit> potential_splits =
+      this->get_nonsequence_splits(resources);
+
+  NonsequenceSplit best_split = potential_splits.front();
   float best_cost = this->execute_nonsequence_split<float>(
       first_graph, second_graph, source, sink, resources, best_split);
   for (NonsequenceSplit const &split : potential_splits) {
+    if (split.type == SplitType::SEQUENTIAL) {
+      continue;
+    }
     float cost = this->execute_nonsequence_split<float>(
         first_graph, second_graph, source, sink, resources, split);
     this->logger->debug() << "Found cost: " << cost;
@@ -333,6 +368,7 @@ void Graph::add_edge(Node const &srcOp,
     outEdges[srcOp];
   }
   Edge e(srcOp, dstOp, srcIdx, dstIdx);
+  this->invalidate_cached_analyses();
   inEdges[srcOp];
   outEdges[dstOp];
   inEdges[dstOp].insert(e);
@@ -340,11 +376,13 @@ void Graph::add_edge(Node const &srcOp,
 }
 
 void Graph::add_node(Node const &node) {
+  this->invalidate_cached_analyses();
   inEdges[node];
   outEdges[node];
 }
 
 void Graph::add_edge(Edge const &e) {
+  this->invalidate_cached_analyses();
   inEdges[e.srcOp];
   outEdges[e.dstOp];
 
@@ -355,6 +393,7 @@ void Graph::add_edge(Edge const &e) {
 void Graph::remove_edge(Edge const &e, bool remove_node_if_unused) {
   assert(outEdges[e.srcOp].find(e) != outEdges[e.srcOp].end());
   assert(inEdges[e.dstOp].find(e) != inEdges[e.dstOp].end());
+  this->invalidate_cached_analyses();
   assert(outEdges[e.srcOp].erase(e) == 1);
   assert(inEdges[e.dstOp].erase(e) == 1);
   if (remove_node_if_unused) {
@@ -517,72 +556,80 @@ bool Graph::check_correctness(void) {
 
 std::vector<MachineView> SearchHelper::get_valid_machine_views(
     Node const &node, MachineResource const &resource, bool log) const {
-  this->logger->info() << "Getting valid machine views for "
-                       << node.to_string();
+  if (log) {
+    this->logger->info() << "Getting valid machine views for "
+                         << node.to_string();
+  }
   return this->get_valid_machine_views(node.ptr, resource, log);
 }
 
+ValidViewsKey::ValidViewsKey(Op const *op) {
+  for (int i = 0; i < op->numOutputs; i++) {
+    ParallelTensor const &output = op->outputs[i];
+    output_shapes.push_back(output->get_shape());
+    for (int j = 0; j < output->num_dims; j++) {
+      parallel_idxs.push_back(output->dims[j].parallel_idx);
+    }
+  }
+}
+
+bool ValidViewsKey::operator==(ValidViewsKey const &other) const {
+  return output_shapes == other.output_shapes &&
+         parallel_idxs == other.parallel_idxs;
+}
+
+static std::string machine_view_to_string(MachineView const &view) {
+  std::ostringstream oss;
+  oss << "[" << view.ndims << "](";
+  for (int i = 0; i < view.ndims; i++) {
+    oss << view.dim[i] << "/" << view.stride[i];
+    if (i != view.ndims - 1) {
+      oss << " ";
+    }
+  }
+  oss << ")";
+  return oss.str();
+}
+
 std::vector<MachineView> SearchHelper::get_valid_machine_views(
     Op const *op, MachineResource const &resource, bool log) const {
   std::vector<MachineView> const *cached_op_views = NULL;
   std::vector<MachineView> valid_views;
 
-  auto const &iter = cached_operator_valid_views.find(op->op_guid);
+  ValidViewsKey key(op);
+  auto const &iter = cached_operator_valid_views.find(key);
   if (iter != cached_operator_valid_views.end()) {
     cached_op_views = iter->second.get();
   } else {
-    auto to_cache = std::unique_ptr<std::vector<MachineView>>(
-        new std::vector<MachineView>());
+    std::vector<MachineView> const &all_views = this->model->all_valid_views;
     if (log) {
-      this->logger->info() << "Considering a total of "
-                           << this->model->all_valid_views.size()
+      this->logger->info() << "Considering a total of " << all_views.size()
                            << " potential valid views";
     }
-    for (size_t i = 0; i < this->model->all_valid_views.size(); i++) {
-      bool valid = true;
-      for (int j = 0; j < op->numOutputs; j++) {
-        if (!op->outputs[j]->is_valid_machine_view(
-                this->model->all_valid_views[i])) {
-          valid = false;
-          {
-            MachineView const &view = this->model->all_valid_views[i];
-            std::ostringstream oss;
-            oss << "[" << view.ndims << "](";
-            for (int i = 0; i < view.ndims; i++) {
-              oss << view.dim[i] << "/" << view.stride[i];
-              if (i != view.ndims - 1) {
-                oss << " ";
-              }
-            }
-            oss << ")";
-            if (log) {
-              this->logger->info() << "Rejecting machine view: " << oss.str();
-            }
-          }
-          break;
-        }
+    std::vector<ParallelTensorShape> const &shapes = key.output_shapes;
+    std::vector<char> valid(all_views.size());
+    cpu_parallel_for(0, all_views.size(), 256, [&](int64_t lo, int64_t hi) {
+      for (int64_t i = lo; i < hi; i++) {
+        valid[i] = std::all_of(
+            shapes.begin(), shapes.end(), [&](ParallelTensorShape const &s) {
+              return s.is_valid_machine_view(all_views[i]);
+            });
       }
-      if (valid) {
-        {
-          MachineView const &view = this->model->all_valid_views[i];
-          std::ostringstream oss;
-          oss << "[" << view.ndims << "](";
-          for (int i = 0; i < view.ndims; i++) {
-            oss << view.dim[i] << "/" << view.stride[i];
-            if (i != view.ndims - 1) {
-              oss << " ";
-            }
-          }
-          oss << ")";
-          if (log) {
-            this->logger->info() << "Accepting machine view: " << oss.str();
-          }
-        }
-        to_cache->push_back(this->model->all_valid_views[i]);
+    });
+    auto to_cache = std::unique_ptr<std::vector<MachineView>>(
+        new std::vector<MachineView>());
+    for (size_t i = 0; i < all_views.size(); i++) {
+      if (valid[i]) {
+        to_cache->push_back(all_views[i]);
+      }
+      if (log) {
+        this->logger->info()
+            << (valid[i] ? "Accepting" : "Rejecting")
+            << " machine view: " << machine_view_to_string(all_views[i]);
       }
     }
-    cached_operator_valid_views[op->op_guid] = std::move(to_cache);
-    cached_op_views = cached_operator_valid_views.at(op->op_guid).get();
+    cached_op_views = to_cache.get();
+    cached_operator_valid_views[key] = std::move(to_cache);
   }
   if (log) {
     this->logger->info() << "Found " << cached_op_views->size()
@@ -606,29 +653,72 @@ std::vector<MachineView> SearchHelper::get_valid_machine_views(
 
 Node Graph::find_bottleneck_node(Node const &sink_node,
                                  Node const &source_node) const {
-  using FlexFlow::PCG::Utils::GraphStructure;
-  using FlexFlow::PCG::Utils::imm_post_dominators;
-  using FlexFlow::PCG::Utils::MultisourceGraphStructure;
-  using FlexFlow::PCG::Utils::roots;
+  using FlexFlow::PCG::Utils::DominatorTree;
+  using FlexFlow::PCG::Utils::IndexedGraphView;
+
+  DominatorTree<Node> const &tree = this->get_post_dominator_tree();
 
   Node source(source_node);
-  std::unordered_map<Node, Node> ipd;
-  std::unordered_set<Node> graph_roots = roots(*this);
-  if (source_node != Node::INVALID_NODE) {
-    ipd = imm_post_dominators(*this);
-  } else if (graph_roots.size() == 1) {
-    ipd = imm_post_dominators(*this);
-    source = *graph_roots.begin();
+  tl::optional<Node> bn_node = tl::nullopt;
+  std::unordered_set<Node> graph_roots;
+  {
+    IndexedGraphView<Node> const &view = this->get_indexed_view();
+    std::vector<int> root_indices;
+    view.roots(&root_indices);
+    for (int i : root_indices) {
+      graph_roots.insert(view.node(i));
+    }
+  }
+  if (source_node == Node::INVALID_NODE && graph_roots.size() > 1) {
+    // The immediate post-dominator of the virtual source that feeds all roots
+    bn_node = tree.common_dominator(graph_roots);
   } else {
-    ipd = imm_post_dominators<Graph, MultisourceGraphStructure<Graph>>(*this);
+    if (source_node == Node::INVALID_NODE) {
+      source = *graph_roots.begin();
+    }
+    if (tree.has_imm_dominator(source)) {
+      bn_node = tree.imm_dominator(source);
+    }
   }
 
-  Node bn_node = ipd.at(source);
-  if (bn_node == source || bn_node == sink_node) {
+  if (!bn_node.has_value() || !this->has_node(bn_node.value()) ||
+      bn_node.value() == source || bn_node.value() == sink_node) {
     return Node::INVALID_NODE;
   }
 
-  return bn_node;
+  return bn_node.value();
+}
+
+Utils::DominatorTree<Node> const &Graph::get_post_dominator_tree() const {
+  using FlexFlow::PCG::Utils::DominatorTree;
+  using FlexFlow::PCG::Utils::post_dominator_tree;
+
+  if (this->cached_post_dominator_tree == nullptr) {
+    this->cached_post_dominator_tree =
+        std::make_shared<DominatorTree<Node> const>(
+            post_dominator_tree(this->get_indexed_view()));
+  }
+  return *this->cached_post_dominator_tree;
+}
+
+Utils::IndexedGraphView<Node> const &Graph::get_indexed_view() const {
+  using FlexFlow::PCG::Utils::indexed_graph_view;
+  using FlexFlow::PCG::Utils::IndexedGraphView;
+
+  if (this->cached_indexed_view == nullptr) {
+    this->cached_indexed_view = std::make_shared<IndexedGraphView<Node> const>(
+        indexed_graph_view<Graph>(*this));
+  }
+  return *this->cached_indexed_view;
+}
+
+void Graph::invalidate_cached_analyses() {
+  this->cached_indexed_view.reset();
+  this->cached_post_dominator_tree.reset();
+}
+
+bool Graph::has_node(Node const &node) const {
+  return this->inEdges.find(node) != this->inEdges.end();
 }
 
 void Edge::replace_node(Node const &currentOp, Node const &replaceWith) {
@@ -677,6 +767,7 @@ void Graph::remove_node(Node const &node, bool purge_edges) {
     assert(this->inEdges.at(node).empty());
     assert(this->outEdges.at(node).empty());
   }
+  this->invalidate_cached_analyses();
   this->inEdges.erase(node);
   this->outEdges.erase(node);
 }
@@ -875,6 +966,10 @@ void Graph::simplify(SimplificationSettings const &settings) {
             ((ParallelOp *)n2.ptr)->append_parallel_op_info(parallel_ops);
             Node new_node = model->get_or_create_fused_parallel_node(
                 n1.ptr->inputs[0], parallel_ops);
+            if (new_node == Node::INVALID_NODE) {
+              // The chain is too large to fuse, keep n1 and n2 separate
+              continue;
+            }
             auto const &inList = this->inEdges.find(n1)->second;
             assert(inList.size() == 1);
             Edge e1 = *inList.begin();
@@ -956,17 +1051,19 @@ void Graph::simplify(SimplificationSettings const &settings) {
 
 std::pair<std::unique_ptr<Graph>, std::unique_ptr<Graph>>
     Graph::split_at_node(Node const &bottleneck) const {
-  using FlexFlow::PCG::Utils::topo_sort;
+  using FlexFlow::PCG::Utils::IndexedGraphView;
 
   auto first_graph = std::unique_ptr<Graph>(new Graph(this->model));
   auto second_graph = std::unique_ptr<Graph>(new Graph(this->model));
 
   std::unordered_set<Node> used_nodes;
   {
-    std::vector<Node> topo_sorted;
-    topo_sort(*this, &topo_sorted);
+    IndexedGraphView<Node> const &view = this->get_indexed_view();
+    std::vector<int> topo_sorted;
+    view.topo_sort(&topo_sorted);
 
-    for (auto const &node : topo_sorted) {
+    for (int i : topo_sorted) {
+      Node const &node = view.node(i);
       if (node == bottleneck) {
         break;
       }
@@ -978,6 +1075,7 @@ std::pair<std::unique_ptr<Graph>, std::unique_ptr<Graph>>
     assert(used_nodes.size() < topo_sorted.size());
   }
 
+  bool clean_cut = true;
   for (auto const &it : this->inEdges) {
     auto const &inList = it.second;
     if (used_nodes.find(it.first) != used_nodes.end()) {
@@ -989,10 +1087,23 @@ std::pair<std::unique_ptr<Graph>, std::unique_ptr<Graph>>
       // Add all in-edges of not_used_nodes into the second_graph
       for (auto const &it2 : inList) {
         second_graph->add_edge(it2);
+        clean_cut &= (used_nodes.find(it2.srcOp) == used_nodes.end() ||
+                      it2.srcOp == bottleneck);
       }
     }
   }
 
+  // When the bottleneck is the only node feeding the second graph, no other
+  // path crosses the cut and post-dominance within either half is the same
+  // as in this graph, so both halves can share this graph's tree instead of
+  // rebuilding their own
+  if (clean_cut) {
+    this->get_post_dominator_tree();
+    first_graph->cached_post_dominator_tree = this->cached_post_dominator_tree;
+    second_graph->cached_post_dominator_tree =
+        this->cached_post_dominator_tree;
+  }
+
   return {std::move(first_graph), std::move(second_graph)};
 }
 
@@ -1353,6 +1464,33 @@ void SearchHelper::check_matches_graph<float>(Graph const *g,
                                               float const &r,
                                               Node const &sink) const {}
 
+int SearchHelper::canonical_gpu_shift(NodeAssignment const &source,
+                                      NodeAssignment const &sink,
+                                      MachineResource const &resources) const {
+  std::vector<MachineView> views;
+  for (NodeAssignment const *assignment : {&source, &sink}) {
+    if (assignment->node != Node::INVALID_NODE) {
+      views.push_back(assignment->view);
+    }
+  }
+  return FlexFlow::canonical_gpu_shift(views, resources);
+}
+
+template <>
+void SearchHelper::shift_result_views<float>(float &result, int shift) const {}
+
+template <>
+void SearchHelper::shift_result_views<GraphCostResult>(GraphCostResult &result,
+                                                       int shift) const {
+  shift_gpu_views(result.views, shift);
+}
+
+template <>
+void SearchHelper::shift_result_views<GraphCostResultWithMemory>(
+    GraphCostResultWithMemory &result, int shift) const {
+  shift_gpu_views(result.views, shift);
+}
+
 template <>
 std::pair<bool, float>
     SearchHelper::try_get_cost_from_cache<float>(size_t hash) const {
@@ -1453,6 +1591,10 @@ T SearchHelper::estimate_xfer_cost(Graph const *graph,
       // printf("Estimated xfer cost from %s to %s: %fms\n",
       // source.node.ptr->name, sink.node.ptr->name, estimated_xfer_cost);
       op_cost += estimated_xfer_cost;
+      if (this->model->config.perform_fusion) {
+        op_cost -= this->model->simulator->estimate_fusion_saving(
+            sink.node.ptr, it2.dstIdx, source.view, sink.view);
+      }
     }
     this->add_operator_cost<T>(source, op_cost, &result);
   } else {
@@ -1490,6 +1632,10 @@ GraphCostResultWithMemory
       float estimated_xfer_cost = this->model->simulator->estimate_xfer_cost(
           sink.node.ptr, it2.dstIdx, source.view, sink.view);
       op_cost += estimated_xfer_cost;
+      if (this->model->config.perform_fusion) {
+        op_cost -= this->model->simulator->estimate_fusion_saving(
+            sink.node.ptr, it2.dstIdx, source.view, sink.view);
+      }
     }
     this->add_operator_cost_with_memory(
         source, op_cost, MemoryUsage{}, &result);
@@ -1561,21 +1707,250 @@ void SearchHelper::add_sink_node_costs(NodeAssignment const &sink,
 
 /**
  * @brief Specialization of add_sink_node_costs to handle
- * GraphCostResultWithMemory
+ * GraphCostResultWithMemory. Charges the same memory as the GraphCostFront
+ * specialization, so that both searches rank a strategy alike.
  */
 template <>
 void SearchHelper::add_sink_node_costs<GraphCostResultWithMemory>(
     NodeAssignment const &sink,
     CostMetrics metrics,
     GraphCostResultWithMemory *result) const {
-  float op_total_mem_mb = ((float)(metrics.op_total_mem / 1e4)) / 1e2;
   this->add_operator_cost_with_memory(
       sink,
       metrics.forward_time + metrics.backward_time + metrics.sync_time,
-      MemoryUsage{MemoryUsageType::GLOBAL, op_total_mem_mb},
+      MemoryUsage{MemoryUsageType::GLOBAL, metrics.total_memory_in_mb()},
       result);
 }
 
+void GraphCostFront::prune() {
+  prune_pareto_front(
+      this->points,
+      [](GraphCostResultWithMemory const &p) { return p.cost; },
+      [](GraphCostResultWithMemory const &p) { return p.mem_cost.num; },
+      MAX_POINTS);
+}
+
+GraphCostResultWithMemory
+    GraphCostFront::fastest_within(float memory_limit) const {
+  // points are sorted by increasing run time
+  for (GraphCostResultWithMemory const &point : this->points) {
+    if (point.mem_cost.num <= memory_limit) {
+      return point;
+    }
+  }
+  return GraphCostResultWithMemory::invalid();
+}
+
+std::ostream &operator<<(std::ostream &s, GraphCostFront const &f) {
+  s << "GraphCostFront{";
+  for (size_t i = 0; i < f.points.size(); i++) {
+    if (i > 0) {
+      s << ", ";
+    }
+    s << "(" << f.points[i].cost << ", " << f.points[i].mem_cost.num << ")";
+  }
+  s << "}";
+  return s;
+}
+
+/**
+ * @brief Every combination of a point of first with a point of second, run
+ * one after the other on the same devices.
+ */
+template <>
+GraphCostFront sequence_cost<GraphCostFront>(GraphCostFront const &first,
+                                             GraphCostFront const &second) {
+  GraphCostFront result;
+  for (GraphCostResultWithMemory const &p : first.points) {
+    for (GraphCostResultWithMemory const &q : second.points) {
+      result.points.push_back(sequence_cost(p, q));
+    }
+  }
+  result.prune();
+  return result;
+}
+
+/**
+ * @brief Every combination of a point of first with a point of second, run
+ * side by side on disjoint devices.
+ */
+template <>
+GraphCostFront parallel_cost<GraphCostFront>(GraphCostFront const &first,
+                                             GraphCostFront const &second) {
+  GraphCostFront result;
+  for (GraphCostResultWithMemory const &p : first.points) {
+    for (GraphCostResultWithMemory const &q : second.points) {
+      GraphCostResultWithMemory point = parallel_cost(p, q);
+      point.mem_cost.num = std::max(p.mem_cost.num, q.mem_cost.num);
+      result.points.push_back(point);
+    }
+  }
+  result.prune();
+  return result;
+}
+
+template <>
+bool SearchHelper::is_invalid<GraphCostFront>(
+    GraphCostFront const &cost) const {
+  return cost.points.empty();
+}
+
+template <>
+void SearchHelper::check_matches_graph<GraphCostFront>(
+    Graph const *g, GraphCostFront const &r, Node const &sink) const {
+  for (GraphCostResultWithMemory const &point : r.points) {
+    this->check_matches_graph<GraphCostResultWithMemory>(g, point, sink);
+  }
+}
+
+template <>
+void SearchHelper::shift_result_views<GraphCostFront>(GraphCostFront &result,
+                                                      int shift) const {
+  for (GraphCostResultWithMemory &point : result.points) {
+    this->shift_result_views<GraphCostResultWithMemory>(point, shift);
+  }
+}
+
+template <>
+std::pair<bool, GraphCostFront>
+    SearchHelper::try_get_cost_from_cache<GraphCostFront>(size_t hash) const {
+  auto const &it = this->cached_graph_fronts.find(hash);
+  if (it == this->cached_graph_fronts.end()) {
+    return {false, GraphCostFront{}};
+  } else {
+    return {true, it->second};
+  }
+}
+
+template <>
+void SearchHelper::try_cache_result<GraphCostFront>(
+    size_t hash, GraphCostFront const &value) const {
+  this->logger->debug() << "cached_graph_fronts[" << hash << "] = " << value;
+  this->cached_graph_fronts[hash] = value;
+}
+
+template <>
+GraphCostFront SearchHelper::infinity<GraphCostFront>() const {
+  return GraphCostFront{};
+}
+
+template <>
+GraphCostFront SearchHelper::empty<GraphCostFront>() const {
+  GraphCostFront result;
+  result.points.push_back(this->empty<GraphCostResultWithMemory>());
+  return result;
+}
+
+template <>
+void SearchHelper::add_operator_cost<GraphCostFront>(
+    NodeAssignment const &node, float node_cost, GraphCostFront *cost) const {
+  for (GraphCostResultWithMemory &point : cost->points) {
+    this->add_operator_cost_with_memory(node, node_cost, MemoryUsage{}, &point);
+  }
+}
+
+template <>
+float SearchHelper::get_cost<GraphCostFront>(GraphCostFront const &f) const {
+  if (f.points.empty()) {
+    return std::numeric_limits<float>::infinity();
+  }
+  return f.points.front().cost;
+}
+
+/**
+ * @brief Specialization of add_sink_node_costs to handle GraphCostFront. The
+ * sink's memory counts once per device it runs on, so this adds the size of
+ * one partition of its tensors rather than op_total_mem.
+ */
+template <>
+void SearchHelper::add_sink_node_costs<GraphCostFront>(
+    NodeAssignment const &sink,
+    CostMetrics metrics,
+    GraphCostFront *result) const {
+  for (GraphCostResultWithMemory &point : result->points) {
+    this->add_operator_cost_with_memory(
+        sink,
+        metrics.forward_time + metrics.backward_time + metrics.sync_time,
+        MemoryUsage{MemoryUsageType::GLOBAL, metrics.total_memory_in_mb()},
+        &point);
+  }
+}
+
+template <>
+void SearchHelper::keep_best<GraphCostFront>(
+    GraphCostFront &best, GraphCostFront const &candidate) const {
+  best.points.insert(
+      best.points.end(), candidate.points.begin(), candidate.points.end());
+  best.prune();
+}
+
+/**
+ * @brief Specialization that keeps the strategies of every bottleneck view:
+ * one that is slower for the best view may still use less memory.
+ */
+template <>
+GraphCostFront SearchHelper::find_optimal_sequence_graph_time<GraphCostFront>(
+    Graph const *g,
+    Node const &bn_node,
+    NodeAssignment const &source,
+    NodeAssignment const &sink,
+    MachineResource const &resources) const {
+  std::unique_ptr<Graph> pre_graph;
+  std::unique_ptr<Graph> post_graph;
+  std::tie(pre_graph, post_graph) = g->split_at_node(bn_node);
+
+  GraphCostFront optimal = this->infinity<GraphCostFront>();
+  for (MachineView const &bn_view :
+       this->get_bottleneck_views(g, bn_node, sink, resources)) {
+    this->keep_best(optimal,
+                    this->execute_sequence_split<GraphCostFront>(
+                        pre_graph,
+                        post_graph,
+                        source,
+                        sink,
+                        resources,
+                        {bn_node, bn_view}));
+  }
+
+  check_matches_graph<GraphCostFront>(g, optimal, sink.node);
+
+  return optimal;
+}
+
+/**
+ * @brief Specialization that keeps the strategies of every split, which
+ * trade run time against memory differently.
+ */
+template <>
+GraphCostFront
+    SearchHelper::find_optimal_nonsequence_graph_time<GraphCostFront>(
+        Graph const *g,
+        NodeAssignment const &source,
+        NodeAssignment const &sink,
+        MachineResource const &resources) const {
+  std::unique_ptr<Graph> first_graph;
+  std::unique_ptr<Graph> second_graph;
+  std::tie(first_graph, second_graph) =
+      g->split_horizontal(source.node, sink.node);
+
+  GraphCostFront optimal = this->infinity<GraphCostFront>();
+  for (NonsequenceSplit const &split :
+       this->get_nonsequence_splits(resources)) {
+    this->keep_best(optimal,
+                    this->execute_nonsequence_split<GraphCostFront>(
+                        first_graph,
+                        second_graph,
+                        source,
+                        sink,
+                        resources,
+                        split));
+  }
+
+  check_matches_graph<GraphCostFront>(g, optimal, sink.node);
+
+  return optimal;
+}
+
 /**
  * @brief Core function to analyze the cost of a graph.
  *
@@ -1610,6 +1985,29 @@ T SearchHelper::graph_cost(Graph const *graph,
     assert(graph->outEdges.find(source.node) != graph->outEdges.end());
   }
 
+  if (this->model->config.canonical_machine_views) {
+    // Solve the representative of the state's symmetry class at the lowest
+    // devices, so that translated states share its cache entries, and move
+    // the resulting views back
+    int shift = this->canonical_gpu_shift(source, sink, resources);
+    if (shift > 0) {
+      NodeAssignment canonical_source = source, canonical_sink = sink;
+      MachineResource canonical_resources = resources;
+      if (source.node != Node::INVALID_NODE) {
+        canonical_source.view.start_device_id -= shift;
+      }
+      canonical_sink.view.start_device_id -= shift;
+      canonical_resources.start_gpu_id -= shift;
+      T result = this->graph_cost<T>(graph,
+                                     canonical_source,
+                                     canonical_sink,
+                                     canonical_resources,
+                                     include_sink_compute_time);
+      this->shift_result_views<T>(result, shift);
+      return result;
+    }
+  }
+
   size_t hash = dp_state_hash(
       graph, sink.node, sink.view, source.node, source.view, resources);
   this->logger->spew() << "hash = " << hash;
@@ -1662,6 +2060,12 @@ T SearchHelper::graph_cost(Graph const *graph,
     // Sink node costs
     CostMetrics metrics =
         this->model->simulator->measure_operator_cost(sink.node.ptr, sink.view);
+    if (this->model->config.perform_fusion) {
+      // Every operator pays for its own task launches here, and the edges
+      // into operators that apply_fusion would fuse refund them in
+      // estimate_xfer_cost, so a fused group costs a single launch
+      this->model->simulator->add_launch_costs(sink.node.ptr, metrics);
+    }
 
     // Adjust operator memory usage
     this->logger->spew()
@@ -1721,13 +2125,13 @@ T SearchHelper::graph_cost(Graph const *graph,
                            weight_num_parts * metrics.weights_memory;
 
     this->logger->spew() << "  op_total_mem: " << metrics.op_total_mem;
-    float op_total_mem_mb = (float)((metrics.op_total_mem) / 1e4) / 1e2;
     this->logger->debug() << "[PCG::SearchHelper::graph_cost] Sink node cost ["
                           << sink.node.to_string() << "]: "
                           << "forward(" << metrics.forward_time << ") "
                           << "backward(" << metrics.backward_time << ") "
                           << "sync(" << metrics.sync_time << ") "
-                          << "memory(" << op_total_mem_mb << " MB)";
+                          << "memory(" << metrics.total_memory_in_mb()
+                          << " MB)";
     this->add_sink_node_costs<T>(sink, metrics, &result);
   }
 
@@ -1765,6 +2169,22 @@ float Graph::optimal_cost_with_memory(float run_time_cost_factor) const {
   return combined_cost;
 }
 
+/**
+ * @brief Get every strategy of a PCG that is not beaten in both run time and
+ * peak per-device memory by another one, in a single DP pass.
+ */
+GraphCostFront Graph::optimal_cost_front() const {
+  return this->generic_optimal_cost<GraphCostFront>();
+}
+
+GraphCostResultWithMemory
+    Graph::optimal_cost_within_memory(float memory_limit) const {
+  GraphCostFront front = this->optimal_cost_front();
+  this->search->logger->spew()
+      << "Graph::optimal_cost_within_memory: " << front;
+  return front.fastest_within(memory_limit);
+}
+
 std::unordered_map<Node, MachineView> Graph::optimal_views() const {
   return this->generic_optimal_cost<GraphCostResult>().views;
 }
@@ -1834,9 +2254,7 @@ T Graph::generic_optimal_cost() const {
                               {sink_node, sink_view},
                               resource,
                               true);
-    if (new_cost < optimal) {
-      optimal = new_cost;
-    }
+    search->keep_best(optimal, new_cost);
   }
 
   return optimal;
@@ -1877,11 +2295,12 @@ size_t dp_state_hash(Graph const *graph,
 namespace {
 
 /**
- * @brief Given a lambda value, perform the search and return the optimized PCG
- * and corresponding MachineView.
+ * @brief Given a memory optimization config, perform the search and return the
+ * optimized PCG and corresponding MachineView.
  */
 std::pair<std::unique_ptr<Graph>, std::unordered_map<Node, MachineView>>
-    try_one_lambda(std::pair<float, MemorySearchResult> &lambda,
+    try_one_config(MemoryOptimConfig const &mem_config,
+                   MemorySearchResult &search_result,
                    Task const *task,
                    std::shared_ptr<Simulator> &cached_simulator,
                    bool perform_memory_search) {
@@ -1904,16 +2323,21 @@ std::pair<std::unique_ptr<Graph>, std::unordered_map<Node, MachineView>>
                        .only_kind(Memory::GPU_FB_MEM)
                        .best_affinity_to(task->target_proc)
                        .first();
+  // Without a GPU (the search can run on a CPU with the roofline cost model),
+  // take the device memory from the config instead
+  size_t gpu_mem_capacity =
+      gpu_mem.exists() ? gpu_mem.capacity()
+                       : (size_t)model->config.device_mem * 1024 * 1024;
   MachineModel *machine;
   if (model->config.machine_model_version == 0) {
     machine =
         (MachineModel *)new SimpleMachineModel(model->config.numNodes,
                                                model->config.workersPerNode,
-                                               gpu_mem.capacity());
+                                               gpu_mem_capacity);
   } else if (model->config.machine_model_version == 1 and
              !model->config.machine_model_file.empty()) {
     machine = (MachineModel *)new EnhancedMachineModel(
-        model->config.machine_model_file, gpu_mem.capacity());
+        model->config.machine_model_file, gpu_mem_capacity);
   } else {
     assert(false &&
            "machine model creation error: currently only support "
@@ -1969,30 +2393,19 @@ std::pair<std::unique_ptr<Graph>, std::unordered_map<Node, MachineView>>
                           curr_best_graph,
                           curr_optimal_views,
                           perform_memory_search,
-                          MemoryOptimConfig{lambda.first},
-                          lambda.second);
+                          mem_config,
+                          search_result);
   }
   // Return the best result of the current search
   return std::make_pair(std::move(curr_best_graph), curr_optimal_views);
 };
 
 /**
- * @brief Analyze the per-device memory cost and compare with the memory
- * threshold of each device.
+ * @brief The memory in MB each device needs for the operators placed on it.
  */
-bool is_valid_strategy(
-    std::vector<std::pair<float, MemorySearchResult>> &lambdas_results,
-    Graph *curr_graph,
-    std::unordered_map<Node, MachineView> &curr_views,
-    std::shared_ptr<Simulator> const cached_simulator,
-    float memory_threshold) {
-  std::cout << "try to check valid for lambda " << lambdas_results.back().first
-            << std::endl;
-  assert(cached_simulator.get() != nullptr &&
-         "cached_simulator cannot be nullptr");
-
-  // Analyze the strategy and update max_per_device_mem_all_deivces in the
-  // lambda_result.
+std::unordered_map<int, float>
+    get_device_memory(std::unordered_map<Node, MachineView> const &curr_views,
+                      std::shared_ptr<Simulator> const cached_simulator) {
   std::unordered_map<int, float> device_to_mem{};
   for (auto const &view : curr_views) {
     CostMetrics op_cost =
@@ -2007,6 +2420,25 @@ bool is_valid_strategy(
       }
     }
   }
+  return device_to_mem;
+}
+
+/**
+ * @brief Analyze the per-device memory cost and compare with the memory
+ * threshold of each device.
+ */
+bool is_valid_strategy(MemorySearchResult &search_result,
+                       Graph *curr_graph,
+                       std::unordered_map<Node, MachineView> &curr_views,
+                       std::shared_ptr<Simulator> const cached_simulator,
+                       float memory_threshold) {
+  assert(cached_simulator.get() != nullptr &&
+         "cached_simulator cannot be nullptr");
+
+  // Analyze the strategy and update max_per_device_mem_all_deivces in the
+  // search_result.
+  std::unordered_map<int, float> device_to_mem =
+      get_device_memory(curr_views, cached_simulator);
 
   float max_per_device_mem = 0.0;
   float total_device_mem = 0.0;
@@ -2018,11 +2450,10 @@ bool is_valid_strategy(
     }
   }
 
-  lambdas_results.back().second.max_per_device_mem_all_deivces =
-      max_per_device_mem;
+  search_result.max_per_device_mem_all_deivces = max_per_device_mem;
 
   std::cout << "max_per_device_mem: "
-            << lambdas_results.back().second.max_per_device_mem_all_deivces
+            << search_result.max_per_device_mem_all_deivces
             << ", total_device_mem: " << total_device_mem << std::endl;
 
   if (max_per_device_mem >= memory_threshold) {
@@ -2031,6 +2462,60 @@ bool is_valid_strategy(
   return true;
 };
 
+/**
+ * @brief Searches the model for every node count of --cluster-sizing and
+ * prints the predicted throughput, scaling efficiency and memory of each.
+ *
+ * @details The shapes are searched one after another, since the search state
+ * lives in the FFModel, but share cached_simulator so that the operator costs
+ * measured for one shape are reused by all others. The config is restored
+ * afterwards for the search of the actual machine.
+ */
+void size_cluster(Task const *task,
+                  std::shared_ptr<Simulator> &cached_simulator,
+                  bool perform_memory_search) {
+  FFConfig &config = (*((FFModel **)task->args))->config;
+  if (config.machine_model_version != 0) {
+    fprintf(stderr,
+            "Cluster sizing only supports --machine-model-version 0\n");
+    return;
+  }
+  tl::optional<int> search_num_nodes = config.search_num_nodes;
+  int num_nodes = config.numNodes, workers_per_node = config.workersPerNode;
+  std::vector<ClusterShapeResult> results;
+  for (int shape_num_nodes : config.cluster_sizing_nodes) {
+    config.search_num_nodes = shape_num_nodes;
+    MemorySearchResult search_result{};
+    auto shape_result =
+        try_one_config(MemoryOptimConfig{MemorySearchAlgo::PARETO_FRONT},
+                       search_result,
+                       task,
+                       cached_simulator,
+                       perform_memory_search);
+    std::unordered_map<int, float> device_to_mem =
+        get_device_memory(shape_result.second, cached_simulator);
+    float max_device_memory = 0.0f;
+    for (auto const &d : device_to_mem) {
+      max_device_memory = std::max(max_device_memory, d.second);
+    }
+    ClusterShapeResult result;
+    result.num_nodes = config.numNodes;
+    result.workers_per_node = config.workersPerNode;
+    result.iteration_time_ms = perform_memory_search
+                                   ? search_result.run_time_cost
+                                   : shape_result.first->optimal_cost();
+    result.max_device_memory_mb = max_device_memory;
+    results.push_back(result);
+  }
+  config.search_num_nodes = search_num_nodes;
+  config.numNodes = num_nodes;
+  config.workersPerNode = workers_per_node;
+
+  std::cout << "Cluster sizing:" << std::endl;
+  write_cluster_sizing_table(
+      std::cout, results, config.batchSize, config.device_mem);
+}
+
 }; // namespace
 
 /**
@@ -2053,112 +2538,60 @@ GraphOptimalViewSerialized
   float memory_threshold = model_config.device_mem;
   bool only_data_parallel = model_config.only_data_parallel;
 
-  std::vector<std::pair<float, MemorySearchResult>> lambdas{};
-
   std::shared_ptr<Simulator> cached_simulator{};
+  MemorySearchResult search_result{};
 
-  // Optimized graph from the search
-  std::unique_ptr<Graph> best_graph;
-  std::unordered_map<Node, MachineView> optimal_views;
-
-  // Be optimistic
-  lambdas.emplace_back(std::make_pair(1.0, MemorySearchResult{}));
-  auto try_result = try_one_lambda(
-      lambdas.back(), task, cached_simulator, perform_memory_search);
-  best_graph = std::move(try_result.first);
-  optimal_views = try_result.second;
-
-  bool has_valid_strategy = false;
-  int best_lambda_index = -1;
-  int binary_search_budget = 10;
-
-  if (perform_memory_search && !is_valid_strategy(lambdas,
-                                                  best_graph.get(),
-                                                  optimal_views,
-                                                  cached_simulator,
-                                                  memory_threshold)) {
-    // Not found the strategy; need to do binary search
-    lambdas.emplace_back(std::make_pair(0.0, MemorySearchResult{}));
-    try_result = try_one_lambda(
-        lambdas.back(), task, cached_simulator, perform_memory_search);
-    best_graph = std::move(try_result.first);
-    optimal_views = try_result.second;
-
-    if (!is_valid_strategy(lambdas,
-                           best_graph.get(),
-                           optimal_views,
-                           cached_simulator,
-                           memory_threshold)) {
-      // Cannot find a valid strategy
-      has_valid_strategy = false;
-    } else {
-      has_valid_strategy = true;
-      best_lambda_index = 1;
-
-      // Do a binary search between 0 and 1 for the best lambda
-      int bianry_search_num = 0;
-      float lower = 0.0;
-      float upper = 1.0;
-
-      while (bianry_search_num < binary_search_budget) {
-        bianry_search_num++;
-
-        float mid = (lower + upper) * 0.5;
-
-        lambdas.emplace_back(std::make_pair(mid, MemorySearchResult{}));
-        try_result = try_one_lambda(
-            lambdas.back(), task, cached_simulator, perform_memory_search);
-
-        if (!is_valid_strategy(lambdas,
-                               try_result.first.get(),
-                               try_result.second,
-                               cached_simulator,
-                               memory_threshold)) {
-          upper = mid;
-        } else {
-          // Found a better and valid strategy
-          best_graph = std::move(try_result.first);
-          optimal_views = try_result.second;
-
-          lower = mid;
-          best_lambda_index = 1 + bianry_search_num;
-        }
-      }
-    }
-  } else {
-    has_valid_strategy = true;
-    best_lambda_index = 0;
+  if (!model_config.cluster_sizing_nodes.empty()) {
+    size_cluster(task, cached_simulator, perform_memory_search);
   }
 
+  // A single search finds the Pareto front of run time and per-device memory
+  // and keeps the fastest strategy that fits in memory_threshold, so there is
+  // no need to sweep the run time cost factor of MULTI_OBJECTIVE
+  auto try_result = try_one_config(
+      MemoryOptimConfig{MemorySearchAlgo::PARETO_FRONT},
+      search_result,
+      task,
+      cached_simulator,
+      perform_memory_search);
+  // Optimized graph from the search
+  std::unique_ptr<Graph> best_graph = std::move(try_result.first);
+  std::unordered_map<Node, MachineView> optimal_views = try_result.second;
+
   // Print out the results
   if (perform_memory_search) {
-    if (has_valid_strategy) {
-      auto &best_l = lambdas[best_lambda_index];
+    // The front's memory estimate is conservative, so check the strategy
+    // against the actual per-device usage
+    if (is_valid_strategy(search_result,
+                          best_graph.get(),
+                          optimal_views,
+                          cached_simulator,
+                          memory_threshold)) {
       std::cout << "Found valid strategy with memory_threshold: "
-                << memory_threshold << " | lambda index: " << best_lambda_index
-                << ", lambda value: " << best_l.first
-                << ", result: run time cost: " << best_l.second.run_time_cost
-                << ", memory cost: " << best_l.second.memory_cost
-                << ", search time: " << best_l.second.search_time
+                << memory_threshold
+                << " | result: run time cost: " << search_result.run_time_cost
+                << ", memory cost: " << search_result.memory_cost
+                << ", search time: " << search_result.search_time
                 << ", per-device max memory: "
-                << best_l.second.max_per_device_mem_all_deivces << std::endl;
+                << search_result.max_per_device_mem_all_deivces << std::endl;
     } else {
       std::cout << "Failed to find a valid strategy" << std::endl;
     }
-
-    std::cout << "All lambda results:" << std::endl;
-    for (auto l : lambdas) {
-      std::cout << "lambda: " << l.first
-                << ", run time cost: " << l.second.run_time_cost
-                << ", memory cost: " << l.second.memory_cost
-                << ", search time: " << l.second.search_time
-                << ", per-device max memory: "
-                << l.second.max_per_device_mem_all_deivces << std::endl;
-    }
   } else if (!only_data_parallel) {
     std::cout << "\nNot doing memory search" << std::endl;
   }
 
+  if (!model_config.export_cost_records_file.empty()) {
+    // Includes the records loaded for prediction, so that exported records
+    // accumulate over runs
+    cached_simulator->cost_predictor->save(
+        model_config.export_cost_records_file);
+  }
+  if (!model_config.profile_ops_prefix.empty()) {
+    (*((FFModel **)task->args))->searched_operator_costs =
+        cached_simulator->strict_hash_to_operator_cost;
+  }
+
   // Following lines are to serialize the optimized PCG.
   // Only need best_graph and optimal_views below.
   Serializer sez;
@@ -2319,6 +2752,16 @@ GraphOptimalViewSerialized
 
 }; // namespace FlexFlow::PCG
 
+namespace std {
+size_t hash<FlexFlow::PCG::ValidViewsKey>::operator()(
+    FlexFlow::PCG::ValidViewsKey const &key) const {
+  size_t h = 0;
+  hash_combine(h, key.output_shapes);
+  hash_combine(h, key.parallel_idxs);
+  return h;
+}
+}; // namespace std
+
 namespace FlexFlow {
 
 using PCG::Edge;
@@ -2695,6 +3138,7 @@ void FFModel::deserialize_graph_optimal_view(
           parallel_ops.push_back(info);
         }
         node = get_or_create_node<FusedParallelOp>(inputs[0], {parallel_ops});
+        assert(node != Node::INVALID_NODE);
         break;
       }
       default: {
@@ -1,4 +1,5 @@
 #include "flexflow/machine_view.h"
+#include <algorithm>
 
 namespace FlexFlow {
 
@@ -110,10 +111,15 @@ std::ostream &operator<<(std::ostream &s, MachineView const &view) {
 }
 
 MachineResource::MachineResource(FFConfig const &config)
-    : num_nodes(config.numNodes), all_cpus_per_node(config.cpusPerNode),
-      available_cpus_per_node(config.cpusPerNode),
-      all_gpus_per_node(config.workersPerNode),
-      available_gpus_per_node(config.workersPerNode) {}
+    : MachineResource(
+          config.numNodes, config.cpusPerNode, config.workersPerNode) {}
+
+MachineResource::MachineResource(int num_nodes,
+                                 int cpus_per_node,
+                                 int gpus_per_node)
+    : num_nodes(num_nodes), all_cpus_per_node(cpus_per_node),
+      available_cpus_per_node(cpus_per_node), all_gpus_per_node(gpus_per_node),
+      available_gpus_per_node(gpus_per_node) {}
 
 size_t MachineResource::hash() const {
   size_t ret = 17;
@@ -125,6 +131,30 @@ size_t MachineResource::hash() const {
   return ret;
 }
 
+int canonical_gpu_shift(std::vector<MachineView> const &views,
+                        MachineResource const &resources) {
+  int const gpus_per_node = resources.all_gpus_per_node;
+  int lo = resources.start_gpu_id;
+  int hi = resources.start_gpu_id +
+           (resources.num_nodes - 1) * gpus_per_node +
+           resources.available_gpus_per_node;
+  for (MachineView const &view : views) {
+    if (view.device_type != MachineView::GPU) {
+      return 0;
+    }
+    int last_device_id = view.start_device_id;
+    for (int i = 0; i < view.ndims; i++) {
+      last_device_id += (view.dim[i] - 1) * view.stride[i];
+    }
+    lo = std::min(lo, view.start_device_id);
+    hi = std::max(hi, last_device_id + 1);
+  }
+  if (lo / gpus_per_node == (hi - 1) / gpus_per_node) {
+    return lo;
+  }
+  return lo - lo % gpus_per_node;
+}
+
 }; // namespace FlexFlow
 
 namespace std {
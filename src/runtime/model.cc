@@ -19,9 +19,12 @@
 #else
 #include "flexflow/utils/hip_helper.h"
 #endif
+#include "flexflow/cluster_sizing.h"
 #include "flexflow/ffconst_utils.h"
+#include "flexflow/fusion_planner.h"
 #include "flexflow/graph.h"
 #include "flexflow/mapper.h"
+#include "flexflow/op_profiler.h"
 #include "flexflow/ops/aggregate.h"
 #include "flexflow/ops/aggregate_spec.h"
 #include "flexflow/ops/attention.h"
@@ -252,11 +255,14 @@ void Op::zero_grad(FFModel const &ff) {
   ArgumentMap argmap;
   ZeroInitMeta meta;
   meta.op_ptr = this;
-  meta.num_regions = numWeights + numOutputs;
-  assert(meta.num_regions <= ZeroInitMeta::MAX_NUM_REGIONS);
+  meta.num_regions = 0;
   IndexSpace parallel_is = IndexSpace::NO_SPACE;
   for (int i = 0; i < numWeights; i++) {
-    meta.data_types[i] = weights[i]->data_type;
+    // Weights trained from a sparse gradient have no dense gradient region
+    if (weights[i]->region_grad == LogicalRegion::NO_REGION) {
+      continue;
+    }
+    meta.data_types[meta.num_regions++] = weights[i]->data_type;
     if (parallel_is == IndexSpace::NO_SPACE) {
       parallel_is = weights[i]->parallel_is;
     } else {
@@ -264,13 +270,14 @@ void Op::zero_grad(FFModel const &ff) {
     }
   }
   for (int i = 0; i < numOutputs; i++) {
-    meta.data_types[i + numWeights] = outputs[i]->data_type;
+    meta.data_types[meta.num_regions++] = outputs[i]->data_type;
     if (parallel_is == IndexSpace::NO_SPACE) {
       parallel_is = outputs[i]->parallel_is;
     } else {
       assert(parallel_is == outputs[i]->parallel_is);
     }
   }
+  assert(meta.num_regions <= ZeroInitMeta::MAX_NUM_REGIONS);
   IndexLauncher launcher(ZERO_INIT_TASK_ID,
                          parallel_is,
                          TaskArgument(&meta, sizeof(ZeroInitMeta)),
@@ -279,13 +286,17 @@ void Op::zero_grad(FFModel const &ff) {
                          false /*must*/,
                          0 /*mapper_id*/,
                          outputs[0]->machine_view.hash());
+  int idx = 0;
   for (int i = 0; i < numWeights; i++) {
+    if (weights[i]->region_grad == LogicalRegion::NO_REGION) {
+      continue;
+    }
     launcher.add_region_requirement(RegionRequirement(weights[i]->part_grad,
                                                       0 /*projection id*/,
                                                       WRITE_ONLY,
                                                       EXCLUSIVE,
                                                       weights[i]->region_grad));
-    launcher.add_field(i, FID_DATA);
+    launcher.add_field(idx++, FID_DATA);
   }
   for (int i = 0; i < numOutputs; i++) {
     launcher.add_region_requirement(RegionRequirement(outputs[i]->part_grad,
@@ -297,7 +308,7 @@ void Op::zero_grad(FFModel const &ff) {
     // printf("zero_grad:output[%d]: region(%d,%d,%d)\n", i,
     // lr.get_index_space().get_id(), lr.get_field_space().get_id(),
     // lr.get_tree_id());
-    launcher.add_field(i + numWeights, FID_DATA);
+    launcher.add_field(idx++, FID_DATA);
   }
   runtime->execute_index_space(ctx, launcher);
 }
@@ -1221,6 +1232,14 @@ FFModel::FFModel(FFConfig &_config)
   }
 }
 
+FFModel::~FFModel() {
+  // The last checkpoint of a run can only be loaded once it has a manifest
+  wait_for_checkpoint();
+  if (!config.profile_ops_prefix.empty()) {
+    export_op_profile(config.profile_ops_prefix);
+  }
+}
+
 void FFModel::clear_graph_search_cache() {
   this->graph_search->clear_cache();
   this->search->clear_cache();
@@ -2410,6 +2429,9 @@ void FFModel::init_operators() {
   for (size_t i = 0; i < operators.size(); i++) {
     operators[i]->init(*this);
   }
+  if (!config.profile_ops_prefix.empty()) {
+    register_profiled_ops();
+  }
 }
 
 void FFModel::forward(int seq_length) {
@@ -2422,6 +2444,7 @@ void FFModel::forward(int seq_length) {
 void FFModel::recompile_on_condition(RecompileState &r) {
   if (r.trigger()) {
     r.alter();
+    invalidate_train_step_trace();
   }
 }
 
@@ -2473,6 +2496,90 @@ void FFModel::update() {
   }
 }
 
+size_t FFModel::get_train_step_signature(int seq_length) const {
+  size_t signature = 0;
+  hash_combine(signature, seq_length);
+  hash_combine(signature, optimizer);
+  for (Op const *op : operators) {
+    hash_combine(signature, op->op_guid);
+    for (int i = 0; i < op->numOutputs; i++) {
+      ParallelTensor const &output = op->outputs[i];
+      hash_combine(signature, output->machine_view);
+      for (int j = 0; j < output->num_dims; j++) {
+        hash_combine(signature, output->dims[j].size);
+        hash_combine(signature, output->dims[j].degree);
+      }
+    }
+  }
+  return signature;
+}
+
+void FFModel::invalidate_train_step_trace() {
+  train_step_trace_id = tl::nullopt;
+}
+
+void FFModel::train_step(int seq_length) {
+  // Trace IDs are shared by all models of the top-level task, so they are
+  // never reused
+  static Legion::TraceID next_train_step_trace_id = 10000;
+  Context ctx = config.lg_ctx;
+  Runtime *runtime = config.lg_hlr;
+  size_t signature = get_train_step_signature(seq_length);
+  if (!train_step_trace_id.has_value() || signature != train_step_signature) {
+    // A trace must issue the same launches on every replay
+    train_step_trace_id = next_train_step_trace_id++;
+    train_step_signature = signature;
+  }
+  runtime->begin_trace(ctx, train_step_trace_id.value());
+  forward(seq_length);
+  zero_gradients();
+  backward(seq_length);
+  update();
+  runtime->end_trace(ctx, train_step_trace_id.value());
+}
+
+void FFModel::register_profiled_ops() const {
+  Context ctx = config.lg_ctx;
+  Runtime *runtime = config.lg_hlr;
+  OpProfiler &profiler = OpProfiler::get_instance();
+  for (Op const *op : operators) {
+    // Only operators with tasks that get their OpMeta, see
+    // FFMapper::get_profiled_pass
+    if (op->op_type == OP_INPUT || op->op_type == OP_WEIGHT ||
+        op->op_type == OP_NOOP || op->is_parallel_op()) {
+      continue;
+    }
+    Domain domain = runtime->get_index_space_domain(ctx, op->parallel_is);
+    for (int i = 0; i < (int)domain.get_volume(); i++) {
+      profiler.register_shard(op->meta[i], op->op_guid, op->name, i);
+    }
+  }
+}
+
+bool FFModel::export_op_profile(std::string const &prefix) const {
+  std::map<std::pair<size_t, ProfiledPass>, float> predicted_ms;
+  for (Op const *op : operators) {
+    if (op->numOutputs == 0) {
+      continue;
+    }
+    tl::optional<ProfilingRecordKey> key = Simulator::get_profiling_record_key(
+        op, op->outputs[0]->machine_view);
+    if (!key.has_value()) {
+      continue;
+    }
+    auto const &it = searched_operator_costs.find(key.value());
+    if (it != searched_operator_costs.end()) {
+      predicted_ms[{op->op_guid, ProfiledPass::FORWARD}] =
+          it->second.forward_time;
+      predicted_ms[{op->op_guid, ProfiledPass::BACKWARD}] =
+          it->second.backward_time;
+    }
+  }
+  OpProfiler const &profiler = OpProfiler::get_instance();
+  return profiler.write_csv(prefix + ".csv", predicted_ms) &&
+         profiler.write_chrome_trace(prefix + ".json");
+}
+
 Op *FFModel::get_final_operator() const {
   int idx = operators.size() - 1;
   while (operators[idx]->op_type == OP_INPUT ||
@@ -2492,114 +2599,122 @@ void FFModel::compile(Optimizer *_optimizer,
   compile(loss_type, metrics, comp_mode);
 }
 
+/*static*/
+bool FFModel::can_fuse_operator(Op const *op) {
+  // don't fuse input and weight operator since they don't involve any
+  // forward/backward task launches, nor parallel ops since they have
+  // different parallel_is in forward/backward, nor embeddings with a
+  // sparse gradient since FusedOp only knows about dense weight gradients
+  return op->op_type != OP_INPUT && op->op_type != OP_WEIGHT &&
+         !op->is_parallel_op() &&
+         !(op->op_type == OP_EMBEDDING && ((Embedding const *)op)->sparse_grad);
+}
+
 bool FFModel::apply_fusion(std::vector<Op *> const &operators,
                            std::vector<Op *> &new_operators) {
-  // Context ctx = config.lg_ctx;
-  // Runtime* runtime = config.lg_hlr;
-  for (size_t l = 1; l < operators.size() - 1; l++) {
-    // don't fuse input and weight operator since they don't involve any
-    // forward/backward task launches
-    if (operators[l]->op_type == OP_INPUT ||
-        operators[l]->op_type == OP_WEIGHT) {
-      continue;
+  // Summarize the operators for the planner, numbering machine views and
+  // logical regions
+  std::vector<FusionPlannerOp> planner_ops(operators.size());
+  {
+    std::unordered_map<MachineView, int> view_ids;
+    std::map<LogicalRegion, int> region_ids;
+    std::unordered_map<Op const *, int> positions;
+    auto region_id = [&](ParallelTensor const &tensor) {
+      return region_ids.insert({tensor->region, (int)region_ids.size()})
+          .first->second;
+    };
+    for (size_t l = 0; l < operators.size(); l++) {
+      Op *op = operators[l];
+      FusionPlannerOp &planner_op = planner_ops[l];
+      planner_op.view =
+          view_ids.insert({op->outputs[0]->machine_view, (int)view_ids.size()})
+              .first->second;
+      planner_op.can_fuse = can_fuse_operator(op);
+      // a fused op cannot start with an in-place operator
+      planner_op.can_start_group =
+          planner_op.can_fuse && !op->has_inplace_output();
+      for (int idx = 0; idx < op->numInputs; idx++) {
+        int producer = -1;
+        if (op->inputs[idx]->owner_op != NULL) {
+          assert(positions.find(op->inputs[idx]->owner_op) != positions.end());
+          producer = positions.at(op->inputs[idx]->owner_op);
+        }
+        planner_op.producers.push_back(producer);
+        planner_op.inputs.push_back(region_id(op->inputs[idx]));
+      }
+      for (int idx = 0; idx < op->numWeights; idx++) {
+        planner_op.weights.push_back(region_id(op->weights[idx]));
+      }
+      for (int idx = 0; idx < op->numOutputs; idx++) {
+        planner_op.outputs.push_back(region_id(op->outputs[idx]));
+      }
+      positions[op] = l;
     }
-    // don't fuse parallel op since they have different parallel_is in
-    // forward/backward
-    if (operators[l]->is_parallel_op()) {
+  }
+  FusionLimits limits;
+  limits.max_operators = MAX_NUM_FUSED_OPERATORS;
+  limits.max_tensors = MAX_NUM_FUSED_TENSORS;
+  limits.max_inputs = MAX_NUM_INPUTS;
+  limits.max_weights = MAX_NUM_WEIGHTS;
+  limits.max_outputs = MAX_NUM_OUTPUTS;
+  std::vector<int> group = plan_fusion(planner_ops, limits);
+
+  // Build every FusedOp, adding operators in their original order
+  std::vector<FusedOp *> fused_ops(operators.size(), nullptr);
+  std::unordered_map<Op const *, FusedOp *> fused_owner;
+  bool fused_any = false;
+  for (size_t l = 0; l < operators.size(); l++) {
+    if (group[l] == (int)l) {
       continue;
     }
-    size_t start = 0;
-    {
-      Op *opl = operators[l];
-      for (int idx = 0; idx < opl->numInputs; idx++) {
-        bool found = false;
-        for (size_t i = 0; i < l; i++) {
-          if (opl->inputs[idx]->owner_op == operators[i]) {
-            assert(!found);
-            found = true;
-            if (i > start) {
-              start = i;
-            }
-          }
-        }
-        assert(found || (opl->inputs[idx]->owner_op == NULL));
-      }
-    }
-    for (size_t i = start; i < l; i++) {
-      // Domain d1 =
-      // runtime->get_index_space_domain(operators[l]->outputs[0]->parallel_is);
-      // Domain d2 =
-      // runtime->get_index_space_domain(operators[i]->outputs[0]->parallel_is);
-      MachineView view1 = operators[l]->outputs[0]->machine_view;
-      MachineView view2 = operators[i]->outputs[0]->machine_view;
-      if (view1 == view2) {
-        FusedOp *fused_op = nullptr;
-        bool allocate_new_fused_op = false;
-        if (operators[i]->op_type == OP_FUSED) {
-          fused_op = (FusedOp *)operators[i];
-        } else {
-          //  cannot be an in-place operator
-          if (operators[i]->has_inplace_output()) {
-            continue;
-          }
-          // don't fuse input and weight operator since they don't involve any
-          // forward/backward kernels
-          if (operators[i]->op_type == OP_INPUT ||
-              operators[i]->op_type == OP_WEIGHT) {
-            continue;
-          }
-          // don't fuse parallel op since they have different parallel_is in
-          // forward/backward
-          if (operators[i]->is_parallel_op()) {
-            continue;
-          }
-          fused_op = new FusedOp(*this, operators[i]);
-          allocate_new_fused_op = true;
-        }
-        if (fused_op->add_operator(*this, operators[l])) {
-          // Construct new operators
-          new_operators.clear();
-          for (size_t j = 0; j < i; j++) {
-            new_operators.push_back(operators[j]);
-          }
-          new_operators.push_back(fused_op);
-          for (size_t j = i + 1; j < operators.size(); j++) {
-            if (j == l) {
-              continue; // l and i are fused
-            }
-            Op *op = operators[j];
-            // Update input tensors that belong to operator[l] or operator[i]
-            for (int idx = 0; idx < op->numInputs; idx++) {
-              if ((op->inputs[idx]->owner_op == operators[l]) ||
-                  (op->inputs[idx]->owner_op == operators[i])) {
-                int found = -1;
-                for (int k = 0; k < fused_op->numOutputs; k++) {
-                  if (fused_op->outputs[k]->region == op->inputs[idx]->region) {
-                    assert(found == -1);
-                    found = k;
-                  }
-                }
-                assert(found >= 0);
-                op->inputs[idx] = fused_op->outputs[found];
-              }
-            }
-            // Insert op
-            new_operators.push_back(op);
-          }
-          // We are exact one operator fewer than the original
-          assert(new_operators.size() + 1 == operators.size());
-          return true;
-        } else {
-          // TODO: delete fused_op to avoid memory leakage
-          if (allocate_new_fused_op) {
-            delete fused_op;
-          }
-          continue;
+    int i = group[l];
+    if (fused_ops[i] == nullptr) {
+      fused_ops[i] = new FusedOp(*this, operators[i]);
+      fused_owner[operators[i]] = fused_ops[i];
+    }
+    bool added = fused_ops[i]->add_operator(*this, operators[l]);
+    assert(added && "the fusion planner checks all FusedOp limits");
+    (void)added;
+    fused_owner[operators[l]] = fused_ops[i];
+    fused_any = true;
+  }
+  if (!fused_any) {
+    return false;
+  }
+
+  // Inputs that still belong to a fused operator (e.g. the output of an
+  // in-place operator that shares its region with an earlier output) are
+  // updated to the FusedOp's output with the same region
+  auto update_inputs = [&](Op *op) {
+    for (int idx = 0; idx < op->numInputs; idx++) {
+      auto it = fused_owner.find(op->inputs[idx]->owner_op);
+      if (it == fused_owner.end()) {
+        continue;
+      }
+      FusedOp *fused_op = it->second;
+      int found = -1;
+      for (int k = 0; k < fused_op->numOutputs; k++) {
+        if (fused_op->outputs[k]->region == op->inputs[idx]->region) {
+          assert(found == -1);
+          found = k;
         }
       }
+      assert(found >= 0);
+      op->inputs[idx] = fused_op->outputs[found];
+    }
+  };
+  // Construct new operators
+  new_operators.clear();
+  for (size_t j = 0; j < operators.size(); j++) {
+    update_inputs(operators[j]);
+    if (fused_ops[j] != nullptr) {
+      update_inputs(fused_ops[j]);
+      new_operators.push_back(fused_ops[j]);
+    } else if (group[j] == (int)j) {
+      new_operators.push_back(operators[j]);
     }
   }
-  return false;
+  return true;
 }
 
 Op *FFModel::create_operator_from_layer(
@@ -2803,16 +2918,13 @@ void FFModel::create_operators_from_layers() {
 void FFModel::compile(LossType loss_type,
                       std::vector<MetricsType> const &metrics,
                       CompMode comp_mode) {
+  invalidate_train_step_trace();
   if (metrics_input == -1) {
     metrics_input = operators.size() - 1;
   }
   Context ctx = config.lg_ctx;
   Runtime *runtime = config.lg_hlr;
   config.computationMode = comp_mode;
-  // if (config.import_strategy_file.length() > 0) {
-  //   load_strategies_from_file(config.import_strategy_file,
-  //   config.strategies);
-  // }
   //  Construct operators from layers
   if (config.only_data_parallel) {
     fprintf(stderr,
@@ -2820,16 +2932,29 @@ void FFModel::compile(LossType loss_type,
             "data-parallel PCG.\n");
   }
   create_operators_from_layers();
-  // Launch the graph optimize task
+  // Launch the graph optimize task, unless a strategy searched for this model
+  // before can be imported
   {
-    FFModel *model = this;
-    TaskLauncher launcher(GRAPH_OPTIMIZE_TASK_ID,
-                          TaskArgument(&model, sizeof(FFModel *)));
-    Future future = runtime->execute_task(ctx, launcher);
-
-    PCG::GraphOptimalViewSerialized ret =
-        future.get_result<PCG::GraphOptimalViewSerialized>();
-    Deserializer dez(ret.data, ret.total_bytes);
+    std::unique_ptr<PCG::GraphOptimalViewSerialized> ret(
+        new PCG::GraphOptimalViewSerialized);
+    if (config.import_strategy_file.empty() ||
+        !import_strategy(config.import_strategy_file, *ret)) {
+      if (!config.import_strategy_file.empty()) {
+        fprintf(stderr,
+                "Cannot import strategy from %s, searching for one instead\n",
+                config.import_strategy_file.c_str());
+      }
+      FFModel *model = this;
+      TaskLauncher launcher(GRAPH_OPTIMIZE_TASK_ID,
+                            TaskArgument(&model, sizeof(FFModel *)));
+      Future future = runtime->execute_task(ctx, launcher);
+
+      *ret = future.get_result<PCG::GraphOptimalViewSerialized>();
+      if (!config.export_strategy_file.empty()) {
+        export_strategy(config.export_strategy_file, *ret);
+      }
+    }
+    Deserializer dez(ret->data, ret->total_bytes);
     // Reconstruct operators
     PCG::Graph *best_graph = new PCG::Graph(this);
     std::unordered_map<PCG::Node, MachineView> optimal_views;
@@ -2967,7 +3092,7 @@ void FFModel::compile(LossType loss_type,
     fprintf(stderr, "%zu operators before fusion...\n", operators.size());
     std::vector<Op *> new_operators;
     std::vector<Op *> old_operators = operators;
-    while (apply_fusion(operators, new_operators)) {
+    if (apply_fusion(operators, new_operators)) {
       for (size_t i = 0; i < new_operators.size(); i++) {
         for (int idx = 0; idx < new_operators[i]->numInputs; idx++) {
           for (size_t j = i + 1; j < new_operators.size(); j++) {
@@ -3519,6 +3644,7 @@ FFConfig::FFConfig() {
   enable_parameter_parallel = DefaultConfig::enableParameterParallel;
   enable_attribute_parallel = DefaultConfig::enableAttributeParallel;
   enable_inplace_optimizations = DefaultConfig::enableInplaceOptimizations;
+  sparse_embedding_grad = false;
   allow_tensor_op_math_conversion = DefaultConfig::allowTensorOpMathConversion;
   machine_model_version = DefaultConfig::machine_model_version;
   simulator_segment_size = DefaultConfig::simulator_segment_size;
@@ -3526,6 +3652,12 @@ FFConfig::FFConfig() {
   enable_control_replication = DefaultConfig::enable_control_replication;
   python_data_loader_type = DefaultConfig::python_data_loader_type;
   machine_model_file = "";
+  roofline_device_file = "";
+  cost_predictor_file = "";
+  cost_predictor_threshold = 0.1f;
+  export_cost_records_file = "";
+  task_launch_time = 0.02f;
+  profile_ops_prefix = "";
   import_strategy_file = "";
   export_strategy_file = "";
   export_strategy_task_graph_file = "";
@@ -3533,9 +3665,13 @@ FFConfig::FFConfig() {
   export_strategy_computation_graph_file = "";
   dataset_path = "";
   substitution_json_path = tl::nullopt;
+  substitution_profile_path = tl::nullopt;
+  substitution_prune_top_k = tl::nullopt;
+  substitution_prune_min_utility = tl::nullopt;
   syntheticInput = false;
   perform_fusion = false;
   base_optimize_threshold = DefaultConfig::base_optimize_threshold;
+  canonical_machine_views = false;
   perform_memory_search = false;
 
   // Parse input arguments
@@ -3683,6 +3819,30 @@ void FFConfig::parse_args(char **argv, int argc) {
       machine_model_file = std::string(argv[++i]);
       continue;
     }
+    if (!strcmp(argv[i], "--roofline-cost-model")) {
+      roofline_device_file = std::string(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--cost-predictor")) {
+      cost_predictor_file = std::string(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--cost-predictor-threshold")) {
+      cost_predictor_threshold = atof(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--task-launch-time")) {
+      task_launch_time = atof(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--export-cost-records")) {
+      export_cost_records_file = std::string(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--profile-ops")) {
+      profile_ops_prefix = std::string(argv[++i]);
+      continue;
+    }
     if (!strcmp(argv[i], "--simulator-segment-size")) {
       simulator_segment_size = atoi(argv[++i]);
       continue;
@@ -3695,10 +3855,18 @@ void FFConfig::parse_args(char **argv, int argc) {
       enable_propagation = true;
       continue;
     }
+    if (!strcmp(argv[i], "--canonical-machine-views")) {
+      canonical_machine_views = true;
+      continue;
+    }
     if (!strcmp(argv[i], "--enable-inplace-optimizations")) {
       enable_inplace_optimizations = true;
       continue;
     }
+    if (!strcmp(argv[i], "--sparse-embedding-grad")) {
+      sparse_embedding_grad = true;
+      continue;
+    }
     if (!strcmp(argv[i], "--search-num-nodes")) {
       search_num_nodes = atoi(argv[++i]);
       continue;
@@ -3707,6 +3875,15 @@ void FFConfig::parse_args(char **argv, int argc) {
       search_num_workers = atoi(argv[++i]);
       continue;
     }
+    if (!strcmp(argv[i], "--cluster-sizing")) {
+      if (!parse_cluster_sizing_nodes(argv[++i], cluster_sizing_nodes)) {
+        fprintf(stderr,
+                "Invalid node counts for --cluster-sizing: %s\n",
+                argv[i]);
+        assert(false);
+      }
+      continue;
+    }
     if (!strcmp(argv[i], "--base-optimize-threshold")) {
       base_optimize_threshold = atoi(argv[++i]);
     }
@@ -3722,6 +3899,18 @@ void FFConfig::parse_args(char **argv, int argc) {
       substitution_json_path = std::string(argv[++i]);
       continue;
     }
+    if (!strcmp(argv[i], "--substitution-profile")) {
+      substitution_profile_path = std::string(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--substitution-prune-top-k")) {
+      substitution_prune_top_k = atoi(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--substitution-prune-min-utility")) {
+      substitution_prune_min_utility = atof(argv[++i]);
+      continue;
+    }
     if (!strcmp(argv[i], "--memory-search")) {
       perform_memory_search = true;
       continue;
@@ -4026,20 +4215,50 @@ void register_flexflow_internal_tasks(Runtime *runtime,
     }
   }
   // Embedding task CPU
-  /* {
-    TaskVariantRegistrar registrar(EMBED_FWD_TASK_ID, "Embedding Forward");
+  {
+    TaskVariantRegistrar registrar(EMBED_INIT_TASK_ID, "Embedding Init (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<OpMeta *, Embedding::init_task>(
+          registrar, "Embedding Init (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<OpMeta *, Embedding::init_task>(registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(EMBED_FWD_TASK_ID,
+                                   "Embedding Forward (CPU)");
     registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
     registrar.set_leaf();
-    Runtime::preregister_task_variant<Embedding::forward_task_cpu>(
-        registrar, "Embedding Forward Task");
+    if (pre_register) {
+      Runtime::preregister_task_variant<Embedding::forward_task_cpu>(
+          registrar, "Embedding Forward (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<Embedding::forward_task_cpu>(registrar);
+    }
   }
   {
-    TaskVariantRegistrar registrar(EMBED_BWD_TASK_ID, "Embedding Backward");
+    TaskVariantRegistrar registrar(EMBED_BWD_TASK_ID,
+                                   "Embedding Backward (CPU)");
     registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
     registrar.set_leaf();
-    Runtime::preregister_task_variant<Embedding::backward_task_cpu>(
-        registrar, "Embedding Backward Task");
-  }*/
+    if (pre_register) {
+      Runtime::preregister_task_variant<Embedding::backward_task_cpu>(
+          registrar, "Embedding Backward (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<Embedding::backward_task_cpu>(registrar);
+    }
+  }
   // Gather task
   {
     TaskVariantRegistrar registrar(GATHER_INIT_TASK_ID, "Gather Init");
@@ -4170,6 +4389,52 @@ void register_flexflow_internal_tasks(Runtime *runtime,
       runtime->register_task_variant<Group_by::backward_task>(registrar);
     }
   }
+  {
+    TaskVariantRegistrar registrar(GROUP_BY_INIT_TASK_ID,
+                                   "Group_by Init (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<OpMeta *, Group_by::init_task_cpu>(
+          registrar, "Group_by Init (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<OpMeta *, Group_by::init_task_cpu>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(GROUP_BY_FWD_TASK_ID,
+                                   "Group_by Forward (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<Group_by::forward_task_cpu>(
+          registrar, "Group_by Forward (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<Group_by::forward_task_cpu>(registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(GROUP_BY_BWD_TASK_ID,
+                                   "Group_by Backward (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<Group_by::backward_task_cpu>(
+          registrar, "Group_by Backward (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<Group_by::backward_task_cpu>(registrar);
+    }
+  }
 
   // Aggregate task CPU
   {
@@ -4214,6 +4479,52 @@ void register_flexflow_internal_tasks(Runtime *runtime,
       runtime->register_task_variant<Aggregate::backward_task>(registrar);
     }
   }
+  {
+    TaskVariantRegistrar registrar(AGGREGATE_INIT_TASK_ID,
+                                   "Aggregate Init (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<OpMeta *, Aggregate::init_task_cpu>(
+          registrar, "Aggregate Init (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<OpMeta *, Aggregate::init_task_cpu>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(AGGREGATE_FWD_TASK_ID,
+                                   "Aggregate Forward (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<Aggregate::forward_task_cpu>(
+          registrar, "Aggregate Forward (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<Aggregate::forward_task_cpu>(registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(AGGREGATE_BWD_TASK_ID,
+                                   "Aggregate Backward (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<Aggregate::backward_task_cpu>(
+          registrar, "Aggregate Backward (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<Aggregate::backward_task_cpu>(registrar);
+    }
+  }
 
   // AggregateSpec task CPU
   {
@@ -4262,6 +4573,54 @@ void register_flexflow_internal_tasks(Runtime *runtime,
       runtime->register_task_variant<AggregateSpec::backward_task>(registrar);
     }
   }
+  {
+    TaskVariantRegistrar registrar(AGG_SPEC_INIT_TASK_ID,
+                                   "AggregateSpec Init (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<OpMeta *, AggregateSpec::init_task_cpu>(
+          registrar, "AggregateSpec Init (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<OpMeta *, AggregateSpec::init_task_cpu>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(AGG_SPEC_FWD_TASK_ID,
+                                   "AggregateSpec Forward (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<AggregateSpec::forward_task_cpu>(
+          registrar, "AggregateSpec Forward (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<AggregateSpec::forward_task_cpu>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(AGG_SPEC_BWD_TASK_ID,
+                                   "AggregateSpec Backward (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<AggregateSpec::backward_task_cpu>(
+          registrar, "AggregateSpec Backward (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<AggregateSpec::backward_task_cpu>(
+          registrar);
+    }
+  }
 
   // Pool2D task
   {
@@ -4440,6 +4799,52 @@ void register_flexflow_internal_tasks(Runtime *runtime,
       runtime->register_task_variant<LayerNorm::backward_task>(registrar);
     }
   }
+  {
+    TaskVariantRegistrar registrar(LAYERNORM_INIT_TASK_ID,
+                                   "layernorm_init_task_cpu");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<OpMeta *, LayerNorm::init_task_cpu>(
+          registrar, "layernorm_init_task_cpu");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<OpMeta *, LayerNorm::init_task_cpu>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(LAYERNORM_FWD_TASK_ID,
+                                   "layernorm_fwd_task_cpu");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<LayerNorm::forward_task_cpu>(
+          registrar, "layernorm_fwd_task_cpu");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<LayerNorm::forward_task_cpu>(registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(LAYERNORM_BWD_TASK_ID,
+                                   "layernorm_bwd_task_cpu");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<LayerNorm::backward_task_cpu>(
+          registrar, "layernorm_bwd_task_cpu");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<LayerNorm::backward_task_cpu>(registrar);
+    }
+  }
   // Linear task
   {
     TaskVariantRegistrar registrar(LINEAR_INIT_TASK_ID, "Linear Init");
@@ -4569,6 +4974,50 @@ void register_flexflow_internal_tasks(Runtime *runtime,
       runtime->register_task_variant<Softmax::backward_task>(registrar);
     }
   }
+  {
+    TaskVariantRegistrar registrar(SOFTMAX_INIT_TASK_ID,
+                                   "softmax_init_task_cpu");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<OpMeta *, Softmax::init_task_cpu>(
+          registrar, "softmax_init_task_cpu");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<OpMeta *, Softmax::init_task_cpu>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(SOFTMAX_FWD_TASK_ID, "softmax_fwd_task_cpu");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<Softmax::forward_task_cpu>(
+          registrar, "softmax_fwd_task_cpu");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<Softmax::forward_task_cpu>(registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(SOFTMAX_BWD_TASK_ID, "softmax_bwd_task_cpu");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<Softmax::backward_task_cpu>(
+          registrar, "softmax_bwd_task_cpu");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<Softmax::backward_task_cpu>(registrar);
+    }
+  }
   // compute Loss
   {
     TaskVariantRegistrar registrar(LOSS_BWD_TASK_ID, "Loss Backward");
@@ -4883,6 +5332,48 @@ void register_flexflow_internal_tasks(Runtime *runtime,
       runtime->register_task_variant<TopK::backward_task>(registrar);
     }
   }
+  {
+    TaskVariantRegistrar registrar(TOPK_INIT_TASK_ID, "TopK Init (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<OpMeta *, TopK::init_task>(
+          registrar, "TopK Init (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<OpMeta *, TopK::init_task>(registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(TOPK_FWD_TASK_ID, "TopK Forward (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<TopK::forward_task_cpu>(
+          registrar, "TopK Forward (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<TopK::forward_task_cpu>(registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(TOPK_BWD_TASK_ID, "TopK Backward (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<TopK::backward_task_cpu>(
+          registrar, "TopK Backward (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<TopK::backward_task_cpu>(registrar);
+    }
+  }
   // Transpose task
   {
     TaskVariantRegistrar registrar(TRANSPOSE_INIT_TASK_ID, "Transpose Init");
@@ -4976,6 +5467,56 @@ void register_flexflow_internal_tasks(Runtime *runtime,
           registrar);
     }
   }
+  {
+    TaskVariantRegistrar registrar(ATTENTION_INIT_TASK_ID,
+                                   "MultiHeadAttention Init (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<OpMeta *,
+                                        MultiHeadAttention::init_task_cpu>(
+          registrar, "MultiHeadAttention Init (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<OpMeta *,
+                                     MultiHeadAttention::init_task_cpu>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(ATTENTION_FWD_TASK_ID,
+                                   "MultiHeadAttention Forward (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<MultiHeadAttention::forward_task_cpu>(
+          registrar, "MultiHeadAttention Forward (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<MultiHeadAttention::forward_task_cpu>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(ATTENTION_BWD_TASK_ID,
+                                   "MultiHeadAttention Backward (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<MultiHeadAttention::backward_task_cpu>(
+          registrar, "MultiHeadAttention Backward (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<MultiHeadAttention::backward_task_cpu>(
+          registrar);
+    }
+  }
   // NoOp
   {
     TaskVariantRegistrar registrar(NOOP_INIT_TASK_ID, "Weight NCCL Init");
@@ -5245,6 +5786,38 @@ void register_flexflow_internal_tasks(Runtime *runtime,
       runtime->register_task_variant<AdamOptimizer::ps_update_task>(registrar);
     }
   }
+  {
+    TaskVariantRegistrar registrar(SGD_UPD_PS_TASK_ID,
+                                   "SGD Parameter Server Update (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<SGDOptimizer::ps_update_task_cpu>(
+          registrar, "SGD Parameter Server Update (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<SGDOptimizer::ps_update_task_cpu>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(ADAM_UPD_PS_TASK_ID,
+                                   "Adam Parameter Server Update (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<AdamOptimizer::ps_update_task_cpu>(
+          registrar, "Adam Parameter Server Update (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<AdamOptimizer::ps_update_task_cpu>(
+          registrar);
+    }
+  }
 #ifdef FF_USE_NCCL
   {
     TaskVariantRegistrar registrar(SGD_UPD_NCCL_TASK_ID, "SGD NCCL Update");
@@ -5276,6 +5849,69 @@ void register_flexflow_internal_tasks(Runtime *runtime,
     }
   }
 #endif
+  {
+    TaskVariantRegistrar registrar(SGD_UPD_SPARSE_TASK_ID, "SGD Sparse Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<SGDOptimizer::sparse_update_task>(
+          registrar, "SGD Sparse Update");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<SGDOptimizer::sparse_update_task>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(SGD_UPD_SPARSE_TASK_ID,
+                                   "SGD Sparse Update (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<SGDOptimizer::sparse_update_task_cpu>(
+          registrar, "SGD Sparse Update (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<SGDOptimizer::sparse_update_task_cpu>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(ADAM_UPD_SPARSE_TASK_ID,
+                                   "Adam Sparse Update");
+    registrar.add_constraint(ProcessorConstraint(Processor::TOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<AdamOptimizer::sparse_update_task>(
+          registrar, "Adam Sparse Update");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<AdamOptimizer::sparse_update_task>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(ADAM_UPD_SPARSE_TASK_ID,
+                                   "Adam Sparse Update (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<AdamOptimizer::sparse_update_task_cpu>(
+          registrar, "Adam Sparse Update (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<AdamOptimizer::sparse_update_task_cpu>(
+          registrar);
+    }
+  }
   // Initializer
   {
     TaskVariantRegistrar registrar(ZERO_INIT_TASK_ID, "Zero Init");
@@ -5446,6 +6082,57 @@ void register_flexflow_internal_tasks(Runtime *runtime,
           registrar);
     }
   }
+  // Graph optimize on hosts without GPUs, which requires estimating operator
+  // costs with --roofline-cost-model
+  {
+    TaskVariantRegistrar registrar(GRAPH_OPTIMIZE_TASK_ID,
+                                   "Graph Optimize CPU");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<PCG::GraphOptimalViewSerialized,
+                                        PCG::Graph::graph_optimize_task>(
+          registrar, "Graph Optimize CPU Task");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<PCG::GraphOptimalViewSerialized,
+                                     PCG::Graph::graph_optimize_task>(
+          registrar);
+    }
+  }
+  // Checkpoint tasks
+  {
+    TaskVariantRegistrar registrar(CHECKPOINT_SAVE_TASK_ID, "Checkpoint Save");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<bool, FFModel::checkpoint_save_task>(
+          registrar, "Checkpoint Save Task");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<bool, FFModel::checkpoint_save_task>(
+          registrar);
+    }
+  }
+  {
+    TaskVariantRegistrar registrar(CHECKPOINT_LOAD_TASK_ID, "Checkpoint Load");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<bool, FFModel::checkpoint_load_task>(
+          registrar, "Checkpoint Load Task");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<bool, FFModel::checkpoint_load_task>(
+          registrar);
+    }
+  }
   // Parameter Server Prefetch task
   {
     TaskVariantRegistrar registrar(PS_PREFETCH_TASK_ID, "Weights Prefetch");
@@ -5461,6 +6148,21 @@ void register_flexflow_internal_tasks(Runtime *runtime,
       runtime->register_task_variant<UtilityTasks::dummy_task>(registrar);
     }
   }
+  {
+    TaskVariantRegistrar registrar(PS_PREFETCH_TASK_ID,
+                                   "Weights Prefetch (CPU)");
+    registrar.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    registrar.set_leaf();
+    if (pre_register) {
+      Runtime::preregister_task_variant<UtilityTasks::dummy_task>(
+          registrar, "Weights Prefetch (CPU)");
+    } else {
+      if (enable_control_replication) {
+        registrar.global_registration = false;
+      }
+      runtime->register_task_variant<UtilityTasks::dummy_task>(registrar);
+    }
+  }
 }
 
 // template instantiations
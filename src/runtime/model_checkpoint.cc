@@ -0,0 +1,377 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/checkpoint.h"
+#include "flexflow/model.h"
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+
+namespace FlexFlow {
+
+using namespace Legion;
+
+namespace {
+
+void serialize_string(Serializer &sez, std::string const &s) {
+  sez.serialize(s.size());
+  sez.serialize(s.c_str(), s.size());
+}
+
+std::string deserialize_string(Deserializer &dez) {
+  size_t size;
+  dez.deserialize(size);
+  std::string s(size, '\0');
+  dez.deserialize(&s[0], size);
+  return s;
+}
+
+std::string get_shard_filename(std::string const &name,
+                               DomainPoint const &point) {
+  std::string filename = name;
+  for (int i = 0; i < point.get_dim(); i++) {
+    filename += (i == 0 ? "." : "_") + std::to_string(point[i]);
+  }
+  return filename;
+}
+
+// The part of a shard's region in the tensor without its replica dims, or
+// false for the copies of a replica other than the first
+bool get_logical_rect(Domain const &domain,
+                      std::vector<bool> const &replica_dims,
+                      std::vector<int> &lo,
+                      std::vector<int> &hi) {
+  lo.clear();
+  hi.clear();
+  for (int i = 0; i < domain.get_dim(); i++) {
+    if (replica_dims[i]) {
+      if (domain.lo()[i] != 0) {
+        return false;
+      }
+    } else {
+      lo.push_back(domain.lo()[i]);
+      hi.push_back(domain.hi()[i]);
+    }
+  }
+  return true;
+}
+
+// Checkpoints only restore the state of the same kind of optimizer
+std::string get_optimizer_name(Optimizer const *optimizer) {
+  if (SGDOptimizer const *sgd = dynamic_cast<SGDOptimizer const *>(optimizer)) {
+    return sgd->momentum > 0.0f ? "sgd_momentum" : "sgd";
+  }
+  if (dynamic_cast<AdamOptimizer const *>(optimizer) != nullptr) {
+    return "adam";
+  }
+  return "none";
+}
+
+}; // namespace
+
+std::vector<FFModel::CheckpointTarget>
+    FFModel::get_checkpoint_targets() const {
+  std::vector<CheckpointTarget> targets;
+  SGDOptimizer const *sgd = dynamic_cast<SGDOptimizer const *>(optimizer);
+  AdamOptimizer const *adam = dynamic_cast<AdamOptimizer const *>(optimizer);
+  for (ParallelTensor const &p : parameters) {
+    // Layer GUIDs do not depend on the searched strategy, so that the
+    // checkpoint can be restored under another one
+    std::string name = std::to_string(p->owner_op->layer_guid.id) + "_" +
+                       std::to_string(p->owner_idx);
+    targets.push_back({"weight_" + name, p, p->region});
+    if (sgd != nullptr && sgd->momentum > 0.0f) {
+      targets.push_back({"sgd_v_" + name, p, sgd->v_values.at(p->region)});
+    }
+    if (adam != nullptr) {
+      targets.push_back({"adam_v_" + name, p, adam->v_values.at(p->region)});
+      targets.push_back({"adam_m_" + name, p, adam->m_values.at(p->region)});
+    }
+  }
+  return targets;
+}
+
+bool FFModel::save_checkpoint(std::string const &dir) {
+  Context ctx = config.lg_ctx;
+  Runtime *runtime = config.lg_hlr;
+  wait_for_checkpoint();
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Failed to create checkpoint directory %s\n", dir.c_str());
+    return false;
+  }
+  PendingCheckpoint checkpoint;
+  checkpoint.dir = dir;
+  CheckpointManifest &manifest = checkpoint.manifest;
+  manifest.optimizer = get_optimizer_name(optimizer);
+  if (AdamOptimizer const *adam =
+          dynamic_cast<AdamOptimizer const *>(optimizer)) {
+    manifest.optimizer_state = {adam->alpha_t, adam->beta1_t, adam->beta2_t};
+  }
+  for (CheckpointTarget const &target : get_checkpoint_targets()) {
+    ParallelTensor p = target.parameter;
+    CheckpointTensor tensor;
+    tensor.name = target.name;
+    tensor.data_type = p->data_type;
+    tensor.element_size = data_type_size(p->data_type);
+    std::vector<bool> replica_dims;
+    for (int i = 0; i < p->num_dims; i++) {
+      replica_dims.push_back(p->dims[i].is_replica_dim);
+      if (!p->dims[i].is_replica_dim) {
+        tensor.dims.push_back(p->dims[i].size);
+      }
+    }
+    IndexPartition ip = p->part.get_index_partition();
+    Domain domain = runtime->get_index_space_domain(ctx, p->parallel_is);
+    for (Domain::DomainPointIterator it(domain); it; it++) {
+      CheckpointShard shard;
+      Domain shard_domain = runtime->get_index_space_domain(
+          ctx, runtime->get_index_subspace(ctx, ip, *it));
+      if (get_logical_rect(shard_domain, replica_dims, shard.lo, shard.hi)) {
+        shard.filename = get_shard_filename(target.name, *it);
+        tensor.shards.push_back(shard);
+      }
+    }
+    manifest.tensors.push_back(tensor);
+
+    Serializer sez;
+    serialize_string(sez, dir + "/" + target.name);
+    sez.serialize(p->data_type);
+    sez.serialize(replica_dims.size());
+    for (bool replica_dim : replica_dims) {
+      sez.serialize(replica_dim);
+    }
+    // Copy every shard into a staging region in the zero-copy memory of its
+    // node, so that the next update of target.region only waits for the
+    // copy, while the files are written from the staging region
+    LogicalRegion staging = runtime->create_logical_region(
+        ctx, target.region.get_index_space(), target.region.get_field_space());
+    LogicalPartition part =
+        runtime->get_logical_partition(ctx, target.region, ip);
+    LogicalPartition staging_part =
+        runtime->get_logical_partition(ctx, staging, ip);
+    IndexCopyLauncher copy(p->parallel_is,
+                           Predicate::TRUE_PRED,
+                           0 /*mapper_id*/,
+                           p->machine_view.hash());
+    copy.add_copy_requirements(
+        RegionRequirement(
+            part, 0 /*projection id*/, READ_ONLY, EXCLUSIVE, target.region),
+        RegionRequirement(staging_part,
+                          0 /*projection id*/,
+                          WRITE_DISCARD,
+                          EXCLUSIVE,
+                          staging,
+                          MAP_TO_ZC_MEMORY));
+    copy.add_src_field(0, FID_DATA);
+    copy.add_dst_field(0, FID_DATA);
+    runtime->issue_copy_operation(ctx, copy);
+
+    IndexLauncher launcher(CHECKPOINT_SAVE_TASK_ID,
+                           p->parallel_is,
+                           TaskArgument(sez.get_buffer(), sez.get_used_bytes()),
+                           ArgumentMap(),
+                           Predicate::TRUE_PRED,
+                           false /*must*/,
+                           0 /*mapper_id*/,
+                           p->machine_view.hash());
+    launcher.add_region_requirement(RegionRequirement(
+        staging_part, 0 /*projection id*/, READ_ONLY, EXCLUSIVE, staging));
+    launcher.add_field(0, FID_DATA);
+    checkpoint.future_maps.push_back(
+        {runtime->execute_index_space(ctx, launcher), domain});
+    // Deferred by the runtime until the save tasks are done
+    runtime->destroy_logical_region(ctx, staging);
+  }
+  pending_checkpoint = checkpoint;
+  return true;
+}
+
+bool FFModel::wait_for_checkpoint() {
+  if (!pending_checkpoint.has_value()) {
+    return true;
+  }
+  PendingCheckpoint checkpoint = pending_checkpoint.value();
+  pending_checkpoint = tl::nullopt;
+  bool success = true;
+  for (auto const &future_map : checkpoint.future_maps) {
+    for (Domain::DomainPointIterator it(future_map.second); it; it++) {
+      success = future_map.first.get_result<bool>(*it) && success;
+    }
+  }
+  if (!success) {
+    fprintf(stderr,
+            "Checkpoint %s is incomplete and has no manifest\n",
+            checkpoint.dir.c_str());
+    return false;
+  }
+  // With control replication every node runs this, but only one writes
+  Processor proc = config.lg_hlr->get_executing_processor(config.lg_ctx);
+  if (proc.address_space() != 0) {
+    return true;
+  }
+  return checkpoint.manifest.save(checkpoint.dir);
+}
+
+bool FFModel::load_checkpoint(std::string const &dir) {
+  Context ctx = config.lg_ctx;
+  Runtime *runtime = config.lg_hlr;
+  wait_for_checkpoint();
+  CheckpointManifest manifest;
+  if (!manifest.load(dir)) {
+    return false;
+  }
+  bool load_optimizer = manifest.optimizer == get_optimizer_name(optimizer);
+  std::vector<std::pair<FutureMap, Domain>> future_maps;
+  for (CheckpointTarget const &target : get_checkpoint_targets()) {
+    ParallelTensor p = target.parameter;
+    bool is_weight = target.region == p->region;
+    if (!is_weight && !load_optimizer) {
+      continue;
+    }
+    CheckpointTensor const *tensor = manifest.find_tensor(target.name);
+    std::vector<int> dims;
+    for (int i = 0; i < p->num_dims; i++) {
+      if (!p->dims[i].is_replica_dim) {
+        dims.push_back(p->dims[i].size);
+      }
+    }
+    if (tensor == nullptr || tensor->data_type != p->data_type ||
+        tensor->dims != dims) {
+      fprintf(stderr,
+              "Checkpoint %s has no tensor %s of the model's shape\n",
+              dir.c_str(),
+              target.name.c_str());
+      return false;
+    }
+
+    Serializer sez;
+    serialize_string(sez, dir);
+    serialize_string(sez, target.name);
+    sez.serialize(p->data_type);
+    sez.serialize((size_t)p->num_dims);
+    for (int i = 0; i < p->num_dims; i++) {
+      sez.serialize(p->dims[i].is_replica_dim);
+    }
+    IndexPartition ip = p->part.get_index_partition();
+    IndexLauncher launcher(CHECKPOINT_LOAD_TASK_ID,
+                           p->parallel_is,
+                           TaskArgument(sez.get_buffer(), sez.get_used_bytes()),
+                           ArgumentMap(),
+                           Predicate::TRUE_PRED,
+                           false /*must*/,
+                           0 /*mapper_id*/,
+                           p->machine_view.hash());
+    LogicalPartition part =
+        runtime->get_logical_partition(ctx, target.region, ip);
+    launcher.add_region_requirement(RegionRequirement(
+        part, 0 /*projection id*/, WRITE_ONLY, EXCLUSIVE, target.region));
+    launcher.add_field(0, FID_DATA);
+    Domain domain = runtime->get_index_space_domain(ctx, p->parallel_is);
+    FutureMap fm = runtime->execute_index_space(ctx, launcher);
+    future_maps.push_back({fm, domain});
+  }
+  bool success = true;
+  for (auto const &future_map : future_maps) {
+    for (Domain::DomainPointIterator it(future_map.second); it; it++) {
+      success = future_map.first.get_result<bool>(*it) && success;
+    }
+  }
+  AdamOptimizer *adam = dynamic_cast<AdamOptimizer *>(optimizer);
+  if (success && load_optimizer && adam != nullptr) {
+    assert(manifest.optimizer_state.size() == 3);
+    adam->alpha_t = manifest.optimizer_state[0];
+    adam->beta1_t = manifest.optimizer_state[1];
+    adam->beta2_t = manifest.optimizer_state[2];
+  }
+  return success;
+}
+
+/*
+  regions[0](I): staged copy of a shard of a checkpointed tensor
+*/
+bool FFModel::checkpoint_save_task(Task const *task,
+                                   std::vector<PhysicalRegion> const &regions,
+                                   Context ctx,
+                                   Runtime *runtime) {
+  assert(regions.size() == 1);
+  assert(task->regions.size() == 1);
+  Deserializer dez(task->args, task->arglen);
+  std::string prefix = deserialize_string(dez);
+  DataType data_type;
+  size_t num_dims;
+  dez.deserialize(data_type);
+  dez.deserialize(num_dims);
+  std::vector<bool> replica_dims(num_dims);
+  for (size_t i = 0; i < num_dims; i++) {
+    bool replica_dim;
+    dez.deserialize(replica_dim);
+    replica_dims[i] = replica_dim;
+  }
+  GenericTensorAccessorR acc = helperGetGenericTensorAccessorRO(
+      data_type, regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  std::vector<int> lo, hi;
+  if (!get_logical_rect(acc.domain, replica_dims, lo, hi)) {
+    // Only the first replica is saved
+    return true;
+  }
+  return write_checkpoint_shard(
+      get_shard_filename(prefix, task->index_point),
+      acc.ptr,
+      acc.domain.get_volume() * data_type_size(data_type));
+}
+
+/*
+  regions[0](O): shard of a checkpointed tensor
+*/
+bool FFModel::checkpoint_load_task(Task const *task,
+                                   std::vector<PhysicalRegion> const &regions,
+                                   Context ctx,
+                                   Runtime *runtime) {
+  assert(regions.size() == 1);
+  assert(task->regions.size() == 1);
+  Deserializer dez(task->args, task->arglen);
+  std::string dir = deserialize_string(dez);
+  std::string name = deserialize_string(dez);
+  DataType data_type;
+  size_t num_dims;
+  dez.deserialize(data_type);
+  dez.deserialize(num_dims);
+  std::vector<bool> replica_dims(num_dims);
+  for (size_t i = 0; i < num_dims; i++) {
+    bool replica_dim;
+    dez.deserialize(replica_dim);
+    replica_dims[i] = replica_dim;
+  }
+  CheckpointManifest manifest;
+  if (!manifest.load(dir)) {
+    return false;
+  }
+  CheckpointTensor const *tensor = manifest.find_tensor(name);
+  assert(tensor != nullptr);
+  GenericTensorAccessorW acc = helperGetGenericTensorAccessorWO(
+      data_type, regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  // Every replica is restored from the first one
+  std::vector<int> lo, hi;
+  for (int i = 0; i < acc.domain.get_dim(); i++) {
+    if (!replica_dims[i]) {
+      lo.push_back(acc.domain.lo()[i]);
+      hi.push_back(acc.domain.hi()[i]);
+    }
+  }
+  return read_checkpoint_rect(dir, *tensor, lo, hi, acc.ptr);
+}
+
+}; // namespace FlexFlow
@@ -0,0 +1,189 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/op_profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <ios>
+
+namespace FlexFlow {
+
+namespace {
+
+// Nearest-rank percentile of sorted values
+double percentile(std::vector<double> const &sorted, double p) {
+  size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+  return sorted[std::max(rank, (size_t)1) - 1];
+}
+
+std::string escape_json(std::string const &s) {
+  std::string escaped;
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+}; // namespace
+
+std::string get_profiled_pass_name(ProfiledPass pass) {
+  switch (pass) {
+    case ProfiledPass::FORWARD:
+      return "forward";
+    case ProfiledPass::BACKWARD:
+      return "backward";
+    case ProfiledPass::UPDATE:
+      return "update";
+  }
+  return "unknown";
+}
+
+/*static*/
+OpProfiler &OpProfiler::get_instance() {
+  static OpProfiler profiler;
+  return profiler;
+}
+
+void OpProfiler::register_shard(void const *meta,
+                                size_t op_guid,
+                                std::string const &op_name,
+                                int shard) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->shards[meta] = {op_guid, shard};
+  this->op_names[op_guid] = op_name;
+}
+
+void OpProfiler::record(void const *meta,
+                        ProfiledPass pass,
+                        unsigned long long processor,
+                        double start_us,
+                        double end_us) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto const &it = this->shards.find(meta);
+  if (it == this->shards.end()) {
+    return;
+  }
+  this->samples[it->second.op_guid].push_back(
+      {pass, it->second.shard, processor, start_us, end_us});
+}
+
+void OpProfiler::clear() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->shards.clear();
+  this->op_names.clear();
+  this->samples.clear();
+}
+
+std::vector<OpProfileSummary> OpProfiler::summarize() const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::vector<OpProfileSummary> summaries;
+  for (auto const &kv : this->samples) {
+    std::map<ProfiledPass, std::vector<double>> times_ms;
+    for (OpProfileSample const &sample : kv.second) {
+      times_ms[sample.pass].push_back((sample.end_us - sample.start_us) / 1e3);
+    }
+    for (auto &pass_times : times_ms) {
+      std::vector<double> &times = pass_times.second;
+      std::sort(times.begin(), times.end());
+      OpProfileSummary summary;
+      summary.op_guid = kv.first;
+      summary.op_name = this->op_names.at(kv.first);
+      summary.pass = pass_times.first;
+      summary.num_samples = (int)times.size();
+      summary.mean_ms = 0.0;
+      for (double time : times) {
+        summary.mean_ms += time;
+      }
+      summary.mean_ms /= times.size();
+      summary.p50_ms = percentile(times, 50);
+      summary.p99_ms = percentile(times, 99);
+      summaries.push_back(summary);
+    }
+  }
+  return summaries;
+}
+
+bool OpProfiler::write_csv(
+    std::string const &filename,
+    std::map<std::pair<size_t, ProfiledPass>, float> const &predicted_ms)
+    const {
+  std::ofstream file(filename);
+  if (!file) {
+    fprintf(stderr, "Failed to open op profile file %s\n", filename.c_str());
+    return false;
+  }
+  file << "op_guid,op_name,pass,num_samples,mean_ms,p50_ms,p99_ms,"
+          "predicted_ms,p50_over_predicted\n";
+  for (OpProfileSummary const &summary : this->summarize()) {
+    file << summary.op_guid << "," << summary.op_name << ","
+         << get_profiled_pass_name(summary.pass) << "," << summary.num_samples
+         << "," << summary.mean_ms << "," << summary.p50_ms << ","
+         << summary.p99_ms << ",";
+    auto const &it = predicted_ms.find({summary.op_guid, summary.pass});
+    if (it != predicted_ms.end() && it->second > 0.0f) {
+      file << it->second << "," << summary.p50_ms / it->second;
+    } else {
+      file << ",";
+    }
+    file << "\n";
+  }
+  return true;
+}
+
+bool OpProfiler::write_chrome_trace(std::string const &filename) const {
+  std::ofstream file(filename);
+  if (!file) {
+    fprintf(stderr, "Failed to open op trace file %s\n", filename.c_str());
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(this->mutex);
+  // Realm processor IDs do not fit in the trace's thread IDs, so number the
+  // processors in order of appearance and name the threads after them
+  std::map<unsigned long long, int> thread_ids;
+  file << std::fixed << "{\"traceEvents\": [";
+  bool first = true;
+  for (auto const &kv : this->samples) {
+    std::string op_name = escape_json(this->op_names.at(kv.first));
+    for (OpProfileSample const &sample : kv.second) {
+      auto const &it =
+          thread_ids.insert({sample.processor, (int)thread_ids.size()}).first;
+      file << (first ? "\n" : ",\n") << "{\"name\": \"" << op_name
+           << "\", \"cat\": \"" << get_profiled_pass_name(sample.pass)
+           << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << it->second
+           << ", \"ts\": " << sample.start_us
+           << ", \"dur\": " << sample.end_us - sample.start_us
+           << ", \"args\": {\"op_guid\": " << kv.first
+           << ", \"shard\": " << sample.shard << "}}";
+      first = false;
+    }
+  }
+  for (auto const &kv : thread_ids) {
+    file << (first ? "\n" : ",\n")
+         << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+            "\"tid\": "
+         << kv.second << ", \"args\": {\"name\": \"proc " << std::hex
+         << kv.first << std::dec << "\"}}";
+    first = false;
+  }
+  file << "\n]}\n";
+  return true;
+}
+
+}; // namespace FlexFlow
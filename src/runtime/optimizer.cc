@@ -15,6 +15,10 @@
 
 #include "flexflow/optimizer.h"
 #include "flexflow/model.h"
+#include "flexflow/ops/embedding.h"
+#include "flexflow/ops/kernels/embedding_kernels.h"
+#include "flexflow/utils/cpu_helper.h"
+#include <cmath>
 
 namespace FlexFlow {
 
@@ -42,6 +46,286 @@ ParallelTensor create_replica_parameter(FFModel const *model,
   return v;
 }
 
+void Optimizer::init_sparse_grads(void) {
+  sparse_grads.clear();
+  for (size_t i = 0; i < model->operators.size(); i++) {
+    if (model->operators[i]->op_type != OP_EMBEDDING) {
+      continue;
+    }
+    Embedding const *embed = (Embedding const *)model->operators[i];
+    if (embed->sparse_grad_indices == nullptr) {
+      continue;
+    }
+    assert(embed->weights[0]->region_grad == LogicalRegion::NO_REGION);
+    sparse_grads[embed->weights[0]->region] =
+        std::make_pair(embed->sparse_grad_indices, embed->sparse_grad_values);
+  }
+}
+
+// Launches task_id over p with regions[0]: sparse indices, regions[1]: sparse
+// values, regions[2]: p, followed by one region per optimizer state. Every
+// point reads the sparse gradients of all shards, so no all-reduce is needed.
+static void launch_sparse_update(FFModel const *model,
+                                 const ParallelTensor p,
+                                 TaskID task_id,
+                                 TaskArgument const &arg,
+                                 ParallelTensor const &indices,
+                                 ParallelTensor const &values,
+                                 std::vector<ParallelTensor> const &states) {
+  Context ctx = model->config.lg_ctx;
+  Runtime *runtime = model->config.lg_hlr;
+  if (p->sync_type == ParameterSyncType::PS) {
+    TaskLauncher launcher(task_id,
+                          arg,
+                          Predicate::TRUE_PRED,
+                          0 /*mapper_id*/,
+                          p->machine_view.hash());
+    launcher.add_region_requirement(RegionRequirement(
+        indices->region, READ_ONLY, EXCLUSIVE, indices->region));
+    launcher.add_field(0, FID_DATA);
+    launcher.add_region_requirement(RegionRequirement(
+        values->region, READ_ONLY, EXCLUSIVE, values->region));
+    launcher.add_field(1, FID_DATA);
+    launcher.add_region_requirement(
+        RegionRequirement(p->region, READ_WRITE, EXCLUSIVE, p->region));
+    launcher.add_field(2, FID_DATA);
+    for (size_t i = 0; i < states.size(); i++) {
+      launcher.add_region_requirement(RegionRequirement(
+          states[i]->region, READ_WRITE, EXCLUSIVE, states[i]->region));
+      launcher.add_field(3 + i, FID_DATA);
+    }
+    runtime->execute_task(ctx, launcher);
+    // Directly send the parameters back to all worker devices
+    ArgumentMap argmap;
+    IndexLauncher index_launcher(PS_PREFETCH_TASK_ID,
+                                 p->parallel_is,
+                                 TaskArgument(NULL, 0),
+                                 argmap,
+                                 Predicate::TRUE_PRED,
+                                 false /*must*/,
+                                 0 /*mapper_id*/,
+                                 p->machine_view.hash());
+    // regions[0]: region
+    index_launcher.add_region_requirement(RegionRequirement(
+        p->part, 0 /*projection*/, READ_ONLY, EXCLUSIVE, p->region));
+    index_launcher.add_field(0, FID_DATA);
+    runtime->execute_index_space(ctx, index_launcher);
+  } else if (p->sync_type == ParameterSyncType::NCCL) {
+    assert(p->parallel_is != IndexSpace::NO_SPACE);
+    ArgumentMap argmap;
+    IndexLauncher launcher(task_id,
+                           p->parallel_is,
+                           arg,
+                           argmap,
+                           Predicate::TRUE_PRED,
+                           false /*must_epoch*/,
+                           0 /*mapper_id*/,
+                           p->machine_view.hash());
+    launcher.add_region_requirement(RegionRequirement(
+        indices->region, READ_ONLY, EXCLUSIVE, indices->region));
+    launcher.add_field(0, FID_DATA);
+    launcher.add_region_requirement(RegionRequirement(
+        values->region, READ_ONLY, EXCLUSIVE, values->region));
+    launcher.add_field(1, FID_DATA);
+    launcher.add_region_requirement(RegionRequirement(
+        p->part, 0 /*projection id*/, READ_WRITE, EXCLUSIVE, p->region));
+    launcher.add_field(2, FID_DATA);
+    for (size_t i = 0; i < states.size(); i++) {
+      launcher.add_region_requirement(RegionRequirement(states[i]->part,
+                                                        0 /*projection id*/,
+                                                        READ_WRITE,
+                                                        EXCLUSIVE,
+                                                        states[i]->region));
+      launcher.add_field(3 + i, FID_DATA);
+    }
+    runtime->execute_index_space(ctx, launcher);
+  } else {
+    assert(false);
+  }
+}
+
+struct SparseUpdateArgs {
+  int64_t const *indices;
+  float const *values;
+  int64_t num_lookups, num_entries;
+  int out_dim, num_replicas;
+  // The table followed by its optimizer states, all with the same layout
+  float *tables[3];
+};
+
+// The table in regions[2] is laid out as num_replicas copies of a
+// [num_entries, out_dim] matrix; the sparse values hold one out_dim row per
+// entry of the sparse indices
+static SparseUpdateArgs
+    get_sparse_update_args(Task const *task,
+                           std::vector<PhysicalRegion> const &regions,
+                           Context ctx,
+                           Runtime *runtime) {
+  assert(regions.size() >= 3 && regions.size() <= 5);
+  assert(task->regions.size() == regions.size());
+  SparseUpdateArgs args;
+  Domain indices_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Domain values_domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  Domain table_domain = runtime->get_index_space_domain(
+      ctx, task->regions[2].region.get_index_space());
+  assert(table_domain.get_dim() >= 2);
+  args.out_dim = table_domain.hi()[0] - table_domain.lo()[0] + 1;
+  args.num_entries = table_domain.hi()[1] - table_domain.lo()[1] + 1;
+  assert(table_domain.get_volume() % (args.out_dim * args.num_entries) == 0);
+  args.num_replicas =
+      table_domain.get_volume() / (args.out_dim * args.num_entries);
+  args.num_lookups = indices_domain.get_volume();
+  // Tables partitioned along the channel dimension are not supported
+  assert(values_domain.get_volume() == args.num_lookups * args.out_dim);
+  args.indices = helperGetTensorPointerRO<int64_t>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  args.values = helperGetTensorPointerRO<float>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  for (size_t i = 0; i < 3; i++) {
+    args.tables[i] = nullptr;
+    if (i + 2 < regions.size()) {
+      Domain domain = runtime->get_index_space_domain(
+          ctx, task->regions[i + 2].region.get_index_space());
+      assert(domain == table_domain);
+      args.tables[i] = helperGetTensorPointerRW<float>(
+          regions[i + 2], task->regions[i + 2], FID_DATA, ctx, runtime);
+    }
+  }
+  return args;
+}
+
+// Sums the sparse value rows of every distinct index; grads[r] is the
+// gradient of row groups.rows[r]
+static void reduce_sparse_grad_cpu(int64_t const *indices,
+                                   float const *values,
+                                   int64_t num_lookups,
+                                   int out_dim,
+                                   int64_t num_entries,
+                                   Kernels::Embedding::RowGroups &groups,
+                                   std::vector<float> &grads) {
+  Kernels::Embedding::group_rows_cpu(indices, num_lookups, num_entries, groups);
+  grads.resize(groups.rows.size() * out_dim);
+  Kernels::Embedding::reduce_rows_cpu(groups,
+                                      values,
+                                      1 /*lookups_per_row*/,
+                                      1.0f /*scale*/,
+                                      out_dim,
+                                      grads.data(),
+                                      nullptr /*table*/);
+}
+
+// Fused SGD step over n contiguous elements. The gradient of element i is the
+// sum of grad[i + r * stride] over num_replicas copies.
+static void sgd_update_block(float lr,
+                             float weight_decay,
+                             float momentum,
+                             bool nesterov,
+                             float const *grad,
+                             size_t stride,
+                             int num_replicas,
+                             float *w,
+                             float *v,
+                             int64_t n) {
+  int64_t i = 0;
+#ifdef FF_USE_AVX2
+  __m256 vlr = _mm256_set1_ps(lr);
+  __m256 vdecay = _mm256_set1_ps(weight_decay);
+  __m256 vmomentum = _mm256_set1_ps(momentum);
+  for (; i + 8 <= n; i += 8) {
+    __m256 gt = _mm256_loadu_ps(grad + i);
+    for (int r = 1; r < num_replicas; r++) {
+      gt = _mm256_add_ps(gt, _mm256_loadu_ps(grad + r * stride + i));
+    }
+    __m256 wt = _mm256_loadu_ps(w + i);
+    if (weight_decay != 0.0f) {
+      gt = _mm256_add_ps(gt, _mm256_mul_ps(vdecay, wt));
+    }
+    if (momentum > 0.0f) {
+      __m256 vt =
+          _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(v + i), vmomentum), gt);
+      _mm256_storeu_ps(v + i, vt);
+      gt = nesterov ? _mm256_add_ps(gt, _mm256_mul_ps(vmomentum, vt)) : vt;
+    }
+    _mm256_storeu_ps(w + i, _mm256_sub_ps(wt, _mm256_mul_ps(vlr, gt)));
+  }
+#endif
+  for (; i < n; i++) {
+    float gt = grad[i];
+    for (int r = 1; r < num_replicas; r++) {
+      gt += grad[r * stride + i];
+    }
+    if (weight_decay != 0.0f) {
+      gt += weight_decay * w[i];
+    }
+    if (momentum > 0.0f) {
+      v[i] = v[i] * momentum + gt;
+      gt = nesterov ? gt + momentum * v[i] : v[i];
+    }
+    w[i] -= lr * gt;
+  }
+}
+
+// Fused Adam step over n contiguous elements; alpha_t already carries the
+// bias correction of the current iteration
+static void adam_update_block(float alpha_t,
+                              float beta1,
+                              float beta2,
+                              float weight_decay,
+                              float epsilon,
+                              float const *grad,
+                              size_t stride,
+                              int num_replicas,
+                              float *w,
+                              float *v,
+                              float *m,
+                              int64_t n) {
+  int64_t i = 0;
+#ifdef FF_USE_AVX2
+  __m256 valpha = _mm256_set1_ps(alpha_t);
+  __m256 vbeta1 = _mm256_set1_ps(beta1);
+  __m256 vbeta2 = _mm256_set1_ps(beta2);
+  __m256 vbeta1c = _mm256_set1_ps(1 - beta1);
+  __m256 vbeta2c = _mm256_set1_ps(1 - beta2);
+  __m256 vdecay = _mm256_set1_ps(weight_decay);
+  __m256 vepsilon = _mm256_set1_ps(epsilon);
+  for (; i + 8 <= n; i += 8) {
+    __m256 gt = _mm256_loadu_ps(grad + i);
+    for (int r = 1; r < num_replicas; r++) {
+      gt = _mm256_add_ps(gt, _mm256_loadu_ps(grad + r * stride + i));
+    }
+    __m256 wt = _mm256_loadu_ps(w + i);
+    if (weight_decay != 0.0f) {
+      gt = _mm256_add_ps(gt, _mm256_mul_ps(vdecay, wt));
+    }
+    __m256 mt = _mm256_add_ps(_mm256_mul_ps(vbeta1, _mm256_loadu_ps(m + i)),
+                              _mm256_mul_ps(vbeta1c, gt));
+    __m256 vt = _mm256_add_ps(_mm256_mul_ps(vbeta2, _mm256_loadu_ps(v + i)),
+                              _mm256_mul_ps(_mm256_mul_ps(vbeta2c, gt), gt));
+    _mm256_storeu_ps(m + i, mt);
+    _mm256_storeu_ps(v + i, vt);
+    __m256 denom = _mm256_add_ps(_mm256_sqrt_ps(vt), vepsilon);
+    __m256 step = _mm256_div_ps(_mm256_mul_ps(valpha, mt), denom);
+    _mm256_storeu_ps(w + i, _mm256_sub_ps(wt, step));
+  }
+#endif
+  for (; i < n; i++) {
+    float gt = grad[i];
+    for (int r = 1; r < num_replicas; r++) {
+      gt += grad[r * stride + i];
+    }
+    if (weight_decay != 0.0f) {
+      gt += weight_decay * w[i];
+    }
+    float mt = beta1 * m[i] + (1 - beta1) * gt;
+    float vt = beta2 * v[i] + (1 - beta2) * gt * gt;
+    m[i] = mt;
+    v[i] = vt;
+    w[i] -= alpha_t * mt / (std::sqrt(vt) + epsilon);
+  }
+}
+
 SGDOptimizer::SGDOptimizer(FFModel const *_model,
                            double _lr,
                            double _momentum,
@@ -53,6 +337,7 @@ SGDOptimizer::SGDOptimizer(FFModel const *_model,
 void SGDOptimizer::init(void) {
   Context ctx = model->config.lg_ctx;
   Runtime *runtime = model->config.lg_hlr;
+  init_sparse_grads();
   Initializer *initializer = new ZeroInitializer();
   for (size_t i = 0; i < model->parameters.size(); i++) {
     ParallelTensor p = model->parameters[i];
@@ -91,6 +376,10 @@ void SGDOptimizer::update(const ParallelTensor p) {
   Context ctx = model->config.lg_ctx;
   Runtime *runtime = model->config.lg_hlr;
   assert(p->owner_op != NULL);
+  if (sparse_grads.find(p->region) != sparse_grads.end()) {
+    sparse_update(p);
+    return;
+  }
   if (p->sync_type == ParameterSyncType::PS) {
     TaskLauncher launcher(SGD_UPD_PS_TASK_ID,
                           TaskArgument(this, sizeof(SGDOptimizer)),
@@ -256,6 +545,158 @@ void SGDOptimizer::ps_update_task(Task const *task,
   ps_update_task_gpu(op, w_grad_ptr, size, num_replicas, w_ptr, v_ptr);
 }
 
+void SGDOptimizer::ps_update_task_cpu(
+    Task const *task,
+    std::vector<PhysicalRegion> const &regions,
+    Context ctx,
+    Runtime *runtime) {
+  SGDOptimizer const *op = (SGDOptimizer *)task->args;
+  if (op->momentum > 0.0f) {
+    assert(regions.size() == 3);
+    assert(task->regions.size() == 3);
+  } else {
+    assert(regions.size() == 2);
+    assert(task->regions.size() == 2);
+  }
+  Domain grad_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Domain domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  size_t size = domain.get_volume();
+  assert(grad_domain.get_volume() % size == 0);
+  int num_replicas = grad_domain.get_volume() / size;
+  float const *w_grad_ptr = helperGetTensorPointerRO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float *w_ptr = helperGetTensorPointerRW<float>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  float *v_ptr = NULL;
+  if (op->momentum > 0.0f) {
+    v_ptr = helperGetTensorPointerRW<float>(
+        regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  }
+  update_kernel_cpu(op, w_grad_ptr, size, num_replicas, w_ptr, v_ptr);
+}
+
+void SGDOptimizer::update_kernel_cpu(SGDOptimizer const *op,
+                                     float const *w_grad_ptr,
+                                     size_t size,
+                                     int num_replicas,
+                                     float *w_ptr,
+                                     float *v_ptr) {
+  float lr = op->lr, weight_decay = op->weight_decay;
+  float momentum = op->momentum;
+  bool nesterov = op->nesterov;
+  cpu_parallel_for(0, size, 16384, [&](int64_t lo, int64_t hi) {
+    sgd_update_block(lr,
+                     weight_decay,
+                     momentum,
+                     nesterov,
+                     w_grad_ptr + lo,
+                     size,
+                     num_replicas,
+                     w_ptr + lo,
+                     v_ptr == NULL ? NULL : v_ptr + lo,
+                     hi - lo);
+  });
+}
+
+void SGDOptimizer::sparse_update(const ParallelTensor p) {
+  std::vector<ParallelTensor> states;
+  if (momentum > 0.0f) {
+    assert(v_values.find(p->region) != v_values.end());
+    states.push_back(v_values[p->region]);
+  }
+  launch_sparse_update(model,
+                       p,
+                       SGD_UPD_SPARSE_TASK_ID,
+                       TaskArgument(this, sizeof(SGDOptimizer)),
+                       sparse_grads[p->region].first,
+                       sparse_grads[p->region].second,
+                       states);
+}
+
+void SGDOptimizer::sparse_update_task(
+    Task const *task,
+    std::vector<PhysicalRegion> const &regions,
+    Context ctx,
+    Runtime *runtime) {
+  SGDOptimizer const *op = (SGDOptimizer *)task->args;
+  assert(regions.size() == (op->momentum > 0.0f ? 4 : 3));
+  SparseUpdateArgs args = get_sparse_update_args(task, regions, ctx, runtime);
+  sparse_update_task_gpu(op,
+                         args.indices,
+                         args.values,
+                         args.num_lookups,
+                         args.out_dim,
+                         args.num_entries,
+                         args.num_replicas,
+                         args.tables[0],
+                         args.tables[1]);
+}
+
+void SGDOptimizer::sparse_update_task_cpu(
+    Task const *task,
+    std::vector<PhysicalRegion> const &regions,
+    Context ctx,
+    Runtime *runtime) {
+  SGDOptimizer const *op = (SGDOptimizer *)task->args;
+  assert(regions.size() == (op->momentum > 0.0f ? 4 : 3));
+  SparseUpdateArgs args = get_sparse_update_args(task, regions, ctx, runtime);
+  sparse_update_kernel_cpu(op,
+                           args.indices,
+                           args.values,
+                           args.num_lookups,
+                           args.out_dim,
+                           args.num_entries,
+                           args.num_replicas,
+                           args.tables[0],
+                           args.tables[1]);
+}
+
+void SGDOptimizer::sparse_update_kernel_cpu(SGDOptimizer const *op,
+                                            int64_t const *indices_ptr,
+                                            float const *values_ptr,
+                                            int64_t num_lookups,
+                                            int out_dim,
+                                            int64_t num_entries,
+                                            int num_replicas,
+                                            float *w_ptr,
+                                            float *v_ptr) {
+  Kernels::Embedding::RowGroups groups;
+  std::vector<float> grads;
+  reduce_sparse_grad_cpu(indices_ptr,
+                         values_ptr,
+                         num_lookups,
+                         out_dim,
+                         num_entries,
+                         groups,
+                         grads);
+  float lr = op->lr, weight_decay = op->weight_decay;
+  float momentum = op->momentum;
+  bool nesterov = op->nesterov;
+  int64_t num_rows = groups.rows.size();
+  int64_t grain = std::max((int64_t)1, (int64_t)4096 / out_dim);
+  // Same update as sgd_update, restricted to the rows in the gradient
+  cpu_parallel_for(0, num_rows, grain, [&](int64_t lo, int64_t hi) {
+    for (int64_t r = lo; r < hi; r++) {
+      for (int rep = 0; rep < num_replicas; rep++) {
+        int64_t offset = (rep * num_entries + groups.rows[r]) * out_dim;
+        float *v = momentum > 0.0f ? v_ptr + offset : nullptr;
+        sgd_update_block(lr,
+                         weight_decay,
+                         momentum,
+                         nesterov,
+                         grads.data() + r * out_dim,
+                         0 /*stride*/,
+                         1 /*num_replicas*/,
+                         w_ptr + offset,
+                         v,
+                         out_dim);
+      }
+    }
+  });
+}
+
 #ifdef FF_USE_NCCL
 void SGDOptimizer::nccl_update_task(Task const *task,
                                     std::vector<PhysicalRegion> const &regions,
@@ -332,6 +773,7 @@ AdamOptimizer::AdamOptimizer(FFModel const *_model,
 void AdamOptimizer::init(void) {
   Context ctx = model->config.lg_ctx;
   Runtime *runtime = model->config.lg_hlr;
+  init_sparse_grads();
   Initializer *initializer = new ZeroInitializer();
   for (size_t i = 0; i < model->parameters.size(); i++) {
     ParallelTensor p = model->parameters[i];
@@ -381,6 +823,10 @@ void AdamOptimizer::update(const ParallelTensor p) {
   assert(v_values.find(p->region) != v_values.end());
   assert(m_values.find(p->region) != m_values.end());
   assert(p->owner_op != NULL);
+  if (sparse_grads.find(p->region) != sparse_grads.end()) {
+    sparse_update(p);
+    return;
+  }
   if (p->sync_type == ParameterSyncType::PS) {
     TaskLauncher launcher(ADAM_UPD_PS_TASK_ID,
                           TaskArgument(this, sizeof(AdamOptimizer)),
@@ -547,6 +993,157 @@ void AdamOptimizer::ps_update_task(Task const *task,
   ps_update_task_gpu(op, w_grad_ptr, size, num_replicas, w_ptr, v_ptr, m_ptr);
 }
 
+void AdamOptimizer::ps_update_task_cpu(
+    Task const *task,
+    std::vector<PhysicalRegion> const &regions,
+    Context ctx,
+    Runtime *runtime) {
+  assert(regions.size() == 4);
+  assert(task->regions.size() == 4);
+  AdamOptimizer const *op = (AdamOptimizer *)task->args;
+  Domain grad_domain = runtime->get_index_space_domain(
+      ctx, task->regions[0].region.get_index_space());
+  Domain domain = runtime->get_index_space_domain(
+      ctx, task->regions[1].region.get_index_space());
+  size_t size = domain.get_volume();
+  assert(grad_domain.get_volume() % size == 0);
+  int num_replicas = grad_domain.get_volume() / size;
+  float const *w_grad_ptr = helperGetTensorPointerRO<float>(
+      regions[0], task->regions[0], FID_DATA, ctx, runtime);
+  float *w_ptr = helperGetTensorPointerRW<float>(
+      regions[1], task->regions[1], FID_DATA, ctx, runtime);
+  float *v_ptr = helperGetTensorPointerRW<float>(
+      regions[2], task->regions[2], FID_DATA, ctx, runtime);
+  float *m_ptr = helperGetTensorPointerRW<float>(
+      regions[3], task->regions[3], FID_DATA, ctx, runtime);
+  update_kernel_cpu(op, w_grad_ptr, size, num_replicas, w_ptr, v_ptr, m_ptr);
+}
+
+void AdamOptimizer::update_kernel_cpu(AdamOptimizer const *op,
+                                      float const *w_grad_ptr,
+                                      size_t size,
+                                      int num_replicas,
+                                      float *w_ptr,
+                                      float *v_ptr,
+                                      float *m_ptr) {
+  float alpha_t = op->alpha_t, beta1 = op->beta1, beta2 = op->beta2;
+  float weight_decay = op->weight_decay, epsilon = op->epsilon;
+  cpu_parallel_for(0, size, 16384, [&](int64_t lo, int64_t hi) {
+    adam_update_block(alpha_t,
+                      beta1,
+                      beta2,
+                      weight_decay,
+                      epsilon,
+                      w_grad_ptr + lo,
+                      size,
+                      num_replicas,
+                      w_ptr + lo,
+                      v_ptr + lo,
+                      m_ptr + lo,
+                      hi - lo);
+  });
+}
+
+void AdamOptimizer::sparse_update(const ParallelTensor p) {
+  std::vector<ParallelTensor> states;
+  states.push_back(v_values[p->region]);
+  states.push_back(m_values[p->region]);
+  launch_sparse_update(model,
+                       p,
+                       ADAM_UPD_SPARSE_TASK_ID,
+                       TaskArgument(this, sizeof(AdamOptimizer)),
+                       sparse_grads[p->region].first,
+                       sparse_grads[p->region].second,
+                       states);
+}
+
+void AdamOptimizer::sparse_update_task(
+    Task const *task,
+    std::vector<PhysicalRegion> const &regions,
+    Context ctx,
+    Runtime *runtime) {
+  assert(regions.size() == 5);
+  AdamOptimizer const *op = (AdamOptimizer *)task->args;
+  SparseUpdateArgs args = get_sparse_update_args(task, regions, ctx, runtime);
+  sparse_update_task_gpu(op,
+                         args.indices,
+                         args.values,
+                         args.num_lookups,
+                         args.out_dim,
+                         args.num_entries,
+                         args.num_replicas,
+                         args.tables[0],
+                         args.tables[1],
+                         args.tables[2]);
+}
+
+// Lazy Adam: only the moments of rows present in the gradient are decayed
+// and updated, so the cost scales with the number of distinct rows
+void AdamOptimizer::sparse_update_task_cpu(
+    Task const *task,
+    std::vector<PhysicalRegion> const &regions,
+    Context ctx,
+    Runtime *runtime) {
+  assert(regions.size() == 5);
+  AdamOptimizer const *op = (AdamOptimizer *)task->args;
+  SparseUpdateArgs args = get_sparse_update_args(task, regions, ctx, runtime);
+  sparse_update_kernel_cpu(op,
+                           args.indices,
+                           args.values,
+                           args.num_lookups,
+                           args.out_dim,
+                           args.num_entries,
+                           args.num_replicas,
+                           args.tables[0],
+                           args.tables[1],
+                           args.tables[2]);
+}
+
+void AdamOptimizer::sparse_update_kernel_cpu(AdamOptimizer const *op,
+                                             int64_t const *indices_ptr,
+                                             float const *values_ptr,
+                                             int64_t num_lookups,
+                                             int out_dim,
+                                             int64_t num_entries,
+                                             int num_replicas,
+                                             float *w_ptr,
+                                             float *v_ptr,
+                                             float *m_ptr) {
+  Kernels::Embedding::RowGroups groups;
+  std::vector<float> grads;
+  reduce_sparse_grad_cpu(indices_ptr,
+                         values_ptr,
+                         num_lookups,
+                         out_dim,
+                         num_entries,
+                         groups,
+                         grads);
+  float alpha_t = op->alpha_t, beta1 = op->beta1, beta2 = op->beta2;
+  float weight_decay = op->weight_decay, epsilon = op->epsilon;
+  int64_t num_rows = groups.rows.size();
+  int64_t grain = std::max((int64_t)1, (int64_t)4096 / out_dim);
+  // Same update as adam_update, restricted to the rows in the gradient
+  cpu_parallel_for(0, num_rows, grain, [&](int64_t lo, int64_t hi) {
+    for (int64_t r = lo; r < hi; r++) {
+      for (int rep = 0; rep < num_replicas; rep++) {
+        int64_t offset = (rep * num_entries + groups.rows[r]) * out_dim;
+        adam_update_block(alpha_t,
+                          beta1,
+                          beta2,
+                          weight_decay,
+                          epsilon,
+                          grads.data() + r * out_dim,
+                          0 /*stride*/,
+                          1 /*num_replicas*/,
+                          w_ptr + offset,
+                          v_ptr + offset,
+                          m_ptr + offset,
+                          out_dim);
+      }
+    }
+  });
+}
+
 #ifdef FF_USE_NCCL
 void AdamOptimizer::nccl_update_task(Task const *task,
                                      std::vector<PhysicalRegion> const &regions,
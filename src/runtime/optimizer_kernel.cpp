@@ -18,6 +18,14 @@
 #include "flexflow/optimizer.h"
 #include "flexflow/utils/hip_helper.h"
 #include <hip/hip_runtime.h>
+#include <map>
+#include <mutex>
+#include <thrust/binary_search.h>
+#include <thrust/execution_policy.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/sequence.h>
+#include <thrust/sort.h>
+#include <thrust/unique.h>
 
 namespace FlexFlow {
 
@@ -245,4 +253,291 @@ __host__ void AdamOptimizer::nccl_update_task_gpu(AdamOptimizer const *op,
 }
 #endif
 
+// ==================================================================
+//                   Sparse (row, value) gradients
+// ==================================================================
+// Device memory of the sparse updates, kept per stream across steps since
+// freeing it would synchronize the device. Work on a stream runs in order, so
+// a block released by one update can be handed to the next update on the
+// same stream while the first is still running.
+struct SparseScratchBlock {
+  char *ptr;
+  size_t bytes;
+  bool in_use;
+};
+
+static std::mutex sparse_scratch_mutex;
+static std::map<hipStream_t, std::vector<SparseScratchBlock>> sparse_scratch;
+
+static char *allocate_sparse_scratch(hipStream_t stream, size_t bytes) {
+  // Keep blocks distinct even for empty requests
+  bytes = std::max(bytes, (size_t)1);
+  std::lock_guard<std::mutex> lock(sparse_scratch_mutex);
+  std::vector<SparseScratchBlock> &blocks = sparse_scratch[stream];
+  for (SparseScratchBlock &block : blocks) {
+    if (!block.in_use && block.bytes >= bytes) {
+      block.in_use = true;
+      return block.ptr;
+    }
+  }
+  SparseScratchBlock block;
+  checkCUDA(hipMalloc(&block.ptr, bytes));
+  block.bytes = bytes;
+  block.in_use = true;
+  blocks.push_back(block);
+  return block.ptr;
+}
+
+static void release_sparse_scratch(hipStream_t stream, char *ptr) {
+  std::lock_guard<std::mutex> lock(sparse_scratch_mutex);
+  for (SparseScratchBlock &block : sparse_scratch[stream]) {
+    if (block.ptr == ptr) {
+      block.in_use = false;
+      return;
+    }
+  }
+  assert(false);
+}
+
+// Lets thrust take its temporary storage from the sparse scratch
+struct SparseScratchAllocator {
+  typedef char value_type;
+  hipStream_t stream;
+
+  char *allocate(std::ptrdiff_t bytes) {
+    return allocate_sparse_scratch(stream, bytes);
+  }
+  void deallocate(char *ptr, size_t) { release_sparse_scratch(stream, ptr); }
+};
+
+// Groups the entries of a sparse gradient by row. On return rows holds the
+// distinct non-negative indices in ascending order, and the entries of
+// rows[r] are positions[segment_starts[r]] up to the next segment start (or
+// num_lookups for the last row). Returns the number of distinct rows.
+static int64_t group_sparse_rows(int64_t const *indices,
+                                 int64_t num_lookups,
+                                 int64_t *keys,
+                                 int64_t *positions,
+                                 int64_t *rows,
+                                 int64_t *segment_starts,
+                                 hipStream_t stream) {
+  SparseScratchAllocator alloc{stream};
+  checkCUDA(hipMemcpyAsync(keys,
+                           indices,
+                           num_lookups * sizeof(int64_t),
+                           hipMemcpyDeviceToDevice,
+                           stream));
+  thrust::sequence(thrust::hip::par(alloc).on(stream),
+                   positions,
+                   positions + num_lookups);
+  thrust::sort_by_key(thrust::hip::par(alloc).on(stream),
+                      keys,
+                      keys + num_lookups,
+                      positions);
+  // The -1 padding of each shard sorts first
+  int64_t start = thrust::lower_bound(thrust::hip::par(alloc).on(stream),
+                                      keys,
+                                      keys + num_lookups,
+                                      (int64_t)0) -
+                  keys;
+  auto ends =
+      thrust::unique_by_key_copy(thrust::hip::par(alloc).on(stream),
+                                 keys + start,
+                                 keys + num_lookups,
+                                 thrust::counting_iterator<int64_t>(start),
+                                 rows,
+                                 segment_starts);
+  return ends.first - rows;
+}
+
+__device__ float sparse_row_grad(int64_t r,
+                                 int off,
+                                 int out_dim,
+                                 int64_t num_unique,
+                                 int64_t num_lookups,
+                                 int64_t const *segment_starts,
+                                 int64_t const *positions,
+                                 float const *values) {
+  int64_t end = (r + 1 < num_unique) ? segment_starts[r + 1] : num_lookups;
+  float sum = 0.0f;
+  for (int64_t k = segment_starts[r]; k < end; k++) {
+    sum += values[positions[k] * out_dim + off];
+  }
+  return sum;
+}
+
+// One thread per (distinct row, channel); the row is updated in every
+// replica of the table
+__global__ void sparse_sgd_update(int64_t num_unique,
+                                  int64_t num_lookups,
+                                  int out_dim,
+                                  int64_t num_entries,
+                                  int num_replicas,
+                                  int64_t const *rows,
+                                  int64_t const *segment_starts,
+                                  int64_t const *positions,
+                                  float const *values,
+                                  float lr,
+                                  float weight_decay,
+                                  float momentum,
+                                  bool nesterov,
+                                  float *V,
+                                  float *W) {
+  CUDA_KERNEL_LOOP(i, num_unique * out_dim) {
+    int64_t r = i / out_dim;
+    int off = i % out_dim;
+    float grad = sparse_row_grad(r,
+                                 off,
+                                 out_dim,
+                                 num_unique,
+                                 num_lookups,
+                                 segment_starts,
+                                 positions,
+                                 values);
+    for (int rep = 0; rep < num_replicas; rep++) {
+      int64_t j = (rep * num_entries + rows[r]) * out_dim + off;
+      float gt = grad + weight_decay * W[j];
+      if (momentum > 0.0f) {
+        V[j] = V[j] * momentum + gt;
+        if (nesterov) {
+          gt = gt + momentum * V[j];
+        } else {
+          gt = V[j];
+        }
+      }
+      W[j] -= lr * gt;
+    }
+  }
+}
+
+__host__ void SGDOptimizer::sparse_update_task_gpu(SGDOptimizer const *op,
+                                                   int64_t const *indices_ptr,
+                                                   float const *values_ptr,
+                                                   int64_t num_lookups,
+                                                   int out_dim,
+                                                   int64_t num_entries,
+                                                   int num_replicas,
+                                                   float *w_ptr,
+                                                   float *v_ptr) {
+  hipStream_t stream;
+  checkCUDA(get_legion_stream(&stream));
+  int64_t *keys = (int64_t *)allocate_sparse_scratch(
+      stream, 4 * num_lookups * sizeof(int64_t));
+  int64_t *positions = keys + num_lookups;
+  int64_t *rows = positions + num_lookups;
+  int64_t *segment_starts = rows + num_lookups;
+  int64_t num_unique = group_sparse_rows(
+      indices_ptr, num_lookups, keys, positions, rows, segment_starts, stream);
+  if (num_unique > 0) {
+    hipLaunchKernelGGL(sparse_sgd_update,
+                       GET_BLOCKS(num_unique * out_dim),
+                       CUDA_NUM_THREADS,
+                       0,
+                       stream,
+                       num_unique,
+                       num_lookups,
+                       out_dim,
+                       num_entries,
+                       num_replicas,
+                       rows,
+                       segment_starts,
+                       positions,
+                       values_ptr,
+                       op->lr,
+                       op->weight_decay,
+                       op->momentum,
+                       op->nesterov,
+                       v_ptr,
+                       w_ptr);
+  }
+  release_sparse_scratch(stream, (char *)keys);
+}
+
+// Lazy Adam: only the moments of rows present in the gradient are updated
+__global__ void sparse_adam_update(int64_t num_unique,
+                                   int64_t num_lookups,
+                                   int out_dim,
+                                   int64_t num_entries,
+                                   int num_replicas,
+                                   int64_t const *rows,
+                                   int64_t const *segment_starts,
+                                   int64_t const *positions,
+                                   float const *values,
+                                   float alpha_t,
+                                   float beta1,
+                                   float beta2,
+                                   float weight_decay,
+                                   float epsilon,
+                                   float *M,
+                                   float *V,
+                                   float *W) {
+  CUDA_KERNEL_LOOP(i, num_unique * out_dim) {
+    int64_t r = i / out_dim;
+    int off = i % out_dim;
+    float grad = sparse_row_grad(r,
+                                 off,
+                                 out_dim,
+                                 num_unique,
+                                 num_lookups,
+                                 segment_starts,
+                                 positions,
+                                 values);
+    for (int rep = 0; rep < num_replicas; rep++) {
+      int64_t j = (rep * num_entries + rows[r]) * out_dim + off;
+      float gt = grad + weight_decay * W[j];
+      float mt = beta1 * M[j] + (1 - beta1) * gt;
+      float vt = beta2 * V[j] + (1 - beta2) * gt * gt;
+      M[j] = mt;
+      V[j] = vt;
+      W[j] -= alpha_t * mt / (sqrt(vt) + epsilon);
+    }
+  }
+}
+
+__host__ void AdamOptimizer::sparse_update_task_gpu(AdamOptimizer const *op,
+                                                    int64_t const *indices_ptr,
+                                                    float const *values_ptr,
+                                                    int64_t num_lookups,
+                                                    int out_dim,
+                                                    int64_t num_entries,
+                                                    int num_replicas,
+                                                    float *w_ptr,
+                                                    float *v_ptr,
+                                                    float *m_ptr) {
+  hipStream_t stream;
+  checkCUDA(get_legion_stream(&stream));
+  int64_t *keys = (int64_t *)allocate_sparse_scratch(
+      stream, 4 * num_lookups * sizeof(int64_t));
+  int64_t *positions = keys + num_lookups;
+  int64_t *rows = positions + num_lookups;
+  int64_t *segment_starts = rows + num_lookups;
+  int64_t num_unique = group_sparse_rows(
+      indices_ptr, num_lookups, keys, positions, rows, segment_starts, stream);
+  if (num_unique > 0) {
+    hipLaunchKernelGGL(sparse_adam_update,
+                       GET_BLOCKS(num_unique * out_dim),
+                       CUDA_NUM_THREADS,
+                       0,
+                       stream,
+                       num_unique,
+                       num_lookups,
+                       out_dim,
+                       num_entries,
+                       num_replicas,
+                       rows,
+                       segment_starts,
+                       positions,
+                       values_ptr,
+                       op->alpha_t,
+                       op->beta1,
+                       op->beta2,
+                       op->weight_decay,
+                       op->epsilon,
+                       m_ptr,
+                       v_ptr,
+                       w_ptr);
+  }
+  release_sparse_scratch(stream, (char *)keys);
+}
+
 }; // namespace FlexFlow
\ No newline at end of file
@@ -19,6 +19,42 @@ namespace FlexFlow {
 
 using namespace Legion;
 
+namespace {
+
+Memory get_local_sysmem(Context ctx, Runtime *runtime) {
+  return Machine::MemoryQuery(Machine::get_machine())
+      .has_affinity_to(runtime->get_executing_processor(ctx))
+      .only_kind(Memory::SYSTEM_MEM)
+      .first();
+}
+
+// Colors each replica of a tensor by its coordinates along the replica dims,
+// mapping it to the rect of domain with those dims fixed
+Domain get_replica_domains(Domain const &domain,
+                           ParallelDim const *dims,
+                           int num_dims,
+                           std::map<DomainPoint, Domain> &replicas) {
+  Domain color_domain = domain;
+  for (int i = 0; i < num_dims; i++) {
+    if (!dims[i].is_replica_dim) {
+      color_domain.rect_data[i + num_dims] = color_domain.rect_data[i];
+    }
+  }
+  for (Domain::DomainPointIterator it(color_domain); it; it++) {
+    Domain replica = domain;
+    for (int i = 0; i < num_dims; i++) {
+      if (dims[i].is_replica_dim) {
+        replica.rect_data[i] = (*it)[i];
+        replica.rect_data[i + num_dims] = (*it)[i];
+      }
+    }
+    replicas[*it] = replica;
+  }
+  return color_domain;
+}
+
+}; // namespace
+
 TensorBase::TensorBase(TensorBase const &rhs) {
   tensor_guid = rhs.tensor_guid;
   num_dims = rhs.num_dims;
@@ -56,16 +92,14 @@ bool TensorBase::set_tensor(FFModel const *ff,
   }
   ParallelTensor ptensor = nullptr;
   ff->get_parallel_tensor_from_tensor(this, ptensor);
-  ptensor->set_tensor<T>(ff, dim_sizes, data);
-  return true;
+  return ptensor->set_tensor<T>(ff, dim_sizes, data);
 }
 
 template <typename T>
 bool TensorBase::get_tensor(FFModel const *ff, T *data, bool get_gradients) {
   ParallelTensor ptensor = nullptr;
   ff->get_parallel_tensor_from_tensor(this, ptensor);
-  ptensor->get_tensor<T>(ff, data, get_gradients);
-  return true;
+  return ptensor->get_tensor<T>(ff, data, get_gradients);
 }
 
 template <typename T>
@@ -269,11 +303,7 @@ void ParallelTensorBase::attach_raw_ptr(FFConfig &config,
   Runtime *runtime = config.lg_hlr;
   AttachLauncher launcher(EXTERNAL_INSTANCE, region, region);
   std::vector<FieldID> fields(1, FID_DATA);
-  const Memory local_sysmem =
-      Machine::MemoryQuery(Machine::get_machine())
-          .has_affinity_to(runtime->get_executing_processor(ctx))
-          .only_kind(Memory::SYSTEM_MEM)
-          .first();
+  const Memory local_sysmem = get_local_sysmem(ctx, runtime);
   launcher.attach_array_soa(raw_ptr, column_major, fields, local_sysmem);
   physical_region = runtime->attach_external_resource(ctx, launcher);
 }
@@ -621,7 +651,7 @@ size_t hash<FlexFlow::ParallelTensorShape>::operator()(
 
 namespace FlexFlow {
 
-bool ParallelTensorBase::is_valid_machine_view(MachineView const &view) const {
+bool ParallelTensorShape::is_valid_machine_view(MachineView const &view) const {
   int is_dim = 0;
   for (int i = 0; i < num_dims; i++) {
     if (dims[i].parallel_idx != -1) {
@@ -640,12 +670,20 @@ bool ParallelTensorBase::is_valid_machine_view(MachineView const &view) const {
   if (is_dim != view.ndims) {
     return false;
   }
-  if (get_total_num_parts() != view.num_parts()) {
+  size_t num_parts = 1;
+  for (int i = 0; i < num_dims; i++) {
+    num_parts *= dims[i].degree;
+  }
+  if (num_parts != view.num_parts()) {
     return false;
   }
   return true;
 }
 
+bool ParallelTensorBase::is_valid_machine_view(MachineView const &view) const {
+  return this->get_shape().is_valid_machine_view(view);
+}
+
 template <typename T>
 bool ParallelTensorBase::set_tensor(FFModel const *ff,
                                     std::vector<int> const &dim_sizes,
@@ -653,44 +691,61 @@ bool ParallelTensorBase::set_tensor(FFModel const *ff,
   Context ctx = ff->config.lg_ctx;
   Runtime *runtime = ff->config.lg_hlr;
   // TODO: check data type matches
-  // TODO: Currently we use a task launch, change to index launch for NCCL
-  // parameter
-  size_t volume = 1, num_replicas = 0;
-  if (sync_type == ParameterSyncType::NCCL) {
-    Domain domain = runtime->get_index_space_domain(ctx, parallel_is);
-    num_replicas = domain.get_volume();
-  } else if (sync_type == ParameterSyncType::PS) {
-    num_replicas = 1;
-  } else {
-    num_replicas = 1;
-  }
+  size_t volume = 1;
   for (size_t i = 0; i < dim_sizes.size(); i++) {
     volume = volume * dim_sizes[i];
   }
-  RegionRequirement req(region, READ_WRITE, EXCLUSIVE, region);
-  req.add_field(FID_DATA);
-  InlineLauncher launcher(req);
-  PhysicalRegion pr = runtime->map_region(ctx, launcher);
-  pr.wait_until_valid();
-  switch (num_dims) {
-#define DIMFUNC(DIM)                                                           \
-  case DIM: {                                                                  \
-    TensorAccessorW<T, DIM> acc(pr, req, FID_DATA, ctx, runtime, true);        \
-    assert(acc.rect.volume() == volume * num_replicas);                        \
-    T *ptr = acc.ptr;                                                          \
-    for (size_t i = 0; i < num_replicas; i++) {                                \
-      memcpy(ptr, data, volume * sizeof(T));                                   \
-      ptr += volume;                                                           \
-    }                                                                          \
-    break;                                                                     \
+  IndexSpace is = region.get_index_space();
+  Domain domain = runtime->get_index_space_domain(ctx, is);
+  std::map<DomainPoint, Domain> replicas;
+  Domain color_domain = get_replica_domains(domain, dims, num_dims, replicas);
+  if (domain.get_volume() != volume * replicas.size()) {
+    fprintf(stderr,
+            "Cannot set a tensor of %zu elements per replica from %zu\n",
+            domain.get_volume() / replicas.size(),
+            volume);
+    return false;
   }
-    LEGION_FOREACH_N(DIMFUNC)
-#undef DIMFUNC
-    default:
-      // Unsupported dim
-      assert(false);
+  // Attach data as the instance of a staging region over the points of each
+  // replica and let the runtime copy it into the tensor, so that this task
+  // neither maps the tensor nor touches data itself
+  IndexSpace color_is = runtime->create_index_space(ctx, color_domain);
+  IndexPartition ip =
+      runtime->create_partition_by_domain(ctx, is, replicas, color_is);
+  LogicalPartition replica_part =
+      runtime->get_logical_partition(ctx, region, ip);
+  std::vector<FieldID> fields(1, FID_DATA);
+  Memory local_sysmem = get_local_sysmem(ctx, runtime);
+  std::vector<Future> detached;
+  for (auto const &replica : replicas) {
+    IndexSpace staging_is = runtime->create_index_space(ctx, replica.second);
+    LogicalRegion staging = runtime->create_logical_region(
+        ctx, staging_is, region.get_field_space());
+    AttachLauncher attach(EXTERNAL_INSTANCE, staging, staging);
+    attach.attach_array_soa(
+        const_cast<T *>(data), true /*column_major*/, fields, local_sysmem);
+    PhysicalRegion pr = runtime->attach_external_resource(ctx, attach);
+    LogicalRegion dst = runtime->get_logical_subregion_by_color(
+        ctx, replica_part, replica.first);
+    CopyLauncher copy;
+    copy.add_copy_requirements(
+        RegionRequirement(staging, READ_ONLY, EXCLUSIVE, staging),
+        RegionRequirement(dst, WRITE_DISCARD, EXCLUSIVE, region));
+    copy.add_src_field(0, FID_DATA);
+    copy.add_dst_field(0, FID_DATA);
+    runtime->issue_copy_operation(ctx, copy);
+    // data is only read, so there is nothing to flush
+    detached.push_back(
+        runtime->detach_external_resource(ctx, pr, false /*flush*/));
+    runtime->destroy_logical_region(ctx, staging);
+    runtime->destroy_index_space(ctx, staging_is);
+  }
+  runtime->destroy_index_partition(ctx, ip);
+  runtime->destroy_index_space(ctx, color_is);
+  // data belongs to the caller, so wait until the copies no longer read it
+  for (Future &f : detached) {
+    f.wait();
   }
-  runtime->unmap_region(ctx, pr);
   return true;
 }
 
@@ -723,27 +778,33 @@ bool ParallelTensorBase::get_tensor(FFModel const *ff,
   for (int i = 0; i < num_dims; i++) {
     volume = volume * dims[i].size / dims[i].degree;
   }
-  RegionRequirement req(
-      weight_lr, READ_ONLY, EXCLUSIVE, get_gradients ? region_grad : region);
-  req.add_field(FID_DATA);
-  InlineLauncher launcher(req);
-  PhysicalRegion pr = runtime->map_region(ctx, launcher);
-  pr.wait_until_valid();
-  switch (num_dims) {
-#define DIMFUNC(DIM)                                                           \
-  case DIM: {                                                                  \
-    TensorAccessorR<T, DIM> acc(pr, req, FID_DATA, ctx, runtime);              \
-    assert(acc.rect.volume() == volume);                                       \
-    memcpy(data, acc.ptr, volume * sizeof(T));                                 \
-    break;                                                                     \
-  }
-    LEGION_FOREACH_N(DIMFUNC)
-#undef DIMFUNC
-    default:
-      // Unsupported dim
-      assert(false);
-  }
-  runtime->unmap_region(ctx, pr);
+  LogicalRegion parent = get_gradients ? region_grad : region;
+  Domain domain =
+      runtime->get_index_space_domain(ctx, weight_lr.get_index_space());
+  assert(domain.get_volume() == volume);
+  // Attach data as the instance of a staging region with the points of
+  // weight_lr, so that the runtime copies into it from wherever the tensor is
+  IndexSpace staging_is = runtime->create_index_space(ctx, domain);
+  LogicalRegion staging = runtime->create_logical_region(
+      ctx, staging_is, parent.get_field_space());
+  AttachLauncher attach(EXTERNAL_INSTANCE, staging, staging);
+  std::vector<FieldID> fields(1, FID_DATA);
+  attach.attach_array_soa(data,
+                          true /*column_major*/,
+                          fields,
+                          get_local_sysmem(ctx, runtime));
+  PhysicalRegion pr = runtime->attach_external_resource(ctx, attach);
+  CopyLauncher copy;
+  copy.add_copy_requirements(
+      RegionRequirement(weight_lr, READ_ONLY, EXCLUSIVE, parent),
+      RegionRequirement(staging, WRITE_DISCARD, EXCLUSIVE, staging));
+  copy.add_src_field(0, FID_DATA);
+  copy.add_dst_field(0, FID_DATA);
+  runtime->issue_copy_operation(ctx, copy);
+  // Detaching flushes the copy into data
+  runtime->detach_external_resource(ctx, pr).wait();
+  runtime->destroy_logical_region(ctx, staging);
+  runtime->destroy_index_space(ctx, staging_is);
   return true;
 }
 
@@ -0,0 +1,247 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/roofline_cost_model.h"
+#include "flexflow/ffconst_utils.h"
+#include "flexflow/model.h"
+#include "flexflow/ops/attention.h"
+#include "flexflow/ops/conv_2d.h"
+#include "flexflow/ops/pool_2d.h"
+#include "flexflow/simulator.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+namespace FlexFlow {
+
+namespace {
+
+// The shards of tensors that one device of view computes on
+bool get_shards(ParallelTensor const *tensors,
+                int num_tensors,
+                MachineView const &view,
+                std::vector<ParallelTensorBase> &shards) {
+  for (int i = 0; i < num_tensors; i++) {
+    if (tensors[i] == nullptr) {
+      continue;
+    }
+    ParallelTensorBase shard;
+    if (!tensors[i]->get_sub_tensor(view, shard)) {
+      return false;
+    }
+    shard.data_type = tensors[i]->data_type;
+    shards.push_back(shard);
+  }
+  return true;
+}
+
+double total_bytes(std::vector<ParallelTensorBase> const &shards) {
+  double bytes = 0.0;
+  for (ParallelTensorBase const &shard : shards) {
+    bytes += (double)shard.get_volume() * data_type_size(shard.data_type);
+  }
+  return bytes;
+}
+
+// FLOPs of one forward pass; memory-bound operators count one per output
+// element, or a few for the normalizations
+double forward_flops(Op const *op,
+                     std::vector<ParallelTensorBase> const &inputs,
+                     std::vector<ParallelTensorBase> const &outputs,
+                     std::vector<ParallelTensorBase> const &weights) {
+  double output_volume = outputs.empty() ? 0.0 : outputs[0].get_volume();
+  switch (op->op_type) {
+    case OP_LINEAR: {
+      return 2.0 * output_volume * inputs[0].dims[0].size;
+    }
+    case OP_BATCHMATMUL: {
+      return 2.0 * output_volume * inputs[0].dims[0].size;
+    }
+    case OP_CONV2D: {
+      Conv2D const *conv = (Conv2D const *)op;
+      int in_channels = inputs[0].dims[2].size;
+      return 2.0 * output_volume * conv->kernel_h * conv->kernel_w *
+             in_channels / conv->groups;
+    }
+    case OP_POOL2D: {
+      Pool2D const *pool = (Pool2D const *)op;
+      return output_volume * pool->kernel_h * pool->kernel_w;
+    }
+    case OP_MULTIHEAD_ATTENTION: {
+      MultiHeadAttention const *attn = (MultiHeadAttention const *)op;
+      double batch = inputs[0].dims[2].size;
+      double q_length = inputs[0].dims[1].size;
+      double kv_length = inputs[1].dims[1].size;
+      double params_per_head = attn->qSize * attn->qProjSize +
+                               attn->kSize * attn->kProjSize +
+                               attn->vSize * attn->vProjSize +
+                               attn->oProjSize * attn->vProjSize;
+      double weight_volume = weights[0].get_volume();
+      double num_heads = weight_volume / params_per_head;
+      double projections =
+          2.0 * batch * std::max(q_length, kv_length) * weight_volume;
+      double scores = 2.0 * batch * num_heads * q_length * kv_length *
+                      (attn->kProjSize + attn->vProjSize);
+      return projections + scores;
+    }
+    case OP_SOFTMAX:
+    case OP_LAYERNORM:
+    case OP_BATCHNORM: {
+      return 5.0 * output_volume;
+    }
+    default: {
+      return output_volume;
+    }
+  }
+}
+
+}; // namespace
+
+float DeviceDescription::get_efficiency(OperatorType type) const {
+  auto const &it = this->efficiency.find(type);
+  return it == this->efficiency.end() ? 1.0f : it->second;
+}
+
+/*static*/
+DeviceDescription DeviceDescription::from_file(std::string const &filename) {
+  DeviceDescription device;
+  std::ifstream device_config(filename);
+  if (!device_config) {
+    fprintf(stderr,
+            "Failed to open device description file %s\n",
+            filename.c_str());
+    assert(false);
+  }
+  std::string line;
+  while (std::getline(device_config, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    // split a line into words
+    std::istringstream iss(line);
+    std::vector<std::string> words{std::istream_iterator<std::string>{iss},
+                                   std::istream_iterator<std::string>{}};
+    if (words.size() < 3) {
+      continue;
+    }
+    if (words[0] == "peak_tflops") {
+      device.peak_tflops = stof(words[2]);
+    } else if (words[0] == "memory_bandwidth") {
+      device.memory_bandwidth = stof(words[2]);
+    } else if (words[0] == "kernel_launch_latency") {
+      device.kernel_launch_latency = stof(words[2]);
+    } else if (words[0] == "efficiency" && words.size() >= 4) {
+      // efficiency <operator type name> = <fraction>
+      OperatorType type;
+      if (!get_operator_type_from_name(words[1], type)) {
+        fprintf(stderr,
+                "Unknown operator type %s in device description file %s\n",
+                words[1].c_str(),
+                filename.c_str());
+        assert(false);
+      }
+      device.efficiency[type] = stof(words[3]);
+    }
+  }
+  return device;
+}
+
+RooflineCostModel::RooflineCostModel(DeviceDescription const &_device)
+    : device(_device) {}
+
+float RooflineCostModel::run_time(OperatorType type,
+                                  OperatorWork const &work) const {
+  float efficiency = this->device.get_efficiency(type);
+  // TFLOP/s and GB/s are 1e9 FLOPs and 1e6 bytes per ms
+  double compute_time =
+      work.flops / (this->device.peak_tflops * 1e9 * efficiency);
+  double memory_time =
+      work.bytes / (this->device.memory_bandwidth * 1e6 * efficiency);
+  return std::max(compute_time, memory_time) +
+         work.num_kernels * this->device.kernel_launch_latency;
+}
+
+bool get_operator_work(Op const *op,
+                       MachineView const &view,
+                       CompMode comp_mode,
+                       OperatorWork &forward,
+                       OperatorWork &backward,
+                       CostMetrics &cost_metrics) {
+  forward = OperatorWork();
+  backward = OperatorWork();
+  cost_metrics = CostMetrics();
+  if (op->is_parallel_op() || op->op_type == OP_NOOP ||
+      op->op_type == OP_INPUT || op->op_type == OP_WEIGHT) {
+    // Only move data, which estimate_xfer_cost accounts for
+    return true;
+  }
+
+  std::vector<ParallelTensorBase> inputs, outputs, weights;
+  if (!get_shards(op->inputs, op->numInputs, view, inputs) ||
+      !get_shards(op->outputs, op->numOutputs, view, outputs) ||
+      !get_shards(op->weights, op->numWeights, view, weights)) {
+    return false;
+  }
+  double input_bytes = total_bytes(inputs);
+  double output_bytes = total_bytes(outputs);
+  double weight_bytes = total_bytes(weights);
+  bool has_weights = !weights.empty();
+
+  forward.flops = forward_flops(op, inputs, outputs, weights);
+  forward.num_kernels = op->op_type == OP_MULTIHEAD_ATTENTION ? 4 : 1;
+  if (op->op_type == OP_EMBEDDING) {
+    // Gathers only the looked up rows of the table
+    forward.bytes = input_bytes + 2 * output_bytes;
+  } else {
+    forward.bytes = input_bytes + output_bytes + weight_bytes;
+  }
+
+  if (comp_mode == COMP_MODE_TRAINING) {
+    // Input and weight gradients each cost about a forward pass, and both
+    // read the output gradients
+    backward.flops = forward.flops * (has_weights ? 2 : 1);
+    backward.bytes = forward.bytes + input_bytes + output_bytes;
+    if (op->op_type != OP_EMBEDDING) {
+      backward.bytes += weight_bytes;
+    }
+    backward.num_kernels = forward.num_kernels * (has_weights ? 2 : 1);
+  }
+
+  // Same accounting as profiling: tensors plus their gradients in training
+  size_t copies = comp_mode == COMP_MODE_TRAINING ? 2 : 1;
+  cost_metrics.inputs_memory = copies * (size_t)input_bytes;
+  cost_metrics.outputs_memory = copies * (size_t)output_bytes;
+  cost_metrics.weights_memory = copies * (size_t)weight_bytes;
+  return true;
+}
+
+bool RooflineCostModel::estimate_operator_cost(
+    Op const *op,
+    MachineView const &view,
+    CompMode comp_mode,
+    CostMetrics &cost_metrics) const {
+  OperatorWork forward, backward;
+  if (!get_operator_work(
+          op, view, comp_mode, forward, backward, cost_metrics)) {
+    return false;
+  }
+  cost_metrics.forward_time = this->run_time(op->op_type, forward);
+  cost_metrics.backward_time = this->run_time(op->op_type, backward);
+  return true;
+}
+
+}; // namespace FlexFlow
@@ -15,6 +15,8 @@
 
 #include "flexflow/simulator.h"
 #include "flexflow/model.h"
+#include "flexflow/fusion_planner.h"
+#include "flexflow/ops/kernels/fused_elementwise_kernels.h"
 #include "flexflow/parallel_ops/combine.h"
 #include "flexflow/parallel_ops/partition.h"
 #include "flexflow/parallel_ops/reduction.h"
@@ -486,30 +488,15 @@ void Simulator::add_task_dependencies_with_xfer(SimTask *src_task,
   std::abort();
 }
 
+// Costs are only measured for MachineViews, which the roofline model, the
+// cost predictor and the profiling records are keyed by. The legacy
+// ParallelConfig simulation (FFModel::mcmc_optimize) is not called anymore.
 CostMetrics Simulator::measure_operator_cost(Op const *op,
                                              ParallelConfig const &config) {
-  assert(false);
-#ifdef DEADCODE
-  size_t hash = 17 * 31 + op->get_untyped_params_hash();
-  hash = hash * 31 + std::hash<int>()(config.device_type);
-  hash = hash * 31 + std::hash<int>()(config.nDims);
-  for (int i = 0; i < config.nDims; i++) {
-    hash = hash * 31 + std::hash<int>()(config.dim[i]);
-  }
-  std::unordered_map<size_t, CostMetrics>::const_iterator iter =
-      hash_to_operator_cost.find(hash);
-  if (iter == hash_to_operator_cost.end()) {
-    CostMetrics cost_metrics;
-    bool is_implemented = op->measure_operator_cost(this, config, cost_metrics);
-    if (!is_implemented) {
-      handle_measure_operator_cost_unimplemented(op);
-    }
-    hash_to_operator_cost[hash] = cost_metrics;
-    return cost_metrics;
-  } else {
-    return iter->second;
-  }
-#endif
+  std::cerr << "measure_operator_cost is not supported for ParallelConfigs "
+            << "(op " << op->name << "), measure it for a MachineView instead"
+            << std::endl;
+  std::abort();
 }
 
 ParallelConfig Op::view_to_pc(MachineView const &view) const {
@@ -534,23 +521,116 @@ ParallelConfig Op::view_to_pc(MachineView const &view) const {
   return config;
 }
 
+void Simulator::init_cost_models(FFConfig const &config) {
+  task_launch_time = config.task_launch_time;
+  if (!config.roofline_device_file.empty()) {
+    roofline_model.reset(new RooflineCostModel(
+        DeviceDescription::from_file(config.roofline_device_file)));
+  }
+  predict_costs = !config.cost_predictor_file.empty();
+  if (predict_costs || !config.export_cost_records_file.empty()) {
+    cost_predictor.reset(new CostPredictor(config.cost_predictor_threshold));
+  }
+  if (predict_costs && !cost_predictor->load(config.cost_predictor_file)) {
+    fprintf(stderr,
+            "Profiling all operator costs since the cost records in %s "
+            "cannot be used\n",
+            config.cost_predictor_file.c_str());
+    cost_predictor.reset(new CostPredictor(config.cost_predictor_threshold));
+  }
+}
+
+bool Simulator::compute_operator_cost(Op const *op,
+                                      MachineView const &mv,
+                                      CostMetrics &cost_metrics) {
+  if (this->roofline_model != nullptr) {
+    return this->roofline_model->estimate_operator_cost(
+        op, mv, this->computationMode, cost_metrics);
+  }
+  OperatorWork forward, backward;
+  CostMetrics predicted{};
+  bool has_work = false;
+  if (this->cost_predictor != nullptr) {
+    has_work = get_operator_work(
+        op, mv, this->computationMode, forward, backward, predicted);
+  }
+  if (has_work && this->predict_costs &&
+      this->cost_predictor->predict(op->op_type,
+                                    forward,
+                                    backward,
+                                    predicted.forward_time,
+                                    predicted.backward_time)) {
+    // The memory is the analytical estimate of get_operator_work
+    cost_metrics = predicted;
+    return true;
+  }
+  if (!op->measure_operator_cost(this, mv, cost_metrics)) {
+    return false;
+  }
+  if (has_work) {
+    CostRecord record;
+    record.op_type = op->op_type;
+    record.forward = forward;
+    record.backward = backward;
+    record.forward_time = cost_metrics.forward_time;
+    record.backward_time = cost_metrics.backward_time;
+    this->cost_predictor->add_record(record);
+  }
+  return true;
+}
+
+/*static*/
+tl::optional<ProfilingRecordKey>
+    Simulator::get_profiling_record_key(Op const *op, MachineView const &mv) {
+  tl::optional<OperatorParameters> retrieved_params = get_op_parameters(op);
+  if (!retrieved_params.has_value()) {
+    return tl::nullopt;
+  }
+  std::vector<ParallelTensorShape> shard_shapes;
+  auto add_shard_shapes = [&](ParallelTensor const *tensors, int num_tensors) {
+    for (int i = 0; i < num_tensors; i++) {
+      ParallelTensorBase sub_tensor;
+      sub_tensor.num_dims = 0;
+      sub_tensor.data_type = DT_NONE;
+      if (tensors[i] != nullptr) {
+        if (!tensors[i]->get_sub_tensor(mv, sub_tensor)) {
+          return false;
+        }
+        sub_tensor.data_type = tensors[i]->data_type;
+      }
+      shard_shapes.push_back(sub_tensor.get_shape());
+    }
+    return true;
+  };
+  if (!add_shard_shapes(op->inputs, op->numInputs) ||
+      !add_shard_shapes(op->outputs, op->numOutputs) ||
+      !add_shard_shapes(op->weights, op->numWeights)) {
+    return tl::nullopt;
+  }
+  return ProfilingRecordKey{
+      retrieved_params.value(), mv.device_type, shard_shapes};
+}
+
 CostMetrics Simulator::measure_operator_cost(Op const *op,
                                              MachineView const &mv) {
-  tl::optional<OperatorParameters> retrieved_params = get_op_parameters(op);
-  if (retrieved_params.has_value()) {
-    OperatorParameters params = retrieved_params.value();
-    ProfilingRecordKey key{params, mv};
-    if (this->strict_hash_to_operator_cost.find(key) ==
-        this->strict_hash_to_operator_cost.end()) {
+  tl::optional<ProfilingRecordKey> key = get_profiling_record_key(op, mv);
+  if (key.has_value()) {
+    auto iter = this->strict_hash_to_operator_cost.find(key.value());
+    if (iter == this->strict_hash_to_operator_cost.end()) {
       CostMetrics cost_metrics{};
-      bool is_implemented = op->measure_operator_cost(this, mv, cost_metrics);
+      bool is_implemented = compute_operator_cost(op, mv, cost_metrics);
       if (!is_implemented) {
         handle_measure_operator_cost_unimplemented(op);
       }
-      op->estimate_sync_cost(this, mv, cost_metrics);
-      this->strict_hash_to_operator_cost[key] = cost_metrics;
+      iter = this->strict_hash_to_operator_cost
+                 .emplace(key.value(), cost_metrics)
+                 .first;
     }
-    return this->strict_hash_to_operator_cost.at(key);
+    // The record is shared by all views with these shard shapes, but the
+    // sync cost depends on the view's devices
+    CostMetrics cost_metrics = iter->second;
+    op->estimate_sync_cost(this, mv, cost_metrics);
+    return cost_metrics;
   }
 
   size_t hash = 17 * 31 + op->get_untyped_params_hash();
@@ -564,7 +644,7 @@ CostMetrics Simulator::measure_operator_cost(Op const *op,
 
   if (iter == hash_to_operator_cost.end()) {
     CostMetrics cost_metrics{};
-    bool is_implemented = op->measure_operator_cost(this, mv, cost_metrics);
+    bool is_implemented = compute_operator_cost(op, mv, cost_metrics);
     if (!is_implemented) {
       handle_measure_operator_cost_unimplemented(op);
     }
@@ -757,6 +837,90 @@ float Simulator::estimate_xfer_cost(Op const *op,
   }
 }
 
+namespace {
+
+// Whether FusedOp would evaluate op in an element-wise program, as decided
+// by FusedOp::compile_elementwise_programs
+bool is_elementwise_op(Op const *op) {
+  using namespace Kernels::FusedElementwise;
+  OpInfo info;
+  info.op_type = op->op_type;
+  info.scalar = 0.0f;
+  info.same_shape = op->numWeights == 0;
+  info.shape = 0;
+  ParallelTensorShape shape = op->outputs[0]->get_shape();
+  shape.data_type = DT_NONE;
+  for (int i = 0; i < op->numInputs; i++) {
+    ParallelTensorShape input_shape = op->inputs[i]->get_shape();
+    input_shape.data_type = DT_NONE;
+    info.same_shape &= input_shape == shape;
+    info.inputs.push_back(i);
+    info.input_types.push_back(op->inputs[i]->data_type);
+  }
+  for (int i = 0; i < op->numOutputs; i++) {
+    ParallelTensorShape output_shape = op->outputs[i]->get_shape();
+    output_shape.data_type = DT_NONE;
+    info.same_shape &= output_shape == shape;
+    info.outputs.push_back(op->numInputs + i);
+    info.output_types.push_back(op->outputs[i]->data_type);
+  }
+  return is_elementwise(info);
+}
+
+} // namespace
+
+void Simulator::add_launch_costs(Op const *op,
+                                 CostMetrics &cost_metrics) const {
+  // input and weight operators launch no forward/backward tasks
+  if (op->op_type == OP_INPUT || op->op_type == OP_WEIGHT) {
+    return;
+  }
+  cost_metrics.forward_time += task_launch_time;
+  if (computationMode == COMP_MODE_TRAINING) {
+    cost_metrics.backward_time += task_launch_time;
+  }
+}
+
+// estimate the run time saved when apply_fusion puts Op op into the same
+// FusedOp as the producer of its input_idx-th input, given their views
+float Simulator::estimate_fusion_saving(Op const *op,
+                                        int input_idx,
+                                        MachineView const &source_view,
+                                        MachineView const &sink_view) {
+  Op const *producer = op->inputs[input_idx]->owner_op;
+  // apply_fusion only fuses operators with identical views
+  if (producer == nullptr || source_view != sink_view ||
+      !FFModel::can_fuse_operator(op) ||
+      !FFModel::can_fuse_operator(producer)) {
+    return 0.0f;
+  }
+  float saving = 0.0f;
+  // Only refund op's launches through the first input whose producer
+  // apply_fusion would fuse with op. The views of producers other than
+  // this one are unknown here, so they are taken to match.
+  std::vector<bool> producer_can_fuse(op->numInputs);
+  std::vector<int> producer_views(op->numInputs);
+  for (int i = 0; i < op->numInputs; i++) {
+    Op const *other = op->inputs[i]->owner_op;
+    producer_can_fuse[i] =
+        other != nullptr && FFModel::can_fuse_operator(other);
+    producer_views[i] = (other == producer) ? 0 : -1;
+  }
+  if (fusion_refund_input(0, producer_can_fuse, producer_views) == input_idx) {
+    CostMetrics launches{};
+    this->add_launch_costs(op, launches);
+    saving += launches.forward_time + launches.backward_time;
+  }
+  // Consecutive element-wise operators run as one loop, in which op reads
+  // this input from registers. Their kernels are bound by memory traffic,
+  // which we split evenly among their tensors.
+  if (is_elementwise_op(producer) && is_elementwise_op(op)) {
+    CostMetrics metrics = this->measure_operator_cost(op, sink_view);
+    saving += metrics.forward_time / (op->numInputs + op->numOutputs);
+  }
+  return saving;
+}
+
 bool Op::estimate_sync_cost(Simulator *sim,
                             MachineView const &view,
                             CostMetrics &cost_metrics) const {
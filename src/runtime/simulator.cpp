@@ -58,6 +58,29 @@ Simulator::Simulator(FFModel const *model,
                      MachineModel *machine)
     : memory(_memory), handler(_handler), offset(0), warmup_times(5),
       repeat_times(10), computationMode(model->config.computationMode) {
+  size_t max_num_tasks = 1024 * 1024;
+  this->machine = machine;
+  segment_size = model->config.simulator_segment_size;
+  max_num_segments = model->config.simulator_max_num_segments;
+  // Initialize task manager
+  task_manager = new TaskManager(max_num_tasks);
+
+  init_cost_models(model->config);
+  if (roofline_model != nullptr) {
+    // Operator costs are estimated, so the simulator needs no device
+    base_ptr = nullptr;
+    capacity = 0;
+    conv2d_meta = nullptr;
+    linear_meta = nullptr;
+    pool2d_meta = nullptr;
+    ele_unary_meta = nullptr;
+    ele_binary_meta = nullptr;
+    batch_matmul_meta = nullptr;
+    concat_meta = nullptr;
+    transpose_meta = nullptr;
+    return;
+  }
+
   // Allocate simulator memory
   Rect1 bounds(Point1(0), Point1(0));
   std::vector<size_t> field_sizes;
@@ -78,8 +101,6 @@ Simulator::Simulator(FFModel const *model,
   checkCUDA(hipblasSetStream(handler.blas, stream));
   checkCUDNN(miopenSetStream(handler.dnn, stream));
 
-  size_t max_num_tasks = 1024 * 1024;
-
   hipEventCreate(&start_event);
   hipEventCreate(&end_event);
   conv2d_meta = new Conv2DMeta(handler);
@@ -93,14 +114,12 @@ Simulator::Simulator(FFModel const *model,
   concat_meta = new ConcatMeta(handler);
   // dropout_meta = new DropoutMeta(handler);
   transpose_meta = new TransposeMeta(handler);
-  this->machine = machine;
-  segment_size = model->config.simulator_segment_size;
-  max_num_segments = model->config.simulator_max_num_segments;
-  // Initialize task manager
-  task_manager = new TaskManager(max_num_tasks);
 }
 
 Simulator::~Simulator(void) {
+  if (roofline_model != nullptr) {
+    return;
+  }
   simulatorInst.destroy();
 }
 
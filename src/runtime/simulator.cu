@@ -57,6 +57,29 @@ Simulator::Simulator(FFModel const *model,
                      MachineModel *machine)
     : memory(_memory), handler(_handler), offset(0), warmup_times(5),
       repeat_times(10), computationMode(model->config.computationMode) {
+  size_t max_num_tasks = 1024 * 1024;
+  this->machine = machine;
+  segment_size = model->config.simulator_segment_size;
+  max_num_segments = model->config.simulator_max_num_segments;
+  // Initialize task manager
+  task_manager = new TaskManager(max_num_tasks);
+
+  init_cost_models(model->config);
+  if (roofline_model != nullptr) {
+    // Operator costs are estimated, so the simulator needs no device
+    base_ptr = nullptr;
+    capacity = 0;
+    conv2d_meta = nullptr;
+    linear_meta = nullptr;
+    pool2d_meta = nullptr;
+    ele_unary_meta = nullptr;
+    ele_binary_meta = nullptr;
+    batch_matmul_meta = nullptr;
+    concat_meta = nullptr;
+    transpose_meta = nullptr;
+    return;
+  }
+
   // Allocate simulator memory
   Rect1 bounds(Point1(0), Point1(0));
   std::vector<size_t> field_sizes;
@@ -77,8 +100,6 @@ Simulator::Simulator(FFModel const *model,
   checkCUDA(cublasSetStream(handler.blas, stream));
   checkCUDNN(cudnnSetStream(handler.dnn, stream));
 
-  size_t max_num_tasks = 1024 * 1024;
-
   cudaEventCreate(&start_event);
   cudaEventCreate(&end_event);
   conv2d_meta = new Conv2DMeta(handler);
@@ -92,14 +113,13 @@ Simulator::Simulator(FFModel const *model,
   concat_meta = new ConcatMeta(handler);
   // dropout_meta = new DropoutMeta(handler);
   transpose_meta = new TransposeMeta(handler);
-  this->machine = machine;
-  segment_size = model->config.simulator_segment_size;
-  max_num_segments = model->config.simulator_max_num_segments;
-  // Initialize task manager
-  task_manager = new TaskManager(max_num_tasks);
 }
 
 Simulator::~Simulator(void) {
+  delete task_manager;
+  if (roofline_model != nullptr) {
+    return;
+  }
   simulatorInst.destroy();
   cudaEventDestroy(start_event);
   cudaEventDestroy(end_event);
@@ -110,7 +130,6 @@ Simulator::~Simulator(void) {
   delete batch_matmul_meta;
   delete concat_meta;
   delete transpose_meta;
-  delete task_manager;
 }
 
 __host__ void
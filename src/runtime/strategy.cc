@@ -14,7 +14,10 @@
  */
 
 #include "flexflow/config.h"
+#include "flexflow/graph.h"
 #include "flexflow/simulator.h"
+#include "flexflow/strategy_file.h"
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -194,4 +197,164 @@ bool save_strategies_to_file(
   return true;
 }
 
+namespace {
+
+// The machine the strategy's MachineViews were searched for
+std::pair<int, int> search_machine(FFConfig const &config) {
+  return {config.search_num_nodes.has_value() ? config.search_num_nodes.value()
+                                              : config.numNodes,
+          config.search_num_workers.has_value()
+              ? config.search_num_workers.value()
+              : config.workersPerNode};
+}
+
+// Everything a strategy refers to by value: the layer GUIDs that operators
+// and weights are matched by, the input tensor GUIDs, and the shapes that
+// the parallel tensors of the PCG were derived from
+void serialize_model_signature(FFModel const *model, Serializer &sez) {
+  std::pair<int, int> machine = search_machine(model->config);
+  sez.serialize(machine.first);
+  sez.serialize(machine.second);
+  sez.serialize(model->layers.size());
+  for (Layer const *layer : model->layers) {
+    sez.serialize(layer->layer_guid.id);
+    sez.serialize(layer->op_type);
+    sez.serialize(layer->numOutputs);
+    for (int i = 0; i < layer->numOutputs; i++) {
+      Tensor tensor = layer->outputs[i];
+      sez.serialize(tensor->tensor_guid);
+      sez.serialize(tensor->data_type);
+      sez.serialize(tensor->num_dims);
+      for (int j = 0; j < tensor->num_dims; j++) {
+        sez.serialize(tensor->dims[j]);
+      }
+    }
+  }
+}
+
+// Deserializes value unless the signature is too short to hold it
+template <typename T>
+bool deserialize_signature(Deserializer &dez, T &value) {
+  if (dez.get_remaining_bytes() < sizeof(T)) {
+    return false;
+  }
+  dez.deserialize(value);
+  return true;
+}
+
+bool check_model_signature(FFModel const *model,
+                           std::string const &filename,
+                           Deserializer &dez) {
+  std::pair<int, int> machine = search_machine(model->config);
+  int num_nodes, workers_per_node;
+  size_t num_layers;
+  if (!deserialize_signature(dez, num_nodes) ||
+      !deserialize_signature(dez, workers_per_node) ||
+      !deserialize_signature(dez, num_layers)) {
+    fprintf(stderr,
+            "Strategy file %s has a truncated model signature\n",
+            filename.c_str());
+    return false;
+  }
+  if (num_nodes != machine.first || workers_per_node != machine.second) {
+    fprintf(stderr,
+            "Strategy file %s was searched for %d nodes with %d GPUs each, "
+            "but the search machine has %d nodes with %d GPUs each\n",
+            filename.c_str(),
+            num_nodes,
+            workers_per_node,
+            machine.first,
+            machine.second);
+    return false;
+  }
+  if (num_layers != model->layers.size()) {
+    fprintf(stderr,
+            "Strategy file %s has %zu layers, but the model has %zu\n",
+            filename.c_str(),
+            num_layers,
+            model->layers.size());
+    return false;
+  }
+  for (Layer const *layer : model->layers) {
+    size_t layer_guid;
+    OperatorType op_type;
+    int num_outputs;
+    bool matches = deserialize_signature(dez, layer_guid) &&
+                   deserialize_signature(dez, op_type) &&
+                   deserialize_signature(dez, num_outputs) &&
+                   layer_guid == layer->layer_guid.id &&
+                   op_type == layer->op_type &&
+                   num_outputs == layer->numOutputs;
+    for (int i = 0; matches && i < num_outputs; i++) {
+      Tensor tensor = layer->outputs[i];
+      size_t tensor_guid;
+      DataType data_type;
+      int num_dims;
+      matches = deserialize_signature(dez, tensor_guid) &&
+                deserialize_signature(dez, data_type) &&
+                deserialize_signature(dez, num_dims) &&
+                tensor_guid == tensor->tensor_guid &&
+                data_type == tensor->data_type && num_dims == tensor->num_dims;
+      for (int j = 0; matches && j < num_dims; j++) {
+        int dim;
+        matches = deserialize_signature(dez, dim) && dim == tensor->dims[j];
+      }
+    }
+    if (!matches) {
+      fprintf(stderr,
+              "Strategy file %s does not match layer %s (guid %zu): its "
+              "GUIDs, operator type or output shapes differ\n",
+              filename.c_str(),
+              layer->name,
+              layer->layer_guid.id);
+      return false;
+    }
+  }
+  if (dez.get_remaining_bytes() != 0) {
+    fprintf(stderr,
+            "Strategy file %s has %zu unexpected bytes after its model "
+            "signature\n",
+            filename.c_str(),
+            dez.get_remaining_bytes());
+    return false;
+  }
+  return true;
+}
+
+}; // namespace
+
+bool FFModel::export_strategy(
+    std::string const &filename,
+    PCG::GraphOptimalViewSerialized const &strategy) const {
+  Serializer sez;
+  serialize_model_signature(this, sez);
+  char const *buffer = (char const *)sez.get_buffer();
+  std::vector<char> signature(buffer, buffer + sez.get_used_bytes());
+  if (!write_strategy_file(
+          filename, signature, strategy.data, strategy.total_bytes)) {
+    return false;
+  }
+  printf("Exported strategy to %s\n", filename.c_str());
+  return true;
+}
+
+bool FFModel::import_strategy(
+    std::string const &filename,
+    PCG::GraphOptimalViewSerialized &strategy) const {
+  std::vector<char> signature;
+  if (!read_strategy_file(filename,
+                          signature,
+                          strategy.data,
+                          PCG::GraphOptimalViewSerialized::buffer_size,
+                          strategy.total_bytes)) {
+    return false;
+  }
+  Deserializer dez(signature.data(), signature.size());
+  if (!check_model_signature(this, filename, dez)) {
+    return false;
+  }
+  printf("Imported strategy from %s\n", filename.c_str());
+  return true;
+}
+
 }; // namespace FlexFlow
@@ -0,0 +1,130 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/strategy_file.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace FlexFlow {
+
+namespace {
+
+char const STRATEGY_FILE_MAGIC[8] = {'F', 'F', 'S', 'T', 'R', 'A', 'T', '\0'};
+// Bump whenever the serialization in graph_optimize_task changes
+uint32_t const STRATEGY_FILE_VERSION = 1;
+
+// Reads a size field and checks it against both max_bytes and the bytes left
+// in the file
+bool read_size(std::istream &input,
+               size_t file_bytes,
+               size_t max_bytes,
+               size_t &bytes) {
+  input.read((char *)&bytes, sizeof(bytes));
+  if (!input) {
+    return false;
+  }
+  size_t remaining = file_bytes - (size_t)input.tellg();
+  return bytes <= max_bytes && bytes <= remaining;
+}
+
+}; // namespace
+
+bool write_strategy_file(std::string const &filename,
+                         std::vector<char> const &signature,
+                         char const *strategy,
+                         size_t strategy_bytes) {
+  std::fstream output(filename,
+                      std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!output) {
+    fprintf(stderr, "Failed to open strategy file %s\n", filename.c_str());
+    return false;
+  }
+  size_t signature_bytes = signature.size();
+  output.write(STRATEGY_FILE_MAGIC, sizeof(STRATEGY_FILE_MAGIC));
+  output.write((char const *)&STRATEGY_FILE_VERSION,
+               sizeof(STRATEGY_FILE_VERSION));
+  output.write((char const *)&signature_bytes, sizeof(signature_bytes));
+  output.write(signature.data(), signature_bytes);
+  output.write((char const *)&strategy_bytes, sizeof(strategy_bytes));
+  output.write(strategy, strategy_bytes);
+  output.close();
+  if (!output) {
+    fprintf(stderr, "Failed to write strategy file %s\n", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool read_strategy_file(std::string const &filename,
+                        std::vector<char> &signature,
+                        char *strategy,
+                        size_t max_strategy_bytes,
+                        size_t &strategy_bytes) {
+  std::fstream input(filename, std::ios::in | std::ios::binary);
+  if (!input) {
+    fprintf(stderr, "Failed to open strategy file %s\n", filename.c_str());
+    return false;
+  }
+  input.seekg(0, std::ios::end);
+  size_t file_bytes = input.tellg();
+  input.seekg(0, std::ios::beg);
+
+  char magic[sizeof(STRATEGY_FILE_MAGIC)];
+  uint32_t version = 0;
+  input.read(magic, sizeof(magic));
+  input.read((char *)&version, sizeof(version));
+  if (!input || memcmp(magic, STRATEGY_FILE_MAGIC, sizeof(magic)) != 0) {
+    fprintf(stderr, "%s is not a strategy file\n", filename.c_str());
+    return false;
+  }
+  if (version != STRATEGY_FILE_VERSION) {
+    fprintf(stderr,
+            "Strategy file %s has version %u, but this build reads version "
+            "%u\n",
+            filename.c_str(),
+            version,
+            STRATEGY_FILE_VERSION);
+    return false;
+  }
+
+  size_t signature_bytes = 0;
+  if (!read_size(
+          input, file_bytes, MAX_STRATEGY_SIGNATURE_BYTES, signature_bytes)) {
+    fprintf(stderr,
+            "Strategy file %s is truncated or has an invalid model signature\n",
+            filename.c_str());
+    return false;
+  }
+  signature.resize(signature_bytes);
+  input.read(signature.data(), signature_bytes);
+  if (!read_size(input, file_bytes, max_strategy_bytes, strategy_bytes)) {
+    fprintf(stderr,
+            "Strategy file %s is truncated or its strategy is too large\n",
+            filename.c_str());
+    return false;
+  }
+  input.read(strategy, strategy_bytes);
+  if (!input || (size_t)input.tellg() != file_bytes) {
+    fprintf(stderr,
+            "Strategy file %s is truncated or has trailing data\n",
+            filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+}; // namespace FlexFlow
@@ -603,7 +603,8 @@ void GraphXfer::run(
     int maxNumOps,
     SimplificationSettings const &simplification_settings,
     int &num_matches_found,
-    int &num_matches_rejected) {
+    int &num_matches_rejected,
+    std::vector<Graph *> *new_candidates) {
   // printf("run: depth(%d) srcOps.size(%zu) graph.size(%zu) candidates(%zu)\n",
   // depth, srcOps.size(), graph->inEdges.size(), candidates.size());
   if (depth >= (int)srcOps.size()) {
@@ -653,6 +654,9 @@ void GraphXfer::run(
         log_xfers.spew() << "Found new candidate";
         // newGraph->print_dot();
         candidates.push(newGraph);
+        if (new_candidates != nullptr) {
+          new_candidates->push_back(newGraph);
+        }
       }
     } else {
       num_matches_rejected++;
@@ -675,7 +679,8 @@ void GraphXfer::run(
             maxNumOps,
             simplification_settings,
             num_matches_found,
-            num_matches_rejected);
+            num_matches_rejected,
+            new_candidates);
         unmatch(srcOp, op, graph);
       }
     }
@@ -1404,6 +1409,10 @@ std::string GraphXfer::get_name() const {
   }
 }
 
+bool GraphXfer::has_name() const {
+  return this->name.has_value() && !this->name.value().empty();
+}
+
 int get_num_outputs(sl::Operator const &op) {
   switch (op.op_type) {
     case OP_SPLIT:
@@ -1656,11 +1665,11 @@ bool check_opxes_have_same_type_and_constraints(OpX const &src_opx,
   return true;
 }
 
-std::vector<GraphXfer *> create_xfers(FFModel *model,
-                                      sl::RuleCollection const &rules,
-                                      int parallel_degree) {
-  std::vector<GraphXfer *> xfers;
-  for (sl::Rule const &r : rules.rules) {
+void append_xfers(FFModel *model,
+                  std::vector<sl::Rule> const &rules,
+                  int parallel_degree,
+                  std::vector<GraphXfer *> &xfers) {
+  for (sl::Rule const &r : rules) {
     GraphXfer *xfer = new GraphXfer(model);
     create_xfer(*xfer, r, parallel_degree);
     if (xfer->srcOps.size() == 1 && xfer->dstOps.size() == 1) {
@@ -1705,13 +1714,29 @@ std::vector<GraphXfer *> create_xfers(FFModel *model,
       delete (xfer);
     }
   }
+}
+
+std::vector<GraphXfer *> create_xfers(FFModel *model,
+                                      sl::RuleCollection const &rules,
+                                      int parallel_degree) {
+  std::vector<GraphXfer *> xfers;
+  append_xfers(model, rules.rules, parallel_degree, xfers);
   return xfers;
 }
 
 GraphSearchHelper::GraphSearchHelper(FFModel *model)
     : model(model), config(model->config), mem_config(1.0) {
   this->logger = std::unique_ptr<RecursiveLogger>(new RecursiveLogger("gs"));
+  if (config.substitution_profile_path.has_value()) {
+    substitution_profile.load(config.substitution_profile_path.value());
+    pruned_xfers = substitution_profile.select_pruned(
+        config.substitution_prune_top_k, config.substitution_prune_min_utility);
+    log_xfers.info() << "Pruned " << pruned_xfers.size() << " of "
+                     << substitution_profile.size()
+                     << " profiled substitutions";
+  }
   generate_all_pcg_xfers();
+  prune_xfers();
 }
 
 void GraphSearchHelper::clear_cache() {
@@ -1719,8 +1744,116 @@ void GraphSearchHelper::clear_cache() {
 }
 
 void GraphSearchHelper::load_graph_substitutions(
-    std::vector<GraphXfer *> &xfers) const {
+    Graph const *graph, std::vector<GraphXfer *> &xfers) const {
   xfers = all_pcg_xfers;
+  if (this->rule_collection == nullptr) {
+    return;
+  }
+  std::vector<OperatorType> op_types;
+  for (auto const &it : graph->inEdges) {
+    op_types.push_back(it.first.ptr->op_type);
+  }
+  // The built-in substitutions may introduce more op types
+  for (GraphXfer const *xfer : all_pcg_xfers) {
+    for (OpX const *opx : xfer->dstOps) {
+      op_types.push_back(opx->type);
+    }
+  }
+  this->load_rules_for_op_types(op_types);
+  for (std::vector<GraphXfer *> const &degree_xfers : this->rule_xfers) {
+    xfers.insert(xfers.end(), degree_xfers.begin(), degree_xfers.end());
+  }
+}
+
+void GraphSearchHelper::load_rules_for_op_types(
+    std::vector<OperatorType> op_types) const {
+  // A rule can also match ops that other substitutions introduce while the
+  // graph is rewritten, so follow the destination ops of every rule loaded
+  // until no new op type shows up
+  std::vector<sl::Rule> rules;
+  std::vector<OperatorType> src_op_types, dst_op_types;
+  while (!op_types.empty()) {
+    OperatorType op_type = op_types.back();
+    op_types.pop_back();
+    if (!this->loaded_rule_op_types.insert(op_type).second) {
+      continue;
+    }
+    for (int rule_id : this->rule_collection->rules_with_root(op_type)) {
+      // Only the name is needed to skip a pruned rule
+      std::string name = this->rule_collection->get_name(rule_id);
+      if (!name.empty() && this->pruned_xfers.count(name) > 0) {
+        continue;
+      }
+      this->rule_collection->get_op_types(rule_id, src_op_types, dst_op_types);
+      op_types.insert(op_types.end(), dst_op_types.begin(), dst_op_types.end());
+      rules.push_back(this->rule_collection->get_rule(rule_id));
+    }
+  }
+  if (rules.empty()) {
+    return;
+  }
+  log_xfers.debug() << "Building xfers for " << rules.size() << " of "
+                    << this->rule_collection->num_rules() << " rules";
+  for (size_t i = 0; i < this->rule_parallel_degrees.size(); i++) {
+    append_xfers(this->model,
+                 rules,
+                 this->rule_parallel_degrees[i],
+                 this->rule_xfers[i]);
+  }
+}
+
+void GraphSearchHelper::prune_xfers() {
+  std::vector<GraphXfer *> kept;
+  for (GraphXfer *xfer : all_pcg_xfers) {
+    if (xfer->has_name() && pruned_xfers.count(xfer->get_name()) > 0) {
+      delete xfer;
+    } else {
+      kept.push_back(xfer);
+    }
+  }
+  all_pcg_xfers = kept;
+}
+
+void GraphSearchHelper::profile_xfer_run(
+    GraphXfer const *xfer,
+    int num_matches_found,
+    double run_time,
+    std::vector<Graph *> &new_candidates,
+    std::unordered_map<Graph const *, GraphXfer const *> &candidate_xfers) {
+  if (!xfer->has_name()) {
+    new_candidates.clear();
+    return;
+  }
+  XferProfile &profile = substitution_profile.at(xfer->get_name());
+  profile.num_runs++;
+  profile.num_matches += num_matches_found;
+  profile.num_accepted += new_candidates.size();
+  profile.run_time += run_time;
+  for (Graph const *candidate : new_candidates) {
+    candidate_xfers[candidate] = xfer;
+  }
+  new_candidates.clear();
+}
+
+void GraphSearchHelper::profile_candidate(
+    Graph const *candidate,
+    bool improved,
+    std::unordered_map<Graph const *, GraphXfer const *> &candidate_xfers) {
+  // Forget the candidate before it can be deleted and its address reused
+  auto it = candidate_xfers.find(candidate);
+  if (it == candidate_xfers.end()) {
+    return;
+  }
+  if (improved) {
+    substitution_profile.at(it->second->get_name()).num_improvements++;
+  }
+  candidate_xfers.erase(it);
+}
+
+void GraphSearchHelper::save_substitution_profile() const {
+  if (config.substitution_profile_path.has_value()) {
+    substitution_profile.save(config.substitution_profile_path.value());
+  }
 }
 
 void GraphSearchHelper::generate_all_pcg_xfers() {
@@ -1771,17 +1904,21 @@ void GraphSearchHelper::generate_all_pcg_xfers() {
 
   if (config.substitution_json_path.has_value()) {
     // Currently only consider a subset of all_parallel_degrees
-    std::vector<int> considered_parallel_degrees;
-    considered_parallel_degrees.push_back(workersPerNode);
+    rule_parallel_degrees.push_back(workersPerNode);
     if (numNodes > 1) {
-      considered_parallel_degrees.push_back(numNodes * workersPerNode);
-    }
-    sl::RuleCollection rule_collection = sl::load_rule_collection_from_path(
-        config.substitution_json_path.value());
-    for (int degree : considered_parallel_degrees) {
-      std::vector<GraphXfer *> xfers =
-          create_xfers(this->model, rule_collection, degree);
-      all_pcg_xfers.insert(all_pcg_xfers.end(), xfers.begin(), xfers.end());
+      rule_parallel_degrees.push_back(numNodes * workersPerNode);
+    }
+    rule_xfers.resize(rule_parallel_degrees.size());
+    // GraphXfers are built by load_graph_substitutions once the search knows
+    // which op types occur in the PCG
+    std::string const &path = config.substitution_json_path.value();
+    if (sl::is_binary_rule_file(path)) {
+      rule_collection = std::unique_ptr<sl::BinaryRuleCollection>(
+          new sl::BinaryRuleCollection(path));
+    } else {
+      rule_collection = std::unique_ptr<sl::BinaryRuleCollection>(
+          new sl::BinaryRuleCollection(
+              sl::load_rule_collection_from_path(path)));
     }
   } else {
     // Manual substitutions
@@ -1942,6 +2079,7 @@ void GraphSearchHelper::graph_optimize(
   }
   best_graph->print_strategy_computation_graph(optimal.views);
   optimal_views = real_optimal_views;
+  save_substitution_profile();
 }
 
 /**
@@ -2016,8 +2154,17 @@ void GraphSearchHelper::graph_optimize_with_memory(
   best_graph->simplify(settings);
 
   // Get the real optimal machine views.
-  std::unordered_map<Node, MachineView> duplicated_optimal_views =
-      best_graph->optimal_views();
+  std::unordered_map<Node, MachineView> duplicated_optimal_views;
+  if (this->mem_config.mem_search_algo == MemorySearchAlgo::PARETO_FRONT) {
+    GraphCostResultWithMemory within_memory =
+        best_graph->optimal_cost_within_memory(this->config.device_mem);
+    if (within_memory.cost != std::numeric_limits<float>::infinity()) {
+      duplicated_optimal_views = within_memory.views;
+    }
+  }
+  if (duplicated_optimal_views.empty()) {
+    duplicated_optimal_views = best_graph->optimal_views();
+  }
   std::unordered_map<Node, Node> deduplication_map =
       best_graph->deduplicate_input_nodes();
   std::unordered_map<Node, MachineView> real_optimal_views;
@@ -2033,6 +2180,7 @@ void GraphSearchHelper::graph_optimize_with_memory(
   std::cout << std::endl;
 
   optimal_views = real_optimal_views;
+  save_substitution_profile();
 }
 
 void GraphSearchHelper::graph_optimize_no_split(
@@ -2058,6 +2206,7 @@ void GraphSearchHelper::graph_optimize_no_split(
   this->logger->debug() << "Total cache size: "
                         << this->cached_optimized_graphs.size();
   std::cout << "Optimal cost: " << best_graph->optimal_cost() << std::endl;
+  save_substitution_profile();
 }
 
 static void graph_log_representation(Graph const *graph,
@@ -2077,10 +2226,30 @@ void GraphSearchHelper::update_mem_optim_config(
   mem_config = new_config;
 }
 
+/**
+ * @details Under MULTI_OBJECTIVE this is the weighted sum of run time and
+ * memory. Under PARETO_FRONT it is the run time of the fastest strategy that
+ * fits in config.device_mem, or infinity if none does.
+ */
+float GraphSearchHelper::memory_aware_cost(Graph const *graph) const {
+  switch (mem_config.mem_search_algo) {
+    case MemorySearchAlgo::MULTI_OBJECTIVE:
+      return graph->optimal_cost_with_memory(mem_config.run_time_cost_factor);
+    case MemorySearchAlgo::PARETO_FRONT:
+      return graph->optimal_cost_within_memory(this->config.device_mem).cost;
+    default:
+      assert(false);
+  }
+}
+
+bool GraphCompareWithMemory::operator()(Graph *lhs, Graph *rhs) {
+  return search->memory_aware_cost(lhs) > search->memory_aware_cost(rhs);
+}
+
 void GraphSearchHelper::find_rewrite_matches(
     Graph const *graph, std::vector<GraphXferMatch> &matches) const {
   std::vector<GraphXfer *> xfers;
-  this->load_graph_substitutions(xfers);
+  this->load_graph_substitutions(graph, xfers);
 
   for (GraphXfer *xfer : xfers) {
     log_xfer_matches.debug()
@@ -2093,10 +2262,10 @@ void GraphSearchHelper::find_rewrite_matches(
 tl::optional<Node>
     GraphSearchHelper::find_split_node(Graph const *graph,
                                        int base_optimize_threshold) const {
+  using FlexFlow::PCG::Utils::DominatorTree;
   using FlexFlow::PCG::Utils::get_edges;
   using FlexFlow::PCG::Utils::MultisourceGraphStructure;
   using FlexFlow::PCG::Utils::nodes;
-  using FlexFlow::PCG::Utils::post_dominators;
   using FlexFlow::PCG::Utils::roots;
 
   TAG_ENTER(this->logger);
@@ -2152,19 +2321,36 @@ tl::optional<Node>
     }
   }
 
-  std::unordered_map<Node, std::unordered_set<Node>> post_dominator_map =
-      post_dominators<Graph, MultisourceGraphStructure<Graph>>(*graph);
   Node source_node;
+  std::unordered_set<Node> graph_roots = roots<Graph>(*graph);
   {
-    std::unordered_set<Node> source_nodes = roots<Graph>(*graph);
+    std::unordered_set<Node> source_nodes = graph_roots;
     if (source_nodes.size() != 1) {
       source_nodes = roots<Graph, MultisourceGraphStructure<Graph>>(*graph);
     }
     assert(source_nodes.size() == 1);
     source_node = *source_nodes.begin();
   }
-  std::unordered_set<Node> possible_bottlenecks =
-      post_dominator_map.at(source_node);
+  // The post-dominators of the source are its chain in the post-dominator
+  // tree; with several roots, the chain of their common post-dominator
+  // stands in for that of the virtual source
+  std::unordered_set<Node> possible_bottlenecks = {source_node};
+  {
+    DominatorTree<Node> const &tree = graph->get_post_dominator_tree();
+    tl::optional<Node> first = source_node;
+    if (graph_roots.size() != 1) {
+      first = tree.common_dominator(graph_roots);
+    }
+    if (first.has_value()) {
+      for (Node const &n : tree.dominator_chain(first.value())) {
+        // The tree may be shared with the graph this one was split from
+        if (!graph->has_node(n)) {
+          break;
+        }
+        possible_bottlenecks.insert(n);
+      }
+    }
+  }
   Node sink_node = graph->find_sink_node();
 
   int best_weight = 0;
@@ -2241,7 +2427,7 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize(
   this->logger->debug() << "Starting cost: " << r_graph->optimal_cost();
 
   std::vector<GraphXfer *> xfers;
-  this->load_graph_substitutions(xfers);
+  this->load_graph_substitutions(r_graph, xfers);
 
   Graph *graph = new Graph(*r_graph);
 
@@ -2251,6 +2437,9 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize(
   hashmap.insert(graph->hash());
   Graph *best_graph = new Graph(*graph);
   float best_cost = best_graph->optimal_cost();
+  // The xfer that created each candidate in the queue, for profiling
+  std::unordered_map<Graph const *, GraphXfer const *> candidate_xfers;
+  std::vector<Graph *> new_candidates;
   int counter = 0;
   float const alpha = this->model->config.search_alpha;
 
@@ -2268,6 +2457,9 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize(
 
     Graph *cur_graph = candidates.top();
     candidates.pop();
+    profile_candidate(cur_graph,
+                      cur_graph->optimal_cost() < best_graph->optimal_cost(),
+                      candidate_xfers);
     if (cur_graph->optimal_cost() < best_graph->optimal_cost()) {
       delete best_graph;
       best_graph = cur_graph;
@@ -2286,6 +2478,7 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize(
     for (size_t i = 0; i < xfers.size(); i++) {
       int num_matches_found = 0, num_matches_rejected = 0;
       log_xfers.debug() << "Considering xfer: " << xfers[i]->get_name();
+      auto const start = std::chrono::steady_clock::now();
       xfers[i]->run(0,
                     cur_graph,
                     candidates,
@@ -2294,7 +2487,15 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize(
                     1000,
                     simplification_settings,
                     num_matches_found,
-                    num_matches_rejected);
+                    num_matches_rejected,
+                    &new_candidates);
+      profile_xfer_run(xfers[i],
+                       num_matches_found,
+                       std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count(),
+                       new_candidates,
+                       candidate_xfers);
       log_xfers.debug() << "Rejected [ " << num_matches_rejected << " / "
                         << num_matches_found << " ] matches";
       /* std::cout << "." << std::flush; */
@@ -2329,16 +2530,15 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize_with_memory(
     // r_graph->print_dot();
   }
   this->logger->debug() << "Starting cost: "
-                        << r_graph->optimal_cost_with_memory(
-                               mem_config.run_time_cost_factor);
+                        << this->memory_aware_cost(r_graph);
 
   // Construct graph substitutions
   std::vector<GraphXfer *> xfers;
-  this->load_graph_substitutions(xfers);
+  this->load_graph_substitutions(r_graph, xfers);
 
   // Prepare for the search
   std::priority_queue<Graph *, std::vector<Graph *>, GraphCompareWithMemory>
-      candidates(GraphCompareWithMemory{mem_config.run_time_cost_factor});
+      candidates(GraphCompareWithMemory{this});
   std::unordered_set<size_t> hashmap;
 
   Graph *graph = new Graph(*r_graph);
@@ -2346,8 +2546,9 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize_with_memory(
   hashmap.insert(graph->hash());
 
   Graph *best_graph = new Graph(*graph);
-  float best_cost =
-      best_graph->optimal_cost_with_memory(mem_config.run_time_cost_factor);
+  float best_cost = this->memory_aware_cost(best_graph);
+  std::unordered_map<Graph const *, GraphXfer const *> candidate_xfers;
+  std::vector<Graph *> new_candidates;
 
   int counter = 0;
   float const alpha = this->model->config.search_alpha;
@@ -2368,21 +2569,21 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize_with_memory(
 
     Graph *cur_graph = candidates.top();
     candidates.pop();
-    if (cur_graph->optimal_cost_with_memory(mem_config.run_time_cost_factor) <
-        best_graph->optimal_cost_with_memory(mem_config.run_time_cost_factor)) {
+    bool improved = this->memory_aware_cost(cur_graph) <
+                    this->memory_aware_cost(best_graph);
+    profile_candidate(cur_graph, improved, candidate_xfers);
+    if (improved) {
       delete best_graph;
       best_graph = cur_graph;
-      best_cost =
-          cur_graph->optimal_cost_with_memory(mem_config.run_time_cost_factor);
-    } else if (cur_graph->optimal_cost_with_memory(
-                   mem_config.run_time_cost_factor) > best_cost * alpha) {
+      best_cost = this->memory_aware_cost(cur_graph);
+    } else if (this->memory_aware_cost(cur_graph) > best_cost * alpha) {
       continue;
     }
 
     log_xfers.info(
         "[%d] cur_cost(%.4lf) best_cost(%.4lf) candidates.size(%zu)",
         counter,
-        cur_graph->optimal_cost_with_memory(mem_config.run_time_cost_factor),
+        this->memory_aware_cost(cur_graph),
         best_cost,
         candidates.size());
 
@@ -2391,6 +2592,7 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize_with_memory(
     for (size_t i = 0; i < xfers.size(); i++) {
       int num_matches_found = 0, num_matches_rejected = 0;
       log_xfers.debug() << "Considering xfer: " << xfers[i]->get_name();
+      auto const start = std::chrono::steady_clock::now();
       xfers[i]->run(0,
                     cur_graph,
                     candidates,
@@ -2399,7 +2601,15 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize_with_memory(
                     1000,
                     simplification_settings,
                     num_matches_found,
-                    num_matches_rejected);
+                    num_matches_rejected,
+                    &new_candidates);
+      profile_xfer_run(xfers[i],
+                       num_matches_found,
+                       std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count(),
+                       new_candidates,
+                       candidate_xfers);
       log_xfers.debug() << "Rejected [ " << num_matches_rejected << " / "
                         << num_matches_found << " ] matches";
     }
@@ -2411,7 +2621,7 @@ std::unique_ptr<Graph> GraphSearchHelper::base_optimize_with_memory(
 
   this->logger->debug()
       << "Optimized cost at the end of base_optimize_with_memory: "
-      << best_graph->optimal_cost_with_memory(mem_config.run_time_cost_factor);
+      << this->memory_aware_cost(best_graph);
 
   return std::unique_ptr<Graph>(best_graph);
 }
@@ -2476,8 +2686,19 @@ GraphOptimizeResultWithMemory
         std::unique_ptr<Graph> optimized) const {
   GraphOptimizeResultWithMemory result;
   result.graph = *optimized;
-  GraphCostResultWithMemory gcr =
-      optimized->generic_optimal_cost<GraphCostResultWithMemory>();
+  GraphCostResultWithMemory gcr;
+  if (mem_config.mem_search_algo == MemorySearchAlgo::PARETO_FRONT) {
+    // Fall back to the fastest strategy if none fits, so that the sequence
+    // split still has a (penalized) result to combine
+    GraphCostFront front = optimized->optimal_cost_front();
+    gcr = front.fastest_within(this->config.device_mem);
+    if (gcr.cost == std::numeric_limits<float>::infinity() &&
+        !front.points.empty()) {
+      gcr = front.points.front();
+    }
+  } else {
+    gcr = optimized->generic_optimal_cost<GraphCostResultWithMemory>();
+  }
   result.cost = gcr.cost;
   result.views = gcr.views;
   result.mem_cost = gcr.mem_cost;
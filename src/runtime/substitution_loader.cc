@@ -1,7 +1,13 @@
 #include "flexflow/substitution_loader.h"
 #include <cassert>
+#include <cstring>
+#include <fcntl.h>
 #include <functional>
+#include <map>
 #include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using json = nlohmann::json;
 
@@ -71,8 +77,361 @@ RuleCollection load_rule_collection(std::istream &s) {
 }
 
 RuleCollection load_rule_collection_from_path(std::string const &path) {
+  if (is_binary_rule_file(path)) {
+    return BinaryRuleCollection(path).get_rule_collection();
+  }
   std::ifstream input(path);
   return load_rule_collection(input);
 }
 
+// Binary rule format, in 32-bit words:
+//   header:  magic, version, num_rules, num_roots
+//   index:   num_roots x (root op type, first, count) into the rule ids
+//   ids:     num_rules rule ids grouped by root op type
+//   offsets: num_rules word offsets of the rule records
+//   records: name length in bytes, name padded to whole words,
+//            num_src, src ops, num_dst, dst ops,
+//            num_mapped, num_mapped x (dstOpId, dstTsId, srcOpId, srcTsId)
+//   op:      op type, num_inputs x (opId, tsId), num_para x (key, value),
+//            each list preceded by its length
+static uint32_t const BINARY_RULE_MAGIC = 0x4C525346; // "FSRL"
+static uint32_t const BINARY_RULE_VERSION = 1;
+static size_t const BINARY_RULE_HEADER_WORDS = 4;
+
+static void encode_operator(Operator const &o, std::vector<uint32_t> &out) {
+  out.push_back(o.op_type);
+  out.push_back(o.input.size());
+  for (Tensor const &t : o.input) {
+    out.push_back(t.opId);
+    out.push_back(t.tsId);
+  }
+  out.push_back(o.para.size());
+  for (Parameter const &p : o.para) {
+    out.push_back(p.key);
+    out.push_back(p.value);
+  }
+}
+
+static void encode_rule(Rule const &r, std::vector<uint32_t> &out) {
+  out.push_back(r.name.size());
+  size_t name_start = out.size();
+  out.resize(name_start + (r.name.size() + 3) / 4, 0);
+  memcpy(out.data() + name_start, r.name.data(), r.name.size());
+  out.push_back(r.srcOp.size());
+  for (Operator const &o : r.srcOp) {
+    encode_operator(o, out);
+  }
+  out.push_back(r.dstOp.size());
+  for (Operator const &o : r.dstOp) {
+    encode_operator(o, out);
+  }
+  out.push_back(r.mappedOutput.size());
+  for (MapOutput const &m : r.mappedOutput) {
+    out.push_back(m.dstOpId);
+    out.push_back(m.dstTsId);
+    out.push_back(m.srcOpId);
+    out.push_back(m.srcTsId);
+  }
+}
+
+static std::vector<uint32_t> encode_rule_collection(RuleCollection const &c) {
+  size_t num_rules = c.rules.size();
+  std::map<uint32_t, std::vector<uint32_t>> roots;
+  for (size_t i = 0; i < num_rules; i++) {
+    Rule const &r = c.rules[i];
+    roots[r.srcOp.empty() ? OP_INVALID : r.srcOp[0].op_type].push_back(i);
+  }
+  std::vector<uint32_t> out = {
+      BINARY_RULE_MAGIC, BINARY_RULE_VERSION, (uint32_t)num_rules};
+  out.push_back(roots.size());
+  uint32_t first = 0;
+  for (auto const &root : roots) {
+    out.push_back(root.first);
+    out.push_back(first);
+    out.push_back(root.second.size());
+    first += root.second.size();
+  }
+  for (auto const &root : roots) {
+    out.insert(out.end(), root.second.begin(), root.second.end());
+  }
+  size_t offsets_start = out.size();
+  out.resize(offsets_start + num_rules);
+  for (size_t i = 0; i < num_rules; i++) {
+    out[offsets_start + i] = out.size();
+    encode_rule(c.rules[i], out);
+  }
+  return out;
+}
+
+void save_rule_collection_binary(RuleCollection const &c, std::ostream &s) {
+  std::vector<uint32_t> words = encode_rule_collection(c);
+  s.write((char const *)words.data(), words.size() * sizeof(uint32_t));
+}
+
+void save_rule_collection_binary_to_path(RuleCollection const &c,
+                                         std::string const &path) {
+  std::ofstream output(path, std::ios::binary);
+  save_rule_collection_binary(c, output);
+  if (!output) {
+    throw std::runtime_error("Failed to write binary rules to " + path);
+  }
+}
+
+bool is_binary_rule_file(std::string const &path) {
+  std::ifstream input(path, std::ios::binary);
+  uint32_t magic = 0;
+  input.read((char *)&magic, sizeof(magic));
+  return input && magic == BINARY_RULE_MAGIC;
+}
+
+BinaryRuleCollection::BinaryRuleCollection(std::string const &path)
+    : words(nullptr), num_words(0), mapped(nullptr), mapped_size(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open binary rules " + path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    mapped_size = st.st_size;
+    mapped = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      mapped = nullptr;
+      mapped_size = 0;
+    }
+  }
+  close(fd);
+  if (mapped == nullptr) {
+    throw std::runtime_error("Failed to map binary rules " + path);
+  }
+  words = (uint32_t const *)mapped;
+  num_words = mapped_size / sizeof(uint32_t);
+  check_header();
+}
+
+BinaryRuleCollection::BinaryRuleCollection(RuleCollection const &c)
+    : words(nullptr), num_words(0), mapped(nullptr), mapped_size(0) {
+  buffer = encode_rule_collection(c);
+  words = buffer.data();
+  num_words = buffer.size();
+  check_header();
+}
+
+BinaryRuleCollection::~BinaryRuleCollection() {
+  if (mapped != nullptr) {
+    munmap(mapped, mapped_size);
+  }
+}
+
+void BinaryRuleCollection::check_header() {
+  if (num_words < BINARY_RULE_HEADER_WORDS || words[0] != BINARY_RULE_MAGIC) {
+    throw std::runtime_error("Not a binary rule file");
+  }
+  if (words[1] != BINARY_RULE_VERSION) {
+    std::ostringstream oss;
+    oss << "Unsupported binary rule file version " << words[1];
+    throw std::runtime_error(oss.str());
+  }
+  size_t num_roots = words[3];
+  if (num_words < BINARY_RULE_HEADER_WORDS + 3 * num_roots + 2 * num_rules()) {
+    throw std::runtime_error("Truncated binary rule file");
+  }
+  // Validate the index, the ids and the offsets up front so that lookups
+  // never leave the file; the records themselves are checked as they are
+  // decoded
+  size_t ids_start = BINARY_RULE_HEADER_WORDS + 3 * num_roots;
+  uint32_t const *index = words + BINARY_RULE_HEADER_WORDS;
+  for (size_t i = 0; i < num_roots; i++) {
+    uint32_t const *entry = index + 3 * i;
+    // rules_with_root binary searches the index by op type
+    bool sorted = i == 0 || entry[0] > index[3 * (i - 1)];
+    if (!sorted || (size_t)entry[1] + entry[2] > num_rules()) {
+      throw std::runtime_error("Corrupt binary rule file index");
+    }
+  }
+  for (size_t i = 0; i < num_rules(); i++) {
+    if (words[ids_start + i] >= num_rules()) {
+      throw std::runtime_error("Corrupt binary rule file index");
+    }
+  }
+  size_t records_start = ids_start + 2 * num_rules();
+  for (size_t i = 0; i < num_rules(); i++) {
+    uint32_t offset = words[ids_start + num_rules() + i];
+    if (offset < records_start || offset >= num_words) {
+      throw std::runtime_error("Corrupt binary rule file offsets");
+    }
+  }
+}
+
+size_t BinaryRuleCollection::num_rules() const {
+  return words[2];
+}
+
+size_t BinaryRuleCollection::rule_offset(int rule_id) const {
+  assert(rule_id >= 0 && (size_t)rule_id < num_rules());
+  size_t offsets_start = BINARY_RULE_HEADER_WORDS + 3 * words[3] + num_rules();
+  return words[offsets_start + rule_id];
+}
+
+std::vector<OperatorType> BinaryRuleCollection::root_op_types() const {
+  std::vector<OperatorType> op_types;
+  for (size_t i = 0; i < words[3]; i++) {
+    op_types.push_back((OperatorType)words[BINARY_RULE_HEADER_WORDS + 3 * i]);
+  }
+  return op_types;
+}
+
+std::vector<int>
+    BinaryRuleCollection::rules_with_root(OperatorType op_type) const {
+  size_t num_roots = words[3];
+  size_t ids_start = BINARY_RULE_HEADER_WORDS + 3 * num_roots;
+  // The index is sorted by op type
+  size_t lo = 0, hi = num_roots;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    uint32_t const *entry = words + BINARY_RULE_HEADER_WORDS + 3 * mid;
+    if (entry[0] == (uint32_t)op_type) {
+      uint32_t const *ids = words + ids_start + entry[1];
+      return std::vector<int>(ids, ids + entry[2]);
+    }
+    if (entry[0] < (uint32_t)op_type) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return {};
+}
+
+namespace {
+
+// Reads the encoded words of one rule record
+class RuleReader {
+public:
+  RuleReader(uint32_t const *words, size_t num_words, size_t pos)
+      : words(words), num_words(num_words), pos(pos) {}
+
+  uint32_t next() {
+    if (pos >= num_words) {
+      throw std::runtime_error("Truncated binary rule file");
+    }
+    return words[pos++];
+  }
+
+  // Reads the length of a list whose elements take stride words each and
+  // checks that the whole list lies within the file
+  size_t count(size_t stride) {
+    size_t n = next();
+    if (n * stride > num_words - pos) {
+      throw std::runtime_error("Truncated binary rule file");
+    }
+    return n;
+  }
+
+  std::string name(bool skip) {
+    size_t length = next();
+    size_t name_words = length / 4 + (length % 4 != 0);
+    if (name_words > num_words - pos) {
+      throw std::runtime_error("Truncated binary rule file");
+    }
+    std::string s;
+    if (!skip) {
+      s.assign((char const *)(words + pos), length);
+    }
+    pos += name_words;
+    return s;
+  }
+
+  Operator op(bool types_only) {
+    Operator o;
+    o.op_type = (OperatorType)next();
+    size_t num_inputs = count(2);
+    if (types_only) {
+      pos += 2 * num_inputs;
+    } else {
+      for (size_t i = 0; i < num_inputs; i++) {
+        Tensor t;
+        t.opId = (int)next();
+        t.tsId = (int)next();
+        o.input.push_back(t);
+      }
+    }
+    size_t num_para = count(2);
+    if (types_only) {
+      pos += 2 * num_para;
+    } else {
+      for (size_t i = 0; i < num_para; i++) {
+        Parameter p;
+        p.key = (PMParameter)next();
+        p.value = (int)next();
+        o.para.push_back(p);
+      }
+    }
+    return o;
+  }
+
+  std::vector<Operator> ops(bool types_only) {
+    // Every op takes at least three words
+    size_t num_ops = count(3);
+    std::vector<Operator> result;
+    for (size_t i = 0; i < num_ops; i++) {
+      result.push_back(op(types_only));
+    }
+    return result;
+  }
+
+private:
+  uint32_t const *words;
+  size_t num_words;
+  size_t pos;
+};
+
+} // namespace
+
+std::string BinaryRuleCollection::get_name(int rule_id) const {
+  RuleReader reader(words, num_words, rule_offset(rule_id));
+  return reader.name(false /*skip*/);
+}
+
+void BinaryRuleCollection::get_op_types(
+    int rule_id,
+    std::vector<OperatorType> &src_op_types,
+    std::vector<OperatorType> &dst_op_types) const {
+  RuleReader reader(words, num_words, rule_offset(rule_id));
+  reader.name(true /*skip*/);
+  src_op_types.clear();
+  for (Operator const &o : reader.ops(true /*types_only*/)) {
+    src_op_types.push_back(o.op_type);
+  }
+  dst_op_types.clear();
+  for (Operator const &o : reader.ops(true /*types_only*/)) {
+    dst_op_types.push_back(o.op_type);
+  }
+}
+
+Rule BinaryRuleCollection::get_rule(int rule_id) const {
+  RuleReader reader(words, num_words, rule_offset(rule_id));
+  Rule r;
+  r.name = reader.name(false /*skip*/);
+  r.srcOp = reader.ops(false /*types_only*/);
+  r.dstOp = reader.ops(false /*types_only*/);
+  size_t num_mapped = reader.count(4);
+  for (size_t i = 0; i < num_mapped; i++) {
+    MapOutput m;
+    m.dstOpId = (int)reader.next();
+    m.dstTsId = (int)reader.next();
+    m.srcOpId = (int)reader.next();
+    m.srcTsId = (int)reader.next();
+    r.mappedOutput.push_back(m);
+  }
+  return r;
+}
+
+RuleCollection BinaryRuleCollection::get_rule_collection() const {
+  RuleCollection c;
+  for (size_t i = 0; i < num_rules(); i++) {
+    c.rules.push_back(get_rule(i));
+  }
+  return c;
+}
+
 } // namespace FlexFlow::substitution_loader
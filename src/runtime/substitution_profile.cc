@@ -0,0 +1,115 @@
+/* Copyright 2023 CMU, Facebook, LANL, MIT, NVIDIA, and Stanford (alphabetical)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flexflow/substitution_profile.h"
+#include <algorithm>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <vector>
+
+namespace FlexFlow::PCG {
+
+using json = nlohmann::json;
+
+double XferProfile::utility() const {
+  return num_improvements / std::max(run_time, 1e-6);
+}
+
+void XferProfile::merge(XferProfile const &other) {
+  num_runs += other.num_runs;
+  num_matches += other.num_matches;
+  num_accepted += other.num_accepted;
+  num_improvements += other.num_improvements;
+  run_time += other.run_time;
+}
+
+XferProfile &SubstitutionProfile::at(std::string const &name) {
+  return profiles[name];
+}
+
+XferProfile const *SubstitutionProfile::find(std::string const &name) const {
+  auto it = profiles.find(name);
+  return it == profiles.end() ? nullptr : &it->second;
+}
+
+size_t SubstitutionProfile::size() const {
+  return profiles.size();
+}
+
+void SubstitutionProfile::load(std::string const &path) {
+  std::ifstream input(path);
+  if (!input) {
+    return;
+  }
+  json j;
+  input >> j;
+  for (json const &x : j.at("xfers")) {
+    XferProfile p;
+    x.at("runs").get_to(p.num_runs);
+    x.at("matches").get_to(p.num_matches);
+    x.at("accepted").get_to(p.num_accepted);
+    x.at("improvements").get_to(p.num_improvements);
+    x.at("run_time").get_to(p.run_time);
+    profiles[x.at("name").get<std::string>()].merge(p);
+  }
+}
+
+void SubstitutionProfile::save(std::string const &path) const {
+  json xfers = json::array();
+  for (auto const &it : profiles) {
+    XferProfile const &p = it.second;
+    xfers.push_back({{"name", it.first},
+                     {"runs", p.num_runs},
+                     {"matches", p.num_matches},
+                     {"accepted", p.num_accepted},
+                     {"improvements", p.num_improvements},
+                     {"run_time", p.run_time}});
+  }
+  std::ofstream output(path);
+  output << json{{"xfers", xfers}}.dump(2) << std::endl;
+  if (!output) {
+    throw std::runtime_error("Failed to write substitution profile " + path);
+  }
+}
+
+std::unordered_set<std::string>
+    SubstitutionProfile::select_pruned(tl::optional<int> top_k,
+                                       tl::optional<double> min_utility) const {
+  std::vector<std::pair<std::string, XferProfile>> ranked(profiles.begin(),
+                                                          profiles.end());
+  // Ties, e.g. between substitutions that never improved the best cost,
+  // go to the one that added more candidates
+  std::stable_sort(ranked.begin(),
+                   ranked.end(),
+                   [](std::pair<std::string, XferProfile> const &a,
+                      std::pair<std::string, XferProfile> const &b) {
+                     if (a.second.utility() != b.second.utility()) {
+                       return a.second.utility() > b.second.utility();
+                     }
+                     return a.second.num_accepted > b.second.num_accepted;
+                   });
+  std::unordered_set<std::string> pruned;
+  for (size_t i = 0; i < ranked.size(); i++) {
+    bool outside_top_k = top_k.has_value() && (int)i >= top_k.value();
+    bool below_threshold = min_utility.has_value() &&
+                           ranked[i].second.utility() < min_utility.value();
+    if (outside_top_k || below_threshold) {
+      pruned.insert(ranked[i].first);
+    }
+  }
+  return pruned;
+}
+
+} // namespace FlexFlow::PCG
@@ -0,0 +1,76 @@
+#include "flexflow/checkpoint.h"
+#include "gtest/gtest.h"
+
+using namespace FlexFlow;
+
+namespace {
+
+// A 4 x 6 tensor, dim 0 contiguous, saved as two shards of dim 1
+CheckpointTensor save_tensor(std::string const &dir) {
+  CheckpointTensor tensor;
+  tensor.name = "weight_3_0";
+  tensor.data_type = DT_FLOAT;
+  tensor.element_size = sizeof(float);
+  tensor.dims = {4, 6};
+  for (int part = 0; part < 2; part++) {
+    CheckpointShard shard;
+    shard.filename = tensor.name + "." + std::to_string(part);
+    shard.lo = {0, 3 * part};
+    shard.hi = {3, 3 * part + 2};
+    std::vector<float> data;
+    for (int j = shard.lo[1]; j <= shard.hi[1]; j++) {
+      for (int i = 0; i < 4; i++) {
+        data.push_back(10 * j + i);
+      }
+    }
+    EXPECT_TRUE(write_checkpoint_shard(
+        dir + "/" + shard.filename, data.data(), data.size() * sizeof(float)));
+    tensor.shards.push_back(shard);
+  }
+  return tensor;
+}
+
+}; // namespace
+
+TEST(checkpoint, manifest_round_trip) {
+  std::string dir = ::testing::TempDir();
+  CheckpointManifest manifest;
+  manifest.optimizer = "adam";
+  manifest.optimizer_state = {0.001, 0.9, 0.999};
+  manifest.tensors.push_back(save_tensor(dir));
+  ASSERT_TRUE(manifest.save(dir));
+
+  CheckpointManifest loaded;
+  ASSERT_TRUE(loaded.load(dir));
+  EXPECT_EQ(loaded.optimizer, "adam");
+  EXPECT_EQ(loaded.optimizer_state, manifest.optimizer_state);
+  ASSERT_EQ(loaded.tensors.size(), 1);
+  CheckpointTensor const *tensor = loaded.find_tensor("weight_3_0");
+  ASSERT_NE(tensor, nullptr);
+  EXPECT_EQ(tensor->data_type, DT_FLOAT);
+  EXPECT_EQ(tensor->element_size, sizeof(float));
+  EXPECT_EQ(tensor->dims, std::vector<int>({4, 6}));
+  ASSERT_EQ(tensor->shards.size(), 2);
+  EXPECT_EQ(tensor->shards[1].filename, "weight_3_0.1");
+  EXPECT_EQ(tensor->shards[1].lo, std::vector<int>({0, 3}));
+  EXPECT_EQ(tensor->shards[1].hi, std::vector<int>({3, 5}));
+  EXPECT_EQ(loaded.find_tensor("weight_4_0"), nullptr);
+}
+
+TEST(checkpoint, read_rect_across_shards) {
+  std::string dir = ::testing::TempDir();
+  CheckpointTensor tensor = save_tensor(dir);
+
+  // Rows 1..2 of every column, i.e. a partition of dim 0 instead of dim 1
+  std::vector<float> data(2 * 6);
+  ASSERT_TRUE(read_checkpoint_rect(dir, tensor, {1, 0}, {2, 5}, data.data()));
+  for (int j = 0; j < 6; j++) {
+    for (int i = 1; i <= 2; i++) {
+      EXPECT_EQ(data[(i - 1) + 2 * j], 10 * j + i);
+    }
+  }
+
+  // Columns beyond the saved shards are not covered
+  tensor.shards.pop_back();
+  EXPECT_FALSE(read_checkpoint_rect(dir, tensor, {1, 0}, {2, 5}, data.data()));
+}
@@ -0,0 +1,34 @@
+#include "flexflow/cluster_sizing.h"
+#include "gtest/gtest.h"
+#include <sstream>
+
+using namespace FlexFlow;
+
+TEST(cluster_sizing, parse_nodes) {
+  std::vector<int> num_nodes;
+  ASSERT_TRUE(parse_cluster_sizing_nodes("1-64", num_nodes));
+  EXPECT_EQ(num_nodes, std::vector<int>({1, 2, 4, 8, 16, 32, 64}));
+  ASSERT_TRUE(parse_cluster_sizing_nodes("3,1-4,12", num_nodes));
+  EXPECT_EQ(num_nodes, std::vector<int>({1, 2, 3, 4, 12}));
+  EXPECT_FALSE(parse_cluster_sizing_nodes("", num_nodes));
+  EXPECT_FALSE(parse_cluster_sizing_nodes("0,2", num_nodes));
+  EXPECT_FALSE(parse_cluster_sizing_nodes("8-4", num_nodes));
+  EXPECT_FALSE(parse_cluster_sizing_nodes("2,x", num_nodes));
+}
+
+TEST(cluster_sizing, table) {
+  std::vector<ClusterShapeResult> results = {{2, 4, 12.5f, 900.0f},
+                                             {1, 4, 20.0f, 1500.0f}};
+  std::ostringstream oss;
+  write_cluster_sizing_table(oss, results, 64, 1024.0f);
+  std::string table = oss.str();
+  // 64 samples in 12.5 ms on 8 devices against 20 ms on 4 devices
+  EXPECT_NE(table.find("5120.0"), std::string::npos);
+  EXPECT_NE(table.find("80.0%"), std::string::npos);
+  EXPECT_NE(table.find("100.0%"), std::string::npos);
+  // Only the single node shape exceeds the device memory
+  size_t oom = table.find("(OOM)");
+  ASSERT_NE(oom, std::string::npos);
+  EXPECT_EQ(table.find("(OOM)", oom + 1), std::string::npos);
+  EXPECT_GT(oom, table.find("1500.0"));
+}
@@ -0,0 +1,91 @@
+#include "flexflow/cost_predictor.h"
+#include "gtest/gtest.h"
+#include <cmath>
+
+using namespace FlexFlow;
+
+namespace {
+
+// A compute-bound operator whose time follows a power law of its FLOPs
+CostRecord linear_record(double batch) {
+  CostRecord record;
+  record.op_type = OP_LINEAR;
+  record.forward.flops = 2.0 * batch * 1024 * 1024;
+  record.forward.bytes = 4.0 * (2 * batch * 1024 + 1024 * 1024);
+  record.forward.num_kernels = 1;
+  record.backward.flops = 2 * record.forward.flops;
+  record.backward.bytes = 2 * record.forward.bytes;
+  record.backward.num_kernels = 2;
+  record.forward_time = 1e-9 * std::pow(record.forward.flops, 0.9);
+  record.backward_time = 2 * record.forward_time;
+  return record;
+}
+
+} // namespace
+
+TEST(cost_predictor, interpolates_between_profiled_shapes) {
+  CostPredictor predictor(0.05f);
+  for (double batch : {64, 96, 128, 192, 256, 384, 512}) {
+    predictor.add_record(linear_record(batch));
+  }
+  CostRecord expected = linear_record(160);
+  float forward_time = 0.0f, backward_time = 0.0f;
+  ASSERT_TRUE(predictor.predict(OP_LINEAR,
+                                expected.forward,
+                                expected.backward,
+                                forward_time,
+                                backward_time));
+  EXPECT_NEAR(
+      forward_time, expected.forward_time, 0.02 * expected.forward_time);
+  EXPECT_NEAR(
+      backward_time, expected.backward_time, 0.02 * expected.backward_time);
+}
+
+TEST(cost_predictor, uncertain_far_from_records) {
+  CostPredictor predictor;
+  for (double batch : {64, 96, 128, 192}) {
+    predictor.add_record(linear_record(batch));
+  }
+  CostRecord query = linear_record(4096);
+  float forward_time = -1.0f, backward_time = -1.0f;
+  EXPECT_FALSE(predictor.predict(
+      OP_LINEAR, query.forward, query.backward, forward_time, backward_time));
+  EXPECT_FALSE(predictor.predict(
+      OP_CONV2D, query.forward, query.backward, forward_time, backward_time));
+  EXPECT_EQ(forward_time, -1.0f);
+  EXPECT_EQ(backward_time, -1.0f);
+}
+
+TEST(cost_predictor, uncertain_for_noisy_records) {
+  CostPredictor predictor(0.1f);
+  int i = 0;
+  for (double batch : {64, 96, 128, 192, 256, 384}) {
+    CostRecord record = linear_record(batch);
+    record.forward_time *= (i++ % 2 == 0) ? 1.0f : 1.5f;
+    predictor.add_record(record);
+  }
+  CostRecord query = linear_record(160);
+  float forward_time, backward_time;
+  EXPECT_FALSE(predictor.predict(
+      OP_LINEAR, query.forward, query.backward, forward_time, backward_time));
+}
+
+TEST(cost_predictor, save_load_and_evaluate) {
+  CostPredictor predictor(0.05f);
+  for (double batch = 64; batch <= 1024; batch *= 1.25) {
+    predictor.add_record(linear_record(batch));
+  }
+  std::string filename = ::testing::TempDir() + "cost_records";
+  ASSERT_TRUE(predictor.save(filename));
+
+  CostPredictor loaded(0.05f);
+  ASSERT_TRUE(loaded.load(filename));
+  EXPECT_EQ(loaded.num_records(), predictor.num_records());
+
+  auto evaluations = loaded.evaluate();
+  ASSERT_EQ(evaluations.size(), 1);
+  CostPredictorEvaluation const &evaluation = evaluations.at(OP_LINEAR);
+  EXPECT_EQ(evaluation.num_records, (int)predictor.num_records());
+  EXPECT_GT(evaluation.num_confident, evaluation.num_records / 2);
+  EXPECT_LT(evaluation.max_relative_error, 0.05);
+}
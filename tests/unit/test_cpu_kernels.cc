@@ -0,0 +1,900 @@
+#include "flexflow/ops/aggregate.h"
+#include "flexflow/ops/attention.h"
+#include "flexflow/ops/groupby.h"
+#include "flexflow/ops/kernels/embedding_kernels.h"
+#include "flexflow/ops/kernels/softmax_kernels.h"
+#include "flexflow/ops/layer_norm.h"
+#include "flexflow/ops/topk.h"
+#include "flexflow/utils/cpu_helper.h"
+#ifdef FF_USE_CUDA
+#include "flexflow/utils/cuda_helper.h"
+#endif
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace FlexFlow;
+
+TEST(cpu_parallel_for, covers_range_once) {
+  std::vector<int> hits(10007, 0);
+  cpu_parallel_for(0, hits.size(), 16, [&](int64_t lo, int64_t hi) {
+    for (int64_t i = lo; i < hi; i++) {
+      hits[i]++;
+    }
+  });
+  for (int h : hits) {
+    EXPECT_EQ(h, 1);
+  }
+}
+
+TEST(softmax_cpu, matches_reference) {
+  int const num_rows = 5, row_size = 37;
+  std::vector<float> input(num_rows * row_size), output(input.size());
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = std::sin(0.37f * i) * 20.0f;
+  }
+  Kernels::Softmax::forward_kernel_cpu(
+      input.data(), output.data(), num_rows, row_size);
+  for (int r = 0; r < num_rows; r++) {
+    float const *x = input.data() + r * row_size;
+    float max_val = *std::max_element(x, x + row_size);
+    double sum = 0.0;
+    for (int j = 0; j < row_size; j++) {
+      sum += std::exp(x[j] - max_val);
+    }
+    for (int j = 0; j < row_size; j++) {
+      EXPECT_NEAR(
+          output[r * row_size + j], std::exp(x[j] - max_val) / sum, 1e-6);
+    }
+  }
+}
+
+TEST(softmax_cpu, backward_copies_gradient) {
+  // Several chunks of the thread pool, the last one ending mid-vector
+  size_t const num_elements = 3 * 16384 + 5;
+  std::vector<float> output_grad(num_elements), input_grad(num_elements);
+  for (size_t i = 0; i < num_elements; i++) {
+    output_grad[i] = std::cos(0.13f * i);
+  }
+  Kernels::Softmax::backward_kernel_cpu(
+      input_grad.data(), output_grad.data(), num_elements);
+  EXPECT_EQ(input_grad, output_grad);
+}
+
+TEST(embedding_cpu, backward_deduplicates_rows) {
+  int const in_dim = 3, out_dim = 9, batch_size = 41;
+  int64_t const num_entries = 17;
+  std::vector<int64_t> input(in_dim * batch_size);
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = (i * 7) % 5 == 0 ? 2 : (i * 13) % num_entries;
+  }
+  std::vector<float> output_grad(batch_size * out_dim);
+  for (size_t i = 0; i < output_grad.size(); i++) {
+    output_grad[i] = std::cos(0.11f * i);
+  }
+  std::vector<float> expected(num_entries * out_dim, 0.0f);
+  for (int b = 0; b < batch_size; b++) {
+    for (int j = 0; j < in_dim; j++) {
+      for (int k = 0; k < out_dim; k++) {
+        expected[input[b * in_dim + j] * out_dim + k] +=
+            output_grad[b * out_dim + k] / in_dim;
+      }
+    }
+  }
+  std::vector<float> weight_grad(num_entries * out_dim, 0.0f);
+  std::vector<int64_t> sparse_indices(input.size());
+  std::vector<float> sparse_values(input.size() * out_dim);
+  int64_t num_unique =
+      Kernels::Embedding::backward_kernel_cpu(input.data(),
+                                              output_grad.data(),
+                                              weight_grad.data(),
+                                              sparse_indices.data(),
+                                              sparse_values.data(),
+                                              in_dim,
+                                              out_dim,
+                                              batch_size,
+                                              AGGR_MODE_AVG,
+                                              num_entries);
+  std::vector<float> from_sparse(num_entries * out_dim, 0.0f);
+  for (int64_t r = 0; r < num_unique; r++) {
+    if (r > 0) {
+      EXPECT_LT(sparse_indices[r - 1], sparse_indices[r]);
+    }
+    for (int k = 0; k < out_dim; k++) {
+      from_sparse[sparse_indices[r] * out_dim + k] +=
+          sparse_values[r * out_dim + k];
+    }
+  }
+  for (size_t r = num_unique; r < sparse_indices.size(); r++) {
+    EXPECT_EQ(sparse_indices[r], -1);
+  }
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_NEAR(weight_grad[i], expected[i], 1e-5);
+    EXPECT_NEAR(from_sparse[i], expected[i], 1e-5);
+  }
+}
+
+TEST(topk_cpu, matches_partial_sort) {
+  int const batch_size = 7, length = 45, k = 5;
+  std::vector<float> input(batch_size * length);
+  for (size_t i = 0; i < input.size(); i++) {
+    // Coarse values so that rows contain ties
+    input[i] = std::round(std::sin(0.91f * i) * 8.0f);
+  }
+  std::vector<float> values(batch_size * k);
+  std::vector<int> indices(batch_size * k);
+  TopK::forward_kernel_cpu(input.data(),
+                           values.data(),
+                           indices.data(),
+                           batch_size,
+                           length,
+                           k,
+                           true /*sorted*/);
+  for (int r = 0; r < batch_size; r++) {
+    float const *x = input.data() + r * length;
+    std::vector<int> order(length);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+      return x[a] > x[b];
+    });
+    for (int j = 0; j < k; j++) {
+      EXPECT_EQ(indices[r * k + j], order[j]);
+      EXPECT_EQ(values[r * k + j], x[order[j]]);
+    }
+  }
+  std::vector<float> value_grad(values.size(), 1.0f);
+  std::vector<float> input_grad(input.size(), 0.5f);
+  TopK::backward_kernel_cpu(value_grad.data(),
+                            indices.data(),
+                            input_grad.data(),
+                            batch_size,
+                            length,
+                            k);
+  for (int r = 0; r < batch_size; r++) {
+    for (int j = 0; j < k; j++) {
+      EXPECT_EQ(input_grad[r * length + indices[r * k + j]], 1.5f);
+    }
+  }
+}
+
+TEST(group_by_cpu, respects_expert_capacity) {
+  int const n = 3, k = 2, batch_size = 6, data_dim = 5;
+  float const alpha = 1.0f;
+  int const capacity = 4; // ceil(alpha * k / n * batch_size)
+  // Expert 0 is chosen by every sample, so its last two choices are dropped
+  std::vector<int> assign = {0, 1, 0, 2, 1, 0, 0, 2, 0, 1, 2, 0};
+  std::vector<float> input(batch_size * data_dim);
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = 0.25f * i;
+  }
+  std::vector<std::vector<float>> expert_bufs(
+      n, std::vector<float>(capacity * data_dim, -1.0f));
+  float *outputs[n];
+  for (int e = 0; e < n; e++) {
+    outputs[e] = expert_bufs[e].data();
+  }
+  Group_by::forward_kernel_cpu(input.data(),
+                               assign.data(),
+                               outputs,
+                               n,
+                               k,
+                               alpha,
+                               batch_size,
+                               data_dim);
+  std::vector<int> fill(n, 0);
+  std::vector<float> expected_grad(input.size(), 0.0f);
+  for (int i = 0; i < k * batch_size; i++) {
+    int e = assign[i], b = i / k;
+    if (fill[e] == capacity) {
+      continue;
+    }
+    for (int d = 0; d < data_dim; d++) {
+      EXPECT_EQ(outputs[e][fill[e] * data_dim + d], input[b * data_dim + d]);
+      expected_grad[b * data_dim + d] += fill[e] + 10.0f * e;
+    }
+    fill[e]++;
+  }
+  EXPECT_EQ(fill[0], capacity);
+  // Unused rows are zeroed; use the buffers as gradients tagged by position
+  for (int e = 0; e < n; e++) {
+    for (int r = 0; r < capacity; r++) {
+      for (int d = 0; d < data_dim; d++) {
+        if (r >= fill[e]) {
+          EXPECT_EQ(outputs[e][r * data_dim + d], 0.0f);
+        }
+        outputs[e][r * data_dim + d] = r + 10.0f * e;
+      }
+    }
+  }
+  std::vector<float> input_grad(input.size(), 0.0f);
+  Group_by::backward_kernel_cpu(input_grad.data(),
+                                assign.data(),
+                                outputs,
+                                n,
+                                k,
+                                alpha,
+                                batch_size,
+                                data_dim);
+  for (size_t i = 0; i < input_grad.size(); i++) {
+    EXPECT_EQ(input_grad[i], expected_grad[i]);
+  }
+}
+
+TEST(aggregate_cpu, matches_reference) {
+  int const n = 4, k = 2, batch_size = 9, rows = 4, out_dim = 11;
+  float const lambda_bal = 0.04f;
+  std::vector<int> assign(k * batch_size), true_assign(k * batch_size);
+  std::vector<float> gate_pred(k * batch_size);
+  for (int i = 0; i < k * batch_size; i++) {
+    assign[i] = (i * 3 + i / k) % n;
+    true_assign[i] = assign[i];
+    gate_pred[i] = 0.1f + 0.05f * (i % 7);
+  }
+  // The last sample's cached assignment is stale
+  true_assign[k * batch_size - 1] = (assign[k * batch_size - 1] + 1) % n;
+  std::vector<std::vector<float>> preds(n), grads(n);
+  float const *exp_preds[n];
+  float *exp_grads[n];
+  for (int e = 0; e < n; e++) {
+    preds[e].resize(rows * out_dim);
+    grads[e].assign(rows * out_dim, 0.0f);
+    for (int i = 0; i < rows * out_dim; i++) {
+      preds[e][i] = std::sin(0.3f * i + e);
+    }
+    exp_preds[e] = preds[e].data();
+    exp_grads[e] = grads[e].data();
+  }
+  std::vector<float> output(batch_size * out_dim);
+  Aggregate::forward_kernel_cpu(exp_preds,
+                                assign.data(),
+                                gate_pred.data(),
+                                output.data(),
+                                n,
+                                k,
+                                rows,
+                                batch_size,
+                                out_dim);
+  std::vector<float> output_grad(batch_size * out_dim);
+  for (size_t i = 0; i < output_grad.size(); i++) {
+    output_grad[i] = std::cos(0.17f * i);
+  }
+  std::vector<float> gate_grad(batch_size * n, 0.0f);
+  Aggregate::backward_kernel_cpu(exp_preds,
+                                 exp_grads,
+                                 assign.data(),
+                                 true_assign.data(),
+                                 gate_pred.data(),
+                                 gate_grad.data(),
+                                 output_grad.data(),
+                                 n,
+                                 k,
+                                 rows,
+                                 lambda_bal,
+                                 batch_size,
+                                 out_dim);
+  // Reference following the sequential slot assignment of the GPU kernels
+  std::vector<float> ref_output(output.size(), 0.0f);
+  std::vector<std::vector<float>> ref_grads(
+      n, std::vector<float>(rows * out_dim, 0.0f));
+  std::vector<float> ref_gate(gate_grad.size(), 0.0f);
+  std::vector<int> fwd_fill(n, 0), bwd_fill(n, 0);
+  for (int i = 0; i < batch_size; i++) {
+    bool cache_corr = true;
+    for (int j = 0; j < k; j++) {
+      cache_corr &= assign[i * k + j] == true_assign[i * k + j];
+    }
+    for (int j = 0; j < k; j++) {
+      int slot = i * k + j, e = assign[slot];
+      if (fwd_fill[e] < rows) {
+        for (int d = 0; d < out_dim; d++) {
+          ref_output[i * out_dim + d] +=
+              gate_pred[slot] * preds[e][fwd_fill[e] * out_dim + d];
+        }
+      }
+      fwd_fill[e]++;
+      int te = true_assign[slot];
+      if (bwd_fill[te] < rows) {
+        for (int d = 0; d < out_dim; d++) {
+          float g = output_grad[i * out_dim + d];
+          ref_grads[te][bwd_fill[te] * out_dim + d] += gate_pred[slot] * g;
+          if (cache_corr) {
+            ref_gate[i * n + e] += g * preds[te][bwd_fill[te] * out_dim + d];
+          }
+        }
+      }
+      bwd_fill[te]++;
+    }
+  }
+  for (int i = 0; i < batch_size; i++) {
+    float sum = 0.0f;
+    for (int e = 0; e < n; e++) {
+      ref_gate[i * n + e] += lambda_bal * n / batch_size * bwd_fill[e];
+      sum += ref_gate[i * n + e];
+    }
+    for (int e = 0; e < n; e++) {
+      ref_gate[i * n + e] -= sum / n;
+    }
+  }
+  for (size_t i = 0; i < output.size(); i++) {
+    EXPECT_NEAR(output[i], ref_output[i], 1e-5);
+  }
+  for (int e = 0; e < n; e++) {
+    for (int i = 0; i < rows * out_dim; i++) {
+      EXPECT_NEAR(grads[e][i], ref_grads[e][i], 1e-5);
+    }
+  }
+  for (size_t i = 0; i < gate_grad.size(); i++) {
+    EXPECT_NEAR(gate_grad[i], ref_gate[i], 1e-4);
+  }
+}
+
+namespace {
+
+void expect_near_all(std::vector<float> const &actual,
+                     std::vector<double> const &expected,
+                     double tolerance) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t i = 0; i < actual.size(); i++) {
+    EXPECT_NEAR(actual[i], expected[i], tolerance) << "element " << i;
+  }
+}
+
+std::vector<float> make_input(size_t size, float freq, float scale) {
+  std::vector<float> x(size);
+  for (size_t i = 0; i < size; i++) {
+    x[i] = std::sin(freq * i + 0.5f) * scale;
+  }
+  return x;
+}
+
+struct AttentionDims {
+  int num_samples, num_heads;
+  int q_size, k_size, v_size, qk_proj_size, v_proj_size, o_proj_size;
+  int q_length, kv_length;
+
+  int head_params() const {
+    return qk_proj_size * (q_size + k_size) + v_proj_size * v_size +
+           o_proj_size * v_proj_size;
+  }
+};
+
+// out[i] = w x[i] for num_rows rows of x and a column-major
+// [out_size x in_size] matrix w
+std::vector<double> project_reference(float const *x,
+                                      float const *w,
+                                      int num_rows,
+                                      int out_size,
+                                      int in_size) {
+  std::vector<double> out(num_rows * out_size, 0.0);
+  for (int i = 0; i < num_rows; i++) {
+    for (int r = 0; r < out_size; r++) {
+      for (int c = 0; c < in_size; c++) {
+        out[i * out_size + r] +=
+            (double)x[i * in_size + c] * w[c * out_size + r];
+      }
+    }
+  }
+  return out;
+}
+
+// Accumulates the gradients of out = project_reference(x, w) into x_grad
+// and w_grad
+void project_backward_reference(float const *x,
+                                float const *w,
+                                std::vector<double> const &out_grad,
+                                double *x_grad,
+                                double *w_grad,
+                                int num_rows,
+                                int out_size,
+                                int in_size) {
+  for (int i = 0; i < num_rows; i++) {
+    for (int r = 0; r < out_size; r++) {
+      double g = out_grad[i * out_size + r];
+      for (int c = 0; c < in_size; c++) {
+        x_grad[i * in_size + c] += g * w[c * out_size + r];
+        w_grad[c * out_size + r] += g * x[i * in_size + c];
+      }
+    }
+  }
+}
+
+// Dense double precision attention that materializes the full probability
+// matrix of every (sample, head), using cuDNN's weight layout: the
+// column-major Wq of all heads, then Wk, Wv and Wo
+void attention_reference(AttentionDims const &d,
+                         std::vector<float> const &query,
+                         std::vector<float> const &key,
+                         std::vector<float> const &value,
+                         std::vector<float> const &weight,
+                         std::vector<float> const &output_grad,
+                         std::vector<double> &output,
+                         std::vector<double> &query_grad,
+                         std::vector<double> &key_grad,
+                         std::vector<double> &value_grad,
+                         std::vector<double> &weight_grad) {
+  int const Lq = d.q_length, Lk = d.kv_length;
+  int const dk = d.qk_proj_size, dv = d.v_proj_size, o_size = d.o_proj_size;
+  output.assign(d.num_samples * Lq * o_size, 0.0);
+  query_grad.assign(query.size(), 0.0);
+  key_grad.assign(key.size(), 0.0);
+  value_grad.assign(value.size(), 0.0);
+  weight_grad.assign(weight.size(), 0.0);
+  for (int b = 0; b < d.num_samples; b++) {
+    float const *xq = query.data() + b * Lq * d.q_size;
+    float const *xk = key.data() + b * Lk * d.k_size;
+    float const *xv = value.data() + b * Lk * d.v_size;
+    float const *dy = output_grad.data() + b * Lq * o_size;
+    for (int h = 0; h < d.num_heads; h++) {
+      int const H = d.num_heads;
+      int const wq_off = h * dk * d.q_size;
+      int const wk_off = H * dk * d.q_size + h * dk * d.k_size;
+      int const wv_off = H * dk * (d.q_size + d.k_size) + h * dv * d.v_size;
+      int const wo_off =
+          H * (dk * (d.q_size + d.k_size) + dv * d.v_size) + h * o_size * dv;
+      float const *wq = weight.data() + wq_off;
+      float const *wk = weight.data() + wk_off;
+      float const *wv = weight.data() + wv_off;
+      float const *wo = weight.data() + wo_off;
+      double *dwq = weight_grad.data() + wq_off;
+      double *dwk = weight_grad.data() + wk_off;
+      double *dwv = weight_grad.data() + wv_off;
+      double *dwo = weight_grad.data() + wo_off;
+      std::vector<double> Q = project_reference(xq, wq, Lq, dk, d.q_size);
+      std::vector<double> K = project_reference(xk, wk, Lk, dk, d.k_size);
+      std::vector<double> V = project_reference(xv, wv, Lk, dv, d.v_size);
+      std::vector<double> P(Lq * Lk), O(Lq * dv, 0.0);
+      for (int i = 0; i < Lq; i++) {
+        double max_score = -1e30, sum = 0.0;
+        for (int j = 0; j < Lk; j++) {
+          double score = 0.0;
+          for (int a = 0; a < dk; a++) {
+            score += Q[i * dk + a] * K[j * dk + a];
+          }
+          P[i * Lk + j] = score;
+          max_score = std::max(max_score, score);
+        }
+        for (int j = 0; j < Lk; j++) {
+          P[i * Lk + j] = std::exp(P[i * Lk + j] - max_score);
+          sum += P[i * Lk + j];
+        }
+        for (int j = 0; j < Lk; j++) {
+          P[i * Lk + j] /= sum;
+          for (int e = 0; e < dv; e++) {
+            O[i * dv + e] += P[i * Lk + j] * V[j * dv + e];
+          }
+        }
+        for (int c = 0; c < o_size; c++) {
+          for (int e = 0; e < dv; e++) {
+            output[(b * Lq + i) * o_size + c] +=
+                O[i * dv + e] * wo[e * o_size + c];
+            dwo[e * o_size + c] += dy[i * o_size + c] * O[i * dv + e];
+          }
+        }
+      }
+      // dO = dY Wo, dV = P^T dO, dS = P * (dP - rowsum(P * dP))
+      std::vector<double> dO(Lq * dv, 0.0), dV(Lk * dv, 0.0);
+      std::vector<double> dQ(Lq * dk, 0.0), dK(Lk * dk, 0.0);
+      for (int i = 0; i < Lq; i++) {
+        for (int e = 0; e < dv; e++) {
+          for (int c = 0; c < o_size; c++) {
+            dO[i * dv + e] += dy[i * o_size + c] * wo[e * o_size + c];
+          }
+        }
+        std::vector<double> dP(Lk, 0.0);
+        double row_dot = 0.0;
+        for (int j = 0; j < Lk; j++) {
+          for (int e = 0; e < dv; e++) {
+            dP[j] += dO[i * dv + e] * V[j * dv + e];
+            dV[j * dv + e] += P[i * Lk + j] * dO[i * dv + e];
+          }
+          row_dot += P[i * Lk + j] * dP[j];
+        }
+        for (int j = 0; j < Lk; j++) {
+          double dS = P[i * Lk + j] * (dP[j] - row_dot);
+          for (int a = 0; a < dk; a++) {
+            dQ[i * dk + a] += dS * K[j * dk + a];
+            dK[j * dk + a] += dS * Q[i * dk + a];
+          }
+        }
+      }
+      project_backward_reference(xq,
+                                 wq,
+                                 dQ,
+                                 query_grad.data() + b * Lq * d.q_size,
+                                 dwq,
+                                 Lq,
+                                 dk,
+                                 d.q_size);
+      project_backward_reference(xk,
+                                 wk,
+                                 dK,
+                                 key_grad.data() + b * Lk * d.k_size,
+                                 dwk,
+                                 Lk,
+                                 dk,
+                                 d.k_size);
+      project_backward_reference(xv,
+                                 wv,
+                                 dV,
+                                 value_grad.data() + b * Lk * d.v_size,
+                                 dwv,
+                                 Lk,
+                                 dv,
+                                 d.v_size);
+    }
+  }
+}
+
+// Sequence lengths just past one query and one key tile, and odd
+// projection sizes that leave a partial AVX2 vector
+AttentionDims attention_test_dims() {
+  AttentionDims d;
+  d.num_samples = 2;
+  d.num_heads = 3;
+  d.q_size = 11;
+  d.k_size = 9;
+  d.v_size = 10;
+  d.qk_proj_size = 5;
+  d.v_proj_size = 7;
+  d.o_proj_size = 13;
+  d.q_length = 35;
+  d.kv_length = 67;
+  return d;
+}
+
+}; // namespace
+
+TEST(attention_cpu, matches_reference) {
+  AttentionDims const d = attention_test_dims();
+  std::vector<float> query =
+      make_input(d.num_samples * d.q_length * d.q_size, 0.37f, 1.0f);
+  std::vector<float> key =
+      make_input(d.num_samples * d.kv_length * d.k_size, 0.53f, 1.0f);
+  std::vector<float> value =
+      make_input(d.num_samples * d.kv_length * d.v_size, 0.71f, 1.0f);
+  std::vector<float> weight =
+      make_input(d.num_heads * d.head_params(), 0.29f, 0.4f);
+  std::vector<float> output_grad =
+      make_input(d.num_samples * d.q_length * d.o_proj_size, 0.19f, 1.0f);
+
+  FFHandler handle;
+  MultiHeadAttentionCPUMeta m(handle,
+                              d.num_samples,
+                              d.num_heads,
+                              d.q_size,
+                              d.k_size,
+                              d.v_size,
+                              d.qk_proj_size,
+                              d.qk_proj_size,
+                              d.v_proj_size,
+                              d.o_proj_size,
+                              d.q_length,
+                              d.kv_length);
+  std::vector<float> output(output_grad.size());
+  MultiHeadAttention::forward_kernel_cpu(&m,
+                                         query.data(),
+                                         key.data(),
+                                         value.data(),
+                                         weight.data(),
+                                         output.data());
+  std::vector<float> query_grad(query.size(), 0.0f);
+  std::vector<float> key_grad(key.size(), 0.0f);
+  std::vector<float> value_grad(value.size(), 0.0f);
+  std::vector<float> weight_grad(weight.size(), 0.0f);
+  MultiHeadAttention::backward_kernel_cpu(&m,
+                                          query.data(),
+                                          query_grad.data(),
+                                          key.data(),
+                                          key_grad.data(),
+                                          value.data(),
+                                          value_grad.data(),
+                                          weight.data(),
+                                          weight_grad.data(),
+                                          output_grad.data());
+
+  std::vector<double> ref_output, ref_query_grad, ref_key_grad,
+      ref_value_grad, ref_weight_grad;
+  attention_reference(d,
+                      query,
+                      key,
+                      value,
+                      weight,
+                      output_grad,
+                      ref_output,
+                      ref_query_grad,
+                      ref_key_grad,
+                      ref_value_grad,
+                      ref_weight_grad);
+  expect_near_all(output, ref_output, 1e-4);
+  expect_near_all(query_grad, ref_query_grad, 1e-4);
+  expect_near_all(key_grad, ref_key_grad, 1e-4);
+  expect_near_all(value_grad, ref_value_grad, 1e-4);
+  expect_near_all(weight_grad, ref_weight_grad, 1e-3);
+}
+
+#ifdef FF_USE_CUDA
+namespace {
+
+float *to_device(std::vector<float> const &host) {
+  float *ptr;
+  checkCUDA(cudaMalloc(&ptr, sizeof(float) * host.size()));
+  checkCUDA(cudaMemcpy(ptr,
+                       host.data(),
+                       sizeof(float) * host.size(),
+                       cudaMemcpyHostToDevice));
+  return ptr;
+}
+
+cudnnSeqDataDescriptor_t
+    seq_data_desc(int num_samples, int seq_length, int vect_size) {
+  cudnnSeqDataDescriptor_t desc;
+  checkCUDNN(cudnnCreateSeqDataDescriptor(&desc));
+  int dims[CUDNN_SEQDATA_DIM_COUNT];
+  cudnnSeqDataAxis_t axes[CUDNN_SEQDATA_DIM_COUNT] = {CUDNN_SEQDATA_BATCH_DIM,
+                                                      CUDNN_SEQDATA_TIME_DIM,
+                                                      CUDNN_SEQDATA_BEAM_DIM,
+                                                      CUDNN_SEQDATA_VECT_DIM};
+  dims[CUDNN_SEQDATA_BATCH_DIM] = num_samples;
+  dims[CUDNN_SEQDATA_TIME_DIM] = seq_length;
+  dims[CUDNN_SEQDATA_BEAM_DIM] = 1;
+  dims[CUDNN_SEQDATA_VECT_DIM] = vect_size;
+  std::vector<int> seq_lengths(num_samples, seq_length);
+  checkCUDNN(cudnnSetSeqDataDescriptor(desc,
+                                       CUDNN_DATA_FLOAT,
+                                       CUDNN_SEQDATA_DIM_COUNT,
+                                       dims,
+                                       axes,
+                                       num_samples,
+                                       seq_lengths.data(),
+                                       NULL));
+  return desc;
+}
+
+}; // namespace
+
+// Weights saved by the GPU task variants must mean the same to the CPU ones
+TEST(attention_cpu, matches_cudnn) {
+  int num_gpus = 0;
+  if (cudaGetDeviceCount(&num_gpus) != cudaSuccess || num_gpus == 0) {
+    return;
+  }
+  AttentionDims const d = attention_test_dims();
+  int const dk = d.qk_proj_size, dv = d.v_proj_size;
+  MultiHeadAttentionWeightLayout const layout(d.num_heads,
+                                              d.q_size,
+                                              d.k_size,
+                                              d.v_size,
+                                              dk,
+                                              dk,
+                                              dv,
+                                              d.o_proj_size);
+  std::vector<float> query =
+      make_input(d.num_samples * d.q_length * d.q_size, 0.37f, 1.0f);
+  std::vector<float> key =
+      make_input(d.num_samples * d.kv_length * d.k_size, 0.53f, 1.0f);
+  std::vector<float> value =
+      make_input(d.num_samples * d.kv_length * d.v_size, 0.71f, 1.0f);
+  std::vector<float> weight = make_input(layout.num_params, 0.29f, 0.4f);
+
+  cudnnHandle_t dnn;
+  checkCUDNN(cudnnCreate(&dnn));
+  cudnnAttnDescriptor_t attn_desc;
+  checkCUDNN(cudnnCreateAttnDescriptor(&attn_desc));
+  checkCUDNN(cudnnSetAttnDescriptor(attn_desc,
+                                    CUDNN_ATTN_QUERYMAP_ALL_TO_ONE,
+                                    d.num_heads,
+                                    1.0f /*smScaler*/,
+                                    CUDNN_DATA_FLOAT,
+                                    CUDNN_DATA_FLOAT,
+                                    CUDNN_DEFAULT_MATH,
+                                    NULL /*attnDropoutDesc*/,
+                                    NULL /*postDropoutDesc*/,
+                                    d.q_size,
+                                    d.k_size,
+                                    d.v_size,
+                                    dk,
+                                    dk,
+                                    dv,
+                                    d.o_proj_size,
+                                    d.q_length,
+                                    d.kv_length,
+                                    d.num_samples,
+                                    1 /*maxBeamSize*/));
+  size_t weight_size, work_space_size, reserve_space_size;
+  checkCUDNN(cudnnGetMultiHeadAttnBuffers(dnn,
+                                          attn_desc,
+                                          &weight_size,
+                                          &work_space_size,
+                                          &reserve_space_size));
+  ASSERT_EQ(weight_size, sizeof(float) * layout.num_params);
+
+  float *query_dev = to_device(query);
+  float *key_dev = to_device(key);
+  float *value_dev = to_device(value);
+  float *weight_dev = to_device(weight);
+  // Each projection starts where the layout says
+  cudnnTensorDescriptor_t weight_desc;
+  checkCUDNN(cudnnCreateTensorDescriptor(&weight_desc));
+  std::pair<cudnnMultiHeadAttnWeightKind_t, int64_t> const offsets[] = {
+      {CUDNN_MH_ATTN_Q_WEIGHTS, layout.wq_off},
+      {CUDNN_MH_ATTN_K_WEIGHTS, layout.wk_off},
+      {CUDNN_MH_ATTN_V_WEIGHTS, layout.wv_off},
+      {CUDNN_MH_ATTN_O_WEIGHTS, layout.wo_off}};
+  for (auto const &kind_offset : offsets) {
+    void *address;
+    checkCUDNN(cudnnGetMultiHeadAttnWeights(dnn,
+                                            attn_desc,
+                                            kind_offset.first,
+                                            weight_size,
+                                            weight_dev,
+                                            weight_desc,
+                                            &address));
+    EXPECT_EQ((float *)address - weight_dev, kind_offset.second);
+  }
+  checkCUDNN(cudnnDestroyTensorDescriptor(weight_desc));
+
+  // Inference mode forward pass, without a reserve space
+  std::vector<float> output(d.num_samples * d.q_length * d.o_proj_size);
+  float *output_dev;
+  checkCUDA(cudaMalloc(&output_dev, sizeof(float) * output.size()));
+  void *work_space;
+  checkCUDA(cudaMalloc(&work_space, work_space_size));
+  std::vector<int> seq_lengths(2 * d.num_samples);
+  std::fill(seq_lengths.begin(),
+            seq_lengths.begin() + d.num_samples,
+            d.q_length);
+  std::fill(
+      seq_lengths.begin() + d.num_samples, seq_lengths.end(), d.kv_length);
+  int *seq_lengths_dev;
+  checkCUDA(cudaMalloc(&seq_lengths_dev, sizeof(int) * seq_lengths.size()));
+  checkCUDA(cudaMemcpy(seq_lengths_dev,
+                       seq_lengths.data(),
+                       sizeof(int) * seq_lengths.size(),
+                       cudaMemcpyHostToDevice));
+  std::vector<int> lo_win_idx(d.q_length, 0);
+  std::vector<int> hi_win_idx(d.q_length, d.kv_length);
+  cudnnSeqDataDescriptor_t q_desc =
+      seq_data_desc(d.num_samples, d.q_length, d.q_size);
+  cudnnSeqDataDescriptor_t k_desc =
+      seq_data_desc(d.num_samples, d.kv_length, d.k_size);
+  cudnnSeqDataDescriptor_t v_desc =
+      seq_data_desc(d.num_samples, d.kv_length, d.v_size);
+  cudnnSeqDataDescriptor_t o_desc =
+      seq_data_desc(d.num_samples, d.q_length, d.o_proj_size);
+  checkCUDNN(cudnnMultiHeadAttnForward(dnn,
+                                       attn_desc,
+                                       -1,
+                                       lo_win_idx.data(),
+                                       hi_win_idx.data(),
+                                       seq_lengths_dev,
+                                       seq_lengths_dev + d.num_samples,
+                                       q_desc,
+                                       query_dev,
+                                       NULL /*residuals*/,
+                                       k_desc,
+                                       key_dev,
+                                       v_desc,
+                                       value_dev,
+                                       o_desc,
+                                       output_dev,
+                                       weight_size,
+                                       weight_dev,
+                                       work_space_size,
+                                       work_space,
+                                       0 /*reserveSpaceSizeInBytes*/,
+                                       NULL /*reserveSpace*/));
+  checkCUDA(cudaMemcpy(output.data(),
+                       output_dev,
+                       sizeof(float) * output.size(),
+                       cudaMemcpyDeviceToHost));
+  for (cudnnSeqDataDescriptor_t desc : {q_desc, k_desc, v_desc, o_desc}) {
+    checkCUDNN(cudnnDestroySeqDataDescriptor(desc));
+  }
+  checkCUDNN(cudnnDestroyAttnDescriptor(attn_desc));
+  checkCUDNN(cudnnDestroy(dnn));
+  for (void *ptr : std::initializer_list<void *>{query_dev,
+                                                 key_dev,
+                                                 value_dev,
+                                                 weight_dev,
+                                                 output_dev,
+                                                 work_space,
+                                                 seq_lengths_dev}) {
+    checkCUDA(cudaFree(ptr));
+  }
+
+  FFHandler handle;
+  MultiHeadAttentionCPUMeta m(handle,
+                              d.num_samples,
+                              d.num_heads,
+                              d.q_size,
+                              d.k_size,
+                              d.v_size,
+                              dk,
+                              dk,
+                              dv,
+                              d.o_proj_size,
+                              d.q_length,
+                              d.kv_length);
+  std::vector<float> cpu_output(output.size());
+  MultiHeadAttention::forward_kernel_cpu(&m,
+                                         query.data(),
+                                         key.data(),
+                                         value.data(),
+                                         weight.data(),
+                                         cpu_output.data());
+  expect_near_all(cpu_output,
+                  std::vector<double>(output.begin(), output.end()),
+                  1e-3);
+}
+#endif
+
+TEST(layer_norm_cpu, matches_reference) {
+  // Rows of 45 elements end in a partial AVX2 vector
+  int const num_rows = 6, row_size = 45;
+  float const eps = 1e-5f;
+  std::vector<float> input = make_input(num_rows * row_size, 0.41f, 2.0f);
+  for (size_t i = 0; i < input.size(); i++) {
+    // Rows with a nonzero mean
+    input[i] += (float)(i / row_size);
+  }
+  std::vector<float> gamma = make_input(row_size, 0.83f, 1.0f);
+  std::vector<float> beta = make_input(row_size, 0.61f, 0.5f);
+  std::vector<float> output_grad = make_input(input.size(), 0.23f, 1.0f);
+
+  FFHandler handle;
+  LayerNormMeta m(handle,
+                  true /*elementwise_affine*/,
+                  num_rows,
+                  row_size,
+                  eps,
+                  true /*cpu_kernels*/);
+  std::vector<float> output(input.size());
+  LayerNorm::forward_kernel_cpu(
+      &m, input.data(), output.data(), gamma.data(), beta.data());
+  std::vector<float> input_grad(input.size());
+  std::vector<float> gamma_grad(row_size), beta_grad(row_size);
+  LayerNorm::backward_kernel_cpu(&m,
+                                 output_grad.data(),
+                                 input.data(),
+                                 input_grad.data(),
+                                 gamma.data(),
+                                 gamma_grad.data(),
+                                 beta_grad.data());
+
+  std::vector<double> ref_output(input.size()), ref_input_grad(input.size());
+  std::vector<double> ref_gamma_grad(row_size, 0.0);
+  std::vector<double> ref_beta_grad(row_size, 0.0);
+  for (int r = 0; r < num_rows; r++) {
+    float const *x = input.data() + r * row_size;
+    float const *dy = output_grad.data() + r * row_size;
+    double mean = 0.0, var = 0.0;
+    for (int j = 0; j < row_size; j++) {
+      mean += x[j];
+    }
+    mean /= row_size;
+    for (int j = 0; j < row_size; j++) {
+      var += (x[j] - mean) * (x[j] - mean);
+    }
+    double rstd = 1.0 / std::sqrt(var / row_size + eps);
+    // dX = rstd * (g * dY - mean(g * dY) - x_hat * mean(g * dY * x_hat))
+    double mean_gdy = 0.0, mean_gdy_xhat = 0.0;
+    for (int j = 0; j < row_size; j++) {
+      double x_hat = (x[j] - mean) * rstd;
+      ref_output[r * row_size + j] = x_hat * gamma[j] + beta[j];
+      ref_gamma_grad[j] += dy[j] * x_hat;
+      ref_beta_grad[j] += dy[j];
+      mean_gdy += gamma[j] * dy[j] / row_size;
+      mean_gdy_xhat += gamma[j] * dy[j] * x_hat / row_size;
+    }
+    for (int j = 0; j < row_size; j++) {
+      double x_hat = (x[j] - mean) * rstd;
+      ref_input_grad[r * row_size + j] =
+          rstd * (gamma[j] * dy[j] - mean_gdy - x_hat * mean_gdy_xhat);
+    }
+  }
+  expect_near_all(output, ref_output, 1e-4);
+  expect_near_all(input_grad, ref_input_grad, 1e-4);
+  expect_near_all(gamma_grad, ref_gamma_grad, 1e-4);
+  expect_near_all(beta_grad, ref_beta_grad, 1e-4);
+}
@@ -0,0 +1,231 @@
+#include "flexflow/optimizer.h"
+#include "flexflow/utils/cpu_helper.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+using namespace FlexFlow;
+
+namespace {
+
+struct UpdateData {
+  UpdateData(size_t size, int num_replicas)
+      : grad(size * num_replicas), w(size), v(size), m(size) {
+    for (size_t i = 0; i < grad.size(); i++) {
+      grad[i] = std::sin(0.37f * i);
+    }
+    for (size_t i = 0; i < size; i++) {
+      w[i] = std::cos(0.11f * i);
+      v[i] = 0.01f * (i % 7);
+      m[i] = 0.02f * std::sin(0.5f * i);
+    }
+  }
+  std::vector<float> grad, w, v, m;
+};
+
+float summed_grad(UpdateData const &d, size_t i, int num_replicas) {
+  float g = d.grad[i];
+  for (int r = 1; r < num_replicas; r++) {
+    g += d.grad[r * d.w.size() + i];
+  }
+  return g;
+}
+
+} // namespace
+
+TEST(cpu_optimizer, sgd_matches_reference) {
+  size_t const size = 10007;
+  int const num_replicas = 3;
+  for (bool nesterov : {false, true}) {
+    SGDOptimizer op(nullptr, 0.01, 0.9, nesterov, 1e-4);
+    UpdateData d(size, num_replicas), ref(size, num_replicas);
+    SGDOptimizer::update_kernel_cpu(
+        &op, d.grad.data(), size, num_replicas, d.w.data(), d.v.data());
+    float lr = op.lr, momentum = op.momentum, weight_decay = op.weight_decay;
+    for (size_t i = 0; i < size; i++) {
+      float gt = summed_grad(ref, i, num_replicas) + weight_decay * ref.w[i];
+      ref.v[i] = ref.v[i] * momentum + gt;
+      gt = nesterov ? gt + momentum * ref.v[i] : ref.v[i];
+      ref.w[i] -= lr * gt;
+      EXPECT_NEAR(d.w[i], ref.w[i], 1e-6);
+      EXPECT_NEAR(d.v[i], ref.v[i], 1e-6);
+    }
+  }
+}
+
+TEST(cpu_optimizer, adam_matches_reference) {
+  size_t const size = 10007;
+  int const num_replicas = 2;
+  AdamOptimizer op(nullptr, 0.001, 0.9, 0.999, 1e-2, 1e-8);
+  op.next();
+  UpdateData d(size, num_replicas), ref(size, num_replicas);
+  AdamOptimizer::update_kernel_cpu(&op,
+                                   d.grad.data(),
+                                   size,
+                                   num_replicas,
+                                   d.w.data(),
+                                   d.v.data(),
+                                   d.m.data());
+  float alpha_t = op.alpha_t, beta1 = op.beta1, beta2 = op.beta2;
+  float weight_decay = op.weight_decay, epsilon = op.epsilon;
+  for (size_t i = 0; i < size; i++) {
+    float gt = summed_grad(ref, i, num_replicas) + weight_decay * ref.w[i];
+    ref.m[i] = beta1 * ref.m[i] + (1 - beta1) * gt;
+    ref.v[i] = beta2 * ref.v[i] + (1 - beta2) * gt * gt;
+    ref.w[i] -= alpha_t * ref.m[i] / (std::sqrt(ref.v[i]) + epsilon);
+    EXPECT_NEAR(d.w[i], ref.w[i], 1e-6);
+    EXPECT_NEAR(d.v[i], ref.v[i], 1e-6);
+    EXPECT_NEAR(d.m[i], ref.m[i], 1e-6);
+  }
+}
+
+namespace {
+
+// A table of num_replicas copies of [num_entries, out_dim] rows, updated from
+// lookups with duplicates, a padding slot and untouched rows
+struct SparseUpdateData {
+  static constexpr int num_entries = 6, out_dim = 13, num_replicas = 2;
+  SparseUpdateData()
+      : indices({3, -1, 0, 3, 5, 3}), values(indices.size() * out_dim),
+        w(num_replicas * num_entries * out_dim), v(w.size()), m(w.size()) {
+    for (size_t i = 0; i < values.size(); i++) {
+      values[i] = std::sin(0.37f * i);
+    }
+    for (size_t i = 0; i < w.size(); i++) {
+      w[i] = std::cos(0.11f * i);
+      v[i] = 0.01f * (i % 7);
+      m[i] = 0.02f * std::sin(0.5f * i);
+    }
+  }
+  // The summed gradient of every row, dense
+  std::vector<float> get_dense_grad() const {
+    std::vector<float> grad(num_entries * out_dim, 0.0f);
+    for (size_t k = 0; k < indices.size(); k++) {
+      if (indices[k] < 0) {
+        continue;
+      }
+      for (int j = 0; j < out_dim; j++) {
+        grad[indices[k] * out_dim + j] += values[k * out_dim + j];
+      }
+    }
+    return grad;
+  }
+  bool is_touched(int row) const {
+    return std::find(indices.begin(), indices.end(), row) != indices.end();
+  }
+  std::vector<int64_t> indices;
+  std::vector<float> values, w, v, m;
+};
+
+} // namespace
+
+TEST(cpu_optimizer, sparse_sgd_updates_touched_rows) {
+  SGDOptimizer op(nullptr, 0.01, 0.9, false, 1e-4);
+  SparseUpdateData d, ref;
+  SGDOptimizer::sparse_update_kernel_cpu(&op,
+                                         d.indices.data(),
+                                         d.values.data(),
+                                         d.indices.size(),
+                                         d.out_dim,
+                                         d.num_entries,
+                                         d.num_replicas,
+                                         d.w.data(),
+                                         d.v.data());
+  std::vector<float> grad = ref.get_dense_grad();
+  float lr = op.lr, momentum = op.momentum, weight_decay = op.weight_decay;
+  for (int rep = 0; rep < d.num_replicas; rep++) {
+    for (int row = 0; row < d.num_entries; row++) {
+      for (int j = 0; j < d.out_dim; j++) {
+        size_t i = (rep * d.num_entries + row) * d.out_dim + j;
+        if (ref.is_touched(row)) {
+          float gt = grad[row * d.out_dim + j] + weight_decay * ref.w[i];
+          ref.v[i] = ref.v[i] * momentum + gt;
+          ref.w[i] -= lr * ref.v[i];
+        }
+        EXPECT_NEAR(d.w[i], ref.w[i], 1e-6);
+        EXPECT_NEAR(d.v[i], ref.v[i], 1e-6);
+      }
+    }
+  }
+}
+
+TEST(cpu_optimizer, lazy_adam_updates_touched_rows) {
+  AdamOptimizer op(nullptr, 0.001, 0.9, 0.999, 1e-2, 1e-8);
+  op.next();
+  SparseUpdateData d, ref;
+  AdamOptimizer::sparse_update_kernel_cpu(&op,
+                                          d.indices.data(),
+                                          d.values.data(),
+                                          d.indices.size(),
+                                          d.out_dim,
+                                          d.num_entries,
+                                          d.num_replicas,
+                                          d.w.data(),
+                                          d.v.data(),
+                                          d.m.data());
+  std::vector<float> grad = ref.get_dense_grad();
+  float alpha_t = op.alpha_t, beta1 = op.beta1, beta2 = op.beta2;
+  float weight_decay = op.weight_decay, epsilon = op.epsilon;
+  for (int rep = 0; rep < d.num_replicas; rep++) {
+    for (int row = 0; row < d.num_entries; row++) {
+      for (int j = 0; j < d.out_dim; j++) {
+        size_t i = (rep * d.num_entries + row) * d.out_dim + j;
+        // The moments of untouched rows are not decayed
+        if (ref.is_touched(row)) {
+          float gt = grad[row * d.out_dim + j] + weight_decay * ref.w[i];
+          ref.m[i] = beta1 * ref.m[i] + (1 - beta1) * gt;
+          ref.v[i] = beta2 * ref.v[i] + (1 - beta2) * gt * gt;
+          ref.w[i] -= alpha_t * ref.m[i] / (std::sqrt(ref.v[i]) + epsilon);
+        }
+        EXPECT_NEAR(d.w[i], ref.w[i], 1e-6);
+        EXPECT_NEAR(d.v[i], ref.v[i], 1e-6);
+        EXPECT_NEAR(d.m[i], ref.m[i], 1e-6);
+      }
+    }
+  }
+}
+
+// Reports the memory bandwidth of the CPU update kernels. Run with
+// --gtest_also_run_disabled_tests --gtest_filter=*benchmark*; the thread
+// count follows FF_CPU_NUM_THREADS.
+TEST(cpu_optimizer, DISABLED_benchmark_bandwidth) {
+  size_t const size = 1 << 25;
+  int const num_replicas = 1, num_iters = 10;
+  int num_threads = CPUThreadPool::get_instance().get_num_threads();
+  UpdateData d(size, num_replicas);
+  SGDOptimizer sgd(nullptr, 0.01, 0.9, false, 1e-4);
+  AdamOptimizer adam(nullptr);
+  adam.next();
+  for (int k = 0; k < 2; k++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int it = 0; it < num_iters; it++) {
+      if (k == 0) {
+        SGDOptimizer::update_kernel_cpu(
+            &sgd, d.grad.data(), size, num_replicas, d.w.data(), d.v.data());
+      } else {
+        AdamOptimizer::update_kernel_cpu(&adam,
+                                         d.grad.data(),
+                                         size,
+                                         num_replicas,
+                                         d.w.data(),
+                                         d.v.data(),
+                                         d.m.data());
+      }
+    }
+    double secs = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    // Gradients are read once; the weight and each state are read and written
+    int num_states = (k == 0) ? 1 : 2;
+    double bytes = (double)size * sizeof(float) *
+                   (num_replicas + 2 * (1 + num_states)) * num_iters;
+    double gbps = bytes / secs / 1e9;
+    printf("[%s] %d threads: %.2f GB/s (%.2f GB/s per core)\n",
+           k == 0 ? "SGD" : "Adam",
+           num_threads,
+           gbps,
+           gbps / num_threads);
+  }
+}
@@ -2,6 +2,10 @@
 #include "flexflow/dominators.h"
 #include "flexflow/utils/hash_utils.h"
 #include "gtest/gtest.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
 
 using namespace FlexFlow::PCG::Utils;
 
@@ -173,6 +177,104 @@ TEST(imm_post_dominators, multisource) {
   EXPECT_EQ(result, answer);
 }
 
+TEST(dominator_tree, queries) {
+  BasicGraph<int> g = get_dominator_test_graph();
+  DominatorTree<int> tree = post_dominator_tree(g);
+
+  EXPECT_EQ(tree.imm_dominator(4), 6);
+  EXPECT_FALSE(tree.has_imm_dominator(11));
+  EXPECT_EQ(tree.imm_dominator(11), 11);
+  EXPECT_TRUE(tree.dominates(8, 1));
+  EXPECT_TRUE(tree.dominates(5, 5));
+  EXPECT_FALSE(tree.dominates(6, 7));
+  EXPECT_FALSE(tree.dominates(1, 8));
+  EXPECT_EQ(tree.dominator_chain(3), std::vector<int>({3, 6, 8, 11}));
+  EXPECT_EQ(tree.common_dominator({2, 7}).value(), 8);
+  EXPECT_EQ(tree.common_dominator({3, 5}).value(), 6);
+
+  BasicGraph<int> two_sinks;
+  two_sinks.add_nodes({1, 2, 3});
+  two_sinks.add_edges({{1, 2}, {1, 3}});
+  DominatorTree<int> forest = post_dominator_tree(two_sinks);
+  EXPECT_FALSE(forest.has_imm_dominator(1));
+  EXPECT_FALSE(forest.common_dominator({2, 3}).has_value());
+}
+
+TEST(dominator_tree, matches_reachability_reference) {
+  std::mt19937 gen(0);
+  for (int trial = 0; trial < 50; trial++) {
+    int const num_nodes = 2 + trial % 20;
+    BasicGraph<int> g;
+    for (int i = 0; i < num_nodes; i++) {
+      g.add_node(i);
+    }
+    for (int i = 0; i < num_nodes; i++) {
+      for (int j = i + 1; j < num_nodes; j++) {
+        if (gen() % 4 == 0) {
+          g.add_edge(i, j);
+        }
+      }
+    }
+    std::unordered_set<int> sources = roots(g);
+    // a dominates b iff b cannot be reached from the roots without a
+    auto reachable_without = [&](int removed) {
+      std::unordered_set<int> seen;
+      std::vector<int> stack;
+      for (int r : sources) {
+        if (r != removed) {
+          seen.insert(r);
+          stack.push_back(r);
+        }
+      }
+      while (!stack.empty()) {
+        int n = stack.back();
+        stack.pop_back();
+        std::unordered_set<int> succs;
+        successors<BasicGraph<int>>(g, n, &succs);
+        for (int m : succs) {
+          if (m != removed && seen.insert(m).second) {
+            stack.push_back(m);
+          }
+        }
+      }
+      return seen;
+    };
+    std::unordered_map<int, std::unordered_set<int>> dom = dominators(g);
+    DominatorTree<int> tree = dominator_tree(g);
+    for (int a = 0; a < num_nodes; a++) {
+      std::unordered_set<int> reached = reachable_without(a);
+      for (int b = 0; b < num_nodes; b++) {
+        bool expected = (a == b) || reached.find(b) == reached.end();
+        EXPECT_EQ(tree.dominates(a, b), expected) << a << " dom " << b;
+        EXPECT_EQ(dom.at(b).count(a) == 1, expected) << a << " dom " << b;
+      }
+    }
+  }
+}
+
+// Times the post-dominator tree on a long chain of diamonds, the shape of
+// a deep PCG. Run with --gtest_also_run_disabled_tests.
+TEST(dominator_tree, DISABLED_benchmark_diamond_chain) {
+  int const num_diamonds = 100000;
+  BasicGraph<int> g;
+  for (int i = 0; i < num_diamonds; i++) {
+    int top = 3 * i;
+    g.add_edges({{top, top + 1},
+                 {top, top + 2},
+                 {top + 1, top + 3},
+                 {top + 2, top + 3}});
+  }
+  auto start = std::chrono::steady_clock::now();
+  DominatorTree<int> tree = post_dominator_tree(g);
+  double secs =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  EXPECT_EQ(tree.imm_dominator(0), 3);
+  printf("post_dominator_tree: %zu nodes in %.3f s\n",
+         tree.topo_order().size(),
+         secs);
+}
+
 TEST(transitive_reduction, basic) {
   BasicGraph<int> g({1, 2, 3}, {{1, 2}, {2, 3}, {1, 3}});
 
@@ -319,3 +421,55 @@ TEST(weakly_connected_components, basic) {
   EXPECT_TRUE(component2_found);
   EXPECT_TRUE(component3_found);
 }
+
+// A graph that caches its indexed view, like PCG::Graph does
+struct CachingGraph : public BasicGraph<int> {
+  using BasicGraph<int>::BasicGraph;
+
+  mutable std::shared_ptr<IndexedGraphView<int> const> view;
+  mutable int num_views_built = 0;
+};
+
+namespace FlexFlow::PCG::Utils {
+template <>
+struct GraphStructure<CachingGraph> : public GraphStructure<BasicGraph<int>> {
+  using graph_type = CachingGraph;
+};
+
+template <>
+struct indexed_view<CachingGraph, GraphStructure<CachingGraph>> {
+  IndexedGraphView<int> operator()(CachingGraph const &g) const {
+    if (g.view == nullptr) {
+      g.num_views_built++;
+      g.view = std::make_shared<IndexedGraphView<int> const>(
+          indexed_graph_view<BasicGraph<int>>(g));
+    }
+    return *g.view;
+  }
+};
+} // namespace FlexFlow::PCG::Utils
+
+TEST(indexed_view, uses_cached_view) {
+  BasicGraph<int> basic = get_dominator_test_graph();
+  CachingGraph g(basic.nodes, {});
+  for (auto const &kv : basic.out_edges) {
+    g.add_edges(kv.second);
+  }
+
+  std::vector<int> order;
+  topo_sort(g, &order);
+  ASSERT_EQ(order.size(), basic.nodes.size());
+  std::unordered_map<int, int> position;
+  for (int i = 0; i < (int)order.size(); i++) {
+    position[order[i]] = i;
+  }
+  for (auto const &kv : basic.out_edges) {
+    for (auto const &e : kv.second) {
+      EXPECT_LT(position.at(e.first), position.at(e.second));
+    }
+  }
+  EXPECT_EQ(dominators(g), dominators(basic));
+  EXPECT_EQ(imm_dominators(g), imm_dominators(basic));
+  EXPECT_EQ(descendants(g, 4), descendants(basic, 4));
+  EXPECT_EQ(g.num_views_built, 1);
+}
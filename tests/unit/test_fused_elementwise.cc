@@ -0,0 +1,334 @@
+#include "flexflow/ops/kernels/fused_elementwise_kernels.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+
+using namespace FlexFlow;
+using namespace FlexFlow::Kernels::FusedElementwise;
+
+namespace {
+
+OpInfo make_op(OperatorType type,
+               std::vector<int> const &inputs,
+               int output,
+               float scalar = 0.0f) {
+  OpInfo op;
+  op.op_type = type;
+  op.scalar = scalar;
+  op.same_shape = true;
+  op.shape = 0;
+  op.inputs = inputs;
+  op.outputs = {output};
+  op.input_types.assign(inputs.size(), DT_FLOAT);
+  op.output_types = {DT_FLOAT};
+  return op;
+}
+
+float reference_op(OpInfo const &op, float a, float b) {
+  switch (op.op_type) {
+    case OP_EW_ADD:
+      return a + b;
+    case OP_EW_SUB:
+      return a - b;
+    case OP_EW_MUL:
+      return a * b;
+    case OP_EW_MAX:
+      return std::max(a, b);
+    case OP_RELU:
+      return std::max(a, 0.0f);
+    case OP_SIGMOID:
+      return 1.0f / (1.0f + std::exp(-a));
+    case OP_TANH:
+      return std::tanh(a);
+    case OP_ELU:
+      return a > 0.0f ? a : std::exp(a) - 1.0f;
+    case OP_SCALAR_MULTIPLY:
+      return a * op.scalar;
+    case OP_SCALAR_ADD:
+      return a + op.scalar;
+    case OP_CAST:
+      return op.output_types[0] == DT_INT32 ? (float)(int32_t)a : a;
+    default:
+      assert(false);
+      return 0.0f;
+  }
+}
+
+// Tensors of the tests: float tensors of `volume` elements, indexed by id
+struct Tensors {
+  Tensors(int num_tensors, size_t volume)
+      : data(num_tensors, std::vector<float>(volume)) {}
+
+  // Evaluates ops one at a time, the way unfused operators would
+  void run_reference(std::vector<OpInfo> const &ops) {
+    for (OpInfo const &op : ops) {
+      std::vector<float> result(data[0].size());
+      for (size_t i = 0; i < result.size(); i++) {
+        float a = data[op.inputs[0]][i];
+        float b = op.inputs.size() > 1 ? data[op.inputs[1]][i] : 0.0f;
+        result[i] = reference_op(op, a, b);
+      }
+      data[op.outputs[0]] = result;
+    }
+  }
+
+  void run_programs(std::vector<OpInfo> const &ops,
+                    std::vector<bool> const &pinned) {
+    std::vector<Program> programs;
+    std::vector<int> op_program;
+    std::vector<bool> materialized;
+    plan_programs(ops, pinned, &programs, &op_program, &materialized);
+    for (Program const &p : programs) {
+      void const *inputs[MAX_NUM_FUSED_EW_TENSORS];
+      void *outputs[MAX_NUM_FUSED_EW_TENSORS];
+      for (int i = 0; i < p.num_inputs; i++) {
+        inputs[i] = data[p.input_tensors[i]].data();
+      }
+      for (int i = 0; i < p.num_outputs; i++) {
+        outputs[i] = data[p.output_tensors[i]].data();
+      }
+      forward_kernel_cpu(p, inputs, outputs, data[0].size());
+    }
+  }
+
+  std::vector<std::vector<float>> data;
+};
+
+// A random chain over tensors 0..num_ops+1; tensors 0 and 1 are inputs and
+// operator k writes tensor k + 2, or overwrites its own input
+std::vector<OpInfo> random_chain(int num_ops, std::mt19937 &gen) {
+  OperatorType const binary[] = {OP_EW_ADD, OP_EW_SUB, OP_EW_MUL, OP_EW_MAX};
+  OperatorType const unary[] = {OP_RELU,
+                                OP_SIGMOID,
+                                OP_TANH,
+                                OP_ELU,
+                                OP_SCALAR_MULTIPLY,
+                                OP_SCALAR_ADD};
+  std::vector<OpInfo> ops;
+  for (int k = 0; k < num_ops; k++) {
+    int a = gen() % (k + 2), b = gen() % (k + 2);
+    int output = k + 2;
+    if (gen() % 2 == 0) {
+      ops.push_back(make_op(binary[gen() % 4], {a, b}, output));
+    } else {
+      if (a >= 2 && gen() % 4 == 0) {
+        // in place
+        output = a;
+      }
+      ops.push_back(
+          make_op(unary[gen() % 6], {a}, output, 0.5f + gen() % 3));
+    }
+  }
+  return ops;
+}
+
+} // namespace
+
+TEST(fused_elementwise, plans_chain_after_other_operator) {
+  // linear(0) -> 1; add(1, 2) -> 3; relu(3) -> 4; 4 is read elsewhere
+  std::vector<OpInfo> ops = {make_op(OP_LINEAR, {0}, 1),
+                             make_op(OP_EW_ADD, {1, 2}, 3),
+                             make_op(OP_RELU, {3}, 4)};
+  std::vector<bool> pinned(5, false);
+  pinned[4] = true;
+  std::vector<Program> programs;
+  std::vector<int> op_program;
+  std::vector<bool> materialized;
+  plan_programs(ops, pinned, &programs, &op_program, &materialized);
+
+  ASSERT_EQ(programs.size(), 1);
+  EXPECT_EQ(op_program, std::vector<int>({-1, 0, 0}));
+  Program const &p = programs[0];
+  EXPECT_EQ(p.num_inputs, 2);
+  EXPECT_EQ(p.num_outputs, 1);
+  EXPECT_EQ(p.output_tensors[0], 4);
+  // load, load, add, relu, store; the relu reuses a register of the add
+  EXPECT_EQ(p.num_instrs, 5);
+  EXPECT_EQ(p.num_registers, 2);
+  // the output of the add only lives in a register
+  EXPECT_EQ(materialized, std::vector<bool>({true, true, true, false, true}));
+}
+
+TEST(fused_elementwise, stores_values_read_after_the_chain) {
+  // add(0, 1) -> 2; relu(2) -> 3; linear(2) -> 4
+  std::vector<OpInfo> ops = {make_op(OP_EW_ADD, {0, 1}, 2),
+                             make_op(OP_RELU, {2}, 3),
+                             make_op(OP_LINEAR, {2}, 4)};
+  std::vector<bool> pinned(5, false);
+  std::vector<Program> programs;
+  std::vector<int> op_program;
+  std::vector<bool> materialized;
+  plan_programs(ops, pinned, &programs, &op_program, &materialized);
+  ASSERT_EQ(programs.size(), 1);
+  EXPECT_EQ(op_program, std::vector<int>({0, 0, -1}));
+  // 2 is read by the linear, 3 is read by nothing and not pinned
+  EXPECT_EQ(programs[0].num_outputs, 1);
+  EXPECT_EQ(programs[0].output_tensors[0], 2);
+  EXPECT_FALSE(materialized[3]);
+}
+
+TEST(fused_elementwise, rejects_broadcasts_and_other_types) {
+  OpInfo add = make_op(OP_EW_ADD, {0, 1}, 2);
+  EXPECT_TRUE(is_elementwise(add));
+  add.same_shape = false;
+  EXPECT_FALSE(is_elementwise(add));
+  OpInfo relu = make_op(OP_RELU, {0}, 1);
+  relu.input_types[0] = relu.output_types[0] = DT_HALF;
+  EXPECT_FALSE(is_elementwise(relu));
+  OpInfo cast = make_op(OP_CAST, {0}, 1);
+  cast.output_types[0] = DT_INT64;
+  EXPECT_TRUE(is_elementwise(cast));
+  cast.input_types[0] = DT_DOUBLE;
+  EXPECT_FALSE(is_elementwise(cast));
+  EXPECT_FALSE(is_elementwise(make_op(OP_DROPOUT, {0}, 1)));
+}
+
+TEST(fused_elementwise, cpu_matches_reference) {
+  std::mt19937 gen(0);
+  size_t const volume = 1000;
+  for (int trial = 0; trial < 100; trial++) {
+    int num_ops = 1 + trial % 20;
+    std::vector<OpInfo> ops = random_chain(num_ops, gen);
+    std::vector<bool> pinned(num_ops + 2, trial % 2 == 0);
+    pinned[num_ops + 1] = true;
+    Tensors expected(num_ops + 2, volume), actual(num_ops + 2, volume);
+    for (size_t i = 0; i < volume; i++) {
+      expected.data[0][i] = actual.data[0][i] = std::sin(0.1f * i) * 3.0f;
+      expected.data[1][i] = actual.data[1][i] = std::cos(0.7f * i);
+    }
+    expected.run_reference(ops);
+    actual.run_programs(ops, pinned);
+    for (int t = 0; t < num_ops + 2; t++) {
+      if (!pinned[t]) {
+        continue;
+      }
+      for (size_t i = 0; i < volume; i++) {
+        ASSERT_NEAR(actual.data[t][i],
+                    expected.data[t][i],
+                    1e-4f * (1.0f + std::abs(expected.data[t][i])))
+            << "trial " << trial << " tensor " << t << " element " << i;
+      }
+    }
+  }
+}
+
+TEST(fused_elementwise, splits_programs_at_limits) {
+  // Independent adds, each reading two fresh inputs, exceed the number of
+  // tensors a single program can load
+  int const num_ops = 12;
+  std::vector<OpInfo> ops;
+  for (int k = 0; k < num_ops; k++) {
+    ops.push_back(make_op(OP_EW_ADD, {2 * k, 2 * k + 1}, 2 * num_ops + k));
+  }
+  std::vector<bool> pinned(3 * num_ops, true);
+  std::vector<Program> programs;
+  std::vector<int> op_program;
+  std::vector<bool> materialized;
+  plan_programs(ops, pinned, &programs, &op_program, &materialized);
+  EXPECT_EQ(programs.size(), 3);
+  for (Program const &p : programs) {
+    EXPECT_LE(p.num_inputs, MAX_NUM_FUSED_EW_TENSORS);
+  }
+
+  size_t const volume = 37;
+  Tensors tensors(3 * num_ops, volume);
+  for (int t = 0; t < 2 * num_ops; t++) {
+    for (size_t i = 0; i < volume; i++) {
+      tensors.data[t][i] = t * 100.0f + i;
+    }
+  }
+  tensors.run_programs(ops, pinned);
+  for (int k = 0; k < num_ops; k++) {
+    for (size_t i = 0; i < volume; i++) {
+      EXPECT_EQ(tensors.data[2 * num_ops + k][i],
+                (4 * k + 1) * 100.0f + 2 * i);
+    }
+  }
+}
+
+TEST(fused_elementwise, casts_at_chain_boundaries) {
+  // cast(int64 0 -> float) -> 1; scalar_multiply(1) -> 2;
+  // cast(2 -> int32) -> 3; cast(3 -> float) -> 4; add(2, 4) -> 5
+  std::vector<OpInfo> ops = {make_op(OP_CAST, {0}, 1),
+                             make_op(OP_SCALAR_MULTIPLY, {1}, 2, 0.7f),
+                             make_op(OP_CAST, {2}, 3),
+                             make_op(OP_CAST, {3}, 4),
+                             make_op(OP_EW_ADD, {2, 4}, 5)};
+  ops[0].input_types[0] = DT_INT64;
+  ops[2].output_types[0] = DT_INT32;
+  ops[3].input_types[0] = DT_INT32;
+  std::vector<bool> pinned(6, false);
+  pinned[3] = pinned[5] = true;
+  std::vector<Program> programs;
+  std::vector<int> op_program;
+  std::vector<bool> materialized;
+  plan_programs(ops, pinned, &programs, &op_program, &materialized);
+  ASSERT_EQ(programs.size(), 1);
+
+  size_t const volume = 100;
+  std::vector<int64_t> in(volume);
+  std::vector<int32_t> truncated(volume);
+  std::vector<float> sum(volume);
+  for (size_t i = 0; i < volume; i++) {
+    in[i] = (int64_t)i - 50;
+  }
+  Program const &p = programs[0];
+  ASSERT_EQ(p.num_inputs, 1);
+  ASSERT_EQ(p.num_outputs, 2);
+  void const *inputs[] = {in.data()};
+  void *outputs[2];
+  for (int i = 0; i < 2; i++) {
+    outputs[i] = p.output_tensors[i] == 3 ? (void *)truncated.data()
+                                          : (void *)sum.data();
+  }
+  forward_kernel_cpu(p, inputs, outputs, volume);
+  for (size_t i = 0; i < volume; i++) {
+    float scaled = (float)in[i] * 0.7f;
+    EXPECT_EQ(truncated[i], (int32_t)scaled);
+    EXPECT_FLOAT_EQ(sum[i], scaled + (float)(int32_t)scaled);
+  }
+}
+
+// Compares one fused loop with running the same chain one operator at a
+// time. Run with --gtest_also_run_disabled_tests --gtest_filter=*benchmark*.
+TEST(fused_elementwise, DISABLED_benchmark_bias_relu_scale) {
+  size_t const volume = 1 << 24;
+  int const num_iters = 10;
+  // add(0, 1) -> 2; relu(2) -> 3; scalar_multiply(3) -> 4
+  std::vector<OpInfo> ops = {make_op(OP_EW_ADD, {0, 1}, 2),
+                             make_op(OP_RELU, {2}, 3),
+                             make_op(OP_SCALAR_MULTIPLY, {3}, 4, 2.0f)};
+  Tensors tensors(5, volume);
+  for (size_t i = 0; i < volume; i++) {
+    tensors.data[0][i] = std::sin(0.001f * i);
+    tensors.data[1][i] = 0.1f;
+  }
+  std::vector<bool> all(5, true), last(5, false);
+  last[4] = true;
+  auto time = [&](std::vector<bool> const &pinned, bool one_by_one) {
+    auto start = std::chrono::steady_clock::now();
+    for (int it = 0; it < num_iters; it++) {
+      if (one_by_one) {
+        for (OpInfo const &op : ops) {
+          tensors.run_programs({op}, all);
+        }
+      } else {
+        tensors.run_programs(ops, pinned);
+      }
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+               .count() /
+           num_iters;
+  };
+  double separate = time(all, true);
+  double fused = time(all, false);
+  double registers_only = time(last, false);
+  printf("%zu elements\n", volume);
+  printf("  one loop per operator       %8.3f ms\n", separate * 1e3);
+  printf("  fused, storing every output %8.3f ms\n", fused * 1e3);
+  printf("  fused, storing the result   %8.3f ms\n", registers_only * 1e3);
+}
@@ -0,0 +1,151 @@
+#include "flexflow/parallel_ops/kernels/fused_parallel_op_kernels.h"
+#include "gtest/gtest.h"
+#include <random>
+
+using namespace FlexFlow;
+using namespace FlexFlow::Kernels::FusedParallelOp;
+
+namespace {
+
+ParallelOpInfo make_info(OperatorType type, int dim, int degree) {
+  ParallelOpInfo info;
+  info.op_type = type;
+  info.parallel_dim = dim;
+  info.parallel_degree = degree;
+  return info;
+}
+
+// Runs the chain one operator at a time on the replicas of a tensor with a
+// single element per replica, like the separate Replicate and Reduction
+// kernels would
+std::vector<long> run_chain(std::vector<ParallelOpInfo> const &ops,
+                            int replica_dim,
+                            std::vector<long> replicas) {
+  for (ParallelOpInfo const &info : ops) {
+    if (info.parallel_dim != replica_dim) {
+      continue;
+    }
+    size_t size = replicas.size();
+    std::vector<long> next;
+    if (info.op_type == OP_REPLICATE) {
+      for (int j = 0; j < info.parallel_degree; j++) {
+        next.insert(next.end(), replicas.begin(), replicas.end());
+      }
+    } else if (info.op_type == OP_REDUCTION) {
+      next.assign(size / info.parallel_degree, 0);
+      for (size_t r = 0; r < size; r++) {
+        next[r % next.size()] += replicas[r];
+      }
+    } else {
+      next = replicas;
+    }
+    replicas.swap(next);
+  }
+  return replicas;
+}
+
+std::vector<long> apply_plan(CopyPlan const &plan,
+                             std::vector<long> const &src) {
+  EXPECT_EQ(plan.num_src, (int)src.size());
+  std::vector<long> dst(plan.num_dst, 0);
+  for (int r = 0; r < plan.num_dst; r++) {
+    for (int e = plan.row_start[r]; e < plan.row_start[r + 1]; e++) {
+      dst[r] += plan.weight[e] * src[plan.source[e]];
+    }
+  }
+  return dst;
+}
+
+} // namespace
+
+TEST(fused_parallel_op, shard_moves_are_one_copy) {
+  std::vector<ParallelOpInfo> ops = {make_info(OP_REPARTITION, 0, 4),
+                                     make_info(OP_COMBINE, 1, 2)};
+  CopyPlan plan = plan_copy({8, 8, 1}, ops).value();
+  EXPECT_EQ(plan.replica_dim, -1);
+  EXPECT_EQ(plan.num_dst, 1);
+  EXPECT_EQ(plan.num_entries, 1);
+  EXPECT_EQ(plan.weight[0], 1);
+}
+
+TEST(fused_parallel_op, replicate_then_reduce) {
+  std::vector<ParallelOpInfo> ops = {make_info(OP_REPLICATE, 2, 4),
+                                     make_info(OP_REPARTITION, 0, 2),
+                                     make_info(OP_REDUCTION, 2, 4)};
+  CopyPlan plan = plan_copy({8, 8, 1}, ops).value();
+  EXPECT_EQ(plan.replica_dim, 2);
+  EXPECT_EQ(plan.num_src, 1);
+  EXPECT_EQ(plan.num_dst, 1);
+  // the four replicas are summed without ever being materialized
+  EXPECT_EQ(plan.num_entries, 1);
+  EXPECT_EQ(plan.weight[0], 4);
+}
+
+TEST(fused_parallel_op, matches_separate_operators) {
+  std::mt19937 gen(0);
+  for (int trial = 0; trial < 200; trial++) {
+    int num_src = 1 << (gen() % 3);
+    int size = num_src;
+    std::vector<ParallelOpInfo> ops;
+    int num_ops = 1 + gen() % 5;
+    for (int i = 0; i < num_ops; i++) {
+      int degree = 1 << (1 + gen() % 2);
+      switch (gen() % 3) {
+        case 0:
+          if (size * degree <= 16) {
+            ops.push_back(make_info(OP_REPLICATE, 1, degree));
+            size *= degree;
+          }
+          break;
+        case 1:
+          if (size % degree == 0) {
+            ops.push_back(make_info(OP_REDUCTION, 1, degree));
+            size /= degree;
+          }
+          break;
+        default:
+          ops.push_back(make_info(OP_REPARTITION, 0, degree));
+          break;
+      }
+    }
+    CopyPlan plan = plan_copy({16, num_src}, ops).value();
+    std::vector<long> src(num_src), dst(size);
+    for (long &v : src) {
+      v = gen() % 100;
+    }
+    for (long &v : dst) {
+      v = gen() % 100;
+    }
+    std::vector<long> expected = run_chain(ops, 1, src);
+    if (plan.replica_dim == -1) {
+      EXPECT_EQ(expected, src) << "trial " << trial;
+      continue;
+    }
+    EXPECT_EQ(apply_plan(plan, src), expected) << "trial " << trial;
+    // backward must be the adjoint: <A src, dst> == <src, A^T dst>
+    std::vector<long> grad = apply_plan(transpose_plan(plan).value(), dst);
+    long lhs = 0, rhs = 0;
+    for (int r = 0; r < size; r++) {
+      lhs += expected[r] * dst[r];
+    }
+    for (int s = 0; s < num_src; s++) {
+      rhs += src[s] * grad[s];
+    }
+    EXPECT_EQ(lhs, rhs) << "trial " << trial;
+  }
+}
+
+TEST(fused_parallel_op, oversized_chains_have_no_plan) {
+  // 128 destination replicas
+  std::vector<ParallelOpInfo> replicate = {make_info(OP_REPLICATE, 1, 128)};
+  EXPECT_FALSE(plan_copy({8, 1}, replicate).has_value());
+  // fits forward, but backward fans out to 128 replicas
+  std::vector<ParallelOpInfo> reduce = {make_info(OP_REDUCTION, 1, 128)};
+  tl::optional<CopyPlan> plan = plan_copy({8, 128}, reduce);
+  ASSERT_TRUE(plan.has_value());
+  EXPECT_EQ(plan->num_dst, 1);
+  EXPECT_FALSE(transpose_plan(plan.value()).has_value());
+  // 64 destination replicas summing 8 sources each
+  std::vector<ParallelOpInfo> partial = {make_info(OP_REDUCTION, 1, 8)};
+  EXPECT_FALSE(plan_copy({8, 512}, partial).has_value());
+}
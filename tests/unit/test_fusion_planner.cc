@@ -0,0 +1,253 @@
+#include "flexflow/fusion_planner.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using namespace FlexFlow;
+
+namespace {
+
+FusionLimits default_limits() {
+  FusionLimits limits;
+  limits.max_operators = 64;
+  limits.max_tensors = 64;
+  limits.max_inputs = 256;
+  limits.max_weights = 64;
+  limits.max_outputs = 256;
+  return limits;
+}
+
+// Whether a FusedOp made of ops[members] stays within the limits, replaying
+// the bookkeeping of FusedOp::add_operator from scratch
+bool group_fits(std::vector<FusionPlannerOp> const &ops,
+                std::vector<int> const &members,
+                FusionLimits const &limits) {
+  int input_slots = 0, weight_slots = 0, output_slots = 0;
+  std::vector<int> inputs, weights, outputs;
+  auto contains = [](std::vector<int> const &v, int t) {
+    return std::find(v.begin(), v.end(), t) != v.end();
+  };
+  for (size_t m = 0; m < members.size(); m++) {
+    FusionPlannerOp const &op = ops[members[m]];
+    input_slots += op.inputs.size();
+    weight_slots += op.weights.size();
+    output_slots += op.outputs.size();
+    for (int t : op.inputs) {
+      if (!contains(inputs, t) && !contains(outputs, t)) {
+        inputs.push_back(t);
+      }
+    }
+    for (int t : op.weights) {
+      // the first operator's weights are copied without deduplication
+      if (m == 0 || !contains(weights, t)) {
+        weights.push_back(t);
+      }
+    }
+    for (int t : op.outputs) {
+      if (m == 0 || !contains(outputs, t)) {
+        outputs.push_back(t);
+      }
+    }
+  }
+  return (int)members.size() <= limits.max_operators &&
+         input_slots <= limits.max_tensors &&
+         weight_slots <= limits.max_tensors &&
+         output_slots <= limits.max_tensors &&
+         (int)inputs.size() <= limits.max_inputs &&
+         (int)weights.size() <= limits.max_weights &&
+         (int)outputs.size() <= limits.max_outputs;
+}
+
+// The previous FFModel::apply_fusion loop: fuse the first fusable pair,
+// rebuild the operator list and rescan from the start until nothing changes
+std::vector<int> restart_fusion(std::vector<FusionPlannerOp> const &ops,
+                                FusionLimits const &limits) {
+  std::vector<std::vector<int>> entries;
+  for (int i = 0; i < (int)ops.size(); i++) {
+    entries.push_back({i});
+  }
+  auto entry_of = [&](int op) {
+    for (size_t e = 0; e < entries.size(); e++) {
+      auto const &members = entries[e];
+      if (std::find(members.begin(), members.end(), op) != members.end()) {
+        return (int)e;
+      }
+    }
+    assert(false);
+    return -1;
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t l = 1; l + 1 < entries.size() && !changed; l++) {
+      if (entries[l].size() > 1 || !ops[entries[l][0]].can_fuse) {
+        continue;
+      }
+      FusionPlannerOp const &opl = ops[entries[l][0]];
+      int start = 0;
+      for (int p : opl.producers) {
+        if (p >= 0) {
+          start = std::max(start, entry_of(p));
+        }
+      }
+      for (size_t i = start; i < l; i++) {
+        std::vector<int> &host = entries[i];
+        if (ops[host[0]].view != opl.view ||
+            (host.size() == 1 && !ops[host[0]].can_start_group)) {
+          continue;
+        }
+        std::vector<int> members = host;
+        members.push_back(entries[l][0]);
+        if (!group_fits(ops, members, limits)) {
+          continue;
+        }
+        host = members;
+        entries.erase(entries.begin() + l);
+        changed = true;
+        break;
+      }
+    }
+  }
+  std::vector<int> group(ops.size());
+  for (auto const &members : entries) {
+    for (int m : members) {
+      group[m] = members[0];
+    }
+  }
+  return group;
+}
+
+// A random operator list in topological order. Tensor ids are the producing
+// operator's index times 4 plus the output index; weights use negative ids.
+std::vector<FusionPlannerOp>
+    random_ops(int num_ops, int num_views, std::mt19937 &gen) {
+  std::vector<FusionPlannerOp> ops(num_ops);
+  for (int i = 0; i < num_ops; i++) {
+    FusionPlannerOp &op = ops[i];
+    op.view = gen() % num_views;
+    op.can_fuse = gen() % 8 != 0;
+    op.can_start_group = op.can_fuse && gen() % 6 != 0;
+    int num_outputs = 1 + gen() % 2;
+    for (int k = 0; k < num_outputs; k++) {
+      op.outputs.push_back(4 * i + k);
+    }
+    if (i == 0) {
+      continue;
+    }
+    int num_inputs = 1 + gen() % 3;
+    for (int k = 0; k < num_inputs; k++) {
+      // mostly consume recent outputs, like a layered model
+      int p = std::max(0, i - 1 - (int)(gen() % 4));
+      if (gen() % 10 == 0) {
+        p = gen() % i;
+      }
+      op.producers.push_back(p);
+      op.inputs.push_back(4 * p + (int)(gen() % ops[p].outputs.size()));
+    }
+    if (!op.can_start_group && op.can_fuse && gen() % 2 == 0) {
+      // an in-place operator writes to its first input's region
+      op.outputs[0] = op.inputs[0];
+    }
+    int num_weights = gen() % 3;
+    for (int k = 0; k < num_weights; k++) {
+      op.weights.push_back(-1 - (int)(gen() % (2 * num_ops)));
+    }
+  }
+  return ops;
+}
+
+} // namespace
+
+TEST(fusion_planner, chain) {
+  // input -> a -> b -> c -> d(view 1) -> e -> output
+  std::vector<FusionPlannerOp> ops(7);
+  for (int i = 0; i < 7; i++) {
+    ops[i].view = (i == 4) ? 1 : 0;
+    ops[i].can_fuse = (i > 0);
+    ops[i].can_start_group = (i > 0);
+    ops[i].outputs = {i};
+    if (i > 0) {
+      ops[i].producers = {i - 1};
+      ops[i].inputs = {i - 1};
+    }
+  }
+  std::vector<int> group = plan_fusion(ops, default_limits());
+  // b and c join a; e may only join operators from d onwards, which has
+  // another view; the input and the last operator are never fused
+  EXPECT_EQ(group, std::vector<int>({0, 1, 1, 1, 4, 5, 6}));
+}
+
+TEST(fusion_planner, respects_operator_limit) {
+  int const num_ops = 12;
+  std::vector<FusionPlannerOp> ops(num_ops);
+  for (int i = 0; i < num_ops; i++) {
+    ops[i].view = 0;
+    ops[i].can_fuse = ops[i].can_start_group = true;
+    ops[i].outputs = {i};
+    if (i > 0) {
+      ops[i].producers = {i - 1};
+      ops[i].inputs = {i - 1};
+    }
+  }
+  FusionLimits limits = default_limits();
+  limits.max_operators = 4;
+  std::vector<int> group = plan_fusion(ops, limits);
+  EXPECT_EQ(group, std::vector<int>({0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 11}));
+}
+
+TEST(fusion_planner, matches_restart_loop) {
+  std::mt19937 gen(0);
+  for (int trial = 0; trial < 300; trial++) {
+    int num_ops = 2 + trial % 40;
+    std::vector<FusionPlannerOp> ops = random_ops(num_ops, 1 + trial % 3, gen);
+    FusionLimits limits = default_limits();
+    if (trial % 2 == 0) {
+      limits.max_operators = 2 + gen() % 5;
+      limits.max_tensors = 3 + gen() % 8;
+      limits.max_inputs = 2 + gen() % 4;
+      limits.max_weights = 1 + gen() % 3;
+      limits.max_outputs = 2 + gen() % 4;
+    }
+    EXPECT_EQ(plan_fusion(ops, limits), restart_fusion(ops, limits))
+        << "trial " << trial;
+  }
+}
+
+// Reports the planning time for a model of the size of our larger PCGs. Run
+// with --gtest_also_run_disabled_tests --gtest_filter=*benchmark*.
+TEST(fusion_planner, refund_input_on_fusable_chain) {
+  // A chain: the only input's producer can fuse and has the same view
+  EXPECT_EQ(fusion_refund_input(0, {true}, {0}), 0);
+  // The refund goes through the first fusable producer only
+  EXPECT_EQ(fusion_refund_input(0, {false, true, true}, {0, 0, 0}), 1);
+  // Producers of unknown views are taken to match
+  EXPECT_EQ(fusion_refund_input(0, {true, true}, {-1, 0}), 0);
+}
+
+TEST(fusion_planner, no_refund_with_mismatched_views) {
+  EXPECT_EQ(fusion_refund_input(0, {true}, {1}), -1);
+  EXPECT_EQ(fusion_refund_input(0, {true, false}, {1, 0}), -1);
+  // An earlier producer with another view does not take the refund
+  EXPECT_EQ(fusion_refund_input(0, {true, true}, {1, 0}), 1);
+}
+
+TEST(fusion_planner, DISABLED_benchmark_3000_ops) {
+  std::mt19937 gen(0);
+  std::vector<FusionPlannerOp> ops = random_ops(3000, 2, gen);
+  auto start = std::chrono::steady_clock::now();
+  std::vector<int> group = plan_fusion(ops, default_limits());
+  double secs =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  int num_groups = 0;
+  for (int i = 0; i < (int)group.size(); i++) {
+    num_groups += (group[i] == i);
+  }
+  printf("plan_fusion: %zu operators -> %d in %.3f ms\n",
+         ops.size(),
+         num_groups,
+         secs * 1e3);
+}
@@ -0,0 +1,182 @@
+#include "flexflow/basic_graph.h"
+#include "flexflow/dominators.h"
+#include "flexflow/indexed_graph_view.h"
+#include "flexflow/utils/hash_utils.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using namespace FlexFlow::PCG::Utils;
+
+namespace {
+
+BasicGraph<int> get_random_dag(int num_nodes, int edge_one_in, int seed) {
+  std::mt19937 gen(seed);
+  BasicGraph<int> g;
+  for (int i = 0; i < num_nodes; i++) {
+    g.add_node(i);
+  }
+  for (int i = 0; i < num_nodes; i++) {
+    for (int j = i + 1; j < num_nodes; j++) {
+      if (gen() % edge_one_in == 0) {
+        g.add_edge(i, j);
+      }
+    }
+  }
+  return g;
+}
+
+// A chain of diamonds with a skip edge around every diamond, the shape of a
+// deep PCG with residual connections
+BasicGraph<int> get_residual_chain(int num_blocks) {
+  BasicGraph<int> g;
+  for (int i = 0; i < num_blocks; i++) {
+    int top = 3 * i;
+    g.add_edges({{top, top + 1},
+                 {top, top + 2},
+                 {top + 1, top + 3},
+                 {top + 2, top + 3},
+                 {top, top + 3}});
+  }
+  return g;
+}
+
+template <typename F>
+double time_secs(int num_iters, F const &f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int it = 0; it < num_iters; it++) {
+    f();
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+             .count() /
+         num_iters;
+}
+
+} // namespace
+
+TEST(indexed_graph_view, adjacency) {
+  BasicGraph<int> g;
+  g.add_nodes({10, 20, 30, 40});
+  g.add_edges({{10, 30}, {20, 30}, {30, 40}, {10, 40}});
+
+  IndexedGraphView<int> view = indexed_graph_view(g);
+  EXPECT_EQ(view.num_nodes(), 4);
+  EXPECT_EQ(view.num_edges(), 4);
+  for (auto const &e : std::vector<std::pair<int, int>>{
+           {10, 30}, {20, 30}, {30, 40}, {10, 40}}) {
+    EXPECT_TRUE(view.has_edge(view.index_of(e.first), view.index_of(e.second)));
+  }
+  EXPECT_FALSE(view.has_edge(view.index_of(30), view.index_of(10)));
+
+  int n30 = view.index_of(30);
+  std::unordered_set<int> preds;
+  for (int p : view.predecessors(n30)) {
+    preds.insert(view.node(p));
+  }
+  EXPECT_EQ(preds, std::unordered_set<int>({10, 20}));
+
+  std::vector<int> root_indices;
+  view.roots(&root_indices);
+  std::unordered_set<int> root_nodes;
+  for (int i : root_indices) {
+    root_nodes.insert(view.node(i));
+  }
+  EXPECT_EQ(root_nodes, std::unordered_set<int>({10, 20}));
+
+  IndexedGraphView<int> reversed = view.reversed();
+  EXPECT_TRUE(reversed.has_edge(n30, view.index_of(10)));
+  std::vector<int> leaf_indices;
+  reversed.leaves(&leaf_indices);
+  EXPECT_EQ(leaf_indices.size(), 2);
+}
+
+TEST(indexed_graph_view, merges_parallel_edges) {
+  IndexedGraphView<char> view({'a', 'b'}, {{0, 1}, {0, 1}, {0, 1}});
+  EXPECT_EQ(view.num_edges(), 1);
+  EXPECT_EQ(view.successors(0).size(), 1);
+  EXPECT_EQ(view.predecessors(1).size(), 1);
+}
+
+TEST(indexed_graph_view, traversals) {
+  for (int seed = 0; seed < 20; seed++) {
+    BasicGraph<int> g = get_random_dag(30, 6, seed);
+    IndexedGraphView<int> view = indexed_graph_view(g);
+
+    std::vector<int> topo;
+    EXPECT_TRUE(view.topo_sort(&topo));
+    ASSERT_EQ(topo.size(), 30);
+    std::vector<int> pos(30);
+    for (int t = 0; t < 30; t++) {
+      pos[topo[t]] = t;
+    }
+    for (int n = 0; n < 30; n++) {
+      for (int m : view.successors(n)) {
+        EXPECT_LT(pos[n], pos[m]);
+      }
+    }
+
+    int src = view.index_of(seed % 10);
+    std::unordered_set<int> from_bfs, from_dfs;
+    view.bfs(src, [&](int i) { EXPECT_TRUE(from_bfs.insert(i).second); });
+    view.dfs(src, [&](int i) { EXPECT_TRUE(from_dfs.insert(i).second); });
+    std::unordered_set<int> expected;
+    for (int n : descendants(g, seed % 10)) {
+      expected.insert(view.index_of(n));
+    }
+    EXPECT_EQ(from_bfs, expected);
+    EXPECT_EQ(from_dfs, expected);
+  }
+}
+
+TEST(indexed_graph_view, detects_cycles) {
+  IndexedGraphView<int> view({0, 1, 2, 3}, {{0, 1}, {1, 2}, {2, 1}, {2, 3}});
+  std::vector<int> topo;
+  EXPECT_FALSE(view.topo_sort(&topo));
+  EXPECT_EQ(topo, std::vector<int>({0}));
+}
+
+// Compares the generic algorithms, which build a view per call, with the same
+// queries on a view that is built once. Run with
+// --gtest_also_run_disabled_tests --gtest_filter=*benchmark*.
+TEST(indexed_graph_view, DISABLED_benchmark_residual_chain) {
+  int const num_blocks = 50000, num_iters = 5;
+  BasicGraph<int> g = get_residual_chain(num_blocks);
+  IndexedGraphView<int> view;
+
+  double build = time_secs(num_iters, [&] { view = indexed_graph_view(g); });
+  double generic_topo = time_secs(num_iters, [&] {
+    std::vector<int> ordering;
+    topo_sort(g, &ordering);
+  });
+  double view_topo = time_secs(num_iters, [&] {
+    std::vector<int> ordering;
+    view.topo_sort(&ordering);
+  });
+  double generic_desc =
+      time_secs(num_iters, [&] { descendants(g, num_blocks); });
+  double view_desc = time_secs(num_iters, [&] {
+    size_t count = 0;
+    view.bfs(view.index_of(num_blocks), [&](int) { count++; });
+  });
+  double view_domtree =
+      time_secs(num_iters, [&] { post_dominator_tree(view); });
+
+  printf("%d nodes, %zu edges\n", view.num_nodes(), view.num_edges());
+  printf("  build view            %8.3f ms\n", build * 1e3);
+  printf("  topo_sort   generic   %8.3f ms  view %8.3f ms\n",
+         generic_topo * 1e3,
+         view_topo * 1e3);
+  printf("  descendants generic   %8.3f ms  view %8.3f ms\n",
+         generic_desc * 1e3,
+         view_desc * 1e3);
+  printf("  post_dominator_tree   %8.3f ms (on view)\n", view_domtree * 1e3);
+}
+
+TEST(indexed_graph_view, DISABLED_benchmark_transitive_reduction) {
+  int const num_nodes = 400, num_iters = 3;
+  BasicGraph<int> g = get_random_dag(num_nodes, 8, 0);
+  double secs = time_secs(num_iters, [&] { transitive_reduction(g); });
+  printf("transitive_reduction: %d nodes in %.3f ms\n", num_nodes, secs * 1e3);
+}
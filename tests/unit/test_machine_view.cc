@@ -1,5 +1,6 @@
 #include "flexflow/config.h"
 #include "flexflow/machine_view.h"
+#include "flexflow/parallel_tensor.h"
 #include "gtest/gtest.h"
 
 using namespace Legion;
@@ -31,3 +32,107 @@ TEST(machine_view_get_device_id, basic) {
   EXPECT_EQ(mv.get_device_id({0}), 2);
   EXPECT_EQ(mv.get_device_id({1}), 3);
 }
+
+TEST(parallel_tensor_shape_is_valid_machine_view, basic) {
+  // 64 x 16 split 4 ways along the first dim and replicated twice
+  ParallelTensorShape shape;
+  shape.num_dims = 3;
+  shape.data_type = DT_FLOAT;
+  shape.dims[0].size = 64;
+  shape.dims[0].degree = 4;
+  shape.dims[0].parallel_idx = 0;
+  shape.dims[1].size = 16;
+  shape.dims[1].degree = 1;
+  shape.dims[1].parallel_idx = -1;
+  shape.dims[2].size = 2;
+  shape.dims[2].degree = 2;
+  shape.dims[2].parallel_idx = 1;
+  shape.dims[2].is_replica_dim = true;
+
+  MachineView mv;
+  mv.ndims = 2;
+  mv.start_device_id = 0;
+  mv.dim[0] = 4;
+  mv.dim[1] = 2;
+  mv.stride[0] = mv.stride[1] = 1;
+  EXPECT_TRUE(shape.is_valid_machine_view(mv));
+
+  mv.dim[0] = 2;
+  mv.dim[1] = 4;
+  EXPECT_FALSE(shape.is_valid_machine_view(mv));
+
+  mv.ndims = 1;
+  mv.dim[0] = 8;
+  EXPECT_FALSE(shape.is_valid_machine_view(mv));
+}
+
+namespace {
+
+MachineView gpu_view(int start_device_id, int dim, int stride) {
+  MachineView mv;
+  mv.ndims = 1;
+  mv.start_device_id = start_device_id;
+  mv.dim[0] = dim;
+  mv.stride[0] = stride;
+  return mv;
+}
+
+} // namespace
+
+TEST(canonical_gpu_shift, source_and_sink) {
+  // 4 nodes of 4 GPUs
+  MachineResource resources(4, 1, 4);
+
+  // Both views and the resources on node 2 move down to GPU 0
+  resources.start_gpu_id = 8;
+  resources.num_nodes = 1;
+  EXPECT_EQ(canonical_gpu_shift({gpu_view(9, 2, 1), gpu_view(8, 4, 1)},
+                                resources),
+            8);
+
+  // Part of node 1: the views still move down to GPU 0
+  resources.start_gpu_id = 6;
+  resources.available_gpus_per_node = 2;
+  EXPECT_EQ(canonical_gpu_shift({gpu_view(6, 2, 1)}, resources), 6);
+
+  // Nodes 1 and 2 only move down by whole nodes
+  resources.start_gpu_id = 4;
+  resources.num_nodes = 2;
+  resources.available_gpus_per_node = 4;
+  EXPECT_EQ(canonical_gpu_shift({gpu_view(5, 4, 2)}, resources), 4);
+
+  // A view outside the resources limits the shift
+  EXPECT_EQ(canonical_gpu_shift({gpu_view(0, 2, 1)}, resources), 0);
+
+  MachineView cpu = gpu_view(8, 1, 1);
+  cpu.device_type = MachineView::CPU;
+  EXPECT_EQ(canonical_gpu_shift({cpu}, resources), 0);
+}
+
+TEST(canonical_gpu_shift, whole_machine) {
+  MachineResource resources(4, 1, 4);
+  EXPECT_EQ(canonical_gpu_shift({gpu_view(0, 16, 1)}, resources), 0);
+  EXPECT_EQ(canonical_gpu_shift({gpu_view(0, 4, 4)}, resources), 0);
+
+  // A view spanning the whole machine pins the state even if the remaining
+  // resources are on later nodes
+  resources.start_gpu_id = 8;
+  resources.num_nodes = 2;
+  EXPECT_EQ(canonical_gpu_shift({gpu_view(0, 16, 1)}, resources), 0);
+}
+
+TEST(shift_gpu_views, round_trip) {
+  MachineView cpu = gpu_view(3, 2, 1);
+  cpu.device_type = MachineView::CPU;
+  std::unordered_map<int, MachineView> views = {
+      {0, gpu_view(8, 4, 1)}, {1, gpu_view(10, 2, 1)}, {2, cpu}};
+  std::unordered_map<int, MachineView> original = views;
+
+  shift_gpu_views(views, -8);
+  EXPECT_EQ(views.at(0), gpu_view(0, 4, 1));
+  EXPECT_EQ(views.at(1), gpu_view(2, 2, 1));
+  EXPECT_EQ(views.at(2), cpu);
+
+  shift_gpu_views(views, 8);
+  EXPECT_EQ(views, original);
+}
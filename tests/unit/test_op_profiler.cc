@@ -0,0 +1,76 @@
+#include "flexflow/op_profiler.h"
+#include "gtest/gtest.h"
+#include <fstream>
+#include <sstream>
+
+using namespace FlexFlow;
+
+namespace {
+
+std::string read_file(std::string const &filename) {
+  std::ifstream f(filename);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  return ss.str();
+}
+
+}; // namespace
+
+TEST(op_profiler, summarize_per_op_and_pass) {
+  OpProfiler &profiler = OpProfiler::get_instance();
+  profiler.clear();
+  int meta0, meta1, unregistered;
+  profiler.register_shard(&meta0, 7, "linear", 0);
+  profiler.register_shard(&meta1, 7, "linear", 1);
+  // 100 forward samples of 1, 2, ..., 100 ms over both shards
+  for (int i = 1; i <= 100; i++) {
+    profiler.record(i % 2 ? &meta0 : &meta1,
+                    ProfiledPass::FORWARD,
+                    1,
+                    0.0,
+                    i * 1e3);
+  }
+  profiler.record(&meta0, ProfiledPass::BACKWARD, 1, 10.0, 2010.0);
+  profiler.record(&unregistered, ProfiledPass::FORWARD, 1, 0.0, 1e3);
+
+  std::vector<OpProfileSummary> summaries = profiler.summarize();
+  ASSERT_EQ(summaries.size(), 2);
+  EXPECT_EQ(summaries[0].op_guid, 7);
+  EXPECT_EQ(summaries[0].op_name, "linear");
+  EXPECT_EQ(summaries[0].pass, ProfiledPass::FORWARD);
+  EXPECT_EQ(summaries[0].num_samples, 100);
+  EXPECT_DOUBLE_EQ(summaries[0].mean_ms, 50.5);
+  EXPECT_DOUBLE_EQ(summaries[0].p50_ms, 50.0);
+  EXPECT_DOUBLE_EQ(summaries[0].p99_ms, 99.0);
+  EXPECT_EQ(summaries[1].pass, ProfiledPass::BACKWARD);
+  EXPECT_EQ(summaries[1].num_samples, 1);
+  EXPECT_DOUBLE_EQ(summaries[1].p99_ms, 2.0);
+  profiler.clear();
+}
+
+TEST(op_profiler, write_csv_and_chrome_trace) {
+  OpProfiler &profiler = OpProfiler::get_instance();
+  profiler.clear();
+  int meta;
+  profiler.register_shard(&meta, 3, "conv", 0);
+  profiler.record(&meta, ProfiledPass::FORWARD, 0x1d00000000000002ULL, 0, 4e3);
+  profiler.record(&meta, ProfiledPass::UPDATE, 0x1d00000000000002ULL, 5e3, 6e3);
+
+  std::map<std::pair<size_t, ProfiledPass>, float> predicted_ms;
+  predicted_ms[{3, ProfiledPass::FORWARD}] = 2.0f;
+  std::string csv_file = ::testing::TempDir() + "op_profile.csv";
+  ASSERT_TRUE(profiler.write_csv(csv_file, predicted_ms));
+  std::string csv = read_file(csv_file);
+  EXPECT_NE(csv.find("3,conv,forward,1,4,4,4,2,2\n"), std::string::npos);
+  EXPECT_NE(csv.find("3,conv,update,1,1,1,1,,\n"), std::string::npos);
+
+  std::string trace_file = ::testing::TempDir() + "op_profile.json";
+  ASSERT_TRUE(profiler.write_chrome_trace(trace_file));
+  std::string trace = read_file(trace_file);
+  EXPECT_NE(trace.find("\"name\": \"conv\", \"cat\": \"forward\""),
+            std::string::npos);
+  EXPECT_NE(trace.find("\"cat\": \"update\""), std::string::npos);
+  EXPECT_NE(trace.find("\"name\": \"proc 1d00000000000002\""),
+            std::string::npos);
+  profiler.clear();
+}
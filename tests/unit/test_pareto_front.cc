@@ -0,0 +1,74 @@
+#include "flexflow/utils/pareto_front.h"
+#include "gtest/gtest.h"
+#include <random>
+#include <utility>
+
+using namespace FlexFlow;
+
+namespace {
+
+using Point = std::pair<float, float>;
+
+void prune(std::vector<Point> &points, size_t max_points) {
+  prune_pareto_front(
+      points,
+      [](Point const &p) { return p.first; },
+      [](Point const &p) { return p.second; },
+      max_points);
+}
+
+bool dominates(Point const &a, Point const &b) {
+  return a.first <= b.first && a.second <= b.second && a != b;
+}
+
+} // namespace
+
+TEST(pareto_front, removes_dominated_points) {
+  std::vector<Point> points = {
+      {3.0f, 1.0f}, {1.0f, 5.0f}, {2.0f, 2.0f}, {2.0f, 4.0f}, {4.0f, 1.0f}};
+  prune(points, 16);
+  std::vector<Point> expected = {{1.0f, 5.0f}, {2.0f, 2.0f}, {3.0f, 1.0f}};
+  EXPECT_EQ(points, expected);
+}
+
+TEST(pareto_front, keeps_one_of_equal_points) {
+  std::vector<Point> points = {{1.0f, 1.0f}, {1.0f, 1.0f}};
+  prune(points, 16);
+  EXPECT_EQ(points.size(), 1);
+}
+
+TEST(pareto_front, thins_to_max_points_keeping_ends) {
+  std::vector<Point> points;
+  for (int i = 0; i < 100; i++) {
+    points.push_back({(float)i, (float)(100 - i)});
+  }
+  prune(points, 8);
+  ASSERT_EQ(points.size(), 8);
+  EXPECT_EQ(points.front(), Point(0.0f, 100.0f));
+  EXPECT_EQ(points.back(), Point(99.0f, 1.0f));
+}
+
+TEST(pareto_front, matches_brute_force) {
+  std::mt19937 gen(0);
+  for (int trial = 0; trial < 100; trial++) {
+    std::vector<Point> points;
+    int num_points = gen() % 30;
+    for (int i = 0; i < num_points; i++) {
+      points.push_back({(float)(gen() % 10), (float)(gen() % 10)});
+    }
+    std::vector<Point> expected;
+    for (Point const &p : points) {
+      bool dominated = false;
+      for (Point const &q : points) {
+        dominated |= dominates(q, p);
+      }
+      if (!dominated &&
+          std::find(expected.begin(), expected.end(), p) == expected.end()) {
+        expected.push_back(p);
+      }
+    }
+    std::sort(expected.begin(), expected.end());
+    prune(points, 0);
+    EXPECT_EQ(points, expected) << "trial " << trial;
+  }
+}
@@ -0,0 +1,57 @@
+#include "flexflow/roofline_cost_model.h"
+#include "gtest/gtest.h"
+#include <fstream>
+
+using namespace FlexFlow;
+
+TEST(roofline_cost_model, device_from_file) {
+  std::string filename = ::testing::TempDir() + "device_config";
+  {
+    std::ofstream f(filename);
+    f << "# comment\n"
+      << "peak_tflops = 100\n"
+      << "memory_bandwidth = 2000\n"
+      << "kernel_launch_latency = 0.01\n"
+      << "efficiency Dense = 0.5\n";
+  }
+  DeviceDescription device = DeviceDescription::from_file(filename);
+
+  EXPECT_FLOAT_EQ(device.peak_tflops, 100.0f);
+  EXPECT_FLOAT_EQ(device.memory_bandwidth, 2000.0f);
+  EXPECT_FLOAT_EQ(device.kernel_launch_latency, 0.01f);
+  EXPECT_FLOAT_EQ(device.get_efficiency(OP_LINEAR), 0.5f);
+  EXPECT_FLOAT_EQ(device.get_efficiency(OP_CONV2D), 1.0f);
+}
+
+TEST(roofline_cost_model, run_time_is_bound_by_slower_resource) {
+  DeviceDescription device;
+  device.peak_tflops = 10.0f;
+  device.memory_bandwidth = 1000.0f;
+  device.kernel_launch_latency = 0.0f;
+  RooflineCostModel model(device);
+
+  // 1e10 FLOPs at 10 TFLOP/s take 1 ms, 1e8 bytes at 1000 GB/s take 0.1 ms
+  OperatorWork compute_bound;
+  compute_bound.flops = 1e10;
+  compute_bound.bytes = 1e8;
+  EXPECT_NEAR(model.run_time(OP_LINEAR, compute_bound), 1.0f, 1e-5);
+
+  OperatorWork memory_bound;
+  memory_bound.flops = 1e8;
+  memory_bound.bytes = 1e9;
+  EXPECT_NEAR(model.run_time(OP_LINEAR, memory_bound), 1.0f, 1e-5);
+}
+
+TEST(roofline_cost_model, run_time_scales_with_efficiency_and_launches) {
+  DeviceDescription device;
+  device.peak_tflops = 10.0f;
+  device.kernel_launch_latency = 0.01f;
+  device.efficiency[OP_LINEAR] = 0.5f;
+  RooflineCostModel model(device);
+
+  OperatorWork work;
+  work.flops = 1e10;
+  work.num_kernels = 2;
+  EXPECT_NEAR(model.run_time(OP_LINEAR, work), 2.02f, 1e-5);
+  EXPECT_NEAR(model.run_time(OP_RELU, work), 1.02f, 1e-5);
+}
@@ -0,0 +1,77 @@
+#include "flexflow/strategy_file.h"
+#include "gtest/gtest.h"
+#include <fstream>
+#include <iterator>
+
+using namespace FlexFlow;
+
+namespace {
+
+std::string read_bytes(std::string const &path) {
+  std::ifstream input(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(input),
+                     std::istreambuf_iterator<char>());
+}
+
+void write_bytes(std::string const &path, std::string const &bytes) {
+  std::ofstream output(path, std::ios::binary | std::ios::trunc);
+  output << bytes;
+}
+
+}; // namespace
+
+TEST(strategy_file, round_trip) {
+  std::string path = ::testing::TempDir() + "strategy.ff";
+  std::vector<char> signature = {'s', 'i', 'g', '\0', 'n'};
+  std::string strategy = "serialized strategy";
+  ASSERT_TRUE(write_strategy_file(
+      path, signature, strategy.data(), strategy.size()));
+
+  std::vector<char> read_signature;
+  char buffer[64];
+  size_t strategy_bytes = 0;
+  ASSERT_TRUE(read_strategy_file(
+      path, read_signature, buffer, sizeof(buffer), strategy_bytes));
+  EXPECT_EQ(read_signature, signature);
+  EXPECT_EQ(std::string(buffer, strategy_bytes), strategy);
+
+  // The strategy has to fit in the caller's buffer
+  EXPECT_FALSE(read_strategy_file(
+      path, read_signature, buffer, strategy.size() - 1, strategy_bytes));
+}
+
+TEST(strategy_file, truncated_or_corrupt) {
+  std::string path = ::testing::TempDir() + "strategy.ff";
+  std::vector<char> signature(40, 'x');
+  std::string strategy(100, 'y');
+  ASSERT_TRUE(write_strategy_file(
+      path, signature, strategy.data(), strategy.size()));
+  std::string bytes = read_bytes(path);
+
+  std::vector<char> read_signature;
+  char buffer[128];
+  size_t strategy_bytes = 0;
+  for (size_t n = 0; n < bytes.size(); n++) {
+    write_bytes(path, bytes.substr(0, n));
+    EXPECT_FALSE(read_strategy_file(
+        path, read_signature, buffer, sizeof(buffer), strategy_bytes))
+        << n << " bytes";
+  }
+
+  write_bytes(path, bytes + "z");
+  EXPECT_FALSE(read_strategy_file(
+      path, read_signature, buffer, sizeof(buffer), strategy_bytes));
+
+  // A signature size far beyond the file, which follows the magic string
+  // and the version
+  std::string corrupt = bytes;
+  size_t huge = (size_t)1 << 40;
+  corrupt.replace(12, sizeof(huge), (char const *)&huge, sizeof(huge));
+  write_bytes(path, corrupt);
+  EXPECT_FALSE(read_strategy_file(
+      path, read_signature, buffer, sizeof(buffer), strategy_bytes));
+
+  write_bytes(path, bytes);
+  EXPECT_TRUE(read_strategy_file(
+      path, read_signature, buffer, sizeof(buffer), strategy_bytes));
+}
@@ -1,6 +1,8 @@
 #include "flexflow/substitution.h"
 #include "flexflow/substitution_loader.h"
 #include "gtest/gtest.h"
+#include <cstring>
+#include <sstream>
 
 namespace sl = FlexFlow::substitution_loader;
 // using namespace FlexFlow::substitution_loader;
@@ -142,3 +144,183 @@ TEST(substitution_loader, operator_deserialization) {
 //   std::vector<GraphXfer *> xfers = create_xfers(nullptr, collection, 2);
 //   EXPECT_EQ(xfers.size(), 640);
 // }
+
+void expect_same_operators(std::vector<sl::Operator> const &a,
+                           std::vector<sl::Operator> const &b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    EXPECT_EQ(a[i].op_type, b[i].op_type);
+    ASSERT_EQ(a[i].input.size(), b[i].input.size());
+    for (size_t j = 0; j < a[i].input.size(); j++) {
+      EXPECT_EQ(a[i].input[j].opId, b[i].input[j].opId);
+      EXPECT_EQ(a[i].input[j].tsId, b[i].input[j].tsId);
+    }
+    ASSERT_EQ(a[i].para.size(), b[i].para.size());
+    for (size_t j = 0; j < a[i].para.size(); j++) {
+      EXPECT_EQ(a[i].para[j].key, b[i].para[j].key);
+      EXPECT_EQ(a[i].para[j].value, b[i].para[j].value);
+    }
+  }
+}
+
+void expect_same_rule(sl::Rule const &a, sl::Rule const &b) {
+  EXPECT_EQ(a.name, b.name);
+  expect_same_operators(a.srcOp, b.srcOp);
+  expect_same_operators(a.dstOp, b.dstOp);
+  ASSERT_EQ(a.mappedOutput.size(), b.mappedOutput.size());
+  for (size_t i = 0; i < a.mappedOutput.size(); i++) {
+    EXPECT_EQ(a.mappedOutput[i].dstOpId, b.mappedOutput[i].dstOpId);
+    EXPECT_EQ(a.mappedOutput[i].dstTsId, b.mappedOutput[i].dstTsId);
+    EXPECT_EQ(a.mappedOutput[i].srcOpId, b.mappedOutput[i].srcOpId);
+    EXPECT_EQ(a.mappedOutput[i].srcTsId, b.mappedOutput[i].srcTsId);
+  }
+}
+
+sl::RuleCollection make_binary_test_rules() {
+  sl::Operator linear;
+  linear.op_type = OP_LINEAR;
+  linear.input = {{-1, 0}};
+  linear.para = {{PM_ACTI, AC_MODE_RELU}};
+
+  sl::Operator partition;
+  partition.op_type = OP_REPARTITION;
+  partition.input = {{-1, 0}};
+  partition.para = {{PM_REPARTITION_DIM, 2}, {PM_REPARTITION_DEGREE, 4}};
+
+  sl::Operator combine;
+  combine.op_type = OP_COMBINE;
+  combine.input = {{1, 0}};
+  combine.para = {{PM_COMBINE_DIM, 2}, {PM_COMBINE_DEGREE, 4}};
+
+  sl::Rule partition_linear;
+  partition_linear.name = "partition_linear_combine";
+  partition_linear.srcOp = {linear};
+  partition_linear.dstOp = {partition, linear, combine};
+  partition_linear.dstOp[1].input = {{0, 0}};
+  partition_linear.mappedOutput = {{2, 0, 0, 0}};
+
+  sl::Rule combine_partition;
+  combine_partition.name = "cp";
+  combine_partition.srcOp = {combine};
+  combine_partition.srcOp[0].input = {{-1, 0}};
+  combine_partition.dstOp = {};
+  combine_partition.mappedOutput = {};
+
+  sl::RuleCollection collection;
+  collection.rules = {partition_linear, combine_partition, partition_linear};
+  collection.rules[2].name = "";
+  return collection;
+}
+
+// The binary encoding of rules as 32-bit words
+std::vector<uint32_t> encode_binary_rules(sl::RuleCollection const &rules) {
+  std::stringstream ss;
+  sl::save_rule_collection_binary(rules, ss);
+  std::string bytes = ss.str();
+  std::vector<uint32_t> words(bytes.size() / sizeof(uint32_t));
+  memcpy(words.data(), bytes.data(), words.size() * sizeof(uint32_t));
+  return words;
+}
+
+std::string write_binary_rules(std::vector<uint32_t> const &words,
+                               size_t num_bytes) {
+  std::string path = ::testing::TempDir() + "corrupt_rules.bin";
+  std::ofstream out(path, std::ios::binary);
+  out.write((char const *)words.data(), num_bytes);
+  return path;
+}
+
+// Opens and fully decodes the rules at path
+void decode_binary_rules(std::string const &path) {
+  sl::BinaryRuleCollection binary(path);
+  binary.get_rule_collection();
+}
+
+TEST(substitution_loader, binary_round_trip) {
+  sl::RuleCollection collection = make_binary_test_rules();
+
+  std::stringstream ss;
+  sl::save_rule_collection_binary(collection, ss);
+  std::string path = ::testing::TempDir() + "rules.bin";
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << ss.str();
+  }
+  EXPECT_TRUE(sl::is_binary_rule_file(path));
+
+  sl::BinaryRuleCollection binary(path);
+  EXPECT_EQ(binary.num_rules(), 3);
+  EXPECT_EQ(binary.rules_with_root(OP_LINEAR), std::vector<int>({0, 2}));
+  EXPECT_EQ(binary.rules_with_root(OP_COMBINE), std::vector<int>({1}));
+  EXPECT_TRUE(binary.rules_with_root(OP_CONV2D).empty());
+
+  EXPECT_EQ(binary.get_name(0), "partition_linear_combine");
+  EXPECT_EQ(binary.get_name(1), "cp");
+  EXPECT_EQ(binary.get_name(2), "");
+
+  std::vector<OperatorType> src_op_types, dst_op_types;
+  binary.get_op_types(0, src_op_types, dst_op_types);
+  EXPECT_EQ(src_op_types, std::vector<OperatorType>({OP_LINEAR}));
+  EXPECT_EQ(dst_op_types,
+            std::vector<OperatorType>({OP_REPARTITION, OP_LINEAR, OP_COMBINE}));
+
+  sl::RuleCollection decoded = sl::load_rule_collection_from_path(path);
+  ASSERT_EQ(decoded.rules.size(), collection.rules.size());
+  for (size_t i = 0; i < collection.rules.size(); i++) {
+    expect_same_rule(decoded.rules[i], collection.rules[i]);
+  }
+}
+
+TEST(substitution_loader, binary_truncated_file) {
+  std::vector<uint32_t> words = encode_binary_rules(make_binary_test_rules());
+  // Every proper prefix cuts into the index or into a rule record
+  for (size_t num_bytes = 0; num_bytes < words.size() * sizeof(uint32_t);
+       num_bytes++) {
+    std::string path = write_binary_rules(words, num_bytes);
+    EXPECT_THROW(decode_binary_rules(path), std::runtime_error)
+        << num_bytes << " bytes";
+  }
+}
+
+TEST(substitution_loader, binary_corrupt_offsets) {
+  std::vector<uint32_t> const words =
+      encode_binary_rules(make_binary_test_rules());
+  size_t num_bytes = words.size() * sizeof(uint32_t);
+  size_t num_rules = words[2];
+  size_t ids_start = 4 + 3 * words[3];
+  size_t offsets_start = ids_start + num_rules;
+
+  // A rule offset past the end of the file
+  std::vector<uint32_t> corrupt = words;
+  corrupt[offsets_start + 1] = words.size() + 100;
+  EXPECT_THROW(decode_binary_rules(write_binary_rules(corrupt, num_bytes)),
+               std::runtime_error);
+
+  // An index entry whose ids run past the rule table
+  corrupt = words;
+  corrupt[4 + 2] = num_rules + 1;
+  EXPECT_THROW(decode_binary_rules(write_binary_rules(corrupt, num_bytes)),
+               std::runtime_error);
+
+  // A rule id out of range
+  corrupt = words;
+  corrupt[ids_start] = num_rules;
+  EXPECT_THROW(decode_binary_rules(write_binary_rules(corrupt, num_bytes)),
+               std::runtime_error);
+
+  // A name length that would wrap around when rounded up to whole words
+  corrupt = words;
+  corrupt[words[offsets_start]] = 0xFFFFFFFF;
+  EXPECT_THROW(decode_binary_rules(write_binary_rules(corrupt, num_bytes)),
+               std::runtime_error);
+
+  // An op count far larger than the rest of the file
+  corrupt = words;
+  // (the name "cp" of rule 1 takes one word)
+  corrupt[words[offsets_start + 1] + 2] = 0x7FFFFFFF;
+  EXPECT_THROW(decode_binary_rules(write_binary_rules(corrupt, num_bytes)),
+               std::runtime_error);
+
+  // The untouched encoding still decodes
+  EXPECT_NO_THROW(decode_binary_rules(write_binary_rules(words, num_bytes)));
+}
@@ -0,0 +1,66 @@
+#include "flexflow/substitution_profile.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+
+using namespace FlexFlow::PCG;
+
+namespace {
+
+XferProfile make_profile(size_t improvements, size_t accepted, double secs) {
+  XferProfile p;
+  p.num_runs = 10;
+  p.num_matches = 2 * accepted;
+  p.num_accepted = accepted;
+  p.num_improvements = improvements;
+  p.run_time = secs;
+  return p;
+}
+
+} // namespace
+
+TEST(substitution_profile, save_and_load_merge) {
+  std::string path = ::testing::TempDir() + "substitution_profile.json";
+  std::remove(path.c_str());
+
+  SubstitutionProfile profile;
+  // A missing file is an empty profile
+  profile.load(path);
+  EXPECT_EQ(profile.size(), 0);
+
+  profile.at("partition_linear_combine") = make_profile(3, 7, 0.5);
+  profile.at("linear_relu_merge") = make_profile(0, 1, 0.25);
+  profile.save(path);
+
+  SubstitutionProfile loaded;
+  loaded.load(path);
+  loaded.load(path);
+  ASSERT_EQ(loaded.size(), 2);
+  XferProfile const *p = loaded.find("partition_linear_combine");
+  ASSERT_NE(p, nullptr);
+  EXPECT_EQ(p->num_runs, 20);
+  EXPECT_EQ(p->num_matches, 28);
+  EXPECT_EQ(p->num_accepted, 14);
+  EXPECT_EQ(p->num_improvements, 6);
+  EXPECT_DOUBLE_EQ(p->run_time, 1.0);
+  EXPECT_EQ(loaded.find("unknown"), nullptr);
+}
+
+TEST(substitution_profile, select_pruned) {
+  SubstitutionProfile profile;
+  profile.at("a") = make_profile(4, 4, 1.0);  // utility 4
+  profile.at("b") = make_profile(1, 9, 0.1);  // utility 10
+  profile.at("c") = make_profile(0, 5, 0.01); // utility 0
+  profile.at("d") = make_profile(0, 2, 2.0);  // utility 0, fewer accepted
+
+  EXPECT_TRUE(profile.select_pruned(tl::nullopt, tl::nullopt).empty());
+  EXPECT_EQ(profile.select_pruned(2, tl::nullopt),
+            std::unordered_set<std::string>({"c", "d"}));
+  EXPECT_EQ(profile.select_pruned(3, tl::nullopt),
+            std::unordered_set<std::string>({"d"}));
+  EXPECT_EQ(profile.select_pruned(tl::nullopt, 5.0),
+            std::unordered_set<std::string>({"a", "c", "d"}));
+  EXPECT_EQ(profile.select_pruned(1, 0.5),
+            std::unordered_set<std::string>({"a", "c", "d"}));
+  // Substitutions that were never profiled are kept
+  EXPECT_EQ(profile.select_pruned(0, tl::nullopt).count("e"), 0);
+}
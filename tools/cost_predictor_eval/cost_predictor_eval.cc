@@ -0,0 +1,49 @@
+#include "flexflow/cost_predictor.h"
+#include "flexflow/ffconst_utils.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace FlexFlow;
+
+int main(int argc, char **argv) {
+  float threshold = 0.1f;
+  std::string output_path;
+  std::vector<std::string> record_paths;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+      output_path = std::string(argv[++i]);
+    } else {
+      record_paths.push_back(std::string(argv[i]));
+    }
+  }
+  if (record_paths.empty()) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--threshold <relative-error>] [--output <merged-file>]"
+              << " <records-file> ..." << std::endl;
+    return 1;
+  }
+
+  CostPredictor predictor(threshold);
+  for (std::string const &path : record_paths) {
+    if (!predictor.load(path)) {
+      return 1;
+    }
+  }
+  std::cout << "Leave-one-out evaluation of " << predictor.num_records()
+            << " records with threshold " << threshold << std::endl;
+  for (auto const &kv : predictor.evaluate()) {
+    CostPredictorEvaluation const &evaluation = kv.second;
+    std::cout << get_operator_type_name(kv.first) << ": "
+              << evaluation.num_confident << "/" << evaluation.num_records
+              << " predicted, mean relative error "
+              << evaluation.mean_relative_error << ", max relative error "
+              << evaluation.max_relative_error << std::endl;
+  }
+  if (!output_path.empty() && !predictor.save(output_path)) {
+    return 1;
+  }
+  return 0;
+}
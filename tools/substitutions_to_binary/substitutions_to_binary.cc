@@ -0,0 +1,24 @@
+#include "flexflow/substitution_loader.h"
+#include <iostream>
+
+using namespace FlexFlow::substitution_loader;
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <json-file> <output-file>"
+              << std::endl;
+    return 1;
+  }
+
+  std::string json_path(argv[1]);
+  std::string output_path(argv[2]);
+
+  RuleCollection rule_collection = load_rule_collection_from_path(json_path);
+  save_rule_collection_binary_to_path(rule_collection, output_path);
+
+  BinaryRuleCollection binary(output_path);
+  std::cout << "Wrote " << binary.num_rules() << " rules with "
+            << binary.root_op_types().size() << " root op types to "
+            << output_path << std::endl;
+  return 0;
+}